@@ -123,6 +123,7 @@ Page* BufferPoolManager::FetchPage(page_id_t page_id)
 	res->page_id_ = page_id;
 	res->is_dirty_ = false;
 	res->pin_count_ = 1;
+	res->BumpVersion();
 	disk_manager_->ReadPage(page_id, res->GetData());  /* disk 数据到内存 page */
 
 	return res;
@@ -221,9 +222,13 @@ BufferPoolManager::DeletePage(page_id_t page_id)
 
 	Page *res = nullptr;
 	if(page_table_->Find(page_id, res)) {
+		// 还有人 pin 着，frame 不能给别的页面用
+		if (res->pin_count_ > 0)
+			return false;
 		page_table_->Remove(page_id);
 		res->page_id_ = INVALID_PAGE_ID;
 		res->is_dirty_ = false;
+		res->BumpVersion();
 
 		replacer_->Erase(res);
 		disk_manager_->DeallocatePage(page_id);
@@ -232,7 +237,9 @@ BufferPoolManager::DeletePage(page_id_t page_id)
 
 		return true;
 	}
-	return false;
+	// 不在 buffer pool 里，只需要通知 disk manager
+	disk_manager_->DeallocatePage(page_id);
+	return true;
 }
 
 /**
@@ -271,6 +278,7 @@ Page* BufferPoolManager::NewPage(page_id_t &page_id)
 	res->page_id_ = page_id;
 	res->is_dirty_ = false;
 	res->pin_count_ = 1;
+	res->BumpVersion();
 	res->ResetMemory();
 
 	return res;
@@ -2,8 +2,16 @@
  * lock_manager.cpp
  * 增加支持超时功能，如果超时，则直接返回false
  * 条件变量有wait_for与wait_until等接口
+ *
+ * 授权按照 FIFO 的顺序：
+ *  - 共享锁只有在它前面的请求全部是已授权的共享锁时才能授权，所以排队的写请求会挡住后来的读请求
+ *  - 排它锁只有排在队首时才能授权
+ *  - 锁升级插到已授权请求的后面、所有等待请求的前面，优先级最高
+ * 已授权的请求总是队列的一个前缀，每个请求只会等它入队时排在它前面的请求（再加上最多一个升级），等待是有界的
+ * 死锁预防仍然是 wait-die：只允许老事务等年轻事务，年轻事务要等老事务就直接 die
  */
 
+#include <algorithm>
 #include <cassert>
 #include "concurrency/lock_manager.h"
 
@@ -20,103 +28,15 @@ namespace cmudb
 bool LockManager::LockShared(Transaction *txn, const RID &rid)
 {
     std::unique_lock<std::mutex> latch(mutex_);
-    // std::printf(
-    //     "LockShared tid=%ld, txn=%d\n", gettid(), static_cast<int>(txn->GetTransactionId()));
     if (txn->GetState() == TransactionState::ABORTED) { return false; }
 
     assert(txn->GetState() == TransactionState::GROWING);
 
-    Request req{txn->GetTransactionId(), LockMode::SHARED, false};
-    if (lock_table_.count(rid) == 0)
-    {
-        // 当前没有其它事务持有该rid的锁，所以下面的在条件变量上的等待是一定可以过的
-        lock_table_[rid].exclusive_cnt = 0;
-        lock_table_[rid].oldest = txn->GetTransactionId();
-        lock_table_[rid].list.push_back(req);
-    }
-    else
-    {
-        // 目前有事务等待在rid上（或读或写）
-        // 如果都是读则不会相互等待的，读锁都是共享的，所以都是共享锁是不会有死锁的
-        // if (lock_table_[rid].exclusive_cnt != 0 &&
-        //     txn->GetTransactionId() > lock_table_[rid].oldest)
-        if (lock_table_[rid].oldest>=0 && txn->GetTransactionId() > lock_table_[rid].oldest)
-        {
-            // // wait die预防死锁
-            // std::printf("id=%d,rid=%s,exclusive cnt=%d,oldest=%d,rid hold=%d\n", 
-            //     txn->GetTransactionId(),
-            //     rid.ToString().c_str(), 
-            //     static_cast<int>(lock_table_[rid].exclusive_cnt), 
-            //     static_cast<int>(lock_table_[rid].oldest),
-            //     static_cast<int>(lock_table_.count(rid)));
-            // // 遍历一下 request list
-            // if(lock_table_[rid].list.empty()){
-            //     std::printf("one waitting but list is empty!\n");
-            // } else {
-            //     for(auto t=lock_table_[rid].list.begin(); t!=lock_table_[rid].list.end(); ++t){
-            //         std::printf("request txn id=%d\n", static_cast<int>(t->txn_id));
-            //     }
-            // }
-            txn->SetState(TransactionState::ABORTED);
-            return false;
-        }
-        if (lock_table_[rid].oldest > txn->GetTransactionId())
-        {
-            lock_table_[rid].oldest = txn->GetTransactionId();
-        }
-        lock_table_[rid].list.push_back(req);
-    }
+    if (!Enqueue(txn, rid, LockMode::SHARED)) { return false; }
 
     // 等待条件变量，等待直到获取读锁
-    // 如果所有阻塞在rid上的事务都是读事务且都获得了授权，则当前线程继续进入读取
-    Request *cur = nullptr;
-    // cond.wait(latch, [&]() -> bool {
-    //     bool all_shared = true, all_granted = true;
-    //     for (auto &r : lock_table_[rid].list)
-    //     {
-    //         if (r.txn_id != txn->GetTransactionId()){
-    //             if (r.mode != LockMode::SHARED || !r.granted) { return false; }
-    //         }
-    //         else{
-    //             // 本身是被push到最后的，所以最后一个一定是新的
-    //             cur = &r;
-    //             return all_shared && all_granted;
-    //         }
-    //     }
-    //     return false;
-    // });
-
-    auto func = [&]() -> bool {
-        bool all_shared = true, all_granted = true;
-        for (auto &r : lock_table_[rid].list)
-        {
-            if (r.txn_id != txn->GetTransactionId()){
-                if (r.mode != LockMode::SHARED || !r.granted) { return false; }
-            }
-            else{
-                // 本身是被push到最后的，所以最后一个一定是新的
-                cur = &r;
-                return all_shared && all_granted;
-            }
-        }
-        return false;
-    };
-
-    bool _cond = !(func());
-    while(_cond){
-        if(cond.wait_for(latch, std::chrono::milliseconds(LOCK_TIME_OUT))==std::cv_status::timeout){
-            txn->SetState(TransactionState::ABORTED);
-            return false;
-        }
-    }
-
-    // 得到了读锁
-    assert(cur != nullptr && cur->txn_id == txn->GetTransactionId());
-    cur->granted = true;
-    txn->GetSharedLockSet()->insert(rid);  // 事务要维护一个set, track当前事务所加读锁的rid
-
-    cond.notify_all();
-    return true;
+    // 如果排在前面的都是已经授权的读锁，则当前线程继续进入读取
+    return WaitForGrant(latch, txn, std::vector<RID>{rid});
 }
 
 /**
@@ -129,72 +49,78 @@ bool LockManager::LockShared(Transaction *txn, const RID &rid)
 bool LockManager::LockExclusive(Transaction *txn, const RID &rid)
 {
     std::unique_lock<std::mutex> latch(mutex_);
-    // std::printf(
-    //     "LockExclusive tid=%ld, txn=%d\n", gettid(), static_cast<int>(txn->GetTransactionId()));
     if (txn->GetState() == TransactionState::ABORTED) { return false; }
 
     // 2PL锁只能在GROWING阶段加锁
     assert(txn->GetState() == TransactionState::GROWING);
 
-    // 构造请求
-    Request req{txn->GetTransactionId(), LockMode::EXCLUSIVE, false};
-    if (lock_table_.count(rid) == 0)
-    {
-        // 还没有事务碰过这个rid
-        lock_table_[rid].oldest = txn->GetTransactionId();
-        lock_table_[rid].list.push_back(req);
-    }
-    else
+    if (!Enqueue(txn, rid, LockMode::EXCLUSIVE)) { return false; }
+
+    // 排它锁只有在等待队列中的第一个才能获得锁
+    // 如果当前的rid被其它事务加了锁，那么当前事务（线程）只能等待，事务（线程）等待在锁管理器的代码上
+    return WaitForGrant(latch, txn, std::vector<RID>{rid});
+}
+
+/**
+ * @brief 批量加共享锁，典型的用法是一次锁住一个 TablePage 上的所有 slot
+ * 只拿一次 mutex_：先把所有请求按 wait-die 入队，再在同一个等待循环里一起授权
+ * 任何一个 rid 需要 die，或者等待超时，都会撤掉本批还没授权的请求并返回 false（事务ABORTED）
+ * 已经持有锁（读或写）的 rid 会被跳过
+ * @param  txn              desc
+ * @param  rids             desc
+ * @return true @c
+ * @return false @c
+ */
+bool LockManager::LockSharedBatch(Transaction *txn, const std::vector<RID> &rids)
+{
+    std::unique_lock<std::mutex> latch(mutex_);
+    if (txn->GetState() == TransactionState::ABORTED) { return false; }
+    assert(txn->GetState() == TransactionState::GROWING);
+
+    std::vector<RID> pending;
+    pending.reserve(rids.size());
+    for (auto &rid : rids)
     {
-        // wait die 是一种非剥夺策略，老的事务等待新的事务释放资源
-        // 即若A比B老，则等待B执行结束，否则A卷回(roll-back)
-        // 一段时间后会以原先的时间戳继续申请。老的才有资格等，年轻的全部卷回
-        // ...
-        // 假设事务 T5、T10、T15 分别具有时间戳 5、10 和 15
-        // 如果 T5 请求 T10 持有的数据项，则 T5 将等待
-        // 如果 T15 请求 T10 持有的数据项，则 T15 将被杀死(死亡)
-        // wait die 为什么能否防止环的出现呢
-        // 如果Ti等待Tj释放锁，记录为 Ti->Tj, wait die只允许Ti等待Tj，且i<j(或j<i)。反正一定是单边的，绝对不可能形成环
-        if (lock_table_[rid].oldest>=0 && txn->GetTransactionId() > lock_table_[rid].oldest)
+        if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid)) { continue; }
+        if (!Enqueue(txn, rid, LockMode::SHARED))
         {
-            // 从根源上杜绝了环的出现，但是也abort了一些无需abort的事务，在性能上有损失 
-            txn->SetState(TransactionState::ABORTED);
+            // 本批里先入队的请求也要撤掉
+            WithdrawBatch(txn, pending);
             return false;
         }
-
-        // 否则就wait
-        lock_table_[rid].oldest = txn->GetTransactionId();
-        lock_table_[rid].list.push_back(req);
+        pending.push_back(rid);
     }
+    return WaitForGrant(latch, txn, std::move(pending));
+}
 
-    ++lock_table_[rid].exclusive_cnt;  // 目标rid如果是第一次被访问并加锁，那就是从0到1
+/**
+ * @brief 批量加排它锁，语义与 LockSharedBatch 相同
+ * 已经持有读锁的 rid 不在这里处理，需要走 LockUpgrade
+ * @param  txn              desc
+ * @param  rids             desc
+ * @return true @c
+ * @return false @c
+ */
+bool LockManager::LockExclusiveBatch(Transaction *txn, const std::vector<RID> &rids)
+{
+    std::unique_lock<std::mutex> latch(mutex_);
+    if (txn->GetState() == TransactionState::ABORTED) { return false; }
+    assert(txn->GetState() == TransactionState::GROWING);
 
-    // 排它锁只有在等待队列中的第一个才能获得锁
-    // 首先下面的语句等价于
-    // while(lock_table_[rid].list.front().txn_id == txn->GetTransactionId()){
-    //     cond.wait(latch);
-    // }
-    // 如果当前的rid被其它事务加了排它锁，那么当前事务（线程）只能等待，事务（线程）等待在锁管理器的代码上
-    // cond.wait_for(
-    //     latch, std::chrono::milliseconds(500), 
-    //     [&]() -> bool {
-    //         return lock_table_[rid].list.front().txn_id == txn->GetTransactionId();
-    //     }
-    // );
-
-    bool _cond = !(lock_table_[rid].list.front().txn_id == txn->GetTransactionId());
-    while(_cond){
-        if(cond.wait_for(latch, std::chrono::milliseconds(LOCK_TIME_OUT))==std::cv_status::timeout){
-            txn->SetState(TransactionState::ABORTED);
+    std::vector<RID> pending;
+    pending.reserve(rids.size());
+    for (auto &rid : rids)
+    {
+        if (txn->IsExclusiveLocked(rid)) { continue; }
+        assert(!txn->IsSharedLocked(rid));
+        if (!Enqueue(txn, rid, LockMode::EXCLUSIVE))
+        {
+            WithdrawBatch(txn, pending);
             return false;
         }
+        pending.push_back(rid);
     }
-
-    assert(lock_table_[rid].list.front().txn_id == txn->GetTransactionId());
-    // 成功得到锁，被授权，返回true，代表成功获取到锁
-    lock_table_[rid].list.front().granted = true;
-    txn->GetExclusiveLockSet()->insert(rid);
-    return true;
+    return WaitForGrant(latch, txn, std::move(pending));
 }
 
 /**
@@ -243,82 +169,46 @@ bool LockManager::LockExclusive(Transaction *txn, const RID &rid)
 bool LockManager::LockUpgrade(Transaction *txn, const RID &rid)
 {
     std::unique_lock<std::mutex> latch(mutex_);
-    // std::printf(
-    //     "LockUpgrade tid=%ld, txn=%d\n", gettid(), static_cast<int>(txn->GetTransactionId()));
     if (txn->GetState() == TransactionState::ABORTED) { return false; }
 
     // 必须位于2pl的加锁阶段
     assert(txn->GetState() == TransactionState::GROWING);
 
-    // // 遍历下这个表验证一个想法
-    // for(auto it=lock_table_.begin(); it!=lock_table_.end();++it){
-    //     std::printf("curr rid=%s,exclusive cnt=%d,oldest=%d\n", 
-    //     it->first.ToString().c_str(), 
-    //     static_cast<int>(it->second.exclusive_cnt), 
-    //     static_cast<int>(it->second.oldest));
-    // }
-
-    // 1. move cur request to the end of `shared` period
-    // 2. change granted to false
-    // 3. change lock mode to EXCLUSIVE
-    auto src = lock_table_[rid].list.end(), tgt = src;
-    for (auto it = lock_table_[rid].list.begin();
-        it != lock_table_[rid].list.end(); ++it)
-    {
-        if (it->txn_id == txn->GetTransactionId()) { src = it; }
-        if (src != lock_table_[rid].list.end())
-        {
-            if (it->mode == LockMode::EXCLUSIVE)
-            {
-                // 共享锁升级为排它锁
-                tgt = it;
-                break;
-            }
-        }
-    }
-    assert(src != lock_table_[rid].list.end());
+    Waiting &queue = GetQueue(rid);
+    auto src = FindRequest(queue, txn);
+    assert(src != queue.list.end() && src->granted && src->mode == LockMode::SHARED);
 
-    // wait-die
-    for (auto it = lock_table_[rid].list.begin(); it != tgt; ++it)
+    // 同一个rid上只能有一个升级在排队，两个读锁同时想升级必然互相等待
+    if (queue.upgrading != INVALID_TXN_ID)
     {
-        if (it->txn_id < src->txn_id) { return false; }
+        txn->SetState(TransactionState::ABORTED);
+        return false;
     }
 
-    Request req = *src;
-    req.granted = false;
-    req.mode = LockMode::EXCLUSIVE;
-
-    lock_table_[rid].list.insert(tgt, req);
-    lock_table_[rid].list.erase(src);
-
-    ++lock_table_[rid].exclusive_cnt;
-
-    // // 条件变量
-    // if(cond.wait_for(latch, [&]() -> bool {
-    //     // check一下为什么线程会卡在这个地方
-    //     std::printf("txn id=%d, rid=%s\n", static_cast<int>(txn->GetTransactionId()), rid.ToString().c_str());
-    //     return lock_table_[rid].list.front().txn_id == txn->GetTransactionId();
-    // })==std::cv_status::timeout){
-    //     return false;
-    // }
-
-    bool _cond = !(lock_table_[rid].list.front().txn_id == txn->GetTransactionId());
-    while(_cond){
-        if(cond.wait_for(latch, std::chrono::milliseconds(LOCK_TIME_OUT))==std::cv_status::timeout){
+    // wait-die: 升级要等其它已授权的读锁释放，其中有更老的事务就只能 die
+    for (auto &r : queue.list)
+    {
+        if (r.granted && r.txn_id < src->txn_id)
+        {
             txn->SetState(TransactionState::ABORTED);
             return false;
         }
     }
 
-    assert(lock_table_[rid].list.front().txn_id == txn->GetTransactionId() &&
-            lock_table_[rid].list.front().mode == LockMode::EXCLUSIVE);
+    // 1. change granted to false
+    // 2. change lock mode to EXCLUSIVE
+    // 3. move cur request to the end of `granted` period, ahead of every waiting request
+    src->granted = false;
+    src->mode = LockMode::EXCLUSIVE;
+    auto tgt = queue.list.begin();
+    while (tgt != queue.list.end() && (tgt == src || tgt->granted)) { ++tgt; }
+    queue.list.splice(tgt, queue.list, src);
+    queue.upgrading = txn->GetTransactionId();
 
-    lock_table_[rid].list.front().granted = true;
+    // 插队不会破坏 wait-die：排在后面的等待者入队时都与升级者已授权的读锁冲突过（或者在等一个更年轻的写锁），
+    // 所以它们一定比升级者老，老的等年轻的，不会成环
 
-    // 共享锁升级为排它锁
-    txn->GetSharedLockSet()->erase(rid);
-    txn->GetExclusiveLockSet()->insert(rid);
-    return true;
+    return WaitForGrant(latch, txn, std::vector<RID>{rid});
 }
 
 /**
@@ -356,57 +246,360 @@ bool LockManager::Unlock(Transaction *txn, const RID &rid)
     }
   }
 
-  assert(lock_table_.count(rid));
-  for (auto it = lock_table_[rid].list.begin();
-       it != lock_table_[rid].list.end(); ++it)
+  // early lock release: 事务已经写了 COMMIT 记录（prev lsn 就是它），但还没有落盘
+  // 记下这个 lsn，后续拿到该rid锁的事务在它持久化之前不能确认提交
+  auto entry = lock_table_.find(rid);
+  if (entry != lock_table_.end() &&
+      txn->GetState() == TransactionState::COMMITTED &&
+      txn->GetPrevLSN() > entry->second->release_lsn) {
+    entry->second->release_lsn = txn->GetPrevLSN();
+  }
+
+  if (EraseRequest(txn, rid))
   {
-    // 遍历rid以找到目标rid
-    if (it->txn_id == txn->GetTransactionId())
+    // 需要唤醒其它等待在该rid上的事务
+    cond.notify_all();
+  }
+  return true;
+}
+
+/**
+ * @brief 请求入队（队尾），wait-die 判定需要 die 时返回 false（事务被置为ABORTED）
+ * 入队之后它要等的就是排在它前面的、与它冲突的请求，其中只要有更老的事务就 die
+ * caller holds mutex_
+ * @param  txn              desc
+ * @param  rid              desc
+ * @param  mode             desc
+ * @return true @c
+ * @return false @c
+ */
+bool LockManager::Enqueue(Transaction *txn, const RID &rid, LockMode mode)
+{
+    Waiting &queue = GetQueue(rid);
+    // wait die 是一种非剥夺策略，老的事务等待新的事务释放资源
+    // 即若A比B老，则等待B执行结束，否则A卷回(roll-back)
+    // 一段时间后会以原先的时间戳继续申请。老的才有资格等，年轻的全部卷回
+    // ...
+    // 假设事务 T5、T10、T15 分别具有时间戳 5、10 和 15
+    // 如果 T5 请求 T10 持有的数据项，则 T5 将等待
+    // 如果 T15 请求 T10 持有的数据项，则 T15 将被杀死(死亡)
+    // wait die 为什么能否防止环的出现呢
+    // 如果Ti等待Tj释放锁，记录为 Ti->Tj, wait die只允许Ti等待Tj，且i<j(或j<i)。反正一定是单边的，绝对不可能形成环
+    for (auto &r : queue.list)
     {
-      bool first = it == lock_table_[rid].list.begin();
-      bool exclusive = it->mode == LockMode::EXCLUSIVE;
-
-      if (exclusive)
-      {
-        // 先-1。这个就是一个统计数据
-        if(lock_table_[rid].exclusive_cnt>0){
-            --lock_table_[rid].exclusive_cnt;
-        } else {
-            lock_table_[rid].exclusive_cnt=0;
+        bool conflict = mode == LockMode::EXCLUSIVE || r.mode == LockMode::EXCLUSIVE;
+        if (conflict && r.txn_id < txn->GetTransactionId())
+        {
+            // 从根源上杜绝了环的出现，但是也abort了一些无需abort的事务，在性能上有损失
+            txn->SetState(TransactionState::ABORTED);
+            return false;
         }
-      }
-      lock_table_[rid].list.erase(it);  // 相当于delete
-
-      txn_id_t oldest_txn_id = lock_table_[rid].oldest;
-      // 继续遍历list，选择最小的tid给到oldest
-      if(!lock_table_[rid].list.empty()){
-          for(auto it=lock_table_[rid].list.begin(); it!=lock_table_[rid].list.end(); ++it){
-              if(it->txn_id<=oldest_txn_id){
-                  lock_table_[rid].oldest=it->txn_id;
-              }
-          }
-      }else{
-          lock_table_[rid].oldest=-1;
-      }
-
-      if (first || exclusive)
-      {
-        // 需要唤醒其它等待在该rid上的事务 
-        cond.notify_all();
-      }
-      break;
     }
-  }
-  return true;
+    AppendRequest(queue, Request{txn->GetTransactionId(), mode, false});
+    return true;
+}
+
+/**
+ * @brief 等到 pending 里所有的请求都被授权，每轮把能授权的都授权掉，剩下的继续等
+ * 等待超时会撤掉剩下的请求并返回 false
+ * @param  latch            holds mutex_
+ * @param  txn              desc
+ * @param  pending          已经入队的请求
+ * @return true @c
+ * @return false @c
+ */
+bool LockManager::WaitForGrant(std::unique_lock<std::mutex> &latch, Transaction *txn,
+                               std::vector<RID> pending)
+{
+    while (!pending.empty())
+    {
+        bool granted = false;
+        for (size_t i = 0; i < pending.size();)
+        {
+            const RID &rid = pending[i];
+            Waiting &queue = GetQueue(rid);
+            auto cur = FindRequest(queue, txn);
+            assert(cur != queue.list.end());
+            if (!Grantable(queue, cur)) { ++i; continue; }
+
+            // 得到了锁
+            cur->granted = true;
+            granted = true;
+            InheritDependency(txn, rid);
+            if (cur->mode == LockMode::SHARED)
+            {
+                txn->GetSharedLockSet()->insert(rid);  // 事务要维护一个set, track当前事务所加读锁的rid
+            }
+            else
+            {
+                if (queue.upgrading == txn->GetTransactionId())
+                {
+                    // 共享锁升级为排它锁
+                    queue.upgrading = INVALID_TXN_ID;
+                    txn->GetSharedLockSet()->erase(rid);
+                }
+                txn->GetExclusiveLockSet()->insert(rid);
+            }
+            pending[i] = pending.back();
+            pending.pop_back();
+        }
+        // 读锁授权之后，排在它后面的读锁可能也可以授权了
+        if (granted) { cond.notify_all(); }
+        if (pending.empty()) { break; }
+
+        // 每次被唤醒都要重新检查条件，否则只能等到超时才能退出
+        if(cond.wait_for(latch, std::chrono::milliseconds(LOCK_TIME_OUT))==std::cv_status::timeout){
+            // 超时的请求要从队列里撤掉，否则会一直挡住后面的事务
+            WithdrawBatch(txn, pending);
+            txn->SetState(TransactionState::ABORTED);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief FIFO 授权：排它锁必须排在队首，共享锁前面必须全部是已授权的共享锁
+ * caller holds mutex_
+ * @param  queue            desc
+ * @param  cur              desc
+ * @return true @c
+ * @return false @c
+ */
+bool LockManager::Grantable(Waiting &queue, std::list<Request>::iterator cur)
+{
+    if (cur->mode == LockMode::EXCLUSIVE) { return cur == queue.list.begin(); }
+    for (auto it = queue.list.begin(); it != cur; ++it)
+    {
+        if (it->mode != LockMode::SHARED || !it->granted) { return false; }
+    }
+    return true;
+}
+
+/**
+ * @brief 找到事务在队列里的请求，caller holds mutex_
+ * @param  queue            desc
+ * @param  txn              desc
+ * @return std::list<LockManager::Request>::iterator @c 找不到时返回 end()
+ */
+std::list<LockManager::Request>::iterator LockManager::FindRequest(Waiting &queue, Transaction *txn)
+{
+    for (auto it = queue.list.begin(); it != queue.list.end(); ++it)
+    {
+        if (it->txn_id == txn->GetTransactionId()) { return it; }
+    }
+    return queue.list.end();
+}
+
+/**
+ * @brief 把事务在rid上的请求从队列里删掉，caller holds mutex_
+ * @param  txn              desc
+ * @param  rid              desc
+ * @return true 删掉了请求，后面的请求可能可以授权了，需要唤醒等待者
+ * @return false @c
+ */
+bool LockManager::EraseRequest(Transaction *txn, const RID &rid)
+{
+    // 队列可能已经被回收了
+    auto entry = lock_table_.find(rid);
+    if (entry == lock_table_.end()) { return false; }
+    Waiting &queue = *entry->second;
+    auto it = FindRequest(queue, txn);
+    if (it == queue.list.end()) { return false; }
+
+    if (queue.upgrading == txn->GetTransactionId()) { queue.upgrading = INVALID_TXN_ID; }
+    // 节点回收到 free_requests_ 里复用
+    RecycleRequest(queue, it);
+    if (queue.list.empty())
+    {
+        // 队列空了就回收，锁表的大小只跟当前被锁住的行数有关
+        ReleaseQueue(rid);
+    }
+    return true;
+}
+
+/**
+ * @brief 撤掉一批还没有被授权的请求并唤醒等待者，caller holds mutex_
+ * @param  txn              desc
+ * @param  rids             desc
+ */
+void LockManager::WithdrawBatch(Transaction *txn, const std::vector<RID> &rids)
+{
+    for (auto &rid : rids) { EraseRequest(txn, rid); }
+    if (!rids.empty()) { cond.notify_all(); }
+}
+
+/**
+ * @brief 取rid对应的请求队列，没有就从 free_waitings_ 里拿一个（或者新建）挂到锁表上
+ * caller holds mutex_
+ * @param  rid              desc
+ * @return LockManager::Waiting& @c
+ */
+LockManager::Waiting &LockManager::GetQueue(const RID &rid)
+{
+    auto it = lock_table_.find(rid);
+    if (it != lock_table_.end()) { return *it->second; }
+
+    Waiting *queue;
+    if (!free_waitings_.empty()) {
+        queue = free_waitings_.back();
+        free_waitings_.pop_back();
+    } else {
+        queue = new Waiting;
+    }
+    // 这个 rid 上一个队列回收时留下的 release_lsn
+    auto released = released_lsns_.find(rid);
+    if (released != released_lsns_.end()) {
+        queue->release_lsn = released->second;
+        released_lsns_.erase(released);
+    }
+    lock_table_.emplace(rid, queue);
+    return *queue;
+}
+
+/**
+ * @brief 队列空了以后把它从锁表上摘下来，放回池子，caller holds mutex_
+ * @param  rid              desc
+ */
+void LockManager::ReleaseQueue(const RID &rid)
+{
+    auto it = lock_table_.find(rid);
+    assert(it != lock_table_.end() && it->second->list.empty());
+    Waiting *queue = it->second;
+    lock_table_.erase(it);
+
+    if (queue->release_lsn != INVALID_LSN) {
+        released_lsns_[rid] = queue->release_lsn;
+        released_order_.emplace_back(queue->release_lsn, rid);
+        if (released_order_.size() > LOCK_POOL_SIZE) { PruneReleased(); }
+    }
+    queue->upgrading = INVALID_TXN_ID;
+    queue->release_lsn = INVALID_LSN;
+    if (free_waitings_.size() < LOCK_POOL_SIZE) {
+        free_waitings_.push_back(queue);
+    } else {
+        delete queue;
+    }
+
+    // 锁表大幅缩小之后，bucket 数组也缩一下
+    if (lock_table_.bucket_count() > LOCK_POOL_SIZE &&
+        lock_table_.size() * 8 < lock_table_.bucket_count()) {
+        lock_table_.rehash(lock_table_.size() * 2);
+    }
+}
+
+/**
+ * @brief 落盘了的 release_lsn 不会再让任何事务等待，从 released_lsns_ 里去掉
+ * released_order_ 按释放的顺序排，也就是 COMMIT 记录的顺序，只从队头往后看，落盘的直接丢掉；
+ * 没落盘的（或者不知道日志落盘到哪里，没有 log manager）在超过一半容量时也从队头丢掉，
+ * lsn 并进 released_floor_lsn_，之后在任何 rid 上拿到锁都依赖它，宁可多等也不丢依赖。
+ * 每一项只出队一次，均摊下来每次释放 O(1)，caller holds mutex_
+ */
+void LockManager::PruneReleased()
+{
+    lsn_t persistent_lsn = log_manager_ == nullptr ? INVALID_LSN : log_manager_->GetPersistentLSN();
+    if (released_floor_lsn_ <= persistent_lsn) { released_floor_lsn_ = INVALID_LSN; }
+    while (!released_order_.empty()) {
+        auto &oldest = released_order_.front();
+        bool persistent = oldest.first <= persistent_lsn;
+        if (!persistent && released_order_.size() <= LOCK_POOL_SIZE / 2) { break; }
+        // rid 之后又建过队列（取走了）或者又释放过（更新了），队列里这一项已经过期
+        auto it = released_lsns_.find(oldest.second);
+        if (it != released_lsns_.end() && it->second == oldest.first) {
+            if (!persistent) { released_floor_lsn_ = std::max(released_floor_lsn_, oldest.first); }
+            released_lsns_.erase(it);
+        }
+        released_order_.pop_front();
+    }
+}
+
+/**
+ * @brief 请求入队，链表节点优先从 free_requests_ 里 splice 过来，caller holds mutex_
+ * @param  queue            desc
+ * @param  req              desc
+ */
+void LockManager::AppendRequest(Waiting &queue, const Request &req)
+{
+    if (free_requests_.empty()) {
+        queue.list.push_back(req);
+        return;
+    }
+    queue.list.splice(queue.list.end(), free_requests_, free_requests_.begin());
+    queue.list.back() = req;
+}
+
+/**
+ * @brief 请求出队，节点还给 free_requests_，池子满了才真正释放，caller holds mutex_
+ * @param  queue            desc
+ * @param  it               desc
+ */
+void LockManager::RecycleRequest(Waiting &queue, std::list<Request>::iterator it)
+{
+    if (free_requests_.size() < LOCK_POOL_SIZE) {
+        free_requests_.splice(free_requests_.end(), queue.list, it);
+    } else {
+        queue.list.erase(it);
+    }
+}
+
+/**
+ * @brief 锁表占用的内存（估算值），包括池子里缓存的节点
+ * @return LockTableStats @c
+ */
+LockTableStats LockManager::GetStats()
+{
+    std::unique_lock<std::mutex> latch(mutex_);
+    // std::list 的节点是 前后指针 + Request，unordered_map 的节点是 next 指针 + pair
+    const size_t request_node = sizeof(Request) + 2 * sizeof(void *);
+    const size_t map_node = sizeof(std::pair<const RID, Waiting *>) + sizeof(void *);
+    const size_t released_node = sizeof(std::pair<const RID, lsn_t>) + sizeof(void *);
+
+    LockTableStats stats;
+    stats.queues = lock_table_.size();
+    for (auto &entry : lock_table_) { stats.requests += entry.second->list.size(); }
+    stats.pooled_queues = free_waitings_.size();
+    stats.pooled_requests = free_requests_.size();
+    stats.released = released_lsns_.size();
+    stats.bytes = lock_table_.bucket_count() * sizeof(void *) +
+                  stats.queues * (map_node + sizeof(Waiting)) +
+                  stats.pooled_queues * (sizeof(Waiting) + sizeof(Waiting *)) +
+                  (stats.requests + stats.pooled_requests) * request_node +
+                  released_lsns_.bucket_count() * sizeof(void *) + released_lsns_.size() * released_node +
+                  released_order_.size() * sizeof(std::pair<lsn_t, RID>);
+    return stats;
+}
+
+/**
+ * @brief 授权时调用，rid 上如果有事务提前释放过锁（已提交但日志可能还没落盘）
+ * 当前事务就依赖于那条 COMMIT 记录
+ * @param  txn              desc
+ * @param  rid              desc
+ */
+void LockManager::InheritDependency(Transaction *txn, const RID &rid)
+{
+    lsn_t release_lsn = std::max(GetQueue(rid).release_lsn, released_floor_lsn_);
+    if (release_lsn > txn->GetDependencyLSN()) {
+        txn->SetDependencyLSN(release_lsn);
+    }
+}
+
+LockManager::~LockManager()
+{
+    for (auto &entry : lock_table_) { delete entry.second; }
+    for (auto queue : free_waitings_) { delete queue; }
 }
 
 void
 LockManager::ToString(){
-    std::printf("num=%d\n", static_cast<int>(lock_table_.size()));
+    LockTableStats stats = GetStats();
+    std::printf("num=%d, requests=%d, pooled=%d/%d, bytes=%d\n",
+                static_cast<int>(stats.queues), static_cast<int>(stats.requests),
+                static_cast<int>(stats.pooled_queues), static_cast<int>(stats.pooled_requests),
+                static_cast<int>(stats.bytes));
     for(auto iter=lock_table_.begin();iter!=lock_table_.end();++iter){
         std::printf("%s\n", iter->first.ToString().c_str());
-        if(iter->second.list.empty()){continue;}
-        for(auto _iter=iter->second.list.begin();_iter!=iter->second.list.end();++_iter){
+        if(iter->second->list.empty()){continue;}
+        for(auto _iter=iter->second->list.begin();_iter!=iter->second->list.end();++_iter){
             std::printf("txnid=%d\n", static_cast<int>(_iter->txn_id));
         }
     }
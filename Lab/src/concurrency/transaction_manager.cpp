@@ -27,88 +27,108 @@ Transaction *TransactionManager::Begin() {
     return txn;
 }
 
+/**
+ * @brief 提交事务，开启日志时采用 early lock release:
+ * COMMIT 记录进入 log buffer 之后立刻释放锁，再等待日志落盘后才向调用者确认提交
+ * 锁等待时间因此不再包含 group flush 的时间
+ * 提前拿到锁的后继事务由 LockManager 记录依赖（dependency lsn），前驱没有持久化之前后继也不会确认提交
+ * @param  txn              desc
+ */
 void TransactionManager::Commit(Transaction *txn) {
     txn->SetState(TransactionState::COMMITTED);
+    // 没有写过任何东西的事务，自己的 COMMIT 记录没必要等，只需要等它依赖的前驱
+    bool read_only = txn->GetWriteSet()->empty() && txn->GetExclusiveLockSet()->empty();
     // truly delete before commit,如果没有到提交这些是需要回滚的
-    auto write_set = txn->GetWriteSet();
-    while (!write_set->empty()) {
-        auto &item = write_set->back();
-        auto table = item.table_;
-        if (item.wtype_ == WType::DELETE) {
-            // this also release the lock when holding the page latch
-            std::printf("rid=%s, txn=%d\n", item.rid_.ToString().c_str(), static_cast<int>(txn->GetTransactionId()));
-            table->ApplyDelete(item.rid_, txn);
+    // 按 page 分组，每个 page 只 fetch/latch 一次；锁统一在 COMMIT 记录写入之后释放
+    for (auto &group : GroupWriteSetByPage(txn)) {
+        std::vector<RID> rids;
+        for (auto item : group.second) {
+            if (item->wtype_ == WType::DELETE) { rids.push_back(item->rid_); }
+        }
+        if (!rids.empty()) {
+            group.first.first->ApplyDeletes(group.first.second, rids, txn);
         }
-        write_set->pop_back();
     }
-    write_set->clear();
+    txn->GetWriteSet()->clear();
 
     if (ENABLE_LOGGING) {
         // TODO: write log and update transaction's prev_lsn here
         LogRecord log(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT);
         txn->SetPrevLSN(log_manager_->AppendLogRecord(log));
 
+        // early lock release，此时提交的顺序已经由日志确定了
+        ReleaseLocks(txn);
+
         // A txnis not considered committed until allits log records have been written to stable storage
         // Make sure that all log records are flushed before it returns an acknowledgement to application
         // 事务的提交确实意味着持久化的完成，这里会卡着不返回
-        while(txn->GetPrevLSN() > log_manager_->GetPersistentLSN()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
+        // 日志是顺序写的，自己的 COMMIT 记录落盘了，前驱的也一定落盘了
+        WaitUntilPersistent(read_only ? txn->GetDependencyLSN() : txn->GetPrevLSN());
+        return;
     }
 
-    // release all the lock
-    std::unordered_set<RID> lock_set;
-    for (auto item : *txn->GetSharedLockSet()) { lock_set.emplace(item); }
-    for (auto item : *txn->GetExclusiveLockSet()) { lock_set.emplace(item); }
-    // lock_set表示的是该事务所有持有锁的rid
-    // release all the lock
-    for (auto locked_rid : lock_set) {
-        lock_manager_->Unlock(txn, locked_rid);
-    }
+    ReleaseLocks(txn);
 }
 
 void TransactionManager::Abort(Transaction *txn) {
   txn->SetState(TransactionState::ABORTED);
   // rollback before releasing lock
   // 除去log中的数据，原地更新的数据全部原地回滚
-  auto write_set = txn->GetWriteSet();
-  while (!write_set->empty()) {
-    auto &item = write_set->back();
-    auto table = item.table_;
-    if (item.wtype_ == WType::DELETE) {
-      LOG_DEBUG("rollback delete");
-      table->RollbackDelete(item.rid_, txn);
-    } else if (item.wtype_ == WType::INSERT) {
-      LOG_DEBUG("rollback insert");
-      table->ApplyDelete(item.rid_, txn);
-    } else if (item.wtype_ == WType::UPDATE) {
-      LOG_DEBUG("rollback update");
-      table->UpdateTuple(item.tuple_, item.rid_, txn);
-    }
-    write_set->pop_back();
+  // 不同 page 上的回滚互不影响，同一个 page 内保持逆序
+  for (auto &group : GroupWriteSetByPage(txn)) {
+    group.first.first->Rollback(group.first.second, group.second, txn);
   }
-  write_set->clear();
+  txn->GetWriteSet()->clear();
 
   if (ENABLE_LOGGING) {
     // TODO: write log and update transaction's prev_lsn here
     LogRecord log(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT);
     txn->SetPrevLSN(log_manager_->AppendLogRecord(log));
     // abort的返回也意味着持久化的完成
-    while(txn->GetPrevLSN() > log_manager_->GetPersistentLSN())
-    {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    WaitUntilPersistent(txn->GetPrevLSN());
   }
 
   // release all the lock
+  ReleaseLocks(txn);
+}
+
+/**
+ * @brief 把 write set 按 (table, page) 分组，组内按写入的逆序排列（后写的先处理）
+ * 组之间按 page id 升序，提交/回滚的代价与涉及的 page 数成正比，而不是行数
+ * @param  txn              desc
+ * @return std::map<...> @c 指向 write set 中的记录，write set 清空之前有效
+ */
+std::map<std::pair<TableHeap *, page_id_t>, std::vector<WriteRecord *>>
+TransactionManager::GroupWriteSetByPage(Transaction *txn) {
+  std::map<std::pair<TableHeap *, page_id_t>, std::vector<WriteRecord *>> groups;
+  auto write_set = txn->GetWriteSet();
+  for (auto it = write_set->rbegin(); it != write_set->rend(); ++it) {
+    groups[std::make_pair(it->table_, it->rid_.GetPageId())].push_back(&*it);
+  }
+  return groups;
+}
+
+/**
+ * @brief 释放事务持有的所有锁
+ * @param  txn              desc
+ */
+void TransactionManager::ReleaseLocks(Transaction *txn) {
   std::unordered_set<RID> lock_set;
-  for (auto item : *txn->GetSharedLockSet())
-    lock_set.emplace(item);
-  for (auto item : *txn->GetExclusiveLockSet())
-    lock_set.emplace(item);
-  // release all the lock
+  for (auto item : *txn->GetSharedLockSet()) { lock_set.emplace(item); }
+  for (auto item : *txn->GetExclusiveLockSet()) { lock_set.emplace(item); }
+  // lock_set表示的是该事务所有持有锁的rid
   for (auto locked_rid : lock_set) {
     lock_manager_->Unlock(txn, locked_rid);
   }
 }
+
+/**
+ * @brief 等待 lsn 之前（含）的日志全部落盘
+ * @param  lsn              desc
+ */
+void TransactionManager::WaitUntilPersistent(lsn_t lsn) {
+  while (lsn > log_manager_->GetPersistentLSN()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
 } // namespace cmudb
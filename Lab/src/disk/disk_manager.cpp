@@ -18,15 +18,14 @@
 
 namespace cmudb {
 
-static char *buffer_used = nullptr;
-
 /**
  * Constructor: open/create a single database file & log file
  * 所以一个数据库的连接就是打开一个数据库文件，断开连接就是close文件
  * @input db_file: database file name
  */
 DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0), num_flushes_(0), flush_log_(false), flush_log_f_(nullptr) {
+    : file_name_(db_file), next_page_id_(0), num_flushes_(0), flush_log_(false), flush_log_f_(nullptr),
+      last_log_buffer_(nullptr) {
 
     std::string::size_type n = file_name_.find(".");
     if (n == std::string::npos) {
@@ -123,8 +122,8 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
  */
 void DiskManager::WriteLog(char *log_data, int size) {
     // enforce swap log buffer
-    assert(log_data != buffer_used);
-    buffer_used = log_data;
+    assert(log_data != last_log_buffer_);
+    last_log_buffer_ = log_data;
 
     if (size == 0) // no effect on num_flushes_ if log buffer is empty
         return;
@@ -0,0 +1,392 @@
+/**
+ * disk_extendible_hash.cpp
+ */
+
+#include "common/exception.h"
+#include "common/rid.h"
+#include "hash/disk_extendible_hash.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+DISK_EXTENDIBLE_HASH_TYPE::DiskExtendibleHash(const std::string &name,
+                                              BufferPoolManager *buffer_pool_manager,
+                                              const KeyComparator &comparator,
+                                              page_id_t directory_page_id)
+    : index_name_(name), buffer_pool_manager_(buffer_pool_manager),
+      comparator_(comparator), directory_page_id_(directory_page_id) {}
+
+/*
+ * FNV-1a 过一遍 key 的字节，最后用 murmur3 的 fmix64 把高位的差异扩散到低位，目录只用低位
+ * key 是编码过的定长字节，相等的 key 字节一定相同
+ */
+INDEX_TEMPLATE_ARGUMENTS
+uint32_t DISK_EXTENDIBLE_HASH_TYPE::Hash(const KeyType &key) const
+{
+    auto *bytes = reinterpret_cast<const unsigned char *>(&key);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(KeyType); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return static_cast<uint32_t>(hash);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *DISK_EXTENDIBLE_HASH_TYPE::FetchPage(page_id_t page_id)
+{
+    auto *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while DiskExtendibleHash"); }
+    return page;
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+/*
+ * 目录读锁下找到桶，锁住桶之后就可以放掉目录了
+ * @return : true means key exists
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool DISK_EXTENDIBLE_HASH_TYPE::GetValue(
+    const KeyType &key, std::vector<ValueType> &result, Transaction *transaction)
+{
+    (void)transaction;
+    if (IsEmpty()) { return false; }
+    uint32_t hash = Hash(key);
+
+    auto *directory_page = FetchPage(directory_page_id_);
+    directory_page->RLatch();
+    auto *directory = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+    auto *page = FetchPage(directory->GetBucketPageId(hash & directory->GetGlobalDepthMask()));
+    page->RLatch();
+    directory_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), false);
+
+    // overflow 页由桶的锁保护
+    auto *bucket = reinterpret_cast<BucketPage *>(page->GetData());
+    bool found = bucket->GetValues(key, result, comparator_) > 0;
+    for (page_id_t next = bucket->GetOverflowPageId(); next != INVALID_PAGE_ID;) {
+        auto *overflow = FetchBucket(next);
+        found = overflow->GetValues(key, result, comparator_) > 0 || found;
+        page_id_t current = next;
+        next = overflow->GetOverflowPageId();
+        buffer_pool_manager_->UnpinPage(current, false);
+    }
+
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    return found;
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+/*
+ * 桶有空位（包括 overflow 页）就直接放进去
+ * 满了并且分裂能把 key 分开的话，放掉桶的锁，拿目录写锁分裂之后重来
+ * @return: false if the same (key, value) already exists
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool DISK_EXTENDIBLE_HASH_TYPE::Insert(
+    const KeyType &key, const ValueType &value, Transaction *transaction)
+{
+    (void)transaction;
+    if (IsEmpty()) { StartNewTable(); }
+    uint32_t hash = Hash(key);
+
+    while (true) {
+        auto *directory_page = FetchPage(directory_page_id_);
+        directory_page->RLatch();
+        auto *directory = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+        auto *page = FetchPage(directory->GetBucketPageId(hash & directory->GetGlobalDepthMask()));
+        page->WLatch();
+        directory_page->RUnlatch();
+        buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), false);
+
+        auto *bucket = reinterpret_cast<BucketPage *>(page->GetData());
+        bool exists = bucket->Find(key, value, comparator_) >= 0;
+        for (page_id_t next = bucket->GetOverflowPageId(); !exists && next != INVALID_PAGE_ID;) {
+            auto *overflow = FetchBucket(next);
+            exists = overflow->Find(key, value, comparator_) >= 0;
+            page_id_t current = next;
+            next = overflow->GetOverflowPageId();
+            buffer_pool_manager_->UnpinPage(current, false);
+        }
+
+        bool split = !exists && NeedSplit(bucket, hash);
+        if (!exists && !split) { AppendToChain(bucket, key, value); }
+        page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), !exists && !split);
+        if (!split) { return !exists; }
+
+        // 分裂失败说明别的线程已经分裂过了，重新找桶就行
+        SplitBucket(hash);
+    }
+}
+
+/*
+ * 第一次插入的时候建立目录和唯一的一个桶，目录页号写进 header page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void DISK_EXTENDIBLE_HASH_TYPE::StartNewTable()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!IsEmpty()) { return; }
+
+    page_id_t directory_page_id, bucket_page_id;
+    auto *directory_page = buffer_pool_manager_->NewPage(directory_page_id);
+    if (directory_page == nullptr) {
+        throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while StartNewTable");
+    }
+    auto *bucket_page = buffer_pool_manager_->NewPage(bucket_page_id);
+    if (bucket_page == nullptr) {
+        buffer_pool_manager_->UnpinPage(directory_page_id, false);
+        buffer_pool_manager_->DeletePage(directory_page_id);
+        throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while StartNewTable");
+    }
+    reinterpret_cast<BucketPage *>(bucket_page->GetData())->Init(bucket_page_id);
+    reinterpret_cast<HashDirectoryPage *>(directory_page->GetData())->Init(directory_page_id, bucket_page_id);
+    buffer_pool_manager_->UnpinPage(bucket_page_id, true);
+    buffer_pool_manager_->UnpinPage(directory_page_id, true);
+
+    // 目录初始化完了才让别的线程看到
+    directory_page_id_ = directory_page_id;
+    UpdateDirectoryPageId(true);
+}
+
+/*
+ * 桶和 overflow 页都满了才需要分裂。桶里的 key 和新 key 的 hash 都一样时
+ * （同一个 key 的重复），分裂多少次也分不开，只能挂 overflow 页；目录到了最大深度也一样
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool DISK_EXTENDIBLE_HASH_TYPE::NeedSplit(BucketPage *bucket, uint32_t hash)
+{
+    if (bucket->GetLocalDepth() >= HASH_MAX_GLOBAL_DEPTH) { return false; }
+    if (!bucket->IsFull()) { return false; }
+
+    bool separable = false;
+    for (int i = 0; i < bucket->GetSize() && !separable; i++) { separable = Hash(bucket->KeyAt(i)) != hash; }
+    for (page_id_t next = bucket->GetOverflowPageId(); next != INVALID_PAGE_ID;) {
+        auto *overflow = FetchBucket(next);
+        bool full = overflow->IsFull();
+        for (int i = 0; i < overflow->GetSize() && !separable; i++) { separable = Hash(overflow->KeyAt(i)) != hash; }
+        page_id_t current = next;
+        next = overflow->GetOverflowPageId();
+        buffer_pool_manager_->UnpinPage(current, false);
+        if (!full) { return false; }
+    }
+    return separable;
+}
+
+/*
+ * 调用者持有桶的写锁，并负责把桶标记为脏
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void DISK_EXTENDIBLE_HASH_TYPE::AppendToChain(BucketPage *bucket, const KeyType &key, const ValueType &value)
+{
+    BucketPage *current = bucket;
+    while (current->IsFull()) {
+        page_id_t next = current->GetOverflowPageId();
+        BucketPage *overflow;
+        if (next == INVALID_PAGE_ID) {
+            auto *page = buffer_pool_manager_->NewPage(next);
+            if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while AppendToChain"); }
+            overflow = reinterpret_cast<BucketPage *>(page->GetData());
+            overflow->Init(next);
+            current->SetOverflowPageId(next);
+        } else {
+            overflow = FetchBucket(next);
+        }
+        if (current != bucket) { buffer_pool_manager_->UnpinPage(current->GetPageId(), true); }
+        current = overflow;
+    }
+    current->Append(key, value);
+    if (current != bucket) { buffer_pool_manager_->UnpinPage(current->GetPageId(), true); }
+}
+
+/*
+ * 桶的 local depth 加一，多看 hash 的一位：这一位是 1 的 kv 搬到新桶（split image）里
+ * local depth 等于 global depth 的时候目录先翻倍
+ * 原来指向这个桶的 slot 里，对应位是 1 的改为指向新桶
+ * overflow 页里的 kv 一起重新分配，分配完还放不下的重新挂 overflow 页
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool DISK_EXTENDIBLE_HASH_TYPE::SplitBucket(uint32_t hash)
+{
+    auto *directory_page = FetchPage(directory_page_id_);
+    directory_page->WLatch();
+    auto *directory = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+    page_id_t bucket_page_id = directory->GetBucketPageId(hash & directory->GetGlobalDepthMask());
+    auto *page = FetchPage(bucket_page_id);
+    page->WLatch();
+    auto *bucket = reinterpret_cast<BucketPage *>(page->GetData());
+
+    // 拿到写锁之前可能已经有别的线程分裂过了
+    bool split = NeedSplit(bucket, hash);
+    if (split) {
+        int local_depth = bucket->GetLocalDepth();
+        if (local_depth == directory->GetGlobalDepth()) { directory->IncrGlobalDepth(); }
+
+        page_id_t image_page_id;
+        auto *image_page = buffer_pool_manager_->NewPage(image_page_id);
+        if (image_page == nullptr) {
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(bucket_page_id, false);
+            directory_page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), true);
+            throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while SplitBucket");
+        }
+        auto *image = reinterpret_cast<BucketPage *>(image_page->GetData());
+        image->Init(image_page_id, local_depth + 1);
+        bucket->SetLocalDepth(local_depth + 1);
+
+        // 取出所有的 kv，overflow 页还给 buffer pool
+        std::vector<MappingType> items;
+        for (int i = 0; i < bucket->GetSize(); i++) { items.push_back(bucket->GetItem(i)); }
+        for (page_id_t next = bucket->GetOverflowPageId(); next != INVALID_PAGE_ID;) {
+            auto *overflow = FetchBucket(next);
+            for (int i = 0; i < overflow->GetSize(); i++) { items.push_back(overflow->GetItem(i)); }
+            page_id_t current = next;
+            next = overflow->GetOverflowPageId();
+            buffer_pool_manager_->UnpinPage(current, false);
+            buffer_pool_manager_->DeletePage(current);
+        }
+        bucket->Clear();
+        bucket->SetOverflowPageId(INVALID_PAGE_ID);
+        for (auto &item : items) {
+            AppendToChain((Hash(item.first) >> local_depth) & 1 ? image : bucket, item.first, item.second);
+        }
+
+        uint32_t low_mask = (1u << local_depth) - 1;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(directory->Size()); i++) {
+            if ((i & low_mask) == (hash & low_mask)) {
+                directory->SetBucketPageId(i, (i >> local_depth) & 1 ? image_page_id : bucket_page_id);
+            }
+        }
+        buffer_pool_manager_->UnpinPage(image_page_id, true);
+    }
+
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, split);
+    directory_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), split);
+    return split;
+}
+
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
+/*
+ * 桶里的 kv 没有顺序，删掉的位置用桶链最后一个 kv 填上，最后一个 overflow 页空了就还回去
+ * 桶不合并，目录也不缩小：删掉的 key 往往还会再插回来
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool DISK_EXTENDIBLE_HASH_TYPE::Remove(
+    const KeyType &key, const ValueType &value, Transaction *transaction)
+{
+    (void)transaction;
+    if (IsEmpty()) { return false; }
+    uint32_t hash = Hash(key);
+
+    auto *directory_page = FetchPage(directory_page_id_);
+    directory_page->RLatch();
+    auto *directory = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+    page_id_t bucket_page_id = directory->GetBucketPageId(hash & directory->GetGlobalDepthMask());
+    auto *page = FetchPage(bucket_page_id);
+    page->WLatch();
+    directory_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), false);
+
+    // 找到 (key, value) 所在的页，顺便记下桶链的最后两页
+    page_id_t target_page_id = INVALID_PAGE_ID, prev_page_id = INVALID_PAGE_ID, last_page_id = INVALID_PAGE_ID;
+    int target_index = -1;
+    for (page_id_t current = bucket_page_id; current != INVALID_PAGE_ID;) {
+        auto *chain = FetchBucket(current);
+        if (target_index < 0) {
+            target_index = chain->Find(key, value, comparator_);
+            if (target_index >= 0) { target_page_id = current; }
+        }
+        prev_page_id = last_page_id;
+        last_page_id = current;
+        current = chain->GetOverflowPageId();
+        buffer_pool_manager_->UnpinPage(last_page_id, false);
+    }
+
+    if (target_index >= 0) {
+        auto *target = FetchBucket(target_page_id);
+        auto *last = FetchBucket(last_page_id);
+        if (target_page_id == last_page_id) { target->RemoveAt(target_index); }
+        else { target->SetItem(target_index, last->PopBack()); }
+        bool release = last_page_id != bucket_page_id && last->GetSize() == 0;
+        buffer_pool_manager_->UnpinPage(target_page_id, true);
+        buffer_pool_manager_->UnpinPage(last_page_id, true);
+        if (release) {
+            FetchBucket(prev_page_id)->SetOverflowPageId(INVALID_PAGE_ID);
+            buffer_pool_manager_->UnpinPage(prev_page_id, true);
+            buffer_pool_manager_->DeletePage(last_page_id);
+        }
+    }
+
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, target_index >= 0);
+    return target_index >= 0;
+}
+
+/*****************************************************************************
+ * UTILITIES AND DEBUG
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+int DISK_EXTENDIBLE_HASH_TYPE::GetGlobalDepth()
+{
+    if (IsEmpty()) { return 0; }
+    auto *directory_page = FetchPage(directory_page_id_);
+    directory_page->RLatch();
+    int depth = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData())->GetGlobalDepth();
+    directory_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), false);
+    return depth;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int DISK_EXTENDIBLE_HASH_TYPE::GetLocalDepth(uint32_t slot)
+{
+    if (IsEmpty()) { return 0; }
+    auto *directory_page = FetchPage(directory_page_id_);
+    directory_page->RLatch();
+    auto *directory = reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+    auto *page = FetchPage(directory->GetBucketPageId(slot & directory->GetGlobalDepthMask()));
+    page->RLatch();
+    directory_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page->GetPageId(), false);
+    int depth = reinterpret_cast<BucketPage *>(page->GetData())->GetLocalDepth();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    return depth;
+}
+
+/*
+ * 和 BPlusTree::UpdateRootPageId 一样，header page 里记的是 <index name, directory page id>
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void DISK_EXTENDIBLE_HASH_TYPE::UpdateDirectoryPageId(bool insert_record)
+{
+    auto *page = FetchPage(HEADER_PAGE_ID);
+    auto *header_page = reinterpret_cast<HeaderPage *>(page);
+    if (insert_record) { header_page->InsertRecord(index_name_, directory_page_id_); }
+    else { header_page->UpdateRecord(index_name_, directory_page_id_); }
+    buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+template class DiskExtendibleHash<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class DiskExtendibleHash<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class DiskExtendibleHash<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class DiskExtendibleHash<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
@@ -38,6 +38,7 @@ public:
 	Page *NewPage(page_id_t &page_id);
 	bool DeletePage(page_id_t page_id);
     HashTable<page_id_t, Page *>* GetPageTable() { return page_table_; }
+	size_t GetPoolSize() const { return pool_size_; }
 
 	// for debug
 	bool Check() const
@@ -10,20 +10,35 @@
 #pragma once
 
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "common/rid.h"
 #include "concurrency/transaction.h"
+#include "logging/log_manager.h"
 
 #define LOCK_TIME_OUT 1000
+// 空闲 Waiting / Request 节点池子的上限，也是锁表 bucket 数组收缩的下限
+#define LOCK_POOL_SIZE 1024
 
 namespace cmudb {
 
 enum class LockMode { SHARED = 0, EXCLUSIVE };
 
+// lock table memory report
+struct LockTableStats {
+    size_t queues = 0;           // rids that currently have a request queue
+    size_t requests = 0;         // requests (granted or waiting) in those queues
+    size_t pooled_queues = 0;    // idle queues kept for reuse
+    size_t pooled_requests = 0;  // idle request nodes kept for reuse
+    size_t released = 0;         // rids whose early-released lock may not be persistent yet
+    size_t bytes = 0;            // estimated memory, including the pools
+};
+
 class LockManager {
     struct Request {
         // 某事务需要向某rid加锁（MODE），很形象就是事务向所管理器请求锁
@@ -34,19 +49,21 @@ class LockManager {
         bool granted = false;  // 请求是否被授权
     };
     struct Waiting {
-        // how many exclusive requests
-        // 排它锁的request是先自增，再尝试获取锁，否则排队
-        // 但是只要入队，排它锁请求exclusive_cnt需要自增
-        // 在这个设计里，只要rid被访问过，rid就会常驻，oldest也要跟着变化
-        // oldest指的是最小的事务id
-        size_t exclusive_cnt = 0;
-        txn_id_t oldest = -1;      // wait-die: txn older than `oldest`(<) can wait or die
+        // 按 FIFO 授权，已授权的请求总是 list 的一个前缀
         std::list<Request> list; // 锁表的list
+        // 正在等待升级的事务，同一时刻最多一个
+        txn_id_t upgrading = INVALID_TXN_ID;
+        // early lock release: 最近一个在该rid上提前释放锁的已提交事务的 COMMIT lsn
+        // 之后拿到这个rid上锁的事务都依赖于这条日志的持久化
+        lsn_t release_lsn = INVALID_LSN;
         //std::mutex mutex_;
         //std::condition_variable cond;
     };
 public:
-    explicit LockManager(bool strict_2PL) : strict_2PL_(strict_2PL) {};
+    // log_manager 用来判断 early lock release 留下的 lsn 是否已经落盘，可以为空
+    explicit LockManager(bool strict_2PL, LogManager *log_manager = nullptr) :
+        strict_2PL_(strict_2PL), log_manager_(log_manager) {};
+    ~LockManager();
 
     // disable copy
     LockManager(LockManager const &) = delete;
@@ -62,18 +79,56 @@ public:
     bool LockExclusive(Transaction *txn, const RID &rid);
     bool LockUpgrade(Transaction *txn, const RID &rid);
 
+    // batch lock: acquire locks on many rids (e.g. all slots of a table page)
+    // under a single latch acquisition, same wait-die semantics as above.
+    // requests are granted in FIFO order: a queued exclusive request blocks
+    // shared requests that arrive after it, and an upgrade jumps ahead of every waiter
+    // rids must be distinct, the ones already locked by txn are skipped. return false if txn is aborted,
+    // in which case none of the not-yet-granted requests stay queued
+    bool LockSharedBatch(Transaction *txn, const std::vector<RID> &rids);
+    bool LockExclusiveBatch(Transaction *txn, const std::vector<RID> &rids);
+
     // unlock:
     // release the lock hold by the txn
     bool Unlock(Transaction *txn, const RID &rid);
     /*** END OF APIs ***/
     void ToString();
+    LockTableStats GetStats();
 
 private:
+    // helpers below assume the caller holds mutex_
+    bool Enqueue(Transaction *txn, const RID &rid, LockMode mode);
+    bool WaitForGrant(std::unique_lock<std::mutex> &latch, Transaction *txn,
+                      std::vector<RID> pending);
+    bool Grantable(Waiting &queue, std::list<Request>::iterator cur);
+    std::list<Request>::iterator FindRequest(Waiting &queue, Transaction *txn);
+    bool EraseRequest(Transaction *txn, const RID &rid);
+    void WithdrawBatch(Transaction *txn, const std::vector<RID> &rids);
+    Waiting &GetQueue(const RID &rid);
+    void ReleaseQueue(const RID &rid);
+    // 去掉 released_lsns_ 里已经落盘的 lsn
+    void PruneReleased();
+    void AppendRequest(Waiting &queue, const Request &req);
+    void RecycleRequest(Waiting &queue, std::list<Request>::iterator it);
+    // 授权时把 rid 上的 release_lsn 继承为事务的 dependency lsn, caller holds mutex_
+    void InheritDependency(Transaction *txn, const RID &rid);
+
     bool strict_2PL_;  // 进一步限制的锁可以被释放的时机
+    LogManager *log_manager_;
     std::mutex mutex_;
     std::condition_variable cond;
-    // 系统维护的锁表
-    std::unordered_map<RID, Waiting> lock_table_;
+    // 系统维护的锁表，只保存当前有请求的rid
+    std::unordered_map<RID, Waiting *> lock_table_;
+    // 回收下来的空闲队列和请求节点
+    std::vector<Waiting *> free_waitings_;
+    std::list<Request> free_requests_;
+    // 队列回收之后 rid 上的 release_lsn 留在这里，这个 rid 再建队列时取回来
+    // 已经落盘的不再需要依赖，released_order_ 超过 LOCK_POOL_SIZE 项时清理一次
+    std::unordered_map<RID, lsn_t> released_lsns_;
+    // (release_lsn, rid) 按释放的顺序排，清理时从队头往后看
+    std::deque<std::pair<lsn_t, RID>> released_order_;
+    // 没落盘就被清理掉的 release_lsn 里最大的那个，所有 rid 都依赖它
+    lsn_t released_floor_lsn_ = INVALID_LSN;
 };
 
 } // namespace cmudb
@@ -52,7 +52,7 @@ public:
   Transaction(txn_id_t txn_id)
       : state_(TransactionState::GROWING),
         thread_id_(std::this_thread::get_id()),
-        txn_id_(txn_id), prev_lsn_(INVALID_LSN), shared_lock_set_{new std::unordered_set<RID>},
+        txn_id_(txn_id), prev_lsn_(INVALID_LSN), dependency_lsn_(INVALID_LSN), shared_lock_set_{new std::unordered_set<RID>},
         exclusive_lock_set_{new std::unordered_set<RID>} 
     {
         // initialize sets
@@ -75,10 +75,14 @@ public:
     inline void AddIntoDeletedPageSet(page_id_t page_id) { deleted_page_set_->insert(page_id); }
     inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() { return shared_lock_set_; }
     inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() { return exclusive_lock_set_; }
+    inline bool IsSharedLocked(const RID &rid) { return shared_lock_set_->count(rid) != 0; }
+    inline bool IsExclusiveLocked(const RID &rid) { return exclusive_lock_set_->count(rid) != 0; }
     inline TransactionState GetState() { return state_; }
     inline void SetState(TransactionState state) { state_ = state; }
     inline lsn_t GetPrevLSN() { return prev_lsn_; }
     inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
+    inline lsn_t GetDependencyLSN() { return dependency_lsn_; }
+    inline void SetDependencyLSN(lsn_t lsn) { dependency_lsn_ = lsn; }
 
 private:
     TransactionState state_;
@@ -95,6 +99,9 @@ private:
     std::shared_ptr<std::deque<WriteRecord>> write_set_;
     // prev lsn
     lsn_t prev_lsn_;
+    // early lock release: 本事务拿到的锁如果是被一个已提交但日志还没落盘的事务提前释放的
+    // 这里记录那些前驱事务 COMMIT 记录的最大 lsn，在它落盘之前本事务不能向客户端确认提交
+    lsn_t dependency_lsn_;
 
     // Below are used by concurrent index
     // this deque contains page pointer that was latched during index operation
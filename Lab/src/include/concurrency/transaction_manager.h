@@ -6,7 +6,9 @@
 #pragma once
 
 #include <atomic>
+#include <map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
@@ -29,6 +31,11 @@ public:
     void Abort(Transaction *txn);
 
 private:
+    std::map<std::pair<TableHeap *, page_id_t>, std::vector<WriteRecord *>>
+    GroupWriteSetByPage(Transaction *txn);
+    void ReleaseLocks(Transaction *txn);
+    void WaitUntilPersistent(lsn_t lsn);
+
     std::atomic<txn_id_t> next_txn_id_;  /* 有一个原子改变的 element，实际是个全局的 事务id */
     LockManager *lock_manager_;
     LogManager *log_manager_;
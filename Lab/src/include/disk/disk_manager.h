@@ -49,6 +49,8 @@ private:
   int num_flushes_;
   bool flush_log_;
   std::future<void> *flush_log_f_;
+  // log buffer of the previous WriteLog, used to check the log manager swaps buffers
+  char *last_log_buffer_;
 };
 
 } // namespace cmudb
\ No newline at end of file
@@ -0,0 +1,88 @@
+/**
+ * disk_extendible_hash.h
+ *
+ * Disk-resident extendible hash table used as an index.
+ * 和 extendible_hash.h 里内存中的 page table 是同一个算法，只是目录和桶都放在 buffer pool 的页面里：
+ *  一个 directory page，global depth 决定用 hash 值的低几位选 slot
+ *  每个 slot 指向一个 bucket page，桶满了就分裂，需要的话目录翻倍
+ * 点查只访问目录和一个桶两个页面，和树的高度无关，但是不支持范围查询
+ *
+ * 目录页号和 b+ tree 的 root 一样记在 header page 里，key 是索引的名字
+ *
+ * 并发：目录读锁保护"找到桶"这一步，桶上的锁保护桶和它的 overflow 页；
+ * 分裂要拿目录写锁。加锁顺序总是先目录再桶
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "concurrency/transaction.h"
+#include "page/hash_bucket_page.h"
+#include "page/hash_directory_page.h"
+
+namespace cmudb {
+
+#define DISK_EXTENDIBLE_HASH_TYPE DiskExtendibleHash<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class DiskExtendibleHash {
+    using BucketPage = HashBucketPage<KeyType, ValueType, KeyComparator>;
+
+public:
+    explicit DiskExtendibleHash(const std::string &name,
+                                BufferPoolManager *buffer_pool_manager,
+                                const KeyComparator &comparator,
+                                page_id_t directory_page_id = INVALID_PAGE_ID);
+
+    bool IsEmpty() const { return directory_page_id_ == INVALID_PAGE_ID; }
+
+    // key 可以重复，同样的 (key, value) 已经存在时返回 false
+    bool Insert(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
+
+    // 删除一对 (key, value)，不存在时返回 false
+    bool Remove(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
+
+    // 把 key 对应的所有 value 追加到 result
+    bool GetValue(const KeyType &key, std::vector<ValueType> &result, Transaction *transaction = nullptr);
+
+    // expose for test purpose
+    int GetGlobalDepth();
+    int GetLocalDepth(uint32_t slot);
+    page_id_t GetDirectoryPageId() const { return directory_page_id_; }
+
+private:
+    uint32_t Hash(const KeyType &key) const;
+
+    // 建立目录和第一个桶
+    void StartNewTable();
+
+    // 桶和它的 overflow 页里找一个空位放进去，都满了就挂一个新的 overflow 页
+    void AppendToChain(BucketPage *bucket, const KeyType &key, const ValueType &value);
+
+    // 桶（连同 overflow 页）满了，并且分裂能把里面的 key 分开
+    bool NeedSplit(BucketPage *bucket, uint32_t hash);
+
+    // 拿着目录写锁分裂 hash 对应的桶，返回 false 说明不用或者不能分裂了
+    bool SplitBucket(uint32_t hash);
+
+    void UpdateDirectoryPageId(bool insert_record = false);
+
+    // FetchPage 失败时抛异常
+    Page *FetchPage(page_id_t page_id);
+    BucketPage *FetchBucket(page_id_t page_id) {
+        return reinterpret_cast<BucketPage *>(FetchPage(page_id)->GetData());
+    }
+
+    // member variable
+    std::string index_name_;
+    BufferPoolManager *buffer_pool_manager_;
+    KeyComparator comparator_;
+    std::atomic<page_id_t> directory_page_id_;
+    std::mutex mutex_;  // 只保护建立目录
+};
+
+} // namespace cmudb
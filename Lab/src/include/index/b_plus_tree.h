@@ -18,7 +18,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "concurrency/transaction.h"
@@ -37,6 +46,30 @@ namespace cmudb {
 
 enum class Operation { READONLY = 0, INSERT, DELETE };
 
+// 节点少于 1/2 就合并或者重分配，经典的 b+ tree
+static const int BPLUSTREE_MERGE_THRESHOLD = 2;
+
+// 自适应哈希索引：一个 key 最近被点查（GetValue / Begin(key) / GetValues）了这么多次才记下它的位置
+static const int BPLUSTREE_HASH_HOT = 3;
+// 哈希表按 slot 分成这么多段，每段一把锁
+static const size_t BPLUSTREE_HASH_LATCHES = 64;
+
+// GetStatistics 的结果，树的形状和这个 BPlusTree 对象创建以来的结构修改次数
+struct BPlusTreeStats {
+    int height = 0;
+    std::vector<int> layer_pages;     // 每层的页面数，下标 0 是 root 所在的层
+    size_t keys = 0;                  // 叶子里的 key 总数
+    double avg_fill_factor = 0;       // 节点里 key（叶子）或者 child（中间节点）的个数除以容量，不算 root
+    double min_fill_factor = 0;
+    size_t splits = 0;
+    size_t merges = 0;
+    size_t redistributions = 0;
+    double leaf_contiguity = 1;       // 叶子链表里相邻的两个叶子页号也相邻的比例，1 表示顺序扫描就是顺序读
+    size_t hash_hits = 0;             // GetValue 靠自适应哈希索引只访问了一个页面的次数
+    size_t hash_misses = 0;           // 查了自适应哈希索引但还是要从 root 下降的次数
+    std::string ToString() const;
+};
+
 // Main class providing the API for the Interactive B+ Tree.
 template <typename KeyType, typename ValueType, typename KeyComparator>
 class BPlusTree {
@@ -46,6 +79,8 @@ public:
                     const KeyComparator &comparator,
                     page_id_t root_page_id = INVALID_PAGE_ID);
 
+    ~BPlusTree() { StopBackgroundCompaction(); }
+
     // Returns true if this B+ tree has no keys and values.
     bool IsEmpty() const;
 
@@ -55,9 +90,52 @@ public:
     // Remove a key and its value from this B+ tree.
     void Remove(const KeyType &key, Transaction *transaction = nullptr);
 
+    // 删除之后节点少于 1/divisor 满才合并或者重分配，divisor 至少是 2（合并后一定放得下）
+    // 阈值低一些，在半满附近来回插入删除不会反复地分裂合并；中间留下的稀疏节点交给 Compact
+    void SetMergeThreshold(int divisor);
+    int GetMergeThreshold() const { return merge_divisor_; }
+
+    // 按经典的半满标准把稀疏的叶子（和跟着变稀疏的中间节点）合并或者重分配，
+    // 和删除走同一条悲观路径，一次只处理一个叶子，不会长时间挡住前台的操作
+    // @return 处理过的叶子个数
+    int Compact(Transaction *transaction = nullptr);
+
+    // 后台线程每隔 interval 检查一次，期间有过删除就 Compact 一遍
+    void StartBackgroundCompaction(std::chrono::milliseconds interval);
+    void StopBackgroundCompaction();
+
+    // expose for test purpose
+    int GetLeafCount();
+
+    // 在 mutex_ 下逐层遍历一遍，期间不会有分裂合并，叶子上的插入删除照常进行
+    BPlusTreeStats GetStatistics();
+
+    // 先 Compact，再按链表顺序把叶子逐个搬到新分配的页面上，让叶子链表在文件里连续
+    // 一次只搬一个叶子，读者最多等一个叶子的拷贝；期间有别的合并改了链表就提前结束
+    // @return 搬过的叶子个数
+    int Defragment(Transaction *transaction = nullptr);
+
+    // 自适应哈希索引：查得多的 key 记下它在哪个叶子的哪个 slot，再查的时候只访问这一个页面
+    // GetValue、Begin(key) 和 GetValues 都先查它，BPlusTreeIndex 默认打开
+    // capacity 是哈希表的项数，0 表示关掉；要在并发使用这棵树之前设置
+    void EnableAdaptiveHash(size_t capacity);
+
     // return the value associated with a given key
     bool GetValue(const KeyType &key, std::vector<ValueType> &result, Transaction *transaction = nullptr);
 
+    // batch point query, the values of keys[i] go to result[i]
+    // probe 先排序，叶子只锁一次就把它覆盖的 probe 全查完，相邻的 probe 顺着 right link 走，不用每个都从 root 下降
+    void GetValues(const std::vector<KeyType> &keys, std::vector<std::vector<ValueType>> &result,
+                   Transaction *transaction = nullptr);
+    // 同上，每个 probe 是一个闭区间 [first, second]，重复 key 的索引用它一次取出一个 key 的所有 value
+    void GetValues(const std::vector<std::pair<KeyType, KeyType>> &ranges,
+                   std::vector<std::vector<ValueType>> &result, Transaction *transaction = nullptr);
+
+    // build the tree bottom-up from key/value pairs, only works on an empty tree
+    // items are sorted in place if needed, duplicate keys keep the first one (same as Insert)
+    // fill_factor in (0, 1] controls how full each node is packed
+    bool BulkLoad(std::vector<MappingType> &items, double fill_factor = 1.0);
+
     // index iterator, 迭代器就是指针，自增自减可以在容器中遍历
     IndexIterator<KeyType, ValueType, KeyComparator> Begin();
     // 指定了起点，这里是重载，通过参数类型的不同
@@ -70,6 +148,8 @@ public:
     void RemoveFromFile(const std::string &file_name, Transaction *transaction = nullptr);
 
     // expose for test purpose
+    // READONLY: optimistic descent, the leaf comes back read latched
+    // INSERT/DELETE: latch crabbing for structure modification, caller holds mutex_
     BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *
     FindLeafPage(const KeyType &key, bool leftMost = false, Operation op = Operation::READONLY, Transaction *transaction = nullptr);
 
@@ -102,8 +182,17 @@ private:
 
     void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key, BPlusTreePage *new_node, Transaction *transaction = nullptr);
 
+    // move_count 是搬到新节点的 kv 个数，0 表示对半分（中间节点总是对半分）
     template <typename N> 
-    N *Split(N *node);
+    N *Split(N *node, int move_count = 0);
+
+    // 单调递增的 key：缓存的最右叶子还有效、key 比它里面所有的 key 都大并且不用分裂的话，不下降直接追加
+    // @return false 表示没有插入，调用者走正常的路径
+    bool InsertRightmost(const KeyType &key, const ValueType &value);
+    // 调用者写锁住了 leaf，它是最右的叶子的话记下来给 InsertRightmost 用
+    void CacheRightmostLeaf(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf);
+    // 最右的叶子被追加的 key 撑满时，只把这么多 kv 分给新叶子（90/10 分裂）
+    static int RightmostSplitCount(int size) { return std::max(1, size / 10); }
 
     template <typename N>
     bool CoalesceOrRedistribute(N *node, Transaction *transaction = nullptr);
@@ -129,23 +218,87 @@ private:
 
     void UpdateRootPageId(bool insert_record = false);
 
+    // bulk load 一层节点：items 平均分给若干个新页面，同层用 right link 串起来
+    // 返回上一层需要的 (low key, page id)
+    template <typename N, typename Item>
+    std::vector<std::pair<KeyType, page_id_t>> BulkLoadLevel(const std::vector<Item> &items, int fill, int layer);
+
     // unlock all parents
     void UnlockUnpinPages(Operation op, Transaction *transaction);
 
+    // optimistic lock coupling over a B-link tree: version validated descent that
+    // moves right past concurrent splits, only the leaf is latched
+    Page *FindLeafPageOptimistic(const KeyType &key, bool leftMost, Operation op);
+
+    // GetValues 用：放掉读锁住的叶子，读锁住它右边的叶子
+    // 期间发生过合并（key 可能被搬到了左边）就返回 nullptr，调用者重新从 root 下降
+    Page *LatchRightLeaf(Page *page, uint64_t epoch);
+
+    // release the write latch of a node, the caller keeps its pin
+    void WUnlatchNode(BPlusTreePage *node);
+
     template <typename N>
     bool isSafe(N *node, Operation op);
 
-    inline void lockRoot() { mutex_.lock(); }
-    inline void unlockRoot() { mutex_.unlock(); }
+    // 合并阈值下节点最少的 key（叶子）或者 child（中间节点）个数，不超过经典的半满
+    int MinSize(BPlusTreePage *node) const;
+    int NodeSize(BPlusTreePage *node) const;
+
+    // 把叶子拷到一个新页面上，父节点和左边叶子的指针改过去，调用者持有 mutex_ 并且 merge_epoch_ 是奇数
+    page_id_t RelocateLeaf(page_id_t page_id, page_id_t left_page_id);
+    // 搬迁之后回收旧叶子的 frame，调用者持有 mutex_，merge_epoch_ 已经加过
+    void ReclaimLeaf(page_id_t page_id);
+
+    // 自适应哈希索引的一项：key 的 lower bound 在叶子 page_id 的第 slot 个（key 不一定在树里），version 和 epoch 是记下位置时
+    // 叶子页面的版本号和 merge_epoch_；hits 是这个 key 最近被查的次数
+    struct HashEntry {
+        KeyType key;
+        page_id_t page_id = INVALID_PAGE_ID;
+        int slot = 0;
+        uint64_t version = 0;
+        uint64_t epoch = 0;
+        int hits = 0;
+    };
+    size_t HashSlot(const KeyType &key) const;
+    // 命中并且位置还有效的话返回读锁住、pin 住的叶子，index 是 key 在叶子里的 lower bound；否则返回 nullptr
+    Page *LookupAdaptiveHash(const KeyType &key, int &index);
+    // 正常下降之后调用，page 是读锁住的叶子，slot 是 key 在叶子里的 lower bound
+    void RecordAdaptiveHash(const KeyType &key, Page *page, int slot);
+    // 点查的入口：先查自适应哈希索引，不行再乐观下降并记下位置
+    // 返回读锁住、pin 住的叶子，index 是 key 在叶子里的 lower bound，树为空的时候返回 nullptr
+    Page *FindLeafPageForRead(const KeyType &key, int &index);
 
     // member variable
     std::string index_name_;  // b+tree是为index服务的，比如说为数据库的哪一个key去建立索引
-    std::mutex mutex_;                       // protect `root_page_id_` from concurrent modification
-    static thread_local bool root_is_locked; // root is locked?
-    page_id_t root_page_id_;
+    std::mutex mutex_;                       // serialize structure modifications (split/merge/new root)
+    std::atomic<page_id_t> root_page_id_;    // 乐观的读者不拿 mutex_ 直接读
+    std::atomic<uint64_t> merge_epoch_{0};   // 删除引起的结构修改期间为奇数，见 FindLeafPageOptimistic
     BufferPoolManager *buffer_pool_manager_;
     KeyComparator comparator_;
 
+    std::atomic<int> merge_divisor_{BPLUSTREE_MERGE_THRESHOLD};
+    std::atomic<bool> compacting_{false};      // Compact 期间按半满判断，只在 mutex_ 下修改
+    std::atomic<size_t> deletes_since_compaction_{0};
+    std::thread compaction_thread_;
+    std::mutex compaction_mutex_;
+    std::condition_variable compaction_cv_;
+    bool compaction_stop_ = false;
+
+    // 最右叶子的缓存：高 32 位是页号，低 32 位是缓存时 merge_epoch_ 的低 32 位
+    // 合并和叶子搬迁都会改 merge_epoch_，epoch 没变说明这个叶子还在树里，见 InsertRightmost
+    std::atomic<uint64_t> rightmost_leaf_{static_cast<uint64_t>(static_cast<uint32_t>(INVALID_PAGE_ID)) << 32};
+
+    // 自适应哈希索引，见 EnableAdaptiveHash
+    std::vector<HashEntry> hash_entries_;
+    std::unique_ptr<std::mutex[]> hash_latches_;
+    std::atomic<size_t> hash_hits_{0};
+    std::atomic<size_t> hash_misses_{0};
+
+    // 结构修改计数，见 GetStatistics
+    std::atomic<size_t> split_count_{0};
+    std::atomic<size_t> merge_count_{0};
+    std::atomic<size_t> redistribute_count_{0};
+
     /**
      * @brief 实际上 B+tree 在每一个节点中能够容纳的k的个数，b+tree的阶一般是节点容量的 1/2 或 2/3，这个秩的定义是有的。在节点中，每一个节点的 header 部分有存
      * 有点奇怪，秩应该是 b+ tree 的性质，而不是节点的性质哦
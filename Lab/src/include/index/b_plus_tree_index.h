@@ -15,6 +15,12 @@ namespace cmudb {
 
 #define BPLUSTREE_INDEX_TYPE BPlusTreeIndex<KeyType, ValueType, KeyComparator>
 
+// 索引上的删除很多是一批一批来的，低于 1/4 满才合并，少做结构修改
+static const int INDEX_MERGE_THRESHOLD = 4;
+
+// 索引上的点查（ScanKey、IN list）先查自适应哈希索引，热点 key 只访问一个叶子
+static const size_t INDEX_ADAPTIVE_HASH_SIZE = 1024;
+
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
 
@@ -28,15 +34,60 @@ public:
     void InsertEntry(const Tuple &key, RID rid,
                     Transaction *transaction = nullptr) override;
 
-    void DeleteEntry(const Tuple &key,
+    void DeleteEntry(const Tuple &key, RID rid,
                     Transaction *transaction = nullptr) override;
 
+    bool CanHold(const Tuple &key) override;
+
     void ScanKey(const Tuple &key, std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    void ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    void ScanRange(const ScanBound *lo, const ScanBound *hi,
+                std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    void BulkLoad(std::vector<std::pair<Tuple, RID>> &entries,
+                double fill_factor = 1.0,
                 Transaction *transaction = nullptr) override;
 
+    // 每个 run 一个任务，各自编码成 index key 排好序，再两两归并，最后自底向上建树
+    void BulkLoadRuns(std::vector<std::vector<std::pair<Tuple, RID>>> &runs,
+                    double fill_factor = 1.0,
+                    Transaction *transaction = nullptr) override;
+
 protected:
+    using Item = std::pair<KeyType, RID>;
+
+    // (entry, rid) 编码成叶子里的 (index key, rid)
+    void EncodeEntries(const std::vector<std::pair<Tuple, RID>> &entries, std::vector<Item> &items) const;
+    // 建树，树不是空的话逐个插入；然后补上 bloom filter
+    void LoadItems(std::vector<Item> &items, double fill_factor, Transaction *transaction);
+
+    // 把叶子里的 key 解码成 entry schema 上的 tuple
+    Tuple DecodeEntry(const KeyType &index_key) const;
+
+    // 查询用的 key 只有 key 列，INCLUDE 列留成全 0
+    // 返回 false 表示 varchar 放不下被截断了，这样的值不可能在索引里
+    bool SetSearchKey(KeyType &index_key, const Tuple &key) const {
+        return index_key.SetFromKey(key, GetKeySchema(), GetEntrySchema());
+    }
+
+    // bloom filter 只看 key 列，对应 index key 开头的 key_bytes_ 个字节
+    uint64_t KeyHash(const KeyType &index_key) const {
+        return BloomFilter::Hash(index_key.data, key_bytes_);
+    }
+    // false 表示 key 一定不在树里；filter 需要重建的话先扫一遍树
+    bool MayContain(const KeyType &search_key);
+
     // comparator for key
     KeyComparator comparator_;
+    int key_bytes_;
     // container
     BPlusTree<KeyType, ValueType, KeyComparator> container_;
 };
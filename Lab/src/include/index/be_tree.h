@@ -0,0 +1,112 @@
+/**
+ * be_tree.h
+ *
+ * Write-optimized B^epsilon tree, used as an index (CREATE 的时候索引描述后面加 "using betree").
+ * b+ tree 每插入一个 key 都要从 root 走到叶子，随机的 key 每次写的都是一个不同的叶子；
+ * 这里插入删除只是往 root 的缓冲区里放一条消息，缓冲区满了再把一个 child 的一整批消息推下去一层，
+ * 到了叶子一次合并一批，一次叶子写入摊给了一整批消息
+ *  (1) key 是唯一的，重复的 key 由索引在末尾拼上 RID 区分
+ *  (2) 写入是盲写，不读叶子，所以 Insert/Remove 不知道 key 原来在不在
+ *  (3) 查询沿路检查缓冲区，上层的消息比下层的新，最先碰到的消息说了算
+ *  (4) 删除不合并节点，空的叶子留着（和 VarlenBPlusTree 一样）
+ *
+ * 并发：整棵树一把读写锁，读（查找、扫描）共享，写（插入、删除）独占
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwmutex.h"
+#include "page/be_tree_page.h"
+
+namespace cmudb {
+
+#define BETREE_TYPE BeTree<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class BeTree {
+    using NodePage = BeTreePage<KeyType, ValueType, KeyComparator>;
+    using Message = BeTreeMessage<KeyType, ValueType, KeyComparator>;
+    // 节点分裂出来的新节点：(新节点里最小的 key, 页号)，要插到父节点里原节点的后面
+    using SplitList = std::vector<std::pair<KeyType, page_id_t>>;
+
+public:
+    explicit BeTree(const std::string &name,
+                    BufferPoolManager *buffer_pool_manager,
+                    const KeyComparator &comparator,
+                    page_id_t root_page_id = INVALID_PAGE_ID);
+
+    // Returns true if this tree has no keys and values.
+    bool IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID; }
+
+    // key 已经存在的话盖掉原来的 value
+    void Insert(const KeyType &key, const ValueType &value);
+
+    void Remove(const KeyType &key);
+
+    bool GetValue(const KeyType &key, ValueType &value);
+
+    // 从第一个 >= lo 的 key 开始按顺序访问 (key, value)，沿途缓冲区里的消息合并进来，visit 返回 false 时停止
+    void Scan(const KeyType &lo, const std::function<bool(const KeyType &, const ValueType &)> &visit);
+
+    // 新建节点的容量，0 表示按页的大小算；测试用小节点造出更深的树
+    void SetNodeCapacity(int leaf_size, int fanout, int buffer_size);
+
+    // expose for test purpose
+    page_id_t GetRootPageId() const { return root_page_id_; }
+    int GetHeight();
+    // 所有缓冲区里还没推到叶子的消息个数
+    size_t GetPendingMessageCount();
+
+private:
+    // 中间节点在内存里的样子，改完一次写回页里，放不下就分裂
+    struct InternalNode {
+        std::vector<page_id_t> children;
+        std::vector<KeyType> pivots;
+        std::vector<Message> buffer;
+    };
+
+    Page *FetchPage(page_id_t page_id);
+    Page *NewPage(page_id_t &page_id);
+    static NodePage *AsNode(Page *page) { return reinterpret_cast<NodePage *>(page->GetData()); }
+
+    void Upsert(const Message &message);
+    void StartNewTree();
+    // root 分裂了，在上面加一层
+    void GrowRoot(SplitList splits);
+
+    // 把 node 缓冲区里消息最多的那个 child 的消息推下去一层，返回 node 分裂出来的新节点
+    SplitList Flush(NodePage *node);
+    // 消息合并到叶子里，返回叶子分裂出来的新叶子
+    SplitList ApplyToLeaf(NodePage *leaf, const std::vector<Message> &messages);
+    // newer 和 older 都按 key 排好序，key 相同的留 newer 的
+    std::vector<Message> MergeMessages(const std::vector<Message> &newer, const std::vector<Message> &older);
+
+    InternalNode LoadInternal(const NodePage *node);
+    SplitList StoreInternal(NodePage *node, InternalNode &content);
+    int ChildIndex(const InternalNode &content, const KeyType &key) const;
+
+    // hi 是这棵子树的上界（不包含），nullptr 表示 +inf；pending 是祖先缓冲区里落在这个范围的消息
+    bool ScanNode(page_id_t page_id, const KeyType &lo, const KeyType *hi, const std::vector<Message> &pending,
+                  const std::function<bool(const KeyType &, const ValueType &)> &visit);
+    size_t CountPending(page_id_t page_id);
+
+    void UpdateRootPageId(bool insert_record = false);
+
+    // member variable
+    std::string index_name_;
+    BufferPoolManager *buffer_pool_manager_;
+    KeyComparator comparator_;
+    page_id_t root_page_id_;
+    int leaf_size_ = 0;
+    int fanout_ = 0;
+    int buffer_size_ = 0;
+    RWMutex latch_;
+};
+
+} // namespace cmudb
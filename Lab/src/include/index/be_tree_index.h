@@ -0,0 +1,69 @@
+/**
+ * be_tree_index.h
+ *
+ * 写优化的索引，CREATE 的时候索引描述后面加 "using betree"
+ * key 的编码和 BPlusTreeIndex 一样：entry（key 列加 INCLUDE 列）后面拼上 RID
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "index/be_tree.h"
+#include "index/index.h"
+
+namespace cmudb {
+
+#define BETREE_INDEX_TYPE BeTreeIndex<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class BeTreeIndex : public Index {
+
+public:
+    BeTreeIndex(IndexMetadata *metadata,
+                BufferPoolManager *buffer_pool_manager,
+                page_id_t root_page_id = INVALID_PAGE_ID);
+
+    ~BeTreeIndex() {}
+
+    void InsertEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    void DeleteEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    bool CanHold(const Tuple &key) override;
+
+    void ScanKey(const Tuple &key, std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    void ScanRange(const ScanBound *lo, const ScanBound *hi,
+                std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+protected:
+    Tuple DecodeEntry(const KeyType &index_key) const;
+
+    // 查询用的 key 只有 key 列，INCLUDE 列留成全 0
+    // 返回 false 表示 varchar 放不下被截断了，这样的值不可能在索引里
+    bool SetSearchKey(KeyType &index_key, const Tuple &key) const {
+        return index_key.SetFromKey(key, GetKeySchema(), GetEntrySchema());
+    }
+
+    // bloom filter 只看 key 列，对应 index key 开头的 key_bytes_ 个字节
+    uint64_t KeyHash(const KeyType &index_key) const {
+        return BloomFilter::Hash(index_key.data, key_bytes_);
+    }
+    bool MayContain(const KeyType &search_key);
+
+    // comparator for key
+    KeyComparator comparator_;
+    int key_bytes_;
+    // container
+    BeTree<KeyType, ValueType, KeyComparator> container_;
+};
+
+} // namespace cmudb
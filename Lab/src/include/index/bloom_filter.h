@@ -0,0 +1,84 @@
+/**
+ * bloom_filter.h
+ *
+ * Blocked Bloom filter in front of an index, answers "definitely not there" for point lookups
+ * so a miss does not have to descend the tree.
+ *
+ * 每个 key 的所有位都落在同一个 64 字节的块里（一条 cache line），查一次只访问一个块；
+ * 代价是假阳性率比普通的 bloom filter 稍高一点，10 bit/key 大约 1%
+ *
+ * 位只加不减，删除只是计数。删掉的 key 多了或者插入的 key 超过了建的时候的容量，假阳性率会变高，
+ * 这时候标记成需要重建，下一次查询时由索引扫一遍所有 key 重建（lazy）。
+ * 刚打开的已有索引还没有 filter，也是先标记成需要重建
+ *
+ * 并发：Add / MayContain 共享锁，位用原子操作设置；Rebuild 独占锁，
+ * 重建期间的插入会等重建完成之后再加到新的 filter 里，不会丢 key
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "common/rwmutex.h"
+
+namespace cmudb {
+
+class BloomFilter {
+public:
+    // 每个 key 分到的位数和在块里设置的位数
+    static const int BITS_PER_KEY = 10;
+    static const int PROBES = 6;
+    // 一个块 512 位
+    static const int BLOCK_WORDS = 8;
+    // 最少按这么多 key 分配
+    static const size_t MIN_KEYS = 1024;
+
+    BloomFilter() { Reset(MIN_KEYS); stale_ = true; }
+
+    static uint64_t Hash(const char *data, size_t length);
+
+    void Add(uint64_t hash);
+    // false 表示 key 一定不在索引里
+    bool MayContain(uint64_t hash);
+
+    // 查询之后索引发现 filter 说可能有的 key 其实没有
+    void RecordFalsePositive() { false_positives_++; }
+    void RecordDelete() { deletes_++; }
+
+    // 删除太多或者 key 超过容量
+    bool NeedsRebuild() const {
+        return stale_ || deletes_ > keys_ / 2 + MIN_KEYS || keys_ > capacity_ * 2;
+    }
+    // collect 把索引里所有 key 的 hash 放进来，在独占锁下调用
+    void Rebuild(const std::function<void(std::vector<uint64_t> &)> &collect);
+
+    // statistics
+    size_t GetMemoryUsage() const { return blocks_.size() * sizeof(uint64_t); }
+    size_t GetKeyCount() const { return keys_; }
+    // 实测的假阳性率：不在索引里的 key 中，filter 没能排除掉的比例
+    double GetFalsePositiveRate() const;
+    // 按 key 数和位数估算的假阳性率
+    double GetEstimatedFalsePositiveRate() const;
+    std::string ToString() const;
+
+private:
+    void Reset(size_t expected_keys);
+    std::atomic<uint64_t> *BlockOf(uint64_t hash);
+    void SetBits(uint64_t hash);
+
+    RWMutex latch_;
+    std::vector<std::atomic<uint64_t>> blocks_;
+    size_t capacity_;
+    std::atomic<bool> stale_;
+    std::atomic<size_t> keys_{0};
+    std::atomic<size_t> deletes_{0};
+    std::atomic<size_t> probes_{0};
+    std::atomic<size_t> negatives_{0};
+    std::atomic<size_t> false_positives_{0};
+};
+
+} // namespace cmudb
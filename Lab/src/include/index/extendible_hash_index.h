@@ -0,0 +1,57 @@
+/**
+ * extendible_hash_index.h
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "hash/disk_extendible_hash.h"
+#include "index/index.h"
+
+namespace cmudb {
+
+#define EXTENDIBLE_HASH_INDEX_TYPE ExtendibleHashIndex<KeyType, ValueType, KeyComparator>
+
+/**
+ * 只支持等值查询的 hash 索引，CREATE 的时候索引描述后面加 "using hash"
+ * key 里不带 RID（RID 部分是全 0），同一个 key 的所有 RID 落在同一个桶里
+ * 不支持 INCLUDE 列，entry 就是 key
+ */
+INDEX_TEMPLATE_ARGUMENTS
+class ExtendibleHashIndex : public Index {
+
+public:
+    ExtendibleHashIndex(IndexMetadata *metadata,
+                        BufferPoolManager *buffer_pool_manager,
+                        page_id_t directory_page_id = INVALID_PAGE_ID);
+
+    ~ExtendibleHashIndex() {}
+
+    void InsertEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    void DeleteEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    bool CanHold(const Tuple &key) override;
+
+    void ScanKey(const Tuple &key, std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    // hash 索引没有顺序
+    void ScanRange(const ScanBound *lo, const ScanBound *hi,
+                std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+protected:
+    // comparator for key
+    KeyComparator comparator_;
+    // container
+    DiskExtendibleHash<KeyType, ValueType, KeyComparator> container_;
+};
+
+} // namespace cmudb
@@ -6,9 +6,11 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "catalog/schema.h"
+#include "index/bloom_filter.h"
 #include "table/tuple.h"
 #include "type/value.h"
 
@@ -26,23 +28,42 @@ namespace cmudb {
  * 组合索引也有自己的 schema，是 table schema 的一个子集
  */
 class Transaction;
+
+// 索引的实现方式，CREATE 时由索引描述末尾的 "using btree" / "using hash" 指定，默认是 b+ tree
+enum class IndexType { BPLUSTREE = 0, HASH, BETREE };
+
 class IndexMetadata {
     IndexMetadata() = delete;
 
 public:
     IndexMetadata(std::string index_name, std::string table_name,
-                    const Schema *tuple_schema, const std::vector<int> &key_attrs)
-        : name_(index_name), table_name_(table_name), key_attrs_(key_attrs) 
+                    const Schema *tuple_schema, const std::vector<int> &key_attrs,
+                    IndexType index_type = IndexType::BPLUSTREE,
+                    const std::vector<int> &include_attrs = std::vector<int>(),
+                    bool bloom_filter = false)
+        : name_(index_name), table_name_(table_name), key_attrs_(key_attrs),
+          include_attrs_(include_attrs), index_type_(index_type), bloom_filter_(bloom_filter)
     {
         key_schema_ = Schema::CopySchema(tuple_schema, key_attrs_);
+        entry_attrs_ = key_attrs_;
+        entry_attrs_.insert(entry_attrs_.end(), include_attrs_.begin(), include_attrs_.end());
+        entry_schema_ = Schema::CopySchema(tuple_schema, entry_attrs_);
     }
 
-    ~IndexMetadata() { delete key_schema_; };
+    ~IndexMetadata() {
+        delete key_schema_;
+        delete entry_schema_;
+    };
 
     inline const std::string &GetName() const { return name_; }
 
     inline const std::string &GetTableName() { return table_name_; }
 
+    inline IndexType GetIndexType() const { return index_type_; }
+
+    // 点查之前先问 bloom filter（"with bloom"）
+    inline bool HasBloomFilter() const { return bloom_filter_; }
+
     // Returns a schema object pointer that represents the indexed key
     inline Schema *GetKeySchema() const { return key_schema_; }
 
@@ -55,15 +76,25 @@ public:
     //  columns
     inline const std::vector<int> &GetKeyAttrs() const { return key_attrs_; }
 
+    // INCLUDE 列：不参与排序，只是跟着 key 存在索引里，查询只用到 key 和 INCLUDE 列时不用回表
+    inline const std::vector<int> &GetIncludeAttrs() const { return include_attrs_; }
+
+    // 索引里存的一条 entry 是 key 列后面跟着 INCLUDE 列，没有 INCLUDE 列时和 key schema 一样
+    inline Schema *GetEntrySchema() const { return entry_schema_; }
+
+    inline const std::vector<int> &GetEntryAttrs() const { return entry_attrs_; }
+
     // Get a string representation for debugging
     const std::string ToString() const {
         std::stringstream os;
 
         os << "IndexMetadata["
             << "Name = " << name_ << ", "
-            << "Type = B+Tree, "
+            << "Type = " << (index_type_ == IndexType::HASH ? "Hash" :
+                             index_type_ == IndexType::BETREE ? "BeTree" : "B+Tree") << ", "
             << "Table name = " << table_name_ << "] :: ";
         os << key_schema_->ToString();
+        if (!include_attrs_.empty()) { os << " INCLUDE " << entry_schema_->ToString(); }
 
         return os.str();
     }
@@ -73,8 +104,28 @@ private:
     std::string table_name_;
     // The mapping relation between key schema and tuple schema
     const std::vector<int> key_attrs_;
+    const std::vector<int> include_attrs_;
+    // key_attrs_ + include_attrs_
+    std::vector<int> entry_attrs_;
+    IndexType index_type_;
+    bool bloom_filter_;
     // schema of the indexed key
     Schema *key_schema_;
+    // schema of the index entry, key columns followed by include columns
+    Schema *entry_schema_;
+};
+
+/**
+ * One end of a range scan.
+ * key is a tuple over the index key schema, only its first column_count columns
+ * bound the scan, so a prefix of a composite key works as well
+ * e.g. index on (a, b), "a = 1 and b > 2" is lo = {(1, 2), 2, false}, hi = {(1, x), 1, true}
+ * 没有用到的列由调用者填成该类型的最小值，下界就能直接拿来定位起点
+ */
+struct ScanBound {
+    Tuple key;
+    int column_count;
+    bool inclusive;
 };
 
 /////////////////////////////////////////////////////////////////////
@@ -97,7 +148,9 @@ private:
  */
 class Index {
 public:
-    Index(IndexMetadata *metadata) : metadata_(metadata) {}
+    Index(IndexMetadata *metadata) : metadata_(metadata) {
+        if (metadata->HasBloomFilter()) { bloom_filter_.reset(new BloomFilter()); }
+    }
 
     virtual ~Index() { delete metadata_; }
 
@@ -112,12 +165,20 @@ public:
 
     const std::vector<int> &GetKeyAttrs() const { return metadata_->GetKeyAttrs(); }
 
+    Schema *GetEntrySchema() const { return metadata_->GetEntrySchema(); }
+
+    const std::vector<int> &GetEntryAttrs() const { return metadata_->GetEntryAttrs(); }
+
+    // nullptr unless the index was created "with bloom"
+    BloomFilter *GetBloomFilter() const { return bloom_filter_.get(); }
+
     // Get a string representation for debugging
     const std::string ToString() const {
         std::stringstream os;
 
         os << "INDEX: (" << GetName() << ")";
         os << metadata_->ToString();
+        if (bloom_filter_ != nullptr) { os << " " << bloom_filter_->ToString(); }
         return os.str();
     }
 
@@ -125,21 +186,73 @@ public:
     // Point Modification
     ///////////////////////////////////////////////////////////////////
     // designed for secondary indexes.
+    // key 是 entry schema 上的 tuple（key 列加上 INCLUDE 列）
     virtual void InsertEntry(const Tuple &key, RID rid,
                             Transaction *transaction = nullptr) = 0;
 
+    // 定长 key 的索引放不下太长的 varchar，写 table heap 之前先用它检查，免得只写了一半
+    virtual bool CanHold(const Tuple &key) {
+        (void)key;
+        return true;
+    }
+
     // delete the index entry linked to given tuple
-    virtual void DeleteEntry(const Tuple &key,
+    // key 可以重复，要用 rid 确定删的是哪一条
+    virtual void DeleteEntry(const Tuple &key, RID rid,
                             Transaction *transaction = nullptr) = 0;
 
+    // 查询用的 key 都是 key schema 上的 tuple
+    // entries 不为空时，和 result 一一对应地放上索引里存的 entry（entry schema 上的 tuple），
+    // 查询需要的列都在 entry 里的话就不用再去 table heap 取 tuple 了
     virtual void ScanKey(const Tuple &key, std::vector<RID> &result,
-                        Transaction *transaction = nullptr) = 0;
+                        Transaction *transaction = nullptr,
+                        std::vector<Tuple> *entries = nullptr) = 0;
+
+    // point query for a batch of keys (IN list), rids of all the keys go to result
+    // the default looks the keys up one by one, indexes that can share the descent override it
+    virtual void ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                        Transaction *transaction = nullptr,
+                        std::vector<Tuple> *entries = nullptr) {
+        for (auto &key : keys) { ScanKey(key, result, transaction, entries); }
+    }
+
+    // range scan in key order, a null bound means unbounded on that side
+    virtual void ScanRange(const ScanBound *lo, const ScanBound *hi,
+                        std::vector<RID> &result,
+                        Transaction *transaction = nullptr,
+                        std::vector<Tuple> *entries = nullptr) = 0;
+
+    // build the index from the (entry, rid) pairs of an existing table
+    // the default just inserts one by one, indexes that can build bottom-up override it
+    virtual void BulkLoad(std::vector<std::pair<Tuple, RID>> &entries,
+                        double fill_factor = 1.0,
+                        Transaction *transaction = nullptr) {
+        (void)fill_factor;
+        for (auto &entry : entries) { InsertEntry(entry.first, entry.second, transaction); }
+    }
+
+    // same as BulkLoad, but the entries come in runs (one per table heap scan worker), in heap order
+    // the default concatenates the runs, indexes that can sort the runs in parallel override it
+    virtual void BulkLoadRuns(std::vector<std::vector<std::pair<Tuple, RID>>> &runs,
+                            double fill_factor = 1.0,
+                            Transaction *transaction = nullptr) {
+        std::vector<std::pair<Tuple, RID>> entries;
+        for (auto &run : runs) {
+            entries.insert(entries.end(), run.begin(), run.end());
+            run.clear();
+        }
+        BulkLoad(entries, fill_factor, transaction);
+    }
 
 private:
     //===--------------------------------------------------------------------===//
     //  Data members
     //===--------------------------------------------------------------------===//
     IndexMetadata *metadata_;
+
+protected:
+    // 支持的索引在 InsertEntry / DeleteEntry 里维护，ScanKey / ScanKeys 先问它
+    std::unique_ptr<BloomFilter> bloom_filter_;
 };
 
 } // namespace cmudb
@@ -30,11 +30,16 @@ public:
 
     bool isEnd();
 
-    const MappingType &operator*();
+    // 叶子里的 key 是压缩存放的，解引用拿到的是拼好的拷贝
+    MappingType operator*();
 
     IndexIterator &operator++();
 
 private:
+    void Release();
+    // 放掉当前叶子，读锁顺着 next page id 换到下一个叶子
+    void NextLeaf();
+
     // add your own private member variables here
     BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf_;  // 指向 叶子节点
     int index_;  // 单 node 内的下标
@@ -0,0 +1,394 @@
+/**
+ * normalized_key.h
+ *
+ * Binary-comparable key used for indexing
+ *
+ * GenericKey keeps the raw tuple bytes, so every comparison has to
+ * deserialize each key column into a Value. NormalizedKey re-encodes every
+ * column when the key is built, and comparing two keys becomes a memcmp.
+ *
+ * 每一列按顺序定长编码，编码后的字节序和值的大小顺序一致：
+ *  boolean / integer : 符号位取反，大端存放
+ *  decimal           : 正数翻转符号位，负数所有位取反，大端存放
+ *  timestamp         : 大端存放
+ *  varchar           : 原始字节，尾部补 0，所有 varchar 列平分定长列和 RID 剩下的空间
+ * NULL 编码成全 0，排在所有值的前面
+ *
+ * key 的最后 8 个字节是 RID（同样的编码），索引允许重复的 key，重复的 key 按 RID 排序，
+ * 整棵树里 (key, RID) 依然是唯一的。只比较列的时候用 ComparePrefix
+ * RID 已经在 key 里了，叶子不再单独存 value，见 KeyCarriesValue
+ *
+ * 覆盖索引的 INCLUDE 列编码在 key 列和 RID 之间，编码是可逆的，GetValue 可以把列值解出来
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include "common/exception.h"
+#include "common/rid.h"
+#include "table/tuple.h"
+#include "type/type.h"
+#include "type/value.h"
+
+namespace cmudb {
+
+// varchar 在 key 里至少占的字节数
+static const int NORMALIZED_VARCHAR_SIZE = 16;
+// 最宽的定长 key，ConstructIndex 按 key 的宽度选实例，最大就是 NormalizedKey<128>
+static const int NORMALIZED_KEY_MAX_SIZE = 128;
+
+// key_schema 编码之后至少需要多少字节，包括末尾的 RID
+inline int NormalizedKeySize(Schema *key_schema) {
+    int size = sizeof(RID);
+    for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+        TypeId type = key_schema->GetType(i);
+        size += type == TypeId::VARCHAR ? NORMALIZED_VARCHAR_SIZE : Type::GetTypeSize(type);
+    }
+    return size;
+}
+
+// 每个 varchar 列都按声明的长度放下，需要多少字节，包括末尾的 RID
+// 超过最大的定长 key 时索引改用变长 key 的 VarlenBPlusTree
+inline int NormalizedKeyDeclaredSize(Schema *key_schema) {
+    int size = sizeof(RID);
+    for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+        TypeId type = key_schema->GetType(i);
+        size += type == TypeId::VARCHAR ? std::max(key_schema->GetVariableLength(i), NORMALIZED_VARCHAR_SIZE)
+                                        : Type::GetTypeSize(type);
+    }
+    return size;
+}
+
+/**
+ * 每一列的编码和解码，定长的 NormalizedKey 和变长的 VarlenKey 共用
+ */
+struct NormalizedEncoding {
+    template <typename T>
+    static inline void EncodeInteger(T value, char *dst) {
+        using U = typename std::make_unsigned<T>::type;
+        // 翻转符号位之后，有符号数的大小顺序就是无符号数的大小顺序
+        U bits = static_cast<U>(static_cast<U>(value) ^ (static_cast<U>(1) << (sizeof(T) * 8 - 1)));
+        EncodeBigEndian<U>(bits, dst);
+    }
+
+    template <typename U>
+    static inline void EncodeBigEndian(U bits, char *dst) {
+        for (int i = sizeof(U) - 1; i >= 0; i--) {
+            dst[i] = static_cast<char>(bits & 0xff);
+            bits = static_cast<U>(bits >> 8);
+        }
+    }
+
+    template <typename T>
+    static inline T DecodeInteger(const char *src) {
+        using U = typename std::make_unsigned<T>::type;
+        U bits = DecodeBigEndian<U>(src) ^ (static_cast<U>(1) << (sizeof(T) * 8 - 1));
+        return static_cast<T>(bits);
+    }
+
+    template <typename U>
+    static inline U DecodeBigEndian(const char *src) {
+        U bits = 0;
+        for (size_t i = 0; i < sizeof(U); i++) {
+            bits = static_cast<U>((bits << 8) | (static_cast<U>(src[i]) & 0xff));
+        }
+        return bits;
+    }
+
+    // 编码一列，放不下的 varchar 只保留前 width 个字节并返回 false，由调用方决定怎么处理
+    // 这里会被 vtable 的回调间接调用，不能抛异常
+    static inline bool Encode(const Value &value, TypeId type, char *dst, int width) {
+        switch (type) {
+        case TypeId::BOOLEAN:
+        case TypeId::TINYINT: EncodeInteger<int8_t>(value.GetAs<int8_t>(), dst); break;
+        case TypeId::SMALLINT: EncodeInteger<int16_t>(value.GetAs<int16_t>(), dst); break;
+        case TypeId::INTEGER: EncodeInteger<int32_t>(value.GetAs<int32_t>(), dst); break;
+        case TypeId::BIGINT: EncodeInteger<int64_t>(value.GetAs<int64_t>(), dst); break;
+        case TypeId::TIMESTAMP: EncodeBigEndian<uint64_t>(value.GetAs<uint64_t>(), dst); break;
+        case TypeId::DECIMAL: {
+            // -0.0 和 0.0 相等，编码也要相同
+            double number = value.GetAs<double>() == 0 ? 0.0 : value.GetAs<double>();
+            uint64_t bits;
+            memcpy(&bits, &number, sizeof(bits));
+            const uint64_t sign = static_cast<uint64_t>(1) << 63;
+            EncodeBigEndian<uint64_t>((bits & sign) ? ~bits : bits | sign, dst);
+            break;
+        }
+        case TypeId::VARCHAR: {
+            // 长度里带着结尾的 '\0'
+            int length = static_cast<int>(value.GetLength()) - 1;
+            memcpy(dst, value.GetData(), std::min(length, width));
+            return length <= width;
+        }
+        default:
+            return false;
+        }
+        return true;
+    }
+
+    // Encode 的逆过程，整数的 NULL 编码之后本来就是全 0，decimal 要单独判断
+    static inline Value Decode(TypeId type, const char *src, int width) {
+        switch (type) {
+        case TypeId::BOOLEAN:
+        case TypeId::TINYINT: return Value(type, DecodeInteger<int8_t>(src));
+        case TypeId::SMALLINT: return Value(type, DecodeInteger<int16_t>(src));
+        case TypeId::INTEGER: return Value(type, DecodeInteger<int32_t>(src));
+        case TypeId::BIGINT: return Value(type, DecodeInteger<int64_t>(src));
+        case TypeId::TIMESTAMP: return Value(type, DecodeBigEndian<uint64_t>(src));
+        case TypeId::DECIMAL: {
+            uint64_t bits = DecodeBigEndian<uint64_t>(src);
+            if (bits == 0) { return Value(type, PELOTON_DECIMAL_NULL); }
+            const uint64_t sign = static_cast<uint64_t>(1) << 63;
+            bits = (bits & sign) ? bits & ~sign : ~bits;
+            double number;
+            memcpy(&number, &bits, sizeof(number));
+            return Value(type, number);
+        }
+        case TypeId::VARCHAR: {
+            // 尾部补的 0 去掉，key 里的 varchar 不会包含 '\0'
+            int length = 0;
+            while (length < width && src[length] != 0) { length++; }
+            return Value(type, std::string(src, length));
+        }
+        default:
+            throw Exception(EXCEPTION_TYPE_UNKNOWN_TYPE, "unknown type for index key");
+        }
+    }
+};
+
+template <size_t KeySize>
+class NormalizedKey {
+public:
+    inline bool SetFromKey(const Tuple &tuple, Schema *key_schema) { return SetFromKey(tuple, key_schema, key_schema); }
+
+    // tuple 只有 layout_schema 的前几列（比如只有 key 列没有 INCLUDE 列），列宽按 layout_schema 算，
+    // 后面没有给出的列是全 0，也就是这些列的最小值
+    // 有 varchar 列放不下时截断并返回 false：截断后的 key 不大于原来的 key，当作查找的下界没问题，
+    // 但是不能写进索引
+    inline bool SetFromKey(const Tuple &tuple, Schema *tuple_schema, Schema *layout_schema) {
+        // initialize to 0, 没用到的字节和 NULL 都是 0
+        memset(data, 0, KeySize);
+        char *dst = data;
+        bool complete = true;
+        for (int i = 0; i < tuple_schema->GetColumnCount(); i++) {
+            int width = ColumnWidth(layout_schema, i);
+            Value value = tuple.GetValue(tuple_schema, i);
+            if (!value.IsNull()) {
+                complete = NormalizedEncoding::Encode(value, tuple_schema->GetType(i), dst, width) && complete;
+            }
+            dst += width;
+        }
+        return complete;
+    }
+
+    // offset 之后（剩下的列和 RID）全部填成 0xff，前 offset 字节相同的 key 里它最大
+    inline void SetUpperBound(int offset) {
+        memset(data + offset, 0xff, KeySize - offset);
+    }
+
+    // 解出 layout_schema 第 column 列的值，全 0 的数值列是 NULL
+    inline Value GetValue(Schema *layout_schema, int column) const {
+        const char *src = data + ColumnOffset(layout_schema, column);
+        return NormalizedEncoding::Decode(layout_schema->GetType(column), src, ColumnWidth(layout_schema, column));
+    }
+
+    // 重复的 key 靠末尾的 RID 区分先后，没有设置的时候是全 0，排在同一个 key 的最前面
+    inline void SetRid(const RID &rid) {
+        static_assert(KeySize > sizeof(RID), "key is too small to carry a RID");
+        NormalizedEncoding::EncodeInteger<int32_t>(rid.GetPageId(), data + KeySize - sizeof(RID));
+        NormalizedEncoding::EncodeInteger<int32_t>(rid.GetSlotNum(), data + KeySize - sizeof(RID) + sizeof(int32_t));
+    }
+
+    inline RID GetRid() const {
+        static_assert(KeySize > sizeof(RID), "key is too small to carry a RID");
+        return RID(NormalizedEncoding::DecodeInteger<int32_t>(data + KeySize - sizeof(RID)),
+                   NormalizedEncoding::DecodeInteger<int32_t>(data + KeySize - sizeof(RID) + sizeof(int32_t)));
+    }
+
+    // NOTE: for test purpose only
+    // encode key as a single bigint column
+    inline void SetFromInteger(int64_t key) {
+        memset(data, 0, KeySize);
+        NormalizedEncoding::EncodeInteger<int64_t>(key, data);
+    }
+
+    // 第 column 列在 key 中的宽度
+    static inline int ColumnWidth(Schema *key_schema, int column) {
+        TypeId type = key_schema->GetType(column);
+        if (type != TypeId::VARCHAR) { return Type::GetTypeSize(type); }
+        int fixed = 0;
+        for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+            if (key_schema->GetType(i) != TypeId::VARCHAR) { fixed += Type::GetTypeSize(key_schema->GetType(i)); }
+        }
+        return (static_cast<int>(KeySize - sizeof(RID)) - fixed) / key_schema->GetUnlinedColumnCount();
+    }
+
+    // 前 column_count 列一共占的字节数
+    static inline int ColumnOffset(Schema *key_schema, int column_count) {
+        int offset = 0;
+        for (int i = 0; i < column_count && i < key_schema->GetColumnCount(); i++) {
+            offset += ColumnWidth(key_schema, i);
+        }
+        return offset;
+    }
+
+    // NOTE: for test purpose only
+    inline std::string ToString() const {
+        std::ostringstream os;
+        os << std::hex;
+        for (size_t i = 0; i < KeySize; i++) { os << (static_cast<unsigned>(data[i]) & 0xff) << ' '; }
+        return os.str();
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const NormalizedKey &key) {
+        os << key.ToString();
+        return os;
+    }
+
+    // actual location of data, extends past the end.
+    char data[KeySize];
+};
+
+/**
+ * value 能不能直接从 key 里解出来
+ * 索引往树里插的 value 就是 key 末尾的 RID，叶子 slot 里不用再存第二份
+ */
+template <typename KeyType, typename ValueType>
+struct KeyCarriesValue {
+    static const bool value = false;
+    static inline ValueType Extract(const KeyType &) { return ValueType(); }
+};
+
+template <size_t KeySize>
+struct KeyCarriesValue<NormalizedKey<KeySize>, RID> {
+    static const bool value = true;
+    static inline RID Extract(const NormalizedKey<KeySize> &key) { return key.GetRid(); }
+};
+
+/**
+ * 变长的 key，VarlenBPlusTree 用
+ * 定长列的编码和 NormalizedKey 一样；varchar 编码成 0x01 + 原始字节 + 0x00，NULL 是一个 0x00，
+ * 每一列都是 prefix-free 的，所以整个 key 按字节比较和逐列比较的结果一样，而且没有长度限制
+ * 末尾同样是 8 字节的 RID
+ */
+struct VarlenKey {
+    // tuple 是 tuple_schema 上的，按顺序把所有列编码到 key 后面
+    static inline void Append(std::string &key, const Tuple &tuple, Schema *tuple_schema) {
+        for (int i = 0; i < tuple_schema->GetColumnCount(); i++) {
+            TypeId type = tuple_schema->GetType(i);
+            Value value = tuple.GetValue(tuple_schema, i);
+            if (type == TypeId::VARCHAR) {
+                if (value.IsNull()) {
+                    key.push_back('\0');
+                } else {
+                    key.push_back('\1');
+                    // 长度里带着结尾的 '\0'
+                    key.append(value.GetData(), value.GetLength());
+                }
+                continue;
+            }
+            char buffer[sizeof(int64_t)] = {0};
+            if (!value.IsNull()) { NormalizedEncoding::Encode(value, type, buffer, Type::GetTypeSize(type)); }
+            key.append(buffer, Type::GetTypeSize(type));
+        }
+    }
+
+    static inline void AppendRid(std::string &key, const RID &rid) {
+        char buffer[sizeof(RID)];
+        NormalizedEncoding::EncodeInteger<int32_t>(rid.GetPageId(), buffer);
+        NormalizedEncoding::EncodeInteger<int32_t>(rid.GetSlotNum(), buffer + sizeof(int32_t));
+        key.append(buffer, sizeof(RID));
+    }
+
+    // 前 column_count 列一共占的字节数，要逐列往后走
+    static inline size_t ColumnOffset(const std::string &key, Schema *layout_schema, int column_count) {
+        size_t offset = 0;
+        for (int i = 0; i < column_count && i < layout_schema->GetColumnCount() && offset < key.size(); i++) {
+            if (layout_schema->GetType(i) != TypeId::VARCHAR) {
+                offset += Type::GetTypeSize(layout_schema->GetType(i));
+            } else if (key[offset] == '\0') {
+                offset++;
+            } else {
+                offset = key.find('\0', offset + 1) + 1;
+            }
+        }
+        return std::min(offset, key.size());
+    }
+
+    static inline Value GetValue(const std::string &key, Schema *layout_schema, int column) {
+        size_t offset = ColumnOffset(key, layout_schema, column);
+        TypeId type = layout_schema->GetType(column);
+        if (type != TypeId::VARCHAR) {
+            return NormalizedEncoding::Decode(type, key.data() + offset, Type::GetTypeSize(type));
+        }
+        if (key[offset] == '\0') { return Value(type, nullptr, 0, false); }
+        return Value(type, std::string(key.data() + offset + 1));
+    }
+
+    // 只比较前 column_count 列
+    static inline int ComparePrefix(const std::string &lhs, const std::string &rhs, Schema *layout_schema,
+                                    int column_count) {
+        int cmp = lhs.compare(0, ColumnOffset(lhs, layout_schema, column_count), rhs, 0,
+                              ColumnOffset(rhs, layout_schema, column_count));
+        return (cmp > 0) - (cmp < 0);
+    }
+};
+
+/**
+ * 编码之后的 key 直接按字节比较
+ */
+template <size_t KeySize>
+struct NormalizedCompare {
+    static inline int Compare(const char *lhs, const char *rhs) {
+        int cmp = memcmp(lhs, rhs, KeySize);
+        return (cmp > 0) - (cmp < 0);
+    }
+};
+
+/**
+ * Function object returns true if lhs < rhs, used for trees
+ */
+template <size_t KeySize>
+class NormalizedComparator {
+public:
+    inline int operator()(const NormalizedKey<KeySize> &lhs, const NormalizedKey<KeySize> &rhs) const {
+        return NormalizedCompare<KeySize>::Compare(lhs.data, rhs.data);
+    }
+
+    // 只比较前 column_count 列，列的边界是固定的，比较前缀字节就行
+    inline int ComparePrefix(const NormalizedKey<KeySize> &lhs, const NormalizedKey<KeySize> &rhs,
+                             int column_count) const {
+        int cmp = memcmp(lhs.data, rhs.data, NormalizedKey<KeySize>::ColumnOffset(key_schema_, column_count));
+        return (cmp > 0) - (cmp < 0);
+    }
+
+    NormalizedComparator(const NormalizedComparator &other) {
+        this->key_schema_ = other.key_schema_;
+    }
+
+    // constructor
+    NormalizedComparator(Schema *key_schema) : key_schema_(key_schema) {}
+
+private:
+    Schema *key_schema_;
+};
+
+/**
+ * 比较的结果和按字节 memcmp 一样，叶子可以直接拿 key 和压缩过的 slot 比较，不用拼出完整的 key
+ */
+template <typename KeyComparator>
+struct ByteComparable {
+    static const bool value = false;
+};
+
+template <size_t KeySize>
+struct ByteComparable<NormalizedComparator<KeySize>> {
+    static const bool value = true;
+};
+
+} // namespace cmudb
@@ -0,0 +1,94 @@
+/**
+ * varlen_b_plus_tree.h
+ *
+ * B+ tree with variable-length keys, built on slotted pages (VarlenBPlusTreePage).
+ * 定长的 BPlusTree 要在编译期选一个 key 的大小，长的 varchar 放不进去；这里 key 是任意长度的字节串，
+ * 按字节序比较（VarlenKey 的编码），value 是 8 个字节（RID::Get()）
+ *  (1) key 是唯一的，重复的 key 由索引在末尾拼上 RID 区分
+ *  (2) 叶子分裂时往上提的分隔 key 只取能把左右分开的最短前缀，中间节点的扇出更大
+ *  (3) 超过 VARLEN_INLINE_KEY_SIZE 的 key 剩下的部分放在 overflow 页里
+ *  (4) 删除不合并节点，空的叶子留在链表里，以后插入还会用到（和 PostgreSQL 的 nbtree 一样）
+ *
+ * 并发：整棵树一把读写锁，读（查找、扫描）共享，写（插入、删除）独占，节点上不加锁
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwmutex.h"
+#include "page/varlen_b_plus_tree_page.h"
+
+namespace cmudb {
+
+class VarlenBPlusTree {
+public:
+    explicit VarlenBPlusTree(const std::string &name,
+                             BufferPoolManager *buffer_pool_manager,
+                             page_id_t root_page_id = INVALID_PAGE_ID);
+
+    // Returns true if this B+ tree has no keys and values.
+    bool IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID; }
+
+    // key 已经存在时返回 false
+    bool Insert(const std::string &key, int64_t value);
+
+    // key 不存在时返回 false
+    bool Remove(const std::string &key);
+
+    bool GetValue(const std::string &key, int64_t &value);
+
+    // 从第一个 >= lo 的 key 开始按顺序访问 (key, value)，visit 返回 false 时停止
+    void Scan(const std::string &lo, const std::function<bool(const std::string &, int64_t)> &visit);
+
+    // expose for test purpose
+    page_id_t GetRootPageId() const { return root_page_id_; }
+    int GetHeight();
+
+private:
+    // 要插入到某个节点里的一条记录，长 key 的 overflow 页已经写好了
+    struct Entry {
+        std::string inline_key;
+        page_id_t overflow_page_id;
+        int key_length;
+        int64_t value;
+    };
+
+    Page *FetchPage(page_id_t page_id);
+    static VarlenBPlusTreePage *AsNode(Page *page) {
+        return reinterpret_cast<VarlenBPlusTreePage *>(page->GetData());
+    }
+
+    // 完整的 key，需要的话读 overflow 页
+    std::string KeyAt(const VarlenBPlusTreePage *node, int index);
+    int CompareKey(const VarlenBPlusTreePage *node, int index, const std::string &key);
+    // 叶子里第一个 >= key 的位置
+    int LowerBound(const VarlenBPlusTreePage *node, const std::string &key);
+    // 中间节点里 key 所在的 child 的下标
+    int ChildIndex(const VarlenBPlusTreePage *node, const std::string &key);
+
+    // 找到 key 所在的叶子（已经 pin 住），path 记下经过的中间节点和走的 child 下标
+    Page *FindLeaf(const std::string &key, std::vector<std::pair<page_id_t, int>> *path);
+
+    Entry MakeEntry(const std::string &key, int64_t value);
+    page_id_t WriteOverflow(const char *data, int length);
+    void FreeOverflow(page_id_t page_id);
+
+    // 把 entry 插到 page_id 的 index 处，放不下就分裂，分隔 key 沿着 path 往上插
+    void InsertEntry(page_id_t page_id, int index, Entry entry, std::vector<std::pair<page_id_t, int>> &path);
+
+    void StartNewTree(const std::string &key, int64_t value);
+    void UpdateRootPageId(bool insert_record = false);
+
+    // member variable
+    std::string index_name_;
+    BufferPoolManager *buffer_pool_manager_;
+    page_id_t root_page_id_;
+    RWMutex latch_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,58 @@
+/**
+ * varlen_b_plus_tree_index.h
+ *
+ * 定长的 NormalizedKey 最大 128 字节，声明的 key（加上 INCLUDE 列）更长的索引用变长 key 的 b+ tree，
+ * key 就是 VarlenKey 编码的 entry 加上 RID，页里能放多少 key 按实际长度算
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "index/index.h"
+#include "index/normalized_key.h"
+#include "index/varlen_b_plus_tree.h"
+
+namespace cmudb {
+
+class VarlenBPlusTreeIndex : public Index {
+
+public:
+    VarlenBPlusTreeIndex(IndexMetadata *metadata,
+                         BufferPoolManager *buffer_pool_manager,
+                         page_id_t root_page_id = INVALID_PAGE_ID);
+
+    ~VarlenBPlusTreeIndex() {}
+
+    void InsertEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    void DeleteEntry(const Tuple &key, RID rid,
+                    Transaction *transaction = nullptr) override;
+
+    void ScanKey(const Tuple &key, std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+    void ScanRange(const ScanBound *lo, const ScanBound *hi,
+                std::vector<RID> &result,
+                Transaction *transaction = nullptr,
+                std::vector<Tuple> *entries = nullptr) override;
+
+protected:
+    std::string EncodeEntry(const Tuple &key, RID rid) const;
+    Tuple DecodeEntry(const std::string &index_key) const;
+
+    // bloom filter 只看 key 列的编码
+    uint64_t KeyHash(const std::string &index_key) const {
+        return BloomFilter::Hash(index_key.data(),
+                                 VarlenKey::ColumnOffset(index_key, GetEntrySchema(), GetKeySchema()->GetColumnCount()));
+    }
+    bool MayContain(const std::string &search_key);
+
+    // container
+    VarlenBPlusTree container_;
+};
+
+} // namespace cmudb
@@ -18,6 +18,12 @@
  * 这个组织形式比我想象的要简单的多
  * b+ tree 的 page 上的key与指针应该是错开的，即假设有2个key,就应该有2+1个指针的slot，指针的 slot 会比 key 的数量多一个
  * 如何巧妙的设计这种对应关系呢，这里的实现非常简单，就是在page中pair，然后第一个key无效即可，然后注意一下对应关系就可以了
+ *
+ * 中间节点的 key 不做前后缀压缩，也不截断分隔 key，只有叶子压缩（见 b_plus_tree_leaf_page.h）：
+ *  1. 中间节点是不加锁读的（FindLeafPageOptimistic 只靠版本号校验），变长的 slot 和 frame 被写了一半时
+ *     读出来的偏移可能越界，定长的 pair 数组不会
+ *  2. 重分配时 SetKeyAt 会换掉父节点里的 key，frame 可能因此变窄、slot 变宽，而那条路径上父节点没法分裂
+ * 中间节点只占整棵树很小一部分页面，压缩叶子已经拿到了绝大部分的空间
  */
 
 #pragma once
@@ -55,6 +61,18 @@ public:
     void MoveFirstToEndOf(BPlusTreeInternalPage *recipient, BufferPoolManager *buffer_pool_manager);
     void MoveLastToFrontOf(BPlusTreeInternalPage *recipient, int parent_index, BufferPoolManager *buffer_pool_manager);
 
+    // bulk load: 已经排好序的 (low key, child) 填进一个刚 Init 的空节点，并改写孩子的 parent id
+    void CopyNFrom(const MappingType *items, int size, BufferPoolManager *buffer_pool_manager);
+
+    // B-link: 同一层的中间节点也用 right link 串起来，high key 是本节点 key 的上界（不含）
+    page_id_t GetRightLink() const { return right_link_; }
+    void SetRightLink(page_id_t right_link) { right_link_ = right_link; }
+    KeyType GetHighKey() const { return high_key_; }
+    void SetHighKey(const KeyType &high_key) { high_key_ = high_key; }
+    bool NeedMoveRight(const KeyType &key, const KeyComparator &comparator) const {
+        return right_link_ != INVALID_PAGE_ID && comparator(key, high_key_) >= 0;
+    }
+
     int GetValueSize() const  { return v_size; }
     void SetValueSize(int size) { v_size = size; }
     void IncreaseValueSize(int amount) { v_size += amount; }
@@ -80,6 +98,8 @@ private:
     void CopyFirstFrom(const MappingType &pair, int parent_index, BufferPoolManager *buffer_pool_manager);
 
     int v_size;  // 节点中 v 的数量，即tree的秩，v-1就是key的数量
+    page_id_t right_link_;  // B-link 右兄弟
+    KeyType high_key_;      // B-link high key
 
     MappingType array[0];
 };
@@ -11,6 +11,13 @@
  * | HEADER | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n)
  *  ----------------------------------------------------------------------
  *  map 类的容器还真没法直接用，最朴素的方式就是自定义数组来存放 std::pair
+ *
+ *  前后缀压缩: 页内所有 key 共同的前 prefix 个字节和后 suffix 个字节只在 header 的 frame 里存一份，
+ *  slot 里只存 key 中间那一段，所以 slot 是变长的 (每页一个宽度)
+ *  ----------------------------------------------------------------------
+ * | HEADER + FRAME | KEY(1)[prefix, N-suffix) + RID(1) | ...
+ *  ----------------------------------------------------------------------
+ *  NormalizedKey 的最后 8 个字节就是 RID，slot 里不再跟一份 RID，ValueAt 从 key 里解出来
  * 
  *  Header format (size in byte, 24 bytes in total):
  *  ---------------------------------------------------------------------
@@ -23,6 +30,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -46,7 +54,8 @@ public:
     KeyType KeyAt(int index) const;
     int KeyIndex(const KeyType &key, const KeyComparator &comparator) const;
 
-    const MappingType &GetItem(int index);
+    ValueType ValueAt(int index) const;
+    MappingType GetItem(int index) const;
 
     // insert and delete methods
     int Insert(const KeyType &key, const ValueType &value, const KeyComparator &comparator);
@@ -55,6 +64,8 @@ public:
 
     // Split and Merge utility methods
     void MoveHalfTo(BPlusTreeLeafPage *recipient, BufferPoolManager *buffer_pool_manager /* Unused */);
+    // 只把最后 count 个 kv 搬走，最右的叶子被追加写满的时候用
+    void MoveTailTo(BPlusTreeLeafPage *recipient, int count, BufferPoolManager *buffer_pool_manager /* Unused */);
 
     void MoveAllTo(BPlusTreeLeafPage *recipient, int /* Unused */, BufferPoolManager * /* Unused */);
 
@@ -62,6 +73,20 @@ public:
 
     void MoveLastToFrontOf(BPlusTreeLeafPage *recipient, int parentIndex, BufferPoolManager *buffer_pool_manager);
 
+    // bulk load: 已经排好序的 kv 直接拷进一个刚 Init 的空叶子
+    void CopyNFrom(const MappingType *items, int size, BufferPoolManager * /* Unused */);
+
+    // B-link: 叶子节点的 right link 就是 next page id
+    // high key 是本节点所有 key 的上界（不含），只有 right link 有效时才有意义，最右边的节点相当于 +inf
+    page_id_t GetRightLink() const { return next_page_id_; }
+    void SetRightLink(page_id_t right_link) { next_page_id_ = right_link; }
+    KeyType GetHighKey() const { return high_key_; }
+    void SetHighKey(const KeyType &high_key) { high_key_ = high_key; }
+    // key 已经不在本节点的范围内了（节点分裂过），要沿着 right link 往右找
+    bool NeedMoveRight(const KeyType &key, const KeyComparator &comparator) const {
+        return next_page_id_ != INVALID_PAGE_ID && comparator(key, high_key_) >= 0;
+    }
+
     int GetKeySize() const { return key_size; }
     void SetKeySize(int size) { key_size = size; }
     void IncreaseKeySize(int amount) { key_size += amount; }
@@ -71,25 +96,69 @@ public:
     int GetMaxKeySize() const { return GetOrder() - 1; }
     int GetMinKeySize() const { return (GetOrder()+1)/2-1; }
 
+    /**
+     * @brief 压缩相关
+     * 秩由页面容量决定时 (没有 SetOrder)，压缩省下来的 slot 可以继续用，分裂的阈值跟着压缩率走，最多放大到两倍的秩
+     * 指定了秩的树分裂阈值就是秩，压缩只是省空间
+     */
+    void SetElasticOrder(bool elastic) { elastic_order_ = elastic; }
+    // 当前 frame 下页面物理上能放多少 kv
+    int GetKeyCapacity() const { return CapacityFor(prefix_len_, suffix_len_); }
+    // key 的数量到了这个值就要分裂
+    int GetSplitSize() const { return SplitSizeFor(prefix_len_, suffix_len_); }
+    // 插入 key 之后 frame 可能变窄，物理上是否还放得下
+    bool CanHold(const KeyType &key) const;
+    // 插入 key 之后不需要分裂
+    bool IsSafeToInsert(const KeyType &key) const;
+
     // Debug
     std::string ToString(bool verbose = false) const;
 
 private:
-    void CopyHalfFrom(MappingType *items, int size);
-    void CopyAllFrom(MappingType *items, int size);
+    void CopyHalfFrom(const MappingType *items, int size);
+    void CopyAllFrom(const MappingType *items, int size);
     void CopyLastFrom(const MappingType &item);
     void CopyFirstFrom(const MappingType &item, int parentIndex, BufferPoolManager *buffer_pool_manager);
 
+    // slot 的读写都要经过 frame 拼出完整的 key
+    // key 里带着 value（NormalizedKey 末尾的 RID）的时候 slot 只存 key
+    using ValueInKey = KeyCarriesValue<KeyType, ValueType>;
+    static int ValueSize() { return ValueInKey::value ? 0 : sizeof(ValueType); }
+    int SlotSize(int prefix, int suffix) const { return sizeof(KeyType) - prefix - suffix + ValueSize(); }
+    // 只有一个 key 时整个 key 都在 frame 里，key 又带着 value，slot 是 0 字节
+    int CapacityFor(int prefix, int suffix) const {
+        return (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) / std::max(SlotSize(prefix, suffix), 1);
+    }
+    int SplitSizeFor(int prefix, int suffix) const;
+    // key 和 slot 按字节比较的 lower bound，前后缀各比一次，每一轮只比中间那一段
+    int KeyIndexInPlace(const KeyType &key) const;
+    // frame 和 key 共同的前后缀
+    void FrameWith(const KeyType &key, int &prefix, int &suffix) const;
+    void WriteSlot(int index, const KeyType &key, const ValueType &value);
+    void ShiftSlots(int from, int to, int count);
+    // frame 变窄，已有的 slot 按新的宽度重新编码
+    void Widen(const KeyType &key);
+    // 按 items 重新算出最紧的 frame 并整页重写
+    void Rewrite(const MappingType *items, int size);
+    void Compact();
+    std::vector<MappingType> Items(int begin, int end) const;
+
     page_id_t next_page_id_;
     // 节点的 容量 与 real_order 都在基类中，这里我想要保存一下 key 的大小，因为能否 insert 一个 k 是取决于 k 的大小的
     int key_size;  // k 的数量，最大是 阶-1，叶子节点能够再 insert 一个值就取决于该值
+    KeyType high_key_;  // B-link high key
+    bool elastic_order_;
+    uint16_t prefix_len_;  // frame 中所有 key 共同的前缀长度
+    uint16_t suffix_len_;  // frame 中所有 key 共同的后缀长度
+    KeyType frame_;  // 前后缀的来源，中间那一段没有意义
     /** 
      * b+ tree 叶子节点所在的页 
      * put a variable-sized array at the end of a structure 
      * struct array { size_t size; int a[];}
      * struct array *array = malloc(sizeof (struct array) + size * sizeof (int))
      * 这种结构用的还是蛮多的
+     * 压缩之后 slot 宽度不再是 sizeof(MappingType)，只能按字节存
      */
-    MappingType array[0];
+    char array[0];
 };
 } // namespace cmudb
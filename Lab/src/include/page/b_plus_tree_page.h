@@ -23,6 +23,7 @@
 
 #include "buffer/buffer_pool_manager.h"
 #include "index/generic_key.h"
+#include "index/normalized_key.h"
 
 namespace cmudb {
 
@@ -0,0 +1,99 @@
+/**
+ * be_tree_page.h
+ *
+ * Page of the write-optimized B^epsilon tree (BeTree).
+ * 叶子和 b+ tree 的叶子一样，是按 key 排好序的 (key, value)
+ * 中间节点只用一部分空间放 pivot 和 child，剩下的是一个消息缓冲区：
+ * 插入和删除先变成一条消息放进 root 的缓冲区，缓冲区满了才把消息最多的那个 child 的消息整批往下推一层
+ * 缓冲区按 key 排好序，同一个 key 只留最新的一条（key 是唯一的，新消息直接盖掉旧消息）
+ * 默认的扇出是 sqrt(页里能放下的消息个数)，即 epsilon = 1/2
+ *
+ * Header format (size in byte, 24 bytes in total):
+ * ----------------------------------------------------------------------------
+ * | PageType (4) | PageId (4) | CurrentSize (4) | MaxSize (4) |
+ * ----------------------------------------------------------------------------
+ * | BufferSize (4) | MaxBufferSize (4) |
+ * ----------------------------------------------------------------------------
+ * Leaf: | (key, value) * MaxSize |
+ * Internal: | child page id * MaxSize | pivot key * MaxSize | message * MaxBufferSize |
+ * 中间节点的 pivot[i] 是 child[i] 子树里最小的 key，pivot[0] 不用（相当于 -inf）
+ */
+
+#pragma once
+
+#include "buffer/buffer_pool_manager.h"
+#include "page/b_plus_tree_page.h"
+
+namespace cmudb {
+
+enum class BeTreeMessageType { INSERT = 0, DELETE };
+
+INDEX_TEMPLATE_ARGUMENTS
+struct BeTreeMessage {
+    KeyType key;
+    ValueType value;
+    BeTreeMessageType type;
+};
+
+INDEX_TEMPLATE_ARGUMENTS
+class BeTreePage {
+public:
+    using Message = BeTreeMessage<KeyType, ValueType, KeyComparator>;
+
+    // After creating a new page from buffer pool, must call initialize
+    // method to set default values
+    // max_size/max_buffer_size 是 0 的时候按页的大小算
+    void Init(page_id_t page_id, IndexPageType page_type, int max_size = 0, int max_buffer_size = 0);
+
+    bool IsLeafPage() const { return page_type_ == IndexPageType::LEAF_PAGE; }
+    page_id_t GetPageId() const { return page_id_; }
+    // 叶子是 key 的个数，中间节点是 child 的个数
+    int GetSize() const { return size_; }
+    void SetSize(int size) { size_ = size; }
+    int GetMaxSize() const { return max_size_; }
+    int GetBufferSize() const { return buffer_size_; }
+    void SetBufferSize(int buffer_size) { buffer_size_ = buffer_size; }
+    int GetMaxBufferSize() const { return max_buffer_size_; }
+
+    // leaf
+    MappingType *Entries() { return reinterpret_cast<MappingType *>(data_); }
+    const MappingType *Entries() const { return reinterpret_cast<const MappingType *>(data_); }
+    // 第一个 >= key 的位置
+    int LowerBound(const KeyType &key, const KeyComparator &comparator) const;
+    bool Lookup(const KeyType &key, ValueType &value, const KeyComparator &comparator) const;
+
+    // internal
+    page_id_t *Children() { return reinterpret_cast<page_id_t *>(data_); }
+    const page_id_t *Children() const { return reinterpret_cast<const page_id_t *>(data_); }
+    KeyType *Pivots() { return reinterpret_cast<KeyType *>(data_ + max_size_ * sizeof(page_id_t)); }
+    const KeyType *Pivots() const {
+        return reinterpret_cast<const KeyType *>(data_ + max_size_ * sizeof(page_id_t));
+    }
+    Message *Buffer() { return reinterpret_cast<Message *>(Pivots() + max_size_); }
+    const Message *Buffer() const { return reinterpret_cast<const Message *>(Pivots() + max_size_); }
+    // key 所在的 child 的下标：最后一个 pivot <= key 的位置
+    int ChildIndex(const KeyType &key, const KeyComparator &comparator) const;
+    // 缓冲区里 key 的消息，没有的话返回 nullptr
+    const Message *FindMessage(const KeyType &key, const KeyComparator &comparator) const;
+    // 按顺序放进缓冲区，同一个 key 已经有消息的话直接盖掉，否则缓冲区必须还有空位
+    void PutMessage(const Message &message, const KeyComparator &comparator);
+
+    // 按页的大小算出来的默认容量
+    static int LeafCapacity();
+    static int FanoutCapacity();
+    static int BufferCapacity(int fanout);
+
+private:
+    // 缓冲区里第一个 >= key 的位置
+    int MessageLowerBound(const KeyType &key, const KeyComparator &comparator) const;
+
+    IndexPageType page_type_;
+    page_id_t page_id_;
+    int size_;
+    int max_size_;
+    int buffer_size_;
+    int max_buffer_size_;
+    char data_[0];
+};
+
+} // namespace cmudb
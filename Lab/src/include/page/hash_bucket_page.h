@@ -0,0 +1,73 @@
+/**
+ * hash_bucket_page.h
+ *
+ * Bucket page of the disk-resident extendible hash index.
+ * 桶里的 kv 不排序，查找就是顺序比较。同一个 key 可以有多个 value（非唯一索引）
+ * 桶满了又没法分裂（同一个 key 的重复太多，或者目录已经到了最大深度）的时候，
+ * 通过 overflow page id 挂上 overflow 页，overflow 页也是一个 bucket page，它的 local depth 没有意义
+ *
+ * Format (size in byte, 20 bytes in total):
+ *  ---------------------------------------------------------------------------
+ * | PageId (4) | LSN (4) | CurrentSize (4) | LocalDepth (4) | OverflowPageId (4)
+ *  ---------------------------------------------------------------------------
+ *  ------------------------------------------------
+ * | KEY(1) + VALUE(1) | ... | KEY(n) + VALUE(n)
+ *  ------------------------------------------------
+ */
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "page/b_plus_tree_page.h"
+
+namespace cmudb {
+
+#define HASH_BUCKET_PAGE_TYPE HashBucketPage<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class HashBucketPage {
+public:
+    // After creating a new bucket page from buffer pool, must call initialize
+    // method to set default values
+    void Init(page_id_t page_id, int local_depth = 0);
+
+    page_id_t GetPageId() const { return page_id_; }
+    int GetSize() const { return size_; }
+    int GetMaxSize() const { return (PAGE_SIZE - sizeof(HashBucketPage)) / sizeof(MappingType); }
+    bool IsFull() const { return size_ >= GetMaxSize(); }
+
+    int GetLocalDepth() const { return local_depth_; }
+    void SetLocalDepth(int local_depth) { local_depth_ = local_depth; }
+
+    page_id_t GetOverflowPageId() const { return overflow_page_id_; }
+    void SetOverflowPageId(page_id_t overflow_page_id) { overflow_page_id_ = overflow_page_id; }
+
+    const KeyType &KeyAt(int index) const { return array[index].first; }
+    const ValueType &ValueAt(int index) const { return array[index].second; }
+    const MappingType &GetItem(int index) const { return array[index]; }
+
+    // 桶没满的时候追加到末尾
+    void Append(const KeyType &key, const ValueType &value);
+    // 把 key 对应的所有 value 追加到 result
+    int GetValues(const KeyType &key, std::vector<ValueType> &result, const KeyComparator &comparator) const;
+    // (key, value) 的下标，没有返回 -1
+    int Find(const KeyType &key, const ValueType &value, const KeyComparator &comparator) const;
+    void SetItem(int index, const MappingType &item) { array[index] = item; }
+    // 删掉 index 处的 kv，本页最后一个 kv 填到空出来的位置
+    void RemoveAt(int index);
+    // 删掉并返回最后一个 kv
+    MappingType PopBack();
+    void Clear() { size_ = 0; }
+
+private:
+    page_id_t page_id_;
+    lsn_t lsn_;
+    int size_;
+    int local_depth_;
+    page_id_t overflow_page_id_;
+    MappingType array[0];
+};
+
+} // namespace cmudb
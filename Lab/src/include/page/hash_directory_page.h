@@ -0,0 +1,65 @@
+/**
+ * hash_directory_page.h
+ *
+ * Directory page of the disk-resident extendible hash index.
+ * 目录的第 i 个 slot 对应 hash 值的低 global depth 位等于 i 的 key，slot 里是桶的页号
+ * 多个 slot 可以指向同一个桶（桶的 local depth 小于 global depth 的时候）
+ *
+ * Format (size in byte):
+ *  --------------------------------------------------------------------------
+ * | PageId (4) | LSN (4) | GlobalDepth (4) | BucketPageId(0) (4) | ... | BucketPageId(511) (4)
+ *  --------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+// 一页目录最多 512 个 slot，global depth 最多是 9，再满的桶只能挂 overflow page
+static const int HASH_MAX_GLOBAL_DEPTH = 9;
+static const int HASH_DIRECTORY_ARRAY_SIZE = 1 << HASH_MAX_GLOBAL_DEPTH;
+
+class HashDirectoryPage {
+public:
+    // 新的目录只有一个 slot，指向唯一的桶
+    void Init(page_id_t page_id, page_id_t bucket_page_id) {
+        page_id_ = page_id;
+        lsn_ = INVALID_LSN;
+        global_depth_ = 0;
+        bucket_page_ids_[0] = bucket_page_id;
+    }
+
+    page_id_t GetPageId() const { return page_id_; }
+
+    int GetGlobalDepth() const { return global_depth_; }
+    uint32_t GetGlobalDepthMask() const { return (1u << global_depth_) - 1; }
+    // 当前用到的 slot 数
+    int Size() const { return 1 << global_depth_; }
+
+    page_id_t GetBucketPageId(uint32_t index) const { return bucket_page_ids_[index]; }
+    void SetBucketPageId(uint32_t index, page_id_t bucket_page_id) { bucket_page_ids_[index] = bucket_page_id; }
+
+    bool CanGrow() const { return global_depth_ < HASH_MAX_GLOBAL_DEPTH; }
+    // 目录翻倍，新的一半与旧的一半指向同样的桶
+    void IncrGlobalDepth() {
+        assert(CanGrow());
+        int size = Size();
+        for (int i = 0; i < size; i++) { bucket_page_ids_[size + i] = bucket_page_ids_[i]; }
+        global_depth_++;
+    }
+
+private:
+    page_id_t page_id_;
+    lsn_t lsn_;
+    int global_depth_;
+    page_id_t bucket_page_ids_[HASH_DIRECTORY_ARRAY_SIZE];
+};
+
+static_assert(sizeof(HashDirectoryPage) <= PAGE_SIZE, "hash directory does not fit in a page");
+
+} // namespace cmudb
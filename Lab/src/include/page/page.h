@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
@@ -37,11 +38,27 @@ public:
     inline int GetPinCount() { return pin_count_; }
 
     // method use to latch/unlatch page content
-    inline void WUnlatch() { rwlatch_.WUnlock(); }
-    inline void WLatch() { rwlatch_.WLock(); }
+    // 写锁持有期间版本号是奇数，释放时再 +1，所以每次修改之后版本号都会前进
+    inline void WUnlatch() {
+        version_.fetch_add(1, std::memory_order_release);
+        rwlatch_.WUnlock();
+    }
+    inline void WLatch() {
+        rwlatch_.WLock();
+        version_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
     inline void RUnlatch() { rwlatch_.RUnlock(); }
     inline void RLatch() { rwlatch_.RLock(); }
 
+    // optimistic lock coupling: 不加锁读之前记下版本号，读完之后校验版本号没有变化
+    // 奇数表示有写者正在修改，读到的内容不可信
+    inline uint64_t GetVersion() { return version_.load(std::memory_order_acquire); }
+    inline bool ValidateVersion(uint64_t version) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version_.load(std::memory_order_relaxed) == version;
+    }
+
     inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + 4); }
     inline void SetLSN(lsn_t lsn) { memcpy(GetData() + 4, &lsn, 4); }
     inline void SetDirty(){ is_dirty_=true; }
@@ -50,6 +67,8 @@ public:
 private:
     // method used by buffer pool manager
     inline void ResetMemory() { memset(data_, 0, PAGE_SIZE); }  // 清0
+    // frame 换给了别的页，让拿着旧版本号的读者校验失败
+    inline void BumpVersion() { version_.fetch_add(2); }
 
     // members, page的元数据
     char data_[PAGE_SIZE]; // actual data，代表内存中的一个页
@@ -57,6 +76,7 @@ private:
     int pin_count_ = 0;
     bool is_dirty_ = false;
     RWMutex rwlatch_;  // 读写锁
+    std::atomic<uint64_t> version_{0};  // 页面内容的版本号，见 WLatch/GetVersion
 };
 
 } // namespace cmudb
\ No newline at end of file
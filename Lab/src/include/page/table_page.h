@@ -21,6 +21,7 @@
 #pragma once
 
 #include <cstring>
+#include <vector>
 
 #include "common/rid.h"
 #include "concurrency/lock_manager.h"
@@ -70,6 +71,10 @@ public:
     */
     bool GetFirstTupleRid(RID &first_rid);
     bool GetNextTupleRid(const RID &cur_rid, RID &next_rid);
+    // rids of all valid tuples in this page, for batch locking
+    void GetTupleRids(std::vector<RID> &rids);
+    // copy out all valid tuples in this page, tuple locks are taken by the caller
+    void GetTuples(std::vector<Tuple> &tuples);
 
 private:
     /**
@@ -0,0 +1,121 @@
+/**
+ * varlen_b_plus_tree_page.h
+ *
+ * Slotted page of the variable-length key B+ tree (VarlenBPlusTree).
+ * 定长 key 的 b+ tree 每个 slot 都按最长的 key 占空间，短 key 浪费空间，长 key 放不下；
+ * 这里 slot 目录从前往后长，记录从页尾往前长，一个页能放多少 key 取决于 key 的实际长度
+ *
+ * 叶子和中间节点用同一种页：叶子的 value 是 RID，中间节点的 value 是 child page id，
+ * 中间节点第 0 个 key 是空的（相当于 -inf），和定长的 internal page 一样
+ *
+ * 超过 VARLEN_INLINE_KEY_SIZE 的 key 只在页里放前 VARLEN_INLINE_KEY_SIZE 个字节，
+ * 剩下的放在 overflow 页组成的链表里，比较的时候前缀相同才需要去读 overflow 页
+ *
+ * Header format (size in byte, 32 bytes in total):
+ * ----------------------------------------------------------------------------
+ * | PageType (4) | LSN (4) | CurrentSize (4) | FreeEnd (4) | PageId (4) |
+ * ----------------------------------------------------------------------------
+ * | NextPageId (4) | Garbage (4) | Reserved (4) |
+ * ----------------------------------------------------------------------------
+ * Slot (4): | Offset (2) | InlineLength (2)，最高位表示 key 有 overflow |
+ * Record: | Value (8) | [OverflowPageId (4) | KeyLength (4)] | inline key bytes |
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "buffer/buffer_pool_manager.h"
+#include "page/b_plus_tree_page.h"
+
+namespace cmudb {
+
+// 在页里直接存放的 key 的最大长度，一个页至少能放下 6 个这么长的 key
+static const int VARLEN_INLINE_KEY_SIZE = 512;
+
+class VarlenBPlusTreePage {
+public:
+    // After creating a new page from buffer pool, must call initialize
+    // method to set default values
+    void Init(page_id_t page_id, IndexPageType page_type);
+
+    bool IsLeafPage() const { return page_type_ == IndexPageType::LEAF_PAGE; }
+    page_id_t GetPageId() const { return page_id_; }
+    int GetSize() const { return size_; }
+
+    // 叶子节点的右兄弟
+    page_id_t GetNextPageId() const { return next_page_id_; }
+    void SetNextPageId(page_id_t next_page_id) { next_page_id_ = next_page_id; }
+
+    // 第 index 个 key 在页里的那一段
+    const char *InlineKeyAt(int index) const { return reinterpret_cast<const char *>(this) + RecordKeyOffset(index); }
+    int InlineLengthAt(int index) const { return slots_[index].length & ~OVERFLOW_FLAG; }
+    bool IsOverflowAt(int index) const { return (slots_[index].length & OVERFLOW_FLAG) != 0; }
+    page_id_t OverflowPageAt(int index) const;
+    // 完整 key 的长度，包括 overflow 页里的部分
+    int KeyLengthAt(int index) const;
+
+    int64_t ValueAt(int index) const;
+    void SetValueAt(int index, int64_t value);
+
+    // 放一条 inline key 长度为 inline_length 的记录需要的空间（包括 slot）
+    static int RecordSize(int inline_length, bool overflow);
+    int RecordSizeAt(int index) const { return RecordSize(InlineLengthAt(index), IsOverflowAt(index)); }
+    // 压缩之后能用的空间
+    int GetFreeSpace() const;
+    // 记录和 slot 一共用了多少字节
+    int GetUsedSpace() const;
+    bool HasRoomFor(int inline_length, bool overflow) const {
+        return GetFreeSpace() >= RecordSize(inline_length, overflow);
+    }
+
+    // 在 index 处插入一条记录，后面的 slot 往后挪，调用者保证放得下
+    void InsertAt(int index, const char *inline_key, int inline_length, page_id_t overflow_page_id, int key_length,
+                  int64_t value);
+    // 把 src 的第 index 条记录原样追加到本页末尾（分裂用，overflow 链表跟着记录走）
+    void CopyFrom(const VarlenBPlusTreePage *src, int index);
+    // 删掉 index 处的记录，空出来的字节记在 garbage 里，空间不够的时候再压缩
+    void RemoveAt(int index);
+    // 保留前 size 条记录
+    void Truncate(int size);
+    // 把记录重新紧凑地放到页尾
+    void Compact();
+
+private:
+    static const uint16_t OVERFLOW_FLAG = 0x8000;
+
+    struct Slot {
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    int RecordKeyOffset(int index) const {
+        return slots_[index].offset + sizeof(int64_t) + (IsOverflowAt(index) ? sizeof(page_id_t) + sizeof(int) : 0);
+    }
+
+    IndexPageType page_type_;
+    lsn_t lsn_;
+    int size_;
+    int free_end_;
+    page_id_t page_id_;
+    page_id_t next_page_id_;
+    int garbage_;
+    int reserved_;
+    Slot slots_[0];
+};
+
+/**
+ * 长 key 放不进页里的部分，多个 overflow 页串成链表
+ * Header format: | NextPageId (4) | Length (4) | data ...
+ */
+class VarlenOverflowPage {
+public:
+    static const int CAPACITY = PAGE_SIZE - sizeof(page_id_t) - sizeof(int);
+
+    page_id_t next_page_id_;
+    int length_;
+    char data_[0];
+};
+
+} // namespace cmudb
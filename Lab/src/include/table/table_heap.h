@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <mutex>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "logging/log_manager.h"
 #include "page/table_page.h"
@@ -44,8 +47,27 @@ public:
                     Transaction *txn); // when commit delete or rollback insert
     void RollbackDelete(const RID &rid, Transaction *txn); // when rollback delete
 
+    // commit/abort time, batched per page: the page is fetched and latched once
+    // for all of its write records, which are applied in the given order
+    void ApplyDeletes(page_id_t page_id, const std::vector<RID> &rids,
+                    Transaction *txn);
+    void Rollback(page_id_t page_id, const std::vector<WriteRecord *> &records,
+                    Transaction *txn);
+
     bool GetTuple(const RID &rid, Tuple &tuple, Transaction *txn);
 
+    // lock a batch of tuples in one lock manager call (scans and bulk writes)
+    bool LockTuples(const std::vector<RID> &rids, Transaction *txn,
+                    bool exclusive = false);
+
+    // page ids in list order, for partitioning a scan across threads
+    void GetPageIds(std::vector<page_id_t> &page_ids);
+
+    // shared lock and copy out all tuples on one page
+    // txn 的锁集合不是线程安全的，几个线程共用一个 txn 时传同一个 txn_mutex 进来
+    bool GetPageTuples(page_id_t page_id, std::vector<Tuple> &tuples,
+                       Transaction *txn, std::mutex *txn_mutex = nullptr);
+
     bool DeleteTableHeap();
 
     TableIterator begin(Transaction *txn);
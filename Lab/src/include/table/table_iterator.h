@@ -14,6 +14,7 @@
 namespace cmudb {
 
 class TableHeap;
+class TablePage;
 
 class TableIterator {
   friend class Cursor;
@@ -40,6 +41,8 @@ public:
   TableIterator operator++(int);
 
 private:
+  bool LockPage(TablePage *page);
+
   TableHeap *table_heap_;
   Tuple *tuple_;
   Transaction *txn_;
@@ -4,11 +4,17 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <thread>
 #include "buffer/lru_replacer.h"
 #include "catalog/schema.h"
 #include "concurrency/transaction_manager.h"
 #include "index/b_plus_tree_index.h"
+#include "index/be_tree_index.h"
+#include "index/extendible_hash_index.h"
+#include "index/varlen_b_plus_tree_index.h"
 #include "logging/log_manager.h"
 #include "sqlite/sqlite3ext.h"
 #include "table/table_heap.h"
@@ -23,6 +29,8 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
                                    const std::string &table_name,
                                    Schema *schema);
 
+Value ConstructValue(TypeId type, sqlite3_value *value);
+
 Tuple ConstructTuple(Schema *schema, sqlite3_value **argv);
 
 Index *ConstructIndex(IndexMetadata *metadata,
@@ -76,7 +84,7 @@ public:
             new BufferPoolManager(BUFFER_POOL_SIZE, disk_manager_, log_manager_);
 
         // txn related
-        lock_manager_ = new LockManager(true); // S2PL
+        lock_manager_ = new LockManager(true, log_manager_); // S2PL
         transaction_manager_ = new TransactionManager(lock_manager_, log_manager_);
     }
 
@@ -102,14 +110,23 @@ StorageEngine *storage_engine_;
 thread_local Transaction *global_transaction_ = nullptr;
 std::mutex thread_mutex;
 
+// 一张表的索引多于这个数时，插入/删除的索引维护并行做
+static const size_t PARALLEL_INDEX_THRESHOLD = 4;
+// 维护一个索引时最多同时 pin 住的页面数（b+ tree 从 root 到叶子再加上分裂出来的页面），
+// 并行的任务数不能超过 buffer pool 装得下的份数，否则 FetchPage 会失败
+static const size_t INDEX_PIN_BUDGET = 8;
+// 建索引时每个扫描 table heap 的 worker 至少分到这么多个页面，页面少的表不值得起线程
+static const size_t BUILD_PAGES_PER_WORKER = 16;
+
 class VirtualTable {
     friend class Cursor;
 
 public:
     VirtualTable(Schema *schema, BufferPoolManager *buffer_pool_manager,
-                LockManager *lock_manager, LogManager *log_manager, Index *index,
+                LockManager *lock_manager, LogManager *log_manager,
+                const std::vector<Index *> &indexes,
                 page_id_t first_page_id = INVALID_PAGE_ID)
-        : schema_(schema), index_(index) 
+        : schema_(schema), indexes_(indexes), buffer_pool_manager_(buffer_pool_manager)
     {
         if (first_page_id != INVALID_PAGE_ID) {
             // reopen an exist table
@@ -126,7 +143,7 @@ public:
     ~VirtualTable() {
         delete schema_;
         delete table_heap_;
-        delete index_;
+        for (auto *index : indexes_) { delete index; }
     }
 
     // insert into table heap
@@ -134,21 +151,20 @@ public:
         return table_heap_->InsertTuple(tuple, rid, GetTransaction());
     }
 
-    // insert into index
+    // insert into every index
     // 所以说索引会降低 写 的速度
     inline void InsertEntry(const Tuple &tuple, const RID &rid) {
-        if (index_ == nullptr) { return; }
-        // construct indexed key-tuple
-        std::vector<Value> key_values;
-
-        // 组合索引，其中会把被组合index的值 insert into vector 以整合在一起
-        // 索引的这个 v 就直接就是值了
-        for (auto &i : index_->GetKeyAttrs()) { 
-            key_values.push_back(tuple.GetValue(schema_, i)); 
-        }
+        ForEachIndex([this, &tuple, &rid](Index *index, Transaction *transaction) {
+            index->InsertEntry(ConstructEntry(index, tuple), rid, transaction);
+        });
+    }
 
-        Tuple key(key_values, index_->GetKeySchema());
-        index_->InsertEntry(key, rid, GetTransaction());
+    // 每个索引都放得下 tuple 对应的 entry 才能写，insert / update 在动 table heap 之前先检查
+    inline bool CanIndex(const Tuple &tuple) {
+        for (auto *index : indexes_) {
+            if (!index->CanHold(ConstructEntry(index, tuple))) { return false; }
+        }
+        return true;
     }
 
     // delete from table heap
@@ -157,19 +173,56 @@ public:
         return table_heap_->MarkDelete(rid, GetTransaction());
     }
 
-    // delete from index，删除索引
+    // delete from every index，删除索引
     inline void DeleteEntry(const RID &rid) {
-        if (index_ == nullptr) { return; }
+        if (indexes_.empty()) { return; }
         Tuple deleted_tuple(rid);
         table_heap_->GetTuple(rid, deleted_tuple, GetTransaction());
-        // construct indexed key tuple
-        std::vector<Value> key_values;
+        ForEachIndex([this, &deleted_tuple, &rid](Index *index, Transaction *transaction) {
+            index->DeleteEntry(ConstructEntry(index, deleted_tuple), rid, transaction);
+        });
+    }
 
-        for (auto &i : index_->GetKeyAttrs()) { 
-            key_values.push_back(deleted_tuple.GetValue(schema_, i)); 
+    // build an index for a table that already has tuples (CREATE INDEX on an existing table)
+    // 扫一遍 table heap 收集 (entry, rid)，交给索引自底向上建，而不是逐个 InsertEntry
+    // heap 的页面按链表顺序切成连续的几段，每段一个 worker 并行扫描，得到的几个 run 交给索引去排序归并
+    // 已有的 tuple 里有索引放不下的 key 时不建，返回 false
+    inline bool BuildIndex(Index *index) {
+        Transaction *txn = storage_engine_->transaction_manager_->Begin();
+        std::vector<page_id_t> page_ids;
+        table_heap_->GetPageIds(page_ids);
+        size_t workers = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(),
+                                                              page_ids.size() / BUILD_PAGES_PER_WORKER));
+        std::vector<std::vector<std::pair<Tuple, RID>>> runs(workers);
+        std::mutex txn_mutex;
+        std::atomic<bool> fits(true);
+        auto scan = [this, index, txn, workers, &page_ids, &runs, &txn_mutex, &fits](size_t worker) {
+            size_t begin = page_ids.size() * worker / workers;
+            size_t end = page_ids.size() * (worker + 1) / workers;
+            std::vector<Tuple> tuples;
+            for (size_t i = begin; i < end; i++) {
+                tuples.clear();
+                if (!table_heap_->GetPageTuples(page_ids[i], tuples, txn, &txn_mutex)) {
+                    throw Exception(EXCEPTION_TYPE_INDEX, "can not read table heap while building index");
+                }
+                for (auto &tuple : tuples) {
+                    runs[worker].emplace_back(ConstructEntry(index, tuple), tuple.GetRid());
+                    if (!index->CanHold(runs[worker].back().first)) { fits = false; }
+                }
+                if (!fits) { return; }
+            }
+        };
+        std::vector<std::future<void>> futures;
+        for (size_t worker = 1; worker < workers; worker++) {
+            futures.push_back(std::async(std::launch::async, scan, worker));
         }
-        Tuple key(key_values, index_->GetKeySchema());
-        index_->DeleteEntry(key, GetTransaction());
+        scan(0);
+        // get() 把任务里的异常带回来
+        for (auto &future : futures) { future.get(); }
+
+        if (fits) { index->BulkLoadRuns(runs, 1.0, txn); }
+        storage_engine_->transaction_manager_->Commit(txn);
+        return fits;
     }
 
     // update table heap tuple
@@ -184,20 +237,63 @@ public:
 
     inline Schema *GetSchema() { return schema_; }
 
-    inline Index *GetIndex() { return index_; }
+    inline const std::vector<Index *> &GetIndexes() { return indexes_; }
+
+    inline Index *GetIndex(int index_no) { return indexes_[index_no]; }
 
     inline TableHeap *GetTableHeap() { return table_heap_; }
 
     inline page_id_t GetFirstPageId() { return table_heap_->GetFirstPageId(); }
 
+    // 插入/删除时维护索引的并行任务数（包括当前线程），1 就是串行
+    // 每个任务要 INDEX_PIN_BUDGET 个 frame，默认的 BUFFER_POOL_SIZE 只够一个任务，只有更大的 buffer pool 才会并行
+    inline size_t IndexWorkers() const {
+        if (indexes_.size() < PARALLEL_INDEX_THRESHOLD) { return 1; }
+        return std::max<size_t>(1, std::min(indexes_.size(), buffer_pool_manager_->GetPoolSize() / INDEX_PIN_BUDGET));
+    }
+
 private:
+    // construct index entry tuple: key columns followed by include columns
+    // 组合索引，其中会把被组合index的值 insert into vector 以整合在一起
+    inline Tuple ConstructEntry(Index *index, const Tuple &tuple) {
+        std::vector<Value> entry_values;
+        for (auto &i : index->GetEntryAttrs()) {
+            entry_values.push_back(tuple.GetValue(schema_, i));
+        }
+        return Tuple(entry_values, index->GetEntrySchema());
+    }
+
+    // op(index, transaction) on every index
+    // 索引多的时候分给几个异步任务并行维护，当前线程也分一份。b+ tree 用 transaction 记录
+    // 加了锁的页面，不能在线程之间共享，所以每个任务用自己的 Transaction（同一个 txn id）
+    template <typename IndexOp>
+    void ForEachIndex(IndexOp op) {
+        size_t workers = IndexWorkers();
+        if (workers == 1) {
+            for (auto *index : indexes_) { op(index, GetTransaction()); }
+            return;
+        }
+        txn_id_t txn_id = GetTransaction() == nullptr ? INVALID_TXN_ID : GetTransaction()->GetTransactionId();
+        std::vector<std::future<void>> futures;
+        for (size_t worker = 1; worker < workers; worker++) {
+            futures.push_back(std::async(std::launch::async, [this, &op, worker, workers, txn_id]() {
+                Transaction transaction(txn_id);
+                for (size_t i = worker; i < indexes_.size(); i += workers) { op(indexes_[i], &transaction); }
+            }));
+        }
+        for (size_t i = 0; i < indexes_.size(); i += workers) { op(indexes_[i], GetTransaction()); }
+        // get() 把任务里的异常带回来
+        for (auto &future : futures) { future.get(); }
+    }
+
     sqlite3_vtab base_;
     // virtual table schema
     Schema *schema_;
     // to read/write actual data in table
     TableHeap *table_heap_;
-    // to insert/delete index entry
-    Index *index_ = nullptr;
+    // to insert/delete index entries, a table can have any number of indexes
+    std::vector<Index *> indexes_;
+    BufferPoolManager *buffer_pool_manager_;
 };
 
 class Cursor {
@@ -212,10 +308,20 @@ public:
 
     inline bool IsIndexScan() { return is_index_scan_; }
 
+    // 查询用到的列都在索引 entry 里（key 列和 INCLUDE 列），列值直接从 entry 里取，不回表
+    inline void SetCoveringFlag(bool is_covering) {
+        is_covering_ = is_covering;
+    }
+
+    // 这次扫描用表上的哪一个索引，由 VtabBestIndex 选出来
+    inline void SetIndex(int index_no) {
+        index_ = virtual_table_->GetIndex(index_no);
+    }
+
     inline VirtualTable *GetVirtualTable() { return virtual_table_; }
 
     inline Schema *GetKeySchema() {
-        return virtual_table_->index_->GetKeySchema();
+        return index_->GetKeySchema();
     }
 
     // return rid at which cursor is currently pointed
@@ -232,7 +338,12 @@ public:
 
     // return tuple at which cursor is currently pointed
     inline Value GetCurrentValue(Schema *schema, int column) {
-        if (is_index_scan_) {
+        if (is_index_scan_ && is_covering_) {
+            const std::vector<int> &entry_attrs = index_->GetEntryAttrs();
+            auto pos = std::find(entry_attrs.begin(), entry_attrs.end(), column) - entry_attrs.begin();
+            assert(pos < static_cast<int>(entry_attrs.size()));
+            return entries_[offset_].GetValue(index_->GetEntrySchema(), pos);
+        } else if (is_index_scan_) {
             RID rid = results[offset_];
             Tuple tuple(rid);
             virtual_table_->table_heap_->GetTuple(rid, tuple, GetTransaction());
@@ -260,8 +371,24 @@ public:
     }
 
     // wrapper around poit scan methods
-    inline void ScanKey(const Tuple &key) {
-        virtual_table_->index_->ScanKey(key, results);
+    // 拿不到锁时返回 false，结果清空，事务被置为 ABORTED
+    inline bool ScanKey(const Tuple &key) {
+        // xFilter 可能在同一个 cursor 上被调用多次（比如 join 的内表）
+        results.clear();
+        entries_.clear();
+        offset_ = 0;
+        index_->ScanKey(key, results, nullptr, GetEntries());
+        // 命中的 tuple 一次性加读锁，读列值时就不用逐个去抢锁了
+        return LockResults();
+    }
+
+    // wrapper around range scan methods
+    inline bool ScanRange(const ScanBound *lo, const ScanBound *hi) {
+        results.clear();
+        entries_.clear();
+        offset_ = 0;
+        index_->ScanRange(lo, hi, results, nullptr, GetEntries());
+        return LockResults();
     }
 
     // debug
@@ -271,14 +398,30 @@ public:
     }
 
 private:
+    inline std::vector<Tuple> *GetEntries() { return is_covering_ ? &entries_ : nullptr; }
+
+    // 和单个 tuple 的 GetTuple 一样，锁不到就 abort 事务
+    inline bool LockResults() {
+        if (virtual_table_->table_heap_->LockTuples(results, GetTransaction())) { return true; }
+        GetTransaction()->SetState(TransactionState::ABORTED);
+        results.clear();
+        entries_.clear();
+        return false;
+    }
+
     sqlite3_vtab_cursor base_; /* Base class - must be first */
     // for index scan
     std::vector<RID> results;
+    // for covering index scan, entries_[i] is the index entry of results[i]
+    std::vector<Tuple> entries_;
+    bool is_covering_ = false;
     int offset_ = 0;
     // for sequential scan
     TableIterator table_iterator_;
     // flag to indicate which scan method is currently used
     bool is_index_scan_ = false;
+    // index used by the current index scan
+    Index *index_ = nullptr;
     VirtualTable *virtual_table_;
 }; // namespace cmudb
 
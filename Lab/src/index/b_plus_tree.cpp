@@ -2,13 +2,19 @@
  * b_plus_tree.cpp
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <numeric>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #include "common/exception.h"
 #include "common/logger.h"
 #include "common/rid.h"
 #include "index/b_plus_tree.h"
+#include "index/bloom_filter.h"
 #include "page/header_page.h"
 
 
@@ -37,10 +43,6 @@ BPlusTree<KeyType, ValueType, KeyComparator>::BPlusTree(
       buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) 
     {}
 
-template <typename KeyType, typename ValueType, typename KeyComparator>
-// 类内 static 的变量必须初始化，因为它不依赖于类对象的实例化
-thread_local bool BPlusTree<KeyType, ValueType, KeyComparator>::root_is_locked = false;
-
 /*
  * Helper function to decide whether current b+tree is empty
  */
@@ -65,30 +67,144 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::GetValue(
     const KeyType &key, std::vector<ValueType> &result,
     Transaction *transaction)
 {
-    // 根据key找到叶子节点页面
-    auto *leaf = FindLeafPage(key, false, Operation::READONLY, transaction);
+    // 根据key找到叶子节点页面，中间节点不加锁，只有叶子节点持有读锁
+    // 热点 key 先查自适应哈希索引，位置还有效的话只访问一个叶子
+    int index;
+    auto *page = FindLeafPageForRead(key, index);
+    if (page == nullptr) { return false; }
+
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    bool ret = index < leaf->GetKeySize() && comparator_(key, leaf->KeyAt(index)) == 0;
+    if (ret) { result.push_back(leaf->ValueAt(index)); }
+
+    // 释放锁
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    return ret;
+}
 
-    bool ret = false;
-    if (leaf != nullptr)
-    {
-        ValueType value;
-        if (leaf->Lookup(key, value, comparator_))
-        {
-            result.push_back(value);
-            ret = true;
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::GetValues(
+    const std::vector<KeyType> &keys, std::vector<std::vector<ValueType>> &result,
+    Transaction *transaction)
+{
+    std::vector<std::pair<KeyType, KeyType>> ranges;
+    ranges.reserve(keys.size());
+    for (auto &key : keys) { ranges.emplace_back(key, key); }
+    GetValues(ranges, result, transaction);
+}
+
+/*
+ * Batch lookup, used by IN lists
+ * 每个 probe 单独查的话每次都要从 root 下降一遍。这里按下界排序之后依次处理：
+ *  1. 当前锁住的叶子覆盖了下一个 probe（不小于叶子的下界，小于 high key），直接在这个叶子里查
+ *  2. 否则看右边相邻的叶子，稠密的 IN list / join key 大多落在这里
+ *  3. 再远就放掉叶子重新从 root 下降，比沿着叶子链表一页一页走便宜
+ * 一个 probe 的区间跨了叶子就顺着 right link 扫下去。同一时刻只持有一个叶子的读锁
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::GetValues(
+    const std::vector<std::pair<KeyType, KeyType>> &ranges,
+    std::vector<std::vector<ValueType>> &result, Transaction *transaction)
+{
+    (void)transaction;
+    result.assign(ranges.size(), std::vector<ValueType>());
+    std::vector<size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return comparator_(ranges[lhs].first, ranges[rhs].first) < 0;
+    });
+
+    using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
+    Page *page = nullptr;
+    KeyType low_key;  // 当前叶子里所有 key 的下界
+    uint64_t epoch = 0;
+    for (size_t n = 0; n < order.size(); n++) {
+        const KeyType &lo = ranges[order[n]].first;
+        const KeyType &hi = ranges[order[n]].second;
+        auto &values = result[order[n]];
+        // 重复的 probe 不用再查一遍
+        if (n > 0 && comparator_(lo, ranges[order[n - 1]].first) == 0 &&
+            comparator_(hi, ranges[order[n - 1]].second) == 0) {
+            values = result[order[n - 1]];
+            continue;
         }
 
-        // 释放锁
-        UnlockUnpinPages(Operation::READONLY, transaction);
+        while (true) {
+            // 定位 lo 所在的叶子，重新下降的时候顺便得到 lo 的位置
+            int index = -1;
+            if (page != nullptr) {
+                auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+                bool reusable = comparator_(lo, low_key) >= 0;
+                if (reusable && leaf->NeedMoveRight(lo, comparator_)) {
+                    low_key = leaf->GetHighKey();
+                    page = LatchRightLeaf(page, epoch);
+                    reusable = page != nullptr &&
+                               !reinterpret_cast<LeafPage *>(page->GetData())->NeedMoveRight(lo, comparator_);
+                }
+                if (!reusable && page != nullptr) {
+                    page->RUnlatch();
+                    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+                    page = nullptr;
+                }
+            }
+            if (page == nullptr) {
+                epoch = merge_epoch_.load(std::memory_order_acquire);
+                page = FindLeafPageForRead(lo, index);
+                // 空树
+                if (page == nullptr) { return; }
+                low_key = lo;
+            }
 
-        if (transaction == nullptr)
-        {
-            auto page_id = leaf->GetPageId();
-            buffer_pool_manager_->FetchPage(page_id)->RUnlatch();
-            buffer_pool_manager_->UnpinPage(page_id, false);
+            // 从 lo 开始往右扫到 hi
+            auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+            if (index < 0) { index = leaf->KeyIndex(lo, comparator_); }
+            while (true) {
+                for (; index < leaf->GetKeySize() && comparator_(leaf->KeyAt(index), hi) <= 0; index++) {
+                    values.push_back(leaf->ValueAt(index));
+                }
+                // 右边叶子的 key 都不小于 high key
+                if (index < leaf->GetKeySize() || leaf->GetRightLink() == INVALID_PAGE_ID ||
+                    comparator_(hi, leaf->GetHighKey()) < 0) {
+                    break;
+                }
+                low_key = leaf->GetHighKey();
+                page = LatchRightLeaf(page, epoch);
+                if (page == nullptr) { break; }
+                leaf = reinterpret_cast<LeafPage *>(page->GetData());
+                index = 0;
+            }
+            if (page != nullptr) { break; }
+            // 扫描途中发生了合并，这个 probe 重新查
+            values.clear();
         }
     }
-    return ret;
+
+    if (page != nullptr) {
+        page->RUnlatch();
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+Page *BPlusTree<KeyType, ValueType, KeyComparator>::LatchRightLeaf(Page *page, uint64_t epoch)
+{
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    page_id_t right_page_id = leaf->GetRightLink();
+    // 先放掉当前叶子再锁右边的叶子，与迭代器的加锁顺序一致
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    if (right_page_id == INVALID_PAGE_ID) { return nullptr; }
+
+    auto *right = buffer_pool_manager_->FetchPage(right_page_id);
+    if (right == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while GetValues"); }
+    right->RLatch();
+    if (merge_epoch_.load(std::memory_order_acquire) != epoch) {
+        right->RUnlatch();
+        buffer_pool_manager_->UnpinPage(right_page_id, false);
+        return nullptr;
+    }
+    return right;
 }
 
 /*****************************************************************************
@@ -109,23 +225,224 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 bool BPlusTree<KeyType, ValueType, KeyComparator>::Insert(
     const KeyType &key, const ValueType &value, Transaction *transaction)
 {
-    // 互斥锁, 如果想要在一个函数中的一部分采用锁，则可以采用中括号用来作为作用域
+    // 自增 id、时间戳这样的 key 总是落在最右的叶子上，先试一下缓存的最右叶子
+    if (InsertRightmost(key, value)) { return true; }
+
+    // 乐观路径：不加锁下降到叶子，只对叶子加写锁，叶子不会分裂的话直接在叶子上完成
+    while (!IsEmpty())
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        // 如果树为空就新建一棵树
-        if (IsEmpty()) {
-            // 秩=3, insert 1,2,3,4,5 的例子，insert 1 走这里
-            StartNewTree(key, value); // 一定是 insert 到 page 节点中的
+        auto *page = FindLeafPageOptimistic(key, false, Operation::INSERT);
+        if (page == nullptr) { break; }
+
+        auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+        CacheRightmostLeaf(leaf);
+        ValueType v;
+        if (leaf->Lookup(key, v, comparator_)) {
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+            return false;
+        }
+        // 新 key 可能让叶子的公共前后缀变短，所以要带着 key 判断
+        if (leaf->IsSafeToInsert(key)) {
+            leaf->Insert(key, value, comparator_);
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
             return true;
         }
+        // 需要分裂，放掉叶子走悲观路径
+        page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        break;
+    }
+
+    // 互斥锁, 结构修改（分裂、新建树）在 mutex_ 下串行执行
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 如果树为空就新建一棵树
+    if (IsEmpty()) {
+        // 秩=3, insert 1,2,3,4,5 的例子，insert 1 走这里
+        StartNewTree(key, value); // 一定是 insert 到 page 节点中的
+        return true;
     }
 
     /**
-     * @brief 离开上面的{}范围之后lock就会释放
-     * 插入操作一定是在叶子节点插入的
+     * @brief 插入操作一定是在叶子节点插入的
      * 秩=3, insert 1,2,3,4,5 的例子，insert 2,3,4,5 都会走到这里
+     * 悲观路径需要用 page set 记录加过锁的页面
      */
-    return InsertIntoLeaf(key, value, transaction);
+    Transaction scratch(INVALID_TXN_ID);
+    return InsertIntoLeaf(key, value, transaction == nullptr ? &scratch : transaction);
+}
+
+/*
+ * 缓存的最右叶子写锁住之后检查：
+ *  1. merge_epoch_ 和缓存时一样，期间没有合并、没有搬迁叶子，它还在树里（页号不会重新分配，旧页号总能 fetch，见 ReclaimLeaf）
+ *  2. right link 还是空的，没有被分裂过，它仍然是最右的叶子，high key 是 +inf
+ *  3. key 比叶子里最大的 key 还大：最右叶子的范围是 [它的 low key, +inf)，key 一定属于它，而且不可能是重复的
+ *  4. 插进去不用分裂；要分裂的话交给悲观路径去做 90/10 分裂
+ * fetch 之前先比一次 epoch，缓存已经过时就不用去 fetch、去抢写锁；
+ * 锁住之后再检查一次，和 FindLeafPageOptimistic 一样：之后开始的合并要动这个叶子就得等我们放锁
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::InsertRightmost(const KeyType &key, const ValueType &value)
+{
+    uint64_t cached = rightmost_leaf_.load(std::memory_order_acquire);
+    auto page_id = static_cast<page_id_t>(static_cast<uint32_t>(cached >> 32));
+    auto epoch_matches = [this, cached]() {
+        return static_cast<uint32_t>(merge_epoch_.load(std::memory_order_acquire)) == static_cast<uint32_t>(cached);
+    };
+    if (page_id == INVALID_PAGE_ID || !epoch_matches()) { return false; }
+
+    auto *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr) { return false; }
+    page->WLatch();
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    bool append = epoch_matches() && leaf->IsLeafPage() && leaf->GetRightLink() == INVALID_PAGE_ID &&
+                  leaf->GetKeySize() > 0 && comparator_(key, leaf->KeyAt(leaf->GetKeySize() - 1)) > 0 && leaf->IsSafeToInsert(key);
+    if (append) { leaf->Insert(key, value, comparator_); }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, append);
+    return append;
+}
+
+/*
+ * epoch 是奇数说明有合并正在进行，这时候不缓存
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::CacheRightmostLeaf(
+    BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf)
+{
+    if (leaf->GetRightLink() != INVALID_PAGE_ID) { return; }
+    uint64_t epoch = merge_epoch_.load(std::memory_order_acquire);
+    if ((epoch & 1) != 0) { return; }
+    uint64_t cached = (static_cast<uint64_t>(static_cast<uint32_t>(leaf->GetPageId())) << 32) |
+                      static_cast<uint32_t>(epoch);
+    if (rightmost_leaf_.load(std::memory_order_relaxed) != cached) {
+        rightmost_leaf_.store(cached, std::memory_order_release);
+    }
+}
+
+/*****************************************************************************
+ * BULK LOAD
+ *****************************************************************************/
+/*
+ * 一层 n 个 kv 平均分到若干个节点里，每个节点最多 fill 个
+ * 平均分配比"前面塞满、最后一个剩多少算多少"好，不会留下一个不满足最小值的尾巴节点
+ */
+static std::vector<int> PlanLevel(int n, int fill)
+{
+    int count = (n + fill - 1) / fill;
+    std::vector<int> sizes(count, n / count);
+    for (int i = 0; i < n % count; ++i) { ++sizes[i]; }
+    return sizes;
+}
+
+/*
+ * 按填充率算每个节点放多少个
+ * 平均分配之后每个节点至少有 (fill+1)/2 个，所以 fill 不能低于 2*min-1，否则会出现不满足最小值的节点
+ */
+static int BulkLoadFill(int max_size, int min_size, double fill_factor)
+{
+    int fill = static_cast<int>(max_size * fill_factor);
+    return std::min(max_size, std::max(fill, 2 * min_size - 1));
+}
+
+/*
+ * Build the tree bottom-up from key/value pairs.
+ * 逐个 Insert 每次都要从 root 下降，而且分裂出来的节点只有半满
+ * 这里先把 kv 排好序，直接按填充率填满叶子，再一层一层往上建中间节点，每个页面只写一次
+ * @return: false if the tree is not empty
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::BulkLoad(
+    std::vector<MappingType> &items, double fill_factor)
+{
+    using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
+    using InternalPage = BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>;
+
+    if (fill_factor <= 0 || fill_factor > 1) {
+        throw Exception(EXCEPTION_TYPE_OUT_OF_RANGE, "fill factor of bulk load must be in (0, 1]");
+    }
+
+    // 和 StartNewTree 一样在 mutex_ 下进行，root 建好之前乐观的读者只会看到空树
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!IsEmpty()) { return false; }
+    if (items.empty()) { return true; }
+
+    auto less = [this](const MappingType &a, const MappingType &b) { return comparator_(a.first, b.first) < 0; };
+    auto equal = [this](const MappingType &a, const MappingType &b) { return comparator_(a.first, b.first) == 0; };
+    if (!std::is_sorted(items.begin(), items.end(), less)) {
+        std::stable_sort(items.begin(), items.end(), less);
+    }
+    items.erase(std::unique(items.begin(), items.end(), equal), items.end());
+
+    // 用一个不落盘的页面探一下叶子和中间节点的阶，阶可能是 SetOrder 指定的
+    std::vector<char> scratch(PAGE_SIZE);
+    auto *leaf_probe = reinterpret_cast<LeafPage *>(scratch.data());
+    leaf_probe->Init(INVALID_PAGE_ID);
+    ReSetPageOrder(leaf_probe);
+    int leaf_fill = BulkLoadFill(leaf_probe->GetMaxKeySize(), leaf_probe->GetMinKeySize(), fill_factor);
+
+    auto *internal_probe = reinterpret_cast<InternalPage *>(scratch.data());
+    internal_probe->Init(INVALID_PAGE_ID);
+    ReSetPageOrder(internal_probe);
+    // 中间节点至少要两个孩子，不然层数降不下来
+    int internal_fill = std::max(2, BulkLoadFill(
+        internal_probe->GetMaxValueSize(), internal_probe->GetMinValueSize(), fill_factor));
+
+    // 先算出树高，root 的层是 1，叶子在最下面
+    int height = 1;
+    for (int n = (items.size() + leaf_fill - 1) / leaf_fill; n > 1; n = (n + internal_fill - 1) / internal_fill) {
+        ++height;
+    }
+
+    auto level = BulkLoadLevel<LeafPage>(items, leaf_fill, height);
+    while (level.size() > 1) {
+        level = BulkLoadLevel<InternalPage>(level, internal_fill, --height);
+    }
+    assert(height == 1);
+
+    // 整棵树都建好了才发布 root
+    root_page_id_ = level[0].second;
+    UpdateRootPageId(true);
+    return true;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+template <typename N, typename Item>
+std::vector<std::pair<KeyType, page_id_t>>
+BPlusTree<KeyType, ValueType, KeyComparator>::BulkLoadLevel(
+    const std::vector<Item> &items, int fill, int layer)
+{
+    std::vector<std::pair<KeyType, page_id_t>> parents;
+    N *prev = nullptr;
+    size_t offset = 0;
+
+    for (int size : PlanLevel(items.size(), fill))
+    {
+        page_id_t page_id;
+        auto *page = buffer_pool_manager_->NewPage(page_id);
+        if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while BulkLoad"); }
+
+        auto *node = reinterpret_cast<N *>(page->GetData());
+        node->Init(page_id, INVALID_PAGE_ID);
+        ReSetPageOrder(node);
+        node->SetLayerId(layer);
+        // 中间节点的 array[0].first 就是它的 low key，和 Split 之后的样子一致
+        node->CopyNFrom(&items[offset], size, buffer_pool_manager_);
+
+        // B-link: 前一个节点的 right link 指向自己，high key 就是自己的 low key
+        if (prev != nullptr) {
+            prev->SetRightLink(page_id);
+            prev->SetHighKey(items[offset].first);
+            buffer_pool_manager_->UnpinPage(prev->GetPageId(), true);
+        }
+        parents.emplace_back(items[offset].first, page_id);
+        prev = node;
+        offset += size;
+    }
+
+    buffer_pool_manager_->UnpinPage(prev->GetPageId(), true);
+    return parents;
 }
 
 /*
@@ -146,7 +463,8 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::StartNewTree(
      * 就目前看来，数据库的内容与index是位于同一个文件
      * 在 page 这个粒度上，DBMS 并没有去 care 这些内容在磁盘上是否要顺序存放
      */
-    auto *page = buffer_pool_manager_->NewPage(root_page_id_);
+    page_id_t root_page_id;
+    auto *page = buffer_pool_manager_->NewPage(root_page_id);
     if (page == nullptr) {
         throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while StartNewTree"); 
     }
@@ -158,11 +476,10 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::StartNewTree(
      * header page 是用来存放表或索引的元数据的
      * 所以在创建表或创建index的过程中，同样需要在 page header page 中注册自己的元数据
      */
-    UpdateRootPageId(true);
     // b+tree 的node节点是内存中的一个page，除了kv之外还有一些元数据被保存在 page 首部
     // 初始化 size=0，但是 maxsize 就是所有能够容纳kv的数量
     // 在 init 之后再 set 一下 maxsize 作为B+ tree 的秩，方便测试的，key的数量是要小于秩的
-    root->Init(root_page_id_, INVALID_PAGE_ID);  // parent id 是 -1 代表的是 root 节点
+    root->Init(root_page_id, INVALID_PAGE_ID);  // parent id 是 -1 代表的是 root 节点
     // reset, if show debug is not defined, the func is a empty func
     // 规则也保证了 b+tree 的阶数至少是2
     ReSetPageOrder(root);
@@ -174,6 +491,10 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::StartNewTree(
      */
     root->Insert(key, value, comparator_);
 
+    // 节点初始化完了才能让乐观的读者看到新的 root
+    root_page_id_ = root_page_id;
+    UpdateRootPageId(true);
+
     // unpin 是为了支持多线程并发的
     buffer_pool_manager_->UnpinPage(root->GetPageId(), true);
 }
@@ -196,16 +517,36 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
     // 先找到正确的叶子节点，在这个过程中，什么都不需要care，只要找到即可，最次就是在最左边或最右边
     // 找到之后检查能够正常的 insert，这里找到的一定是叶子节点
     // 要确定这里 insert 的目标是叶子节点，所以不存在 kv 错位的问题
+    // 悲观插入只对叶子加锁，分裂时各层节点在 InsertIntoParent 里逐层加锁、逐层释放
     auto *leaf = FindLeafPage(key, false, Operation::INSERT, transaction);
     if (leaf == nullptr) { return false; }
 
     ValueType v;
     // 不支持重复 key，意味着一个域中的 属性不能有相同值，所以一般都是针对 primary key 去建立 index
     if (leaf->Lookup(key, v, comparator_)) {
-        UnlockUnpinPages(Operation::INSERT, transaction);
+        WUnlatchNode(leaf);
+        buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
         return false;
     }
 
+    // 最右的叶子并且 key 追加在最后：单调递增的写入，分裂出去的左边不会再被写，
+    // 对半分的话它永远只有半满，所以只把尾巴上的一小部分分给新叶子
+    bool append = leaf->GetRightLink() == INVALID_PAGE_ID && leaf->GetKeySize() >= 2 &&
+                  comparator_(key, leaf->KeyAt(leaf->GetKeySize() - 1)) > 0;
+
+    // 叶子是前后缀压缩存放的，新 key 让 slot 变宽之后物理上可能放不下了
+    // 这时候先分裂，再把 key 插到它该去的那一半，两半都只有秩的一半左右，一定放得下
+    // （追加的时候 key 去的是只分到一小部分的新叶子，同样放得下）
+    if (!leaf->CanHold(key)) {
+        auto *leaf2 = Split<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>>(
+            leaf, append ? RightmostSplitCount(leaf->GetKeySize()) : 0);
+        auto *target = comparator_(key, leaf2->KeyAt(0)) < 0 ? leaf : leaf2;
+        target->Insert(key, value, comparator_);
+        InsertIntoParent(leaf, leaf2->KeyAt(0), leaf2, transaction);
+        buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+        return true;
+    }
+
     // 这个 insert 操作有可能使得叶子结点的key的数量超过 秩-1，即达到 秩
     // 二话不说先 insert
     leaf->Insert(key, value, comparator_);
@@ -220,8 +561,9 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
      *      再触发 root 节点的分裂，将形成新的 root 节点
      *      目前就是 5 的 insert 有问题
      */
-    if (leaf->GetKeySize() >= leaf->GetOrder()) {
-        assert(leaf->GetKeySize()==leaf->GetOrder());  // 只允许大一个之后就需要 split 了
+    // 没有压缩时 GetSplitSize() 就是秩；压缩之后 frame 可能刚被新 key 撑宽，key 的数量会比阈值多几个
+    if (leaf->GetKeySize() >= leaf->GetSplitSize()) {
+        assert(leaf->GetKeySize() <= leaf->GetKeyCapacity());
         /**
          * @brief 如果一个叶子节点的空间不够了，大于等于秩之后，意味着需要分直接裂叶子节点
          * 测试学习的秩 =3
@@ -245,7 +587,8 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
          * 最终还是实现了先 insert 再 split 的策略，如果无法平均分配，即节点的秩为奇数，那么后半段容纳多的那部分
          * 这里实现的是叶子节点的分裂
          */
-        auto *leaf2 = Split<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>>(leaf);
+        auto *leaf2 = Split<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>>(
+            leaf, append ? RightmostSplitCount(leaf->GetKeySize()) : 0);
 
         // /**
         //  * @brief 在分裂一半的基础上+1基本是不可能超出范围的，这个写法不是很好，之后修改掉
@@ -260,9 +603,7 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
 
         // std::cout << "left is " << leaf->KeyAt(0) << "right is " << leaf2->KeyAt(0) << std::endl;
         assert(comparator_(leaf->KeyAt(0), leaf2->KeyAt(0)) < 0);  // 新节点总是后面的那个
-        // 叶子结点生成之后，立刻成 list
-        leaf2->SetNextPageId(leaf->GetNextPageId());
-        leaf->SetNextPageId(leaf2->GetPageId());
+        // 叶子结点生成之后，立刻成 list（在 Split 里面通过 right link 完成）
 
         // // 更新前后关系
         // if (comparator_(leaf->KeyAt(0), leaf2->KeyAt(0)) < 0)
@@ -277,10 +618,13 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
 
         // 将分裂的节点插入到父节点, 这里是有可能导致父节点分裂的，如果父节点分裂，则继续向上传递
         // 大于等于在右边，所以应该将新分裂及节点最左侧的 key 向上推
+        // InsertIntoParent 负责放掉 leaf 的锁
         InsertIntoParent(leaf, leaf2->KeyAt(0), leaf2, transaction);
+    } else {
+        WUnlatchNode(leaf);
     }
 
-    UnlockUnpinPages(Operation::INSERT, transaction);
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
     return true;
 }
 
@@ -296,9 +640,26 @@ BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoLeaf(
  *      对于叶子节点，新的 kv 已经 insert 了，即节点中 key 的数量已经达到了秩
  *      对于中间节点，新的 kv 也已经 insert 了。即节点中的 v 的数量已经超过了秩，k 的数量也达到了 秩
  */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+static void MoveToNewNode(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *node,
+                          BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *new_node,
+                          int move_count, BufferPoolManager *buffer_pool_manager)
+{
+    if (move_count > 0) { node->MoveTailTo(new_node, move_count, buffer_pool_manager); }
+    else { node->MoveHalfTo(new_node, buffer_pool_manager); }
+}
+
+template <typename KeyType, typename KeyComparator>
+static void MoveToNewNode(BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *node,
+                          BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *new_node,
+                          int /* move_count */, BufferPoolManager *buffer_pool_manager)
+{
+    node->MoveHalfTo(new_node, buffer_pool_manager);
+}
+
 template <typename KeyType, typename ValueType, typename KeyComparator>
 template <typename N>
-N *BPlusTree<KeyType, ValueType, KeyComparator>::Split(N *node)
+N *BPlusTree<KeyType, ValueType, KeyComparator>::Split(N *node, int move_count)
 {
     page_id_t page_id;
     // 新创建 page 的过程实际上是磁盘文件++的过程，之前有说过，创建 index 与创建 table 是一样的，它们都是磁盘上的文件
@@ -307,12 +668,23 @@ N *BPlusTree<KeyType, ValueType, KeyComparator>::Split(N *node)
 
     auto new_node = reinterpret_cast<N *>(page->GetData());
     /* N可能是叶子节点也可能是中间节点，叶子节点与中间节点都有自己的init方法 */
-    new_node->Init(page_id);
+    new_node->Init(page_id, node->GetParentPageId());
     // reset order
     ReSetPageOrder(new_node);
 
-    /* 被分裂节点的 move half to 方法 */
-    node->MoveHalfTo(new_node, buffer_pool_manager_);
+    /* 被分裂节点的 move half to 方法，最右叶子的追加分裂只搬走 move_count 个 */
+    MoveToNewNode(node, new_node, move_count, buffer_pool_manager_);
+    split_count_++;
+
+    /**
+     * @brief B-link: 新节点接管原节点的 right link 和 high key，原节点的 high key 变成新节点的第一个 key
+     * 原节点一放锁，落在原节点上的读者就能顺着 right link 找到新节点，不需要等父节点更新
+     * 叶子节点的 right link 就是 next page id，所以叶子在这里就已经成 list 了
+     */
+    new_node->SetRightLink(node->GetRightLink());
+    new_node->SetHighKey(node->GetHighKey());
+    node->SetRightLink(page_id);
+    node->SetHighKey(new_node->KeyAt(0));
     return new_node;
 }
 
@@ -342,34 +714,42 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoParent(
      */
     if (old_node->IsRootPage()) {
         // root节点的分裂，copy L2 中的第一个key到新的root节点
-        auto *page = buffer_pool_manager_->NewPage(root_page_id_);
+        page_id_t root_page_id;
+        auto *page = buffer_pool_manager_->NewPage(root_page_id);
         if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while InsertIntoParent"); }
 
         assert(page->GetPinCount() == 1);
         auto root = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(page->GetData());
 
-        root->Init(root_page_id_);
+        root->Init(root_page_id);
         ReSetPageOrder(root);  // reset b+ tree 的秩，树的 秩 会set到 new node 上
         root->SetLayerId(1);  // 这是新的 root 节点
 
         // 这里就相当于将 L2 的第一个 key 推到上一层，但是上一层是root，新推的key也是 root 的第一个 key
         root->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
-        old_node->SetParentPageId(root_page_id_);
-        new_node->SetParentPageId(root_page_id_);
+        old_node->SetParentPageId(root_page_id);
+        new_node->SetParentPageId(root_page_id);
         
         // 这两个节点要向下走一层，即层数+1
         old_node->SetLayerId(old_node->GetLayerId()+1);
         new_node->SetLayerId(new_node->GetLayerId()+1);
 
-        // 这时需要更新根节点页面id
+        // 这时需要更新根节点页面id，新 root 填好之后才发布出去
+        root_page_id_ = root_page_id;
         UpdateRootPageId(false);
+        WUnlatchNode(old_node);
         // 这一次分裂搞出两个new page来，极具的扩展了B+tree
         buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
         buffer_pool_manager_->UnpinPage(root->GetPageId(), true);
     } else {
+        // B-link: old_node 已经分裂完整了（right link 和 high key 都设置好了），在改父节点之前就放掉它的锁
+        // 这段时间里落在 old_node 上的读者顺着 right link 就能找到 new_node，不用等父节点更新
+        WUnlatchNode(old_node);
+
         // 新增元素的父节点是 非root 节点的中间节点，有可能递归的向上传递，并且可能最终导致 b+tree 整体层数+1
         auto *page = buffer_pool_manager_->FetchPage(old_node->GetParentPageId());
         if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while InsertIntoParent"); }
+        page->WLatch();
 
         // internal是 L与L2 原本的父节点
         auto internal = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(page->GetData());
@@ -432,7 +812,10 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::InsertIntoParent(
             // internal2 的第一个 kv 对的 k 需要继续向上 insert，internal2->KeyAt(0) 是无效的
             // 这里 internal2->KeyAt(0) 就是3了，要形成一个新的 root 节点
             InsertIntoParent(internal, internal2->KeyAt(0), internal2, transaction);
-        } else { new_node->SetParentPageId(internal->GetPageId()); }
+        } else {
+            new_node->SetParentPageId(internal->GetPageId());
+            page->WUnlatch();
+        }
 
         buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
         buffer_pool_manager_->UnpinPage(internal->GetPageId(), true);
@@ -537,9 +920,39 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 void BPlusTree<KeyType, ValueType, KeyComparator>::Remove(
     const KeyType &key, Transaction *transaction)
 {
+    deletes_since_compaction_++;
+    // 乐观路径：叶子删除之后不会下溢的话只对叶子加写锁
+    while (true)
+    {
+        auto *page = FindLeafPageOptimistic(key, false, Operation::DELETE);
+        if (page == nullptr) { return; }
+
+        auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+        ValueType v;
+        if (!leaf->Lookup(key, v, comparator_)) {
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+            return;
+        }
+        if (isSafe(leaf, Operation::DELETE)) {
+            leaf->RemoveAndDeleteRecord(key, comparator_);
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+            return;
+        }
+        page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        break;
+    }
+
+    // 需要合并或者重分配，在 mutex_ 下走悲观路径
+    std::lock_guard<std::mutex> lock(mutex_);
     if (IsEmpty()) { return; }
+    Transaction scratch(INVALID_TXN_ID);
+    if (transaction == nullptr) { transaction = &scratch; }
 
-    // std::printf("start remove\n");
+    // 合并和重分配会把 key 往左边搬，right link 兜不住，期间 merge_epoch_ 是奇数，乐观的下降需要重来
+    merge_epoch_.fetch_add(1);
 
     // 先找到要删除的key所在的叶子节点
     auto *leaf = FindLeafPage(key, false, Operation::DELETE, transaction);
@@ -557,6 +970,7 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::Remove(
         // 下面这个操作会清理 buffer pool manager 的缓存，最后导致出错，写并发的时候再考虑这里
         UnlockUnpinPages(Operation::DELETE, transaction);
     }
+    merge_epoch_.fetch_add(1);
 }
 
 /**
@@ -581,13 +995,13 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::_CoalesceOrRedistribute(
 {
     if (sibling->IsLeafPage()){
         auto _sibling = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(sibling);
-        if (_sibling->GetKeySize()-1 >= _sibling->GetMinKeySize()) {
+        if (_sibling->GetKeySize()-1 >= MinSize(_sibling)) {
             buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
             return true;
         } else { return false; }
     } else {
         auto _sibling = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(sibling);
-        if (_sibling->GetValueSize()-1 >= _sibling->GetMinValueSize()) {
+        if (_sibling->GetValueSize()-1 >= MinSize(_sibling)) {
             buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
             return true;
         } else { return false; }
@@ -633,10 +1047,10 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::CoalesceOrRedistribute(
     // 删除完一个kv之后，b+tree 的规则并没有被破坏
     if (node->IsLeafPage()) {
         auto _node = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
-        if (_node->GetKeySize() >= _node->GetMinKeySize()) { return false; }
+        if (_node->GetKeySize() >= MinSize(_node)) { return false; }
     } else {
         auto _node = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
-        if (_node->GetValueSize() >= _node->GetMinValueSize()) { return false; }
+        if (_node->GetValueSize() >= MinSize(_node)) { return false; }
     }
 
     // std::printf("leaf node is ok\n");
@@ -746,8 +1160,9 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::CoalesceOrRedistribute(
         auto *siblingpage = buffer_pool_manager_->FetchPage(left_sibling_page_id);
         if (siblingpage == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CoalesceOrRedistribute"); }
 
-        // siblingpage->WLatch();
-        // transaction->AddIntoPageSet(siblingpage);
+        // 兄弟节点也会被修改，同样要加写锁，释放交给 UnlockUnpinPages
+        siblingpage->WLatch();
+        transaction->AddIntoPageSet(siblingpage);
 
         auto sibling = reinterpret_cast<N *>(siblingpage->GetData());
         if (_CoalesceOrRedistribute(sibling, parent)) {
@@ -757,12 +1172,13 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::CoalesceOrRedistribute(
             // move from neighbor to node
             // indx=0 means neighbor's first, otherwise neighbor's last
             Redistribute<N>(sibling, node, 1);  // sibling is left neighbor, move last
-            // siblingpage->WUnlatch();
             return true;
         }
 
         auto _siblingpage = buffer_pool_manager_->FetchPage(right_sibling_page_id);
         if (_siblingpage == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CoalesceOrRedistribute"); }
+        _siblingpage->WLatch();
+        transaction->AddIntoPageSet(_siblingpage);
 
         auto _sibling = reinterpret_cast<N *>(_siblingpage->GetData());
         // 再尝试 右边是否可以 no merge
@@ -781,6 +1197,8 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::CoalesceOrRedistribute(
             // only left sibling
             auto *siblingpage = buffer_pool_manager_->FetchPage(left_sibling_page_id);
             if (siblingpage == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CoalesceOrRedistribute"); }
+            siblingpage->WLatch();
+            transaction->AddIntoPageSet(siblingpage);
             auto sibling = reinterpret_cast<N *>(siblingpage->GetData());
             if (_CoalesceOrRedistribute(sibling, parent)){
                 Redistribute<N>(sibling, node, 1);  // move sibling's last to the head of node
@@ -794,6 +1212,8 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::CoalesceOrRedistribute(
             // 然后保留 node
             auto *siblingpage = buffer_pool_manager_->FetchPage(right_sibling_page_id);
             if (siblingpage == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CoalesceOrRedistribute"); }
+            siblingpage->WLatch();
+            transaction->AddIntoPageSet(siblingpage);
             auto sibling = reinterpret_cast<N *>(siblingpage->GetData());
             if (_CoalesceOrRedistribute(sibling, parent)){
                 Redistribute<N>(sibling, node, 0);  // move sibling's first to the end of node
@@ -909,6 +1329,10 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::Coalesce(
     // 无论向左合并还是向右合并，被合并掉的node在父节点中对应的index均直接删除即可
     // 这里有一个比较重要的思考，确实无需调整被合并的page在父节点中对应的kv对的值，是直接合规的
     node->MoveAllTo(neighbor_node, index, buffer_pool_manager_);
+    merge_count_++;
+    // B-link: 合并后的节点接管被合并节点的 right link 和 high key
+    neighbor_node->SetRightLink(node->GetRightLink());
+    neighbor_node->SetHighKey(node->GetHighKey());
     parent->Remove(index);  // 所以这个 remove 方法一定只有中间节点才有的，只是一个简单的 remove
     // buffer_pool_manager_->DeletePage(node->GetPageId());
 
@@ -935,21 +1359,29 @@ template <typename N>
 void BPlusTree<KeyType, ValueType, KeyComparator>::Redistribute(N *neighbor_node, N *node, int index)
 {
     // 由节点 neighbor_node 拿一个 kv 给到 node, 对于 neighbor_node 来说，不是第一个就是最后一个，只有这两种情况
-    if (index == 0) {
-        // 选择的是右边的兄弟，兄弟的第一个来自己 node 做最后一个
-        // neighbor_node's first to node， 对应父节点中的 kv 对也要一起 update
-        neighbor_node->MoveFirstToEndOf(node, buffer_pool_manager_);
-    } else {
-        // 选择的是最左边的兄弟，最左边兄弟的最大值来自己这里做第一个
-        // neighbor_node's last to node
-        auto *page = buffer_pool_manager_->FetchPage(node->GetParentPageId());
-        if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Redistribute"); }
-        auto parent = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(page->GetData());
-        int idx = parent->ValueIndex(node->GetPageId());
-        buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
-
-        neighbor_node->MoveLastToFrontOf(node, idx, buffer_pool_manager_);
-    }
+    auto *page = buffer_pool_manager_->FetchPage(node->GetParentPageId());
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Redistribute"); }
+    auto parent = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(page->GetData());
+    // 删除引起的下溢只差一个，搬一次就够；Compact 按半满的标准补的时候可能要搬好几个
+    do {
+        if (index == 0) {
+            // 选择的是右边的兄弟，兄弟的第一个来自己 node 做最后一个
+            // neighbor_node's first to node， 对应父节点中的 kv 对也要一起 update
+            neighbor_node->MoveFirstToEndOf(node, buffer_pool_manager_);
+        } else {
+            // 选择的是最左边的兄弟，最左边兄弟的最大值来自己这里做第一个
+            // neighbor_node's last to node
+            int idx = parent->ValueIndex(node->GetPageId());
+            neighbor_node->MoveLastToFrontOf(node, idx, buffer_pool_manager_);
+        }
+    } while (NodeSize(node) < MinSize(node) && NodeSize(neighbor_node) - 1 >= MinSize(neighbor_node));
+    redistribute_count_++;
+
+    // B-link: 左边节点的 high key 就是父节点里两者之间的分隔 key
+    N *left = index == 0 ? node : neighbor_node;
+    N *right = index == 0 ? neighbor_node : node;
+    left->SetHighKey(parent->KeyAt(parent->ValueIndex(right->GetPageId())));
+    buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
 }
 
 /*
@@ -1005,6 +1437,435 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::AdjustRoot(
     return false;
 }
 
+/*****************************************************************************
+ * COMPACTION
+ *****************************************************************************/
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::SetMergeThreshold(int divisor)
+{
+    // 两个都低于 1/divisor 的兄弟合并之后一定放得下
+    if (divisor < BPLUSTREE_MERGE_THRESHOLD) { throw Exception(EXCEPTION_TYPE_INDEX, "merge threshold must be at most half full"); }
+    merge_divisor_ = divisor;
+}
+
+/*
+ * 1. 读锁沿叶子链表走一遍，记下不到半满的叶子的第一个 key，期间发生过合并就只处理已经找到的
+ * 2. 每个叶子像 Remove 的悲观路径一样：mutex_ 下 merge_epoch_ 变成奇数，从 root 加写锁下来，
+ *    这时按半满判断安全与否，不到半满的节点的父节点会一直锁着，然后合并或者重分配
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTree<KeyType, ValueType, KeyComparator>::Compact(Transaction *transaction)
+{
+    std::vector<KeyType> sparse;
+    uint64_t epoch = merge_epoch_.load(std::memory_order_acquire);
+    if ((epoch & 1) != 0) { return 0; }
+    auto *page = FindLeafPageOptimistic(KeyType{}, true, Operation::READONLY);
+    while (page != nullptr) {
+        auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+        if (!leaf->IsRootPage() && leaf->GetKeySize() > 0 && leaf->GetKeySize() < leaf->GetMinKeySize()) {
+            sparse.push_back(leaf->KeyAt(0));
+        }
+        page = LatchRightLeaf(page, epoch);
+    }
+
+    Transaction scratch(INVALID_TXN_ID);
+    if (transaction == nullptr) { transaction = &scratch; }
+    int rebalanced = 0;
+    for (auto &key : sparse) {
+        // 和同样稀疏的兄弟合并之后可能还是不到半满，接着处理同一个 key 所在的叶子
+        for (bool sparse_leaf = true; sparse_leaf;) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (IsEmpty()) { break; }
+            merge_epoch_.fetch_add(1);
+            compacting_ = true;
+            auto *leaf = FindLeafPage(key, false, Operation::DELETE, transaction);
+            // 前面的合并可能已经把它补满了
+            sparse_leaf = leaf != nullptr && !leaf->IsRootPage() && leaf->GetKeySize() < MinSize(leaf);
+            if (sparse_leaf) {
+                CoalesceOrRedistribute(leaf, transaction);
+                rebalanced++;
+            }
+            if (leaf != nullptr) { UnlockUnpinPages(Operation::DELETE, transaction); }
+            compacting_ = false;
+            merge_epoch_.fetch_add(1);
+        }
+    }
+    return rebalanced;
+}
+
+/*
+ * 沿叶子链表数一遍，期间发生合并的话数出来的会少，测试用
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTree<KeyType, ValueType, KeyComparator>::GetLeafCount()
+{
+    int count = 0;
+    uint64_t epoch = merge_epoch_.load(std::memory_order_acquire);
+    auto *page = FindLeafPageOptimistic(KeyType{}, true, Operation::READONLY);
+    for (; page != nullptr; page = LatchRightLeaf(page, epoch)) { count++; }
+    return count;
+}
+
+/*
+ * 后台线程自己的 Compact 失败（比如 buffer pool 暂时被占满）就等下一轮
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::StartBackgroundCompaction(std::chrono::milliseconds interval)
+{
+    StopBackgroundCompaction();
+    compaction_stop_ = false;
+    compaction_thread_ = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> lock(compaction_mutex_);
+        while (!compaction_cv_.wait_for(lock, interval, [this] { return compaction_stop_; })) {
+            size_t deletes = deletes_since_compaction_.exchange(0);
+            if (deletes == 0) { continue; }
+            lock.unlock();
+            try {
+                Compact();
+            } catch (Exception &) {
+                deletes_since_compaction_ += deletes;
+            }
+            lock.lock();
+        }
+    });
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::StopBackgroundCompaction()
+{
+    if (!compaction_thread_.joinable()) { return; }
+    {
+        std::lock_guard<std::mutex> lock(compaction_mutex_);
+        compaction_stop_ = true;
+    }
+    compaction_cv_.notify_all();
+    compaction_thread_.join();
+}
+
+/*****************************************************************************
+ * ADAPTIVE HASH INDEX
+ *****************************************************************************/
+/*
+ * 直接映射的哈希表，一个 slot 只放一个 key，不挂链表
+ * 分裂和合并不去找哈希表里指向自己的项，项在使用的时候校验，失效的在下一次正常下降之后重新记下位置
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::EnableAdaptiveHash(size_t capacity)
+{
+    hash_entries_.assign(capacity, HashEntry());
+    hash_latches_.reset(capacity == 0 ? nullptr : new std::mutex[BPLUSTREE_HASH_LATCHES]);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+size_t BPlusTree<KeyType, ValueType, KeyComparator>::HashSlot(const KeyType &key) const
+{
+    return BloomFilter::Hash(key.data, sizeof(key.data)) % hash_entries_.size();
+}
+
+/*
+ * 叶子读锁住之后：
+ *  1. merge_epoch_ 和记下位置时一样：期间没有合并、重分配、搬迁叶子，这个叶子还在树里，
+ *     它的下界也没变（只有合并和重分配会把 key 往左搬），key 当时不小于下界，现在也不小于
+ *  2. key 小于 high key：分裂把 key 搬到右边去了的话交给正常的下降
+ *  3. 页面版本号也一样：叶子没有被写过，slot 还是 lower bound（再比一下 slot 两边，frame 换过页面时版本号可能碰巧相等）；
+ *     否则在这个叶子里二分查找，由 1、2 结果还是对的，顺便更新位置
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+Page *BPlusTree<KeyType, ValueType, KeyComparator>::LookupAdaptiveHash(const KeyType &key, int &index)
+{
+    size_t slot = HashSlot(key);
+    HashEntry entry;
+    {
+        std::lock_guard<std::mutex> lock(hash_latches_[slot % BPLUSTREE_HASH_LATCHES]);
+        entry = hash_entries_[slot];
+    }
+    if (entry.page_id == INVALID_PAGE_ID || comparator_(entry.key, key) != 0) { return nullptr; }
+
+    auto *page = buffer_pool_manager_->FetchPage(entry.page_id);
+    if (page == nullptr) { return nullptr; }
+    page->RLatch();
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    if (merge_epoch_.load(std::memory_order_acquire) != entry.epoch || !leaf->IsLeafPage() ||
+        leaf->GetPageId() != entry.page_id || leaf->NeedMoveRight(key, comparator_)) {
+        page->RUnlatch();
+        buffer_pool_manager_->UnpinPage(entry.page_id, false);
+        hash_misses_++;
+        return nullptr;
+    }
+    int size = leaf->GetKeySize();
+    if (page->GetVersion() == entry.version && entry.slot <= size &&
+        (entry.slot == size || comparator_(leaf->KeyAt(entry.slot), key) >= 0) &&
+        (entry.slot == 0 || comparator_(leaf->KeyAt(entry.slot - 1), key) < 0)) {
+        index = entry.slot;
+    } else {
+        index = leaf->KeyIndex(key, comparator_);
+        RecordAdaptiveHash(key, page, index);
+    }
+    hash_hits_++;
+    return page;
+}
+
+/*
+ * slot 被别的 key 占着的时候，它的次数减一，减到 0 才让给新的 key，偶尔查一次的 key 挤不掉热点
+ * 次数到了 BPLUSTREE_HASH_HOT 就记下位置；merge_epoch_ 是奇数（合并进行中）的时候不记
+ * 不在树里的 key 也记：索引按 key 列查的时候下界带的 RID 是全 0，本来就不在树里，要的是它的 lower bound
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::RecordAdaptiveHash(const KeyType &key, Page *page, int slot)
+{
+    size_t hash_slot = HashSlot(key);
+    std::lock_guard<std::mutex> lock(hash_latches_[hash_slot % BPLUSTREE_HASH_LATCHES]);
+    auto &entry = hash_entries_[hash_slot];
+    if (entry.hits > 0 && comparator_(entry.key, key) != 0) {
+        entry.hits--;
+        return;
+    }
+    if (entry.hits == 0) {
+        entry.key = key;
+        entry.page_id = INVALID_PAGE_ID;
+    }
+    if (entry.hits < BPLUSTREE_HASH_HOT) { entry.hits++; }
+    if (entry.hits < BPLUSTREE_HASH_HOT) { return; }
+
+    uint64_t epoch = merge_epoch_.load(std::memory_order_acquire);
+    entry.page_id = (epoch & 1) == 0 ? page->GetPageId() : INVALID_PAGE_ID;
+    entry.slot = slot;
+    entry.version = page->GetVersion();
+    entry.epoch = epoch;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+Page *BPlusTree<KeyType, ValueType, KeyComparator>::FindLeafPageForRead(const KeyType &key, int &index)
+{
+    if (!hash_entries_.empty()) {
+        auto *page = LookupAdaptiveHash(key, index);
+        if (page != nullptr) { return page; }
+    }
+    auto *page = FindLeafPageOptimistic(key, false, Operation::READONLY);
+    if (page == nullptr) { return nullptr; }
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    index = leaf->KeyIndex(key, comparator_);
+    if (!hash_entries_.empty()) { RecordAdaptiveHash(key, page, index); }
+    return page;
+}
+
+/*****************************************************************************
+ * STATISTICS & DEFRAGMENT
+ *****************************************************************************/
+std::string BPlusTreeStats::ToString() const
+{
+    std::stringstream os;
+    os << "height=" << height << " pages=[";
+    for (size_t i = 0; i < layer_pages.size(); i++) { os << (i == 0 ? "" : ",") << layer_pages[i]; }
+    os << "] keys=" << keys << " fill=" << avg_fill_factor << "(min " << min_fill_factor << ")"
+       << " splits=" << splits << " merges=" << merges << " redistributions=" << redistributions
+       << " leaf_contiguity=" << leaf_contiguity << " hash_hits=" << hash_hits << " hash_misses=" << hash_misses;
+    return os.str();
+}
+
+/*
+ * 一层一层往下走，一次只 pin 一个页面
+ * 叶子层按父节点里 child 的顺序排下来就是叶子链表的顺序
+ * 页面里的 layer 号在 root 分裂时只改了两个孩子，更深的节点不准，这里按下降的深度算层
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+BPlusTreeStats BPlusTree<KeyType, ValueType, KeyComparator>::GetStatistics()
+{
+    BPlusTreeStats stats;
+    stats.splits = split_count_;
+    stats.hash_hits = hash_hits_;
+    stats.hash_misses = hash_misses_;
+    stats.merges = merge_count_;
+    stats.redistributions = redistribute_count_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (IsEmpty()) { return stats; }
+    std::vector<page_id_t> layer{root_page_id_}, next;
+    double fill_sum = 0;
+    int fill_count = 0;
+    stats.min_fill_factor = 1;
+    while (!layer.empty()) {
+        stats.layer_pages.push_back(static_cast<int>(layer.size()));
+        next.clear();
+        for (page_id_t page_id : layer) {
+            auto *page = buffer_pool_manager_->FetchPage(page_id);
+            if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while GetStatistics"); }
+            page->RLatch();
+            auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+            double fill;
+            if (node->IsLeafPage()) {
+                auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
+                stats.keys += leaf->GetKeySize();
+                fill = static_cast<double>(leaf->GetKeySize()) / leaf->GetMaxKeySize();
+            } else {
+                auto *internal = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+                for (int i = 0; i < internal->GetValueSize(); i++) { next.push_back(internal->ValueAt(i)); }
+                fill = static_cast<double>(internal->GetValueSize()) / internal->GetMaxValueSize();
+            }
+            // 只有一个 root 的时候就算 root 的
+            if (!node->IsRootPage() || node->IsLeafPage()) {
+                fill_sum += fill;
+                fill_count++;
+                stats.min_fill_factor = std::min(stats.min_fill_factor, fill);
+            }
+            page->RUnlatch();
+            buffer_pool_manager_->UnpinPage(page_id, false);
+        }
+        if (next.empty()) {
+            int adjacent = 0;
+            for (size_t i = 1; i < layer.size(); i++) { adjacent += layer[i] == layer[i - 1] + 1 ? 1 : 0; }
+            if (layer.size() > 1) { stats.leaf_contiguity = static_cast<double>(adjacent) / (layer.size() - 1); }
+        }
+        layer.swap(next);
+    }
+    stats.height = static_cast<int>(stats.layer_pages.size());
+    stats.avg_fill_factor = fill_sum / fill_count;
+    return stats;
+}
+
+/*
+ * 叶子按链表顺序一个一个地搬，新页面的页号是递增分配的，搬完之后链表在文件里就是连续的
+ * 每搬一个叶子拿一次 mutex_，merge_epoch_ 在这期间是奇数：乐观下降的读者会等一下重来，
+ * 已经锁住旧叶子的读者放锁之后重新检查 epoch 也会重来，所以旧页面不会再被写
+ * 分裂不改左边叶子的 right link 以外的东西，搬完的叶子分裂了就接着搬分出来的那个；
+ * 合并会改链表，发现 epoch 被别人动过就停下来，下次再搬剩下的
+ * 链表和父节点都改过去、epoch 也加过之后旧页面就没有入口了，见 ReclaimLeaf
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTree<KeyType, ValueType, KeyComparator>::Defragment(Transaction *transaction)
+{
+    Compact(transaction);
+    if (GetStatistics().leaf_contiguity == 1) { return 0; }
+
+    int moved = 0;
+    page_id_t left_page_id = INVALID_PAGE_ID;
+    uint64_t epoch = 0;
+    while (true) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (IsEmpty()) { break; }
+        page_id_t page_id;
+        if (left_page_id == INVALID_PAGE_ID) {
+            // 中间节点只在 mutex_ 下修改，不用加锁
+            page_id = root_page_id_;
+            while (true) {
+                auto *page = buffer_pool_manager_->FetchPage(page_id);
+                if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Defragment"); }
+                auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+                bool leaf = node->IsLeafPage();
+                if (!leaf) {
+                    page_id = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node)->ValueAt(0);
+                }
+                buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+                if (leaf) { break; }
+            }
+            // root 就是叶子，没有链表
+            if (page_id == root_page_id_) { break; }
+        } else {
+            if (merge_epoch_.load(std::memory_order_acquire) != epoch) { break; }
+            auto *page = buffer_pool_manager_->FetchPage(left_page_id);
+            if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Defragment"); }
+            page->RLatch();
+            page_id = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData())->GetRightLink();
+            page->RUnlatch();
+            buffer_pool_manager_->UnpinPage(left_page_id, false);
+            if (page_id == INVALID_PAGE_ID) { break; }
+        }
+
+        if (left_page_id != INVALID_PAGE_ID && page_id == left_page_id + 1) {
+            left_page_id = page_id;
+            continue;
+        }
+        merge_epoch_.fetch_add(1);
+        try {
+            left_page_id = RelocateLeaf(page_id, left_page_id);
+        } catch (Exception &) {
+            merge_epoch_.fetch_add(1);
+            throw;
+        }
+        merge_epoch_.fetch_add(1);
+        epoch = merge_epoch_.load(std::memory_order_acquire);
+        ReclaimLeaf(page_id);
+        moved++;
+    }
+    return moved;
+}
+
+/*
+ * 搬走的旧叶子从 buffer pool 里删掉，frame 留给别的页面
+ * 之前从父节点、right link、哈希索引或者最右叶子缓存里拿到旧页号的读者还可能去 fetch 它，
+ * 它们锁住页面之后都会先检查 merge_epoch_，发现变了就重来，不会用页面里的内容。
+ * 所以删之前先把叶子写回磁盘：页号不会被重新分配，之后再 fetch 读到的还是这个叶子，
+ * 乐观下降在加锁之前看到的也是一个叶子，不会把垃圾当成中间节点往下走。
+ * 这时候正好有读者 pin 着的话 DeletePage 失败，留给 LRU 正常换出
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::ReclaimLeaf(page_id_t page_id)
+{
+    buffer_pool_manager_->FlushPage(page_id);
+    buffer_pool_manager_->DeletePage(page_id);
+}
+
+/*
+ * 加锁顺序和迭代器一样从左往右：先左边的叶子再当前叶子，中间节点只有结构修改会加锁
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+page_id_t BPlusTree<KeyType, ValueType, KeyComparator>::RelocateLeaf(page_id_t page_id, page_id_t left_page_id)
+{
+    Page *left = nullptr;
+    if (left_page_id != INVALID_PAGE_ID) {
+        left = buffer_pool_manager_->FetchPage(left_page_id);
+        if (left == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while RelocateLeaf"); }
+        left->WLatch();
+    }
+    auto *page = buffer_pool_manager_->FetchPage(page_id);
+    page_id_t new_page_id = INVALID_PAGE_ID;
+    auto *new_page = page == nullptr ? nullptr : buffer_pool_manager_->NewPage(new_page_id);
+    if (new_page == nullptr) {
+        if (page != nullptr) { buffer_pool_manager_->UnpinPage(page_id, false); }
+        if (left != nullptr) {
+            left->WUnlatch();
+            buffer_pool_manager_->UnpinPage(left_page_id, false);
+        }
+        throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while RelocateLeaf");
+    }
+    page->WLatch();
+
+    memcpy(new_page->GetData(), page->GetData(), PAGE_SIZE);
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(new_page->GetData());
+    leaf->SetPageId(new_page_id);
+
+    auto *parent_page = buffer_pool_manager_->FetchPage(leaf->GetParentPageId());
+    if (parent_page == nullptr) {
+        // 还什么都没改：新页面删掉，两个叶子解锁 unpin
+        page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        buffer_pool_manager_->UnpinPage(new_page_id, false);
+        buffer_pool_manager_->DeletePage(new_page_id);
+        if (left != nullptr) {
+            left->WUnlatch();
+            buffer_pool_manager_->UnpinPage(left_page_id, false);
+        }
+        throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while RelocateLeaf");
+    }
+    parent_page->WLatch();
+    auto *parent = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(parent_page->GetData());
+    int index = parent->ValueIndex(page_id);
+    assert(index < parent->GetValueSize());
+    parent->SetValueAt(index, new_page_id);
+    parent_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), true);
+
+    if (left != nullptr) {
+        reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(left->GetData())->SetRightLink(new_page_id);
+        left->WUnlatch();
+        buffer_pool_manager_->UnpinPage(left_page_id, true);
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    buffer_pool_manager_->UnpinPage(new_page_id, true);
+    return new_page_id;
+}
+
 /*****************************************************************************
  * INDEX ITERATOR
  *****************************************************************************/
@@ -1025,18 +1886,14 @@ IndexIterator<KeyType, ValueType, KeyComparator> BPlusTree<KeyType, ValueType, K
         return IndexIterator<KeyType, ValueType, KeyComparator>(nullptr, 0, buffer_pool_manager_);
     }
 
-    auto node = reinterpret_cast<BPlusTreePage *>(buffer_pool_manager_->FetchPage(root_page_id_));
-    // 将某些函数修改成为了虚函数，有个模板类，类模板的相互派生关系，这个东西我还弄不清楚
-    while (!node->IsLeafPage()) {
-        // 不是叶子节点一定是中间节点
-        auto internode = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
-        page_id_t page_id = internode->ValueAt(0);
-        node = reinterpret_cast<BPlusTreePage *>(buffer_pool_manager_->FetchPage(page_id));
+    // 沿着最左边的孩子下降，拿到的叶子持有读锁，由迭代器负责释放
+    KeyType key{};
+    auto *page = FindLeafPageOptimistic(key, true, Operation::READONLY);
+    if (page == nullptr) {
+        return IndexIterator<KeyType, ValueType, KeyComparator>(nullptr, 0, buffer_pool_manager_);
     }
-
-    auto leafnode = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
-    KeyType key = leafnode->KeyAt(0);
-    return IndexIterator<KeyType, ValueType, KeyComparator>(FindLeafPage(key, false), 0, buffer_pool_manager_);
+    auto leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    return IndexIterator<KeyType, ValueType, KeyComparator>(leaf, 0, buffer_pool_manager_);
 
     // 分割线，作者写的
     // KeyType key {};
@@ -1052,9 +1909,11 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator> BPlusTree<KeyType, ValueType, KeyComparator>::Begin(
     const KeyType &key)
 {
-    auto *leaf = FindLeafPage(key, false);
+    // 索引上的点查也是从这里进来的（key 列相同的一段），和 GetValue 一样先查自适应哈希索引
     int index = 0;
-    if (leaf != nullptr) { index = leaf->KeyIndex(key, comparator_); }
+    auto *page = FindLeafPageForRead(key, index);
+    auto *leaf = page == nullptr ? nullptr
+                                 : reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
     return IndexIterator<KeyType, ValueType, KeyComparator>(leaf, index, buffer_pool_manager_);
 }
 
@@ -1091,11 +1950,6 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::
     //     buffer_pool_manager_->DeletePage(page_id);
     // }
     transaction->GetDeletedPageSet()->clear();
-
-    if (root_is_locked) {
-        root_is_locked = false;
-        unlockRoot();
-    }
 }
 
 /*
@@ -1106,16 +1960,52 @@ template <typename N>
 bool BPlusTree<KeyType, ValueType, KeyComparator>::
     isSafe(N *node, Operation op)
 {
-//   if (op == Operation::INSERT)
-//   {
-//     return node->GetSize() < node->GetMaxSize();
-//   }
-//   else if (op == Operation::DELETE)
-//   {
-//     // >=: keep same with `coalesce logic`
-//     return node->GetSize() > node->GetMinSize() + 1;
-//   }
-  return true;
+    // 安全指的是这次操作不会让该节点分裂或者下溢，它的祖先节点就不会被修改
+    if (node->IsLeafPage()) {
+        auto leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
+        if (op == Operation::INSERT) { return leaf->GetKeySize() + 1 < leaf->GetSplitSize(); }
+        if (op == Operation::DELETE) {
+            // root 叶子删空了要调整 root
+            if (leaf->IsRootPage()) { return leaf->GetKeySize() > 1; }
+            return leaf->GetKeySize() - 1 >= MinSize(leaf);
+        }
+        return true;
+    }
+
+    auto internal = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+    if (op == Operation::INSERT) { return internal->GetValueSize() + 1 <= internal->GetOrder(); }
+    if (op == Operation::DELETE) {
+        // root 只剩一个孩子的时候树要降低一层
+        if (internal->IsRootPage()) { return internal->GetValueSize() > 2; }
+        return internal->GetValueSize() - 1 >= MinSize(internal);
+    }
+    return true;
+}
+
+/*
+ * 经典的下限是半满：叶子 (order+1)/2-1 个 key，中间节点 (order+1)/2 个 child
+ * 1/divisor 的阈值按同样的方式算，最少也要 1 个 key / 2 个 child
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTree<KeyType, ValueType, KeyComparator>::MinSize(BPlusTreePage *node) const
+{
+    int divisor = compacting_ ? BPLUSTREE_MERGE_THRESHOLD : merge_divisor_.load();
+    int lazy = (node->GetOrder() + 1) / divisor;
+    if (node->IsLeafPage()) {
+        auto leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
+        return std::min(leaf->GetMinKeySize(), std::max(1, lazy - 1));
+    }
+    auto internal = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+    return std::min(internal->GetMinValueSize(), std::max(2, lazy));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTree<KeyType, ValueType, KeyComparator>::NodeSize(BPlusTreePage *node) const
+{
+    if (node->IsLeafPage()) {
+        return reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node)->GetKeySize();
+    }
+    return reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node)->GetValueSize();
 }
 // **************** lab3 ***********************
 
@@ -1125,15 +2015,17 @@ bool BPlusTree<KeyType, ValueType, KeyComparator>::
  * 返回的就是 B+tree 的叶子节点
  */
 // 这个函数lab2和lab3有着很多不同
+// 只读操作走乐观路径；写操作是悲观路径，调用者持有 mutex_
 template <typename KeyType, typename ValueType, typename KeyComparator>
 BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *
 BPlusTree<KeyType, ValueType, KeyComparator>::FindLeafPage(
     const KeyType &key, bool leftMost, Operation op, Transaction *transaction)
 {
-    // 如果操作不是只读的，就要锁根节点
-    if (op != Operation::READONLY) {
-        lockRoot();
-        root_is_locked = true;
+    if (op == Operation::READONLY) {
+        auto *page = FindLeafPageOptimistic(key, leftMost, op);
+        if (page == nullptr) { return nullptr; }
+        if (transaction != nullptr) { transaction->AddIntoPageSet(page); }
+        return reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
     }
 
     if (IsEmpty()) { return nullptr; }
@@ -1142,10 +2034,26 @@ BPlusTree<KeyType, ValueType, KeyComparator>::FindLeafPage(
     auto *parent = buffer_pool_manager_->FetchPage(root_page_id_);
     if (parent == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
 
-    if (op == Operation::READONLY) { parent->RLatch(); }
-    else { parent->WLatch(); }
+    // 插入：中间节点只有持有 mutex_ 的结构修改才会改，下降时不用加锁，只锁叶子，叶子不进 page set
+    // 分裂由 InsertIntoParent 自底向上逐层加锁、逐层释放（B-link）
+    // 删除：合并/重分配要同时改父节点和兄弟，沿途加写锁，遇到安全的节点就放掉祖先
+    if (op == Operation::INSERT) {
+        while (!reinterpret_cast<BPlusTreePage *>(parent->GetData())->IsLeafPage()) {
+            auto internal =
+                reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(parent->GetData());
+            page_id_t child_page_id = leftMost ? internal->ValueAt(0) : internal->Lookup(key, comparator_);
+            auto *child = buffer_pool_manager_->FetchPage(child_page_id);
+            if (child == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
+            buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
+            parent = child;
+        }
+        parent->WLatch();
+        return reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(parent->GetData());
+    }
 
-    if (transaction != nullptr) { transaction->AddIntoPageSet(parent);}
+    assert(transaction != nullptr);
+    parent->WLatch();
+    transaction->AddIntoPageSet(parent);
     
     // page 实际就是 b+tree 上的一个node
     auto *node = reinterpret_cast<BPlusTreePage *>(parent->GetData());
@@ -1170,36 +2078,108 @@ BPlusTree<KeyType, ValueType, KeyComparator>::FindLeafPage(
         // 直接拿着key到内部节点中去找，通常就是二分查找
         auto *child = buffer_pool_manager_->FetchPage(child_page_id);
         if (child == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
-
-        if (op == Operation::READONLY) {
-            child->RLatch();
-            UnlockUnpinPages(op, transaction);
-        }
-        else { child->WLatch(); }
+        child->WLatch();
 
         node = reinterpret_cast<BPlusTreePage *>(child->GetData());
+        assert(node->GetParentPageId() == parent_page_id);
+        (void) parent_page_id;
+
+        // 如果是安全的，就释放父节点那的锁
+        if (isSafe(node, op)) { UnlockUnpinPages(op, transaction); }
+        transaction->AddIntoPageSet(child);
+    }
+
+    return reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
+}
+
+/*
+ * optimistic lock coupling + B-link
+ * 下降的过程中不对中间节点加锁，只用版本号保证读到的节点内容是一致的：
+ *  1. 读节点的版本号，奇数说明有写者正在修改这个节点，等一下重新读这个节点（不用从 root 重来）
+ *  2. key 不小于节点的 high key，说明节点分裂过，key 已经搬到右边去了，沿 right link 往右走
+ *  3. 否则在节点里找到孩子，校验版本号之后往下走
+ *  4. 到了叶子节点再加锁（读操作读锁，写操作写锁），加锁后同样要检查 high key，必要时继续往右
+ * 分裂只会把 key 往右搬，所以拿着旧的孩子指针也一定能往右找到目标，不用校验父节点，也不用等分裂结束
+ * 合并和重分配会把 key 往左搬，这种情况靠 merge_epoch_ 检测，发生过的话从 root 重新开始
+ * @return 持有锁并且 pin 住的叶子页面，树为空的时候返回 nullptr
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+Page *BPlusTree<KeyType, ValueType, KeyComparator>::FindLeafPageOptimistic(
+    const KeyType &key, bool leftMost, Operation op)
+{
+restart:
+    uint64_t epoch = merge_epoch_.load(std::memory_order_acquire);
+    if ((epoch & 1) != 0) {
+        std::this_thread::yield();
+        goto restart;
+    }
+    page_id_t root_page_id = root_page_id_;
+    if (root_page_id == INVALID_PAGE_ID) { return nullptr; }
 
-        // only for debug
-        if(node->GetParentPageId() != parent_page_id) {
-            std::cout << "error key is: " << key 
-                << " and pid from self is " << node->GetParentPageId() 
-                << " and curr id is " << parent_page_id << std::endl;
-            BackTracePlus(); 
+    auto *page = buffer_pool_manager_->FetchPage(root_page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
+
+    while (true)
+    {
+        uint64_t version = page->GetVersion();
+        if ((version & 1) != 0) {
+            std::this_thread::yield();
+            continue;
         }
+        auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+        if (node->IsLeafPage()) { break; }
 
-        assert(node->GetParentPageId() == parent_page_id);
+        auto internal =
+            reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+        page_id_t next_page_id;
+        if (leftMost) { next_page_id = internal->ValueAt(0); }
+        else if (internal->NeedMoveRight(key, comparator_)) { next_page_id = internal->GetRightLink(); }
+        else { next_page_id = internal->Lookup(key, comparator_); }
+        if (!page->ValidateVersion(version)) { continue; }
+
+        auto *next = buffer_pool_manager_->FetchPage(next_page_id);
+        if (next == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        page = next;
+    }
 
-        // 如果是安全的，就释放父节点那的锁
-        if (op != Operation::READONLY && isSafe(node, op)) { UnlockUnpinPages(op, transaction); }
-        if (transaction != nullptr) { transaction->AddIntoPageSet(child); }
-        else {
-            parent->RUnlatch();
-            buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
-            parent = child;
+    // 叶子节点加锁，加锁之后叶子的内容就稳定了
+    while (true)
+    {
+        if (op == Operation::READONLY) { page->RLatch(); }
+        else { page->WLatch(); }
+
+        if (merge_epoch_.load(std::memory_order_acquire) != epoch) {
+            if (op == Operation::READONLY) { page->RUnlatch(); }
+            else { page->WUnlatch(); }
+            buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+            goto restart;
         }
+
+        auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+        if (leftMost || !leaf->NeedMoveRight(key, comparator_)) { return page; }
+
+        // 先放掉当前叶子再锁右边的叶子，与迭代器的加锁顺序一致
+        page_id_t right_page_id = leaf->GetRightLink();
+        if (op == Operation::READONLY) { page->RUnlatch(); }
+        else { page->WUnlatch(); }
+        auto *right = buffer_pool_manager_->FetchPage(right_page_id);
+        if (right == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while FindLeafPage"); }
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        page = right;
     }
+}
 
-    return reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node);
+/*
+ * 放掉节点上的写锁，节点的 pin 由调用者负责
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::WUnlatchNode(BPlusTreePage *node)
+{
+    auto *page = buffer_pool_manager_->FetchPage(node->GetPageId());
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while WUnlatchNode"); }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(node->GetPageId(), true);
 }
 
 /*
@@ -1343,12 +2323,18 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::ReSetPageOrder(BPlusTreePage
      * 就保留了一个空间的余量
      * 这个容量也不一样啊，之前作者的工作在这里看起来是有些欠缺的
      */
+    // 没有指定秩（例如 BPlusTreeIndex 里的树），就按页面的实际容量来
+    int page_order = order == 0 ? node->GetMaxCapacity() - 1 : order;
 // #ifdef DEBUG_TREE_SHOW
-    if(order > node->GetMaxCapacity() - 1 || order <= 1) {
+    if(page_order > node->GetMaxCapacity() - 1 || page_order <= 1) {
         // B+ tree 最少二阶，阶指的是 v 的数量，反正就是 kv 对的数量，k 需要空一个出来
         throw Exception(EXCEPTION_TYPE_OUT_OF_RANGE, "order of b+ tree is too big!");
     }
-    node->SetOrder(order);
+    node->SetOrder(page_order);
+    // 秩跟着页面容量走的时候，叶子压缩省下来的空间可以多放 key
+    if (node->IsLeafPage()) {
+        reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(node)->SetElasticOrder(order == 0);
+    }
 // #endif
     return;
 }
@@ -1423,5 +2409,9 @@ template class BPlusTree<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTree<GenericKey<16>, RID, GenericComparator<16>>;
 template class BPlusTree<GenericKey<32>, RID, GenericComparator<32>>;
 template class BPlusTree<GenericKey<64>, RID, GenericComparator<64>>;
+template class BPlusTree<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BPlusTree<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BPlusTree<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BPlusTree<NormalizedKey<128>, RID, NormalizedComparator<128>>;
 
 } // namespace cmudb
\ No newline at end of file
@@ -3,6 +3,10 @@
  * 就是B+tree的insert,delete以及getvalue
  */
 
+#include <algorithm>
+#include <future>
+#include <iterator>
+
 #include "index/b_plus_tree_index.h"
 
 namespace cmudb {
@@ -13,44 +17,243 @@ INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(IndexMetadata *metadata,
                                      BufferPoolManager *buffer_pool_manager,
                                      page_id_t root_page_id)
-    : Index(metadata), comparator_(metadata->GetKeySchema()),
+    : Index(metadata), comparator_(metadata->GetEntrySchema()),
+      key_bytes_(KeyType::ColumnOffset(metadata->GetEntrySchema(), metadata->GetKeySchema()->GetColumnCount())),
       container_(metadata->GetName(), buffer_pool_manager, comparator_,
-                 root_page_id) {}
+                 root_page_id) {
+    container_.SetMergeThreshold(INDEX_MERGE_THRESHOLD);
+    container_.EnableAdaptiveHash(INDEX_ADAPTIVE_HASH_SIZE);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
     // construct insert index key
+    // key 可以重复，带上 RID 之后 (key, RID) 在树里是唯一的
+    // INCLUDE 列编码在 key 列和 RID 之间，key 相同的 entry 之间 INCLUDE 列参与排序也不影响查询
     KeyType index_key;
-    index_key.SetFromKey(key);
+    index_key.SetFromKey(key, GetEntrySchema());
+    index_key.SetRid(rid);
 
     container_.Insert(index_key, rid, transaction);
+    // 先插树再加 filter，和重建交错的时候也不会漏
+    if (bloom_filter_ != nullptr) { bloom_filter_->Add(KeyHash(index_key)); }
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key,
+void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
     // construct delete index key
     KeyType index_key;
-    index_key.SetFromKey(key);
+    index_key.SetFromKey(key, GetEntrySchema());
+    index_key.SetRid(rid);
 
     container_.Remove(index_key, transaction);
+    if (bloom_filter_ != nullptr) { bloom_filter_->RecordDelete(); }
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
-                                   Transaction *transaction) {
-    // construct scan index key
+bool BPLUSTREE_INDEX_TYPE::CanHold(const Tuple &key) {
     KeyType index_key;
-    index_key.SetFromKey(key);
+    return index_key.SetFromKey(key, GetEntrySchema());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
+                                   Transaction *transaction,
+                                   std::vector<Tuple> *entries) {
+    // 同一个 key 的所有 RID 在叶子里是连在一起的（可能跨好几个叶子），按所有列做一次闭区间扫描
+    KeyType search_key;
+    if (!SetSearchKey(search_key, key) || !MayContain(search_key)) { return; }
+    size_t found = result.size();
+    ScanBound bound{key, GetKeySchema()->GetColumnCount(), true};
+    ScanRange(&bound, &bound, result, transaction, entries);
+    if (bloom_filter_ != nullptr && result.size() == found) { bloom_filter_->RecordFalsePositive(); }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::MayContain(const KeyType &search_key) {
+    if (bloom_filter_ == nullptr) { return true; }
+    if (bloom_filter_->NeedsRebuild()) {
+        bloom_filter_->Rebuild([this](std::vector<uint64_t> &hashes) {
+            for (auto iterator = container_.Begin(); !iterator.isEnd(); ++iterator) {
+                hashes.push_back(KeyHash((*iterator).first));
+            }
+        });
+    }
+    return bloom_filter_->MayContain(KeyHash(search_key));
+}
+
+/*
+ * 一个 key 的所有 RID 是闭区间 [(key, 最小的 INCLUDE 列和 RID), (key, 最大的 INCLUDE 列和 RID)]，
+ * 整批交给 GetValues 一起查。IN list 里重复的 key 只查一次，结果里不会出现重复的 RID
+ * GetValues 只返回 value，要 entry 的时候退回去逐个 ScanKey
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                                    Transaction *transaction,
+                                    std::vector<Tuple> *entries) {
+    if (entries != nullptr) {
+        Index::ScanKeys(keys, result, transaction, entries);
+        return;
+    }
+    std::vector<std::pair<KeyType, KeyType>> ranges;
+    ranges.reserve(keys.size());
+    for (auto &key : keys) {
+        KeyType lo_key, hi_key;
+        // 放不下的 key 和 filter 排除掉的 key 不用下降
+        if (!SetSearchKey(lo_key, key) || !MayContain(lo_key)) { continue; }
+        hi_key = lo_key;
+        hi_key.SetUpperBound(key_bytes_);
+        ranges.emplace_back(lo_key, hi_key);
+    }
+    std::sort(ranges.begin(), ranges.end(), [this](const std::pair<KeyType, KeyType> &lhs,
+                                                   const std::pair<KeyType, KeyType> &rhs) {
+        return comparator_(lhs.first, rhs.first) < 0;
+    });
+    ranges.erase(std::unique(ranges.begin(), ranges.end(),
+                             [this](const std::pair<KeyType, KeyType> &lhs, const std::pair<KeyType, KeyType> &rhs) {
+                                 return comparator_(lhs.first, rhs.first) == 0;
+                             }),
+                 ranges.end());
+
+    std::vector<std::vector<RID>> values;
+    container_.GetValues(ranges, values, transaction);
+    for (auto &rids : values) {
+        if (bloom_filter_ != nullptr && rids.empty()) { bloom_filter_->RecordFalsePositive(); }
+        result.insert(result.end(), rids.begin(), rids.end());
+    }
+}
+
+/*
+ * 从下界定位到叶子，然后顺着叶子链表往右扫，超过上界就停
+ * 下界没有用到的列是最小值，RID 也是全 0，所以 Begin(lo) 不会漏掉前缀相同的 key
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanRange(const ScanBound *lo, const ScanBound *hi,
+                                     std::vector<RID> &result,
+                                     Transaction *transaction,
+                                     std::vector<Tuple> *entries) {
+    (void)transaction;
+    KeyType lo_key, hi_key;
+    // 截断的下界比原来的小，只会多扫；截断的上界比原来的小，和它前缀相等的 key 也要扫到，改成闭区间
+    bool hi_inclusive = hi == nullptr || hi->inclusive;
+    if (lo != nullptr) { SetSearchKey(lo_key, lo->key); }
+    if (hi != nullptr && !SetSearchKey(hi_key, hi->key)) { hi_inclusive = true; }
+
+    auto iterator = lo == nullptr ? container_.Begin() : container_.Begin(lo_key);
+    for (; !iterator.isEnd(); ++iterator) {
+        const auto &item = *iterator;
+        if (lo != nullptr && !lo->inclusive &&
+            comparator_.ComparePrefix(item.first, lo_key, lo->column_count) == 0) {
+            continue;
+        }
+        if (hi != nullptr) {
+            int cmp = comparator_.ComparePrefix(item.first, hi_key, hi->column_count);
+            if (cmp > 0 || (cmp == 0 && !hi_inclusive)) { break; }
+        }
+        result.push_back(item.second);
+        if (entries != nullptr) { entries->push_back(DecodeEntry(item.first)); }
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Tuple BPLUSTREE_INDEX_TYPE::DecodeEntry(const KeyType &index_key) const {
+    Schema *entry_schema = GetEntrySchema();
+    std::vector<Value> values;
+    values.reserve(entry_schema->GetColumnCount());
+    for (int i = 0; i < entry_schema->GetColumnCount(); i++) { values.push_back(index_key.GetValue(entry_schema, i)); }
+    return Tuple(values, entry_schema);
+}
+
+/*
+ * 空树直接自底向上建，已经有数据的树只能退回去逐个 insert
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::EncodeEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                                         std::vector<Item> &items) const {
+    items.reserve(items.size() + entries.size());
+    for (auto &entry : entries) {
+        KeyType index_key;
+        index_key.SetFromKey(entry.first, GetEntrySchema());
+        index_key.SetRid(entry.second);
+        items.emplace_back(index_key, entry.second);
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::LoadItems(std::vector<Item> &items, double fill_factor,
+                                     Transaction *transaction) {
+    if (!container_.BulkLoad(items, fill_factor)) {
+        for (auto &item : items) { container_.Insert(item.first, item.second, transaction); }
+    }
+    if (bloom_filter_ != nullptr) {
+        for (auto &item : items) { bloom_filter_->Add(KeyHash(item.first)); }
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::BulkLoad(std::vector<std::pair<Tuple, RID>> &entries,
+                                    double fill_factor,
+                                    Transaction *transaction) {
+    std::vector<Item> items;
+    EncodeEntries(entries, items);
+    LoadItems(items, fill_factor, transaction);
+}
+
+/*
+ * run 之间只按 heap 的顺序排列，run 内部和 run 之间都是乱序的
+ * 1. 每个 run 一个任务（当前线程也做一份）：编码成 index key，稳定排序
+ * 2. 相邻的 run 两两归并，每一轮的归并也是并行的，log(run 数) 轮之后只剩一个
+ * 归并时相等的 key 左边的在前，所以和串行的 BulkLoad 一样，重复的 key 留 heap 里靠前的那个
+ * 整体已经有序，container_.BulkLoad 检查一遍就不再排序了
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::BulkLoadRuns(std::vector<std::vector<std::pair<Tuple, RID>>> &runs,
+                                        double fill_factor,
+                                        Transaction *transaction) {
+    auto less = [this](const Item &a, const Item &b) { return comparator_(a.first, b.first) < 0; };
+    std::vector<std::vector<Item>> sorted(runs.size());
+    auto sort_run = [this, &runs, &sorted, &less](size_t i) {
+        EncodeEntries(runs[i], sorted[i]);
+        std::vector<std::pair<Tuple, RID>>().swap(runs[i]);
+        std::stable_sort(sorted[i].begin(), sorted[i].end(), less);
+    };
+    std::vector<std::future<void>> futures;
+    for (size_t i = 1; i < runs.size(); i++) { futures.push_back(std::async(std::launch::async, sort_run, i)); }
+    if (!runs.empty()) { sort_run(0); }
+    // get() 把任务里的异常带回来
+    for (auto &future : futures) { future.get(); }
+
+    while (sorted.size() > 1) {
+        std::vector<std::vector<Item>> merged((sorted.size() + 1) / 2);
+        auto merge_pair = [&sorted, &merged, &less](size_t i) {
+            if (2 * i + 1 == sorted.size()) {
+                merged[i].swap(sorted[2 * i]);
+                return;
+            }
+            auto &left = sorted[2 * i];
+            auto &right = sorted[2 * i + 1];
+            merged[i].reserve(left.size() + right.size());
+            std::merge(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(merged[i]), less);
+            std::vector<Item>().swap(left);
+            std::vector<Item>().swap(right);
+        };
+        futures.clear();
+        for (size_t i = 1; i < merged.size(); i++) { futures.push_back(std::async(std::launch::async, merge_pair, i)); }
+        merge_pair(0);
+        for (auto &future : futures) { future.get(); }
+        sorted.swap(merged);
+    }
 
-    container_.GetValue(index_key, result, transaction);
+    std::vector<Item> items;
+    if (!sorted.empty()) { items.swap(sorted[0]); }
+    LoadItems(items, fill_factor, transaction);
 }
 
-template class BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>;
-template class BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
-template class BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>;
-template class BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>;
-template class BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>;
+template class BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BPlusTreeIndex<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BPlusTreeIndex<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BPlusTreeIndex<NormalizedKey<128>, RID, NormalizedComparator<128>>;
 
 } // namespace cmudb
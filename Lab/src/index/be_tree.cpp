@@ -0,0 +1,479 @@
+/**
+ * be_tree.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "common/exception.h"
+#include "common/rid.h"
+#include "index/be_tree.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+BETREE_TYPE::BeTree(const std::string &name,
+                    BufferPoolManager *buffer_pool_manager,
+                    const KeyComparator &comparator,
+                    page_id_t root_page_id)
+    : index_name_(name), buffer_pool_manager_(buffer_pool_manager),
+      comparator_(comparator), root_page_id_(root_page_id) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BETREE_TYPE::FetchPage(page_id_t page_id)
+{
+    auto *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while BeTree"); }
+    return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BETREE_TYPE::NewPage(page_id_t &page_id)
+{
+    auto *page = buffer_pool_manager_->NewPage(page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while BeTree"); }
+    return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::SetNodeCapacity(int leaf_size, int fanout, int buffer_size)
+{
+    if (leaf_size > NodePage::LeafCapacity() || fanout > NodePage::FanoutCapacity() ||
+        buffer_size > NodePage::BufferCapacity(fanout > 0 ? fanout : NodePage::FanoutCapacity())) {
+        throw Exception(EXCEPTION_TYPE_INDEX, "BeTree node capacity does not fit in a page");
+    }
+    // 扇出至少是 3，往上加层的时候节点数才会变少
+    if (leaf_size == 1 || (fanout > 0 && fanout < 3) || buffer_size < 0) {
+        throw Exception(EXCEPTION_TYPE_INDEX, "BeTree node capacity is too small");
+    }
+    leaf_size_ = leaf_size;
+    fanout_ = fanout;
+    buffer_size_ = buffer_size;
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+/*
+ * 从 root 往下走，路上缓冲区里有这个 key 的消息就不用再往下了
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BETREE_TYPE::GetValue(const KeyType &key, ValueType &value)
+{
+    latch_.RLock();
+    bool found = false;
+    page_id_t page_id = root_page_id_;
+    while (page_id != INVALID_PAGE_ID) {
+        auto *page = FetchPage(page_id);
+        auto *node = AsNode(page);
+        page_id_t child_page_id = INVALID_PAGE_ID;
+        if (node->IsLeafPage()) {
+            found = node->Lookup(key, value, comparator_);
+        } else {
+            auto *message = node->FindMessage(key, comparator_);
+            if (message != nullptr) {
+                found = message->type == BeTreeMessageType::INSERT;
+                if (found) { value = message->value; }
+            } else {
+                child_page_id = node->Children()[node->ChildIndex(key, comparator_)];
+            }
+        }
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        page_id = child_page_id;
+    }
+    latch_.RUnlock();
+    return found;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::Scan(const KeyType &lo, const std::function<bool(const KeyType &, const ValueType &)> &visit)
+{
+    latch_.RLock();
+    if (!IsEmpty()) { ScanNode(root_page_id_, lo, nullptr, std::vector<Message>(), visit); }
+    latch_.RUnlock();
+}
+
+/*
+ * 按 child 的顺序深度优先，往下走的时候把本节点缓冲区里落在 child 范围内的消息带下去，
+ * 到了叶子和叶子里的 key 归并：有消息的 key 以消息为准，INSERT 输出消息里的 value，DELETE 跳过
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BETREE_TYPE::ScanNode(page_id_t page_id, const KeyType &lo, const KeyType *hi,
+                           const std::vector<Message> &pending,
+                           const std::function<bool(const KeyType &, const ValueType &)> &visit)
+{
+    auto *page = FetchPage(page_id);
+    auto *node = AsNode(page);
+    bool go_on = true;
+    if (node->IsLeafPage()) {
+        const MappingType *entries = node->Entries();
+        int i = node->LowerBound(lo, comparator_);
+        size_t j = 0;
+        while (go_on && (i < node->GetSize() || j < pending.size())) {
+            int cmp = i == node->GetSize() ? 1 : (j == pending.size() ? -1 : comparator_(entries[i].first, pending[j].key));
+            if (cmp < 0) {
+                go_on = visit(entries[i].first, entries[i].second);
+                i++;
+                continue;
+            }
+            if (cmp == 0) { i++; }
+            if (pending[j].type == BeTreeMessageType::INSERT) { go_on = visit(pending[j].key, pending[j].value); }
+            j++;
+        }
+    } else {
+        const KeyType *pivots = node->Pivots();
+        const Message *buffer = node->Buffer();
+        int first = node->ChildIndex(lo, comparator_);
+        for (int c = first; go_on && c < node->GetSize(); c++) {
+            KeyType child_hi;
+            const KeyType *child_hi_ptr = hi;
+            if (c + 1 < node->GetSize()) {
+                child_hi = pivots[c + 1];
+                child_hi_ptr = &child_hi;
+            }
+            // 第一个 child 从 lo 开始，后面的从自己的 pivot 开始
+            const KeyType &child_lo = c == first ? lo : pivots[c];
+            auto in_range = [&](const KeyType &key) {
+                return comparator_(key, child_lo) >= 0 && (child_hi_ptr == nullptr || comparator_(key, *child_hi_ptr) < 0);
+            };
+            std::vector<Message> newer, older;
+            for (auto &message : pending) {
+                if (in_range(message.key)) { newer.push_back(message); }
+            }
+            for (int k = 0; k < node->GetBufferSize(); k++) {
+                if (in_range(buffer[k].key)) { older.push_back(buffer[k]); }
+            }
+            go_on = ScanNode(node->Children()[c], child_lo, child_hi_ptr, MergeMessages(newer, older), visit);
+        }
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    return go_on;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BETREE_TYPE::GetHeight()
+{
+    latch_.RLock();
+    int height = 0;
+    page_id_t page_id = root_page_id_;
+    while (page_id != INVALID_PAGE_ID) {
+        auto *node = AsNode(FetchPage(page_id));
+        height++;
+        page_id_t child_page_id = node->IsLeafPage() ? INVALID_PAGE_ID : node->Children()[0];
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        page_id = child_page_id;
+    }
+    latch_.RUnlock();
+    return height;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+size_t BETREE_TYPE::GetPendingMessageCount()
+{
+    latch_.RLock();
+    size_t count = IsEmpty() ? 0 : CountPending(root_page_id_);
+    latch_.RUnlock();
+    return count;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+size_t BETREE_TYPE::CountPending(page_id_t page_id)
+{
+    auto *node = AsNode(FetchPage(page_id));
+    size_t count = 0;
+    if (!node->IsLeafPage()) {
+        count = node->GetBufferSize();
+        for (int i = 0; i < node->GetSize(); i++) { count += CountPending(node->Children()[i]); }
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    return count;
+}
+
+/*****************************************************************************
+ * INSERTION & DELETION
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::Insert(const KeyType &key, const ValueType &value)
+{
+    Upsert(Message{key, value, BeTreeMessageType::INSERT});
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::Remove(const KeyType &key)
+{
+    Upsert(Message{key, ValueType(), BeTreeMessageType::DELETE});
+}
+
+/*
+ * root 是叶子的时候直接改叶子；否则放进 root 的缓冲区，满了先往下推一批腾出地方
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::Upsert(const Message &message)
+{
+    latch_.WLock();
+    if (IsEmpty()) {
+        if (message.type == BeTreeMessageType::DELETE) {
+            latch_.WUnlock();
+            return;
+        }
+        StartNewTree();
+    }
+
+    auto *page = FetchPage(root_page_id_);
+    auto *root = AsNode(page);
+    if (!root->IsLeafPage() && root->GetBufferSize() == root->GetMaxBufferSize()) {
+        SplitList splits = Flush(root);
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+        if (!splits.empty()) { GrowRoot(splits); }
+        page = FetchPage(root_page_id_);
+        root = AsNode(page);
+    }
+
+    SplitList splits;
+    if (root->IsLeafPage()) {
+        splits = ApplyToLeaf(root, std::vector<Message>{message});
+    } else {
+        root->PutMessage(message, comparator_);
+    }
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+    if (!splits.empty()) { GrowRoot(splits); }
+    latch_.WUnlock();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::StartNewTree()
+{
+    page_id_t page_id;
+    auto *page = NewPage(page_id);
+    AsNode(page)->Init(page_id, IndexPageType::LEAF_PAGE, leaf_size_);
+    buffer_pool_manager_->UnpinPage(page_id, true);
+
+    root_page_id_ = page_id;
+    UpdateRootPageId(true);
+}
+
+/*
+ * 新 root 的 child 是原来的 root 和它分裂出来的节点，太多的话新 root 也要分裂，再加一层
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::GrowRoot(SplitList splits)
+{
+    while (!splits.empty()) {
+        page_id_t page_id;
+        auto *page = NewPage(page_id);
+        auto *root = AsNode(page);
+        root->Init(page_id, IndexPageType::INTERNAL_PAGE, fanout_, buffer_size_);
+
+        InternalNode content;
+        content.children.push_back(root_page_id_);
+        content.pivots.push_back(KeyType{});
+        for (auto &split : splits) {
+            content.pivots.push_back(split.first);
+            content.children.push_back(split.second);
+        }
+        splits = StoreInternal(root, content);
+        buffer_pool_manager_->UnpinPage(page_id, true);
+        root_page_id_ = page_id;
+    }
+    UpdateRootPageId(false);
+}
+
+/*
+ * 缓冲区按 key 排好序，每个 child 的消息是连续的一段，挑最长的一段推下去：
+ *  child 是叶子：整批合并进叶子，叶子放不下就分裂
+ *  child 是中间节点：放进它的缓冲区，它的缓冲区满了就先递归地给它 Flush 一次，
+ *      它可能因此分裂，所以回头重新挑；只放得下一部分的话先推一部分
+ * 每次都推最长的一段，一次叶子（或者下一层节点）写入至少摊给 缓冲区大小/扇出 条消息
+ */
+INDEX_TEMPLATE_ARGUMENTS
+typename BETREE_TYPE::SplitList BETREE_TYPE::Flush(NodePage *node)
+{
+    InternalNode content = LoadInternal(node);
+    assert(!content.buffer.empty());
+    while (true) {
+        int child_index = -1;
+        size_t batch_begin = 0, batch_end = 0;
+        for (size_t begin = 0; begin < content.buffer.size();) {
+            int index = ChildIndex(content, content.buffer[begin].key);
+            size_t end = begin + 1;
+            while (end < content.buffer.size() && ChildIndex(content, content.buffer[end].key) == index) { end++; }
+            if (end - begin > batch_end - batch_begin) {
+                child_index = index;
+                batch_begin = begin;
+                batch_end = end;
+            }
+            begin = end;
+        }
+
+        auto *child_page = FetchPage(content.children[child_index]);
+        auto *child = AsNode(child_page);
+        SplitList splits;
+        bool flushed = true;
+        if (child->IsLeafPage()) {
+            std::vector<Message> batch(content.buffer.begin() + batch_begin, content.buffer.begin() + batch_end);
+            content.buffer.erase(content.buffer.begin() + batch_begin, content.buffer.begin() + batch_end);
+            splits = ApplyToLeaf(child, batch);
+        } else if (child->GetBufferSize() == child->GetMaxBufferSize()) {
+            splits = Flush(child);
+            flushed = false;
+        } else {
+            batch_end = std::min(batch_end, batch_begin + (child->GetMaxBufferSize() - child->GetBufferSize()));
+            InternalNode child_content = LoadInternal(child);
+            std::vector<Message> batch(content.buffer.begin() + batch_begin, content.buffer.begin() + batch_end);
+            content.buffer.erase(content.buffer.begin() + batch_begin, content.buffer.begin() + batch_end);
+            child_content.buffer = MergeMessages(batch, child_content.buffer);
+            StoreInternal(child, child_content);
+        }
+        buffer_pool_manager_->UnpinPage(child_page->GetPageId(), true);
+
+        for (size_t i = 0; i < splits.size(); i++) {
+            content.pivots.insert(content.pivots.begin() + child_index + 1 + i, splits[i].first);
+            content.children.insert(content.children.begin() + child_index + 1 + i, splits[i].second);
+        }
+        if (flushed) { break; }
+    }
+    return StoreInternal(node, content);
+}
+
+/*
+ * 叶子里的 key 和消息归并：INSERT 插入或者覆盖，DELETE 删掉（key 不在就什么也不做）
+ * 放不下的话平均分到几个叶子里
+ */
+INDEX_TEMPLATE_ARGUMENTS
+typename BETREE_TYPE::SplitList BETREE_TYPE::ApplyToLeaf(NodePage *leaf, const std::vector<Message> &messages)
+{
+    const MappingType *old_entries = leaf->Entries();
+    int size = leaf->GetSize();
+    std::vector<MappingType> entries;
+    entries.reserve(size + messages.size());
+    int i = 0;
+    for (auto &message : messages) {
+        while (i < size && comparator_(old_entries[i].first, message.key) < 0) { entries.push_back(old_entries[i++]); }
+        if (i < size && comparator_(old_entries[i].first, message.key) == 0) { i++; }
+        if (message.type == BeTreeMessageType::INSERT) { entries.emplace_back(message.key, message.value); }
+    }
+    while (i < size) { entries.push_back(old_entries[i++]); }
+
+    int total = static_cast<int>(entries.size());
+    int max_size = leaf->GetMaxSize();
+    int count = std::max(1, (total + max_size - 1) / max_size);
+    SplitList splits;
+    int begin = 0;
+    for (int k = 0; k < count; k++) {
+        int end = begin + total / count + (k < total % count ? 1 : 0);
+        NodePage *target = leaf;
+        page_id_t page_id = leaf->GetPageId();
+        if (k > 0) {
+            target = AsNode(NewPage(page_id));
+            target->Init(page_id, IndexPageType::LEAF_PAGE, max_size);
+            splits.emplace_back(entries[begin].first, page_id);
+        }
+        std::copy(entries.begin() + begin, entries.begin() + end, target->Entries());
+        target->SetSize(end - begin);
+        if (k > 0) { buffer_pool_manager_->UnpinPage(page_id, true); }
+        begin = end;
+    }
+    return splits;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+std::vector<BeTreeMessage<KeyType, ValueType, KeyComparator>>
+BETREE_TYPE::MergeMessages(const std::vector<Message> &newer, const std::vector<Message> &older)
+{
+    std::vector<Message> merged;
+    merged.reserve(newer.size() + older.size());
+    size_t i = 0, j = 0;
+    while (i < newer.size() || j < older.size()) {
+        int cmp = i == newer.size() ? 1 : (j == older.size() ? -1 : comparator_(newer[i].key, older[j].key));
+        if (cmp <= 0) {
+            merged.push_back(newer[i++]);
+            if (cmp == 0) { j++; }
+        } else {
+            merged.push_back(older[j++]);
+        }
+    }
+    return merged;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+typename BETREE_TYPE::InternalNode BETREE_TYPE::LoadInternal(const NodePage *node)
+{
+    InternalNode content;
+    content.children.assign(node->Children(), node->Children() + node->GetSize());
+    content.pivots.assign(node->Pivots(), node->Pivots() + node->GetSize());
+    content.buffer.assign(node->Buffer(), node->Buffer() + node->GetBufferSize());
+    return content;
+}
+
+/*
+ * child 太多的话平均分到几个节点里，缓冲区里的消息跟着自己的 child 走
+ */
+INDEX_TEMPLATE_ARGUMENTS
+typename BETREE_TYPE::SplitList BETREE_TYPE::StoreInternal(NodePage *node, InternalNode &content)
+{
+    int total = static_cast<int>(content.children.size());
+    int max_size = node->GetMaxSize();
+    int count = (total + max_size - 1) / max_size;
+    SplitList splits;
+    int child_begin = 0;
+    size_t message_begin = 0;
+    for (int k = 0; k < count; k++) {
+        int child_end = child_begin + total / count + (k < total % count ? 1 : 0);
+        size_t message_end = message_begin;
+        while (message_end < content.buffer.size() &&
+               (child_end == total || comparator_(content.buffer[message_end].key, content.pivots[child_end]) < 0)) {
+            message_end++;
+        }
+
+        NodePage *target = node;
+        page_id_t page_id = node->GetPageId();
+        if (k > 0) {
+            target = AsNode(NewPage(page_id));
+            target->Init(page_id, IndexPageType::INTERNAL_PAGE, max_size, node->GetMaxBufferSize());
+            splits.emplace_back(content.pivots[child_begin], page_id);
+        }
+        assert(static_cast<int>(message_end - message_begin) <= target->GetMaxBufferSize());
+        std::copy(content.children.begin() + child_begin, content.children.begin() + child_end, target->Children());
+        std::copy(content.pivots.begin() + child_begin, content.pivots.begin() + child_end, target->Pivots());
+        std::copy(content.buffer.begin() + message_begin, content.buffer.begin() + message_end, target->Buffer());
+        target->SetSize(child_end - child_begin);
+        target->SetBufferSize(static_cast<int>(message_end - message_begin));
+        if (k > 0) { buffer_pool_manager_->UnpinPage(page_id, true); }
+        child_begin = child_end;
+        message_begin = message_end;
+    }
+    return splits;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BETREE_TYPE::ChildIndex(const InternalNode &content, const KeyType &key) const
+{
+    int lo = 1, hi = static_cast<int>(content.pivots.size());
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (comparator_(content.pivots[mid], key) <= 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo - 1;
+}
+
+/*
+ * 和 BPlusTree::UpdateRootPageId 一样，header page 里记的是 <index name, root page id>
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_TYPE::UpdateRootPageId(bool insert_record)
+{
+    auto *page = FetchPage(HEADER_PAGE_ID);
+    auto *header_page = reinterpret_cast<HeaderPage *>(page);
+    if (insert_record) { header_page->InsertRecord(index_name_, root_page_id_); }
+    else { header_page->UpdateRecord(index_name_, root_page_id_); }
+    buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+template class BeTree<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BeTree<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BeTree<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BeTree<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
@@ -0,0 +1,124 @@
+/**
+ * be_tree_index.cpp
+ */
+
+#include "index/be_tree_index.h"
+
+namespace cmudb {
+/*
+ * Constructor
+ */
+INDEX_TEMPLATE_ARGUMENTS
+BETREE_INDEX_TYPE::BeTreeIndex(IndexMetadata *metadata,
+                               BufferPoolManager *buffer_pool_manager,
+                               page_id_t root_page_id)
+    : Index(metadata), comparator_(metadata->GetEntrySchema()),
+      key_bytes_(KeyType::ColumnOffset(metadata->GetEntrySchema(), metadata->GetKeySchema()->GetColumnCount())),
+      container_(metadata->GetName(), buffer_pool_manager, comparator_, root_page_id) {}
+
+/*
+ * 和 BPlusTreeIndex 一样，(key, INCLUDE 列, RID) 在树里是唯一的
+ * 写入只是一条消息，不读叶子
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
+                                    Transaction *transaction) {
+    (void)transaction;
+    KeyType index_key;
+    index_key.SetFromKey(key, GetEntrySchema());
+    index_key.SetRid(rid);
+
+    container_.Insert(index_key, rid);
+    if (bloom_filter_ != nullptr) { bloom_filter_->Add(KeyHash(index_key)); }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
+                                    Transaction *transaction) {
+    (void)transaction;
+    KeyType index_key;
+    index_key.SetFromKey(key, GetEntrySchema());
+    index_key.SetRid(rid);
+
+    container_.Remove(index_key);
+    if (bloom_filter_ != nullptr) { bloom_filter_->RecordDelete(); }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BETREE_INDEX_TYPE::CanHold(const Tuple &key) {
+    KeyType index_key;
+    return index_key.SetFromKey(key, GetEntrySchema());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
+                                Transaction *transaction,
+                                std::vector<Tuple> *entries) {
+    KeyType search_key;
+    if (!SetSearchKey(search_key, key) || !MayContain(search_key)) { return; }
+    size_t found = result.size();
+    ScanBound bound{key, GetKeySchema()->GetColumnCount(), true};
+    ScanRange(&bound, &bound, result, transaction, entries);
+    if (bloom_filter_ != nullptr && result.size() == found) { bloom_filter_->RecordFalsePositive(); }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BETREE_INDEX_TYPE::MayContain(const KeyType &search_key) {
+    if (bloom_filter_ == nullptr) { return true; }
+    if (bloom_filter_->NeedsRebuild()) {
+        bloom_filter_->Rebuild([this](std::vector<uint64_t> &hashes) {
+            container_.Scan(KeyType{}, [&](const KeyType &index_key, const ValueType &) {
+                hashes.push_back(KeyHash(index_key));
+                return true;
+            });
+        });
+    }
+    return bloom_filter_->MayContain(KeyHash(search_key));
+}
+
+/*
+ * 下界没有用到的列是最小值，RID 也是全 0，从它开始扫不会漏掉前缀相同的 key
+ * 没有下界就从全 0 的 key 开始
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BETREE_INDEX_TYPE::ScanRange(const ScanBound *lo, const ScanBound *hi,
+                                  std::vector<RID> &result,
+                                  Transaction *transaction,
+                                  std::vector<Tuple> *entries) {
+    (void)transaction;
+    KeyType lo_key{}, hi_key;
+    // 截断的上界要改成闭区间，见 BPlusTreeIndex::ScanRange
+    bool hi_inclusive = hi == nullptr || hi->inclusive;
+    if (lo != nullptr) { SetSearchKey(lo_key, lo->key); }
+    if (hi != nullptr && !SetSearchKey(hi_key, hi->key)) { hi_inclusive = true; }
+
+    container_.Scan(lo_key, [&](const KeyType &index_key, const ValueType &value) {
+        if (lo != nullptr && !lo->inclusive &&
+            comparator_.ComparePrefix(index_key, lo_key, lo->column_count) == 0) {
+            return true;
+        }
+        if (hi != nullptr) {
+            int cmp = comparator_.ComparePrefix(index_key, hi_key, hi->column_count);
+            if (cmp > 0 || (cmp == 0 && !hi_inclusive)) { return false; }
+        }
+        result.push_back(value);
+        if (entries != nullptr) { entries->push_back(DecodeEntry(index_key)); }
+        return true;
+    });
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Tuple BETREE_INDEX_TYPE::DecodeEntry(const KeyType &index_key) const {
+    Schema *entry_schema = GetEntrySchema();
+    std::vector<Value> values;
+    values.reserve(entry_schema->GetColumnCount());
+    for (int i = 0; i < entry_schema->GetColumnCount(); i++) { values.push_back(index_key.GetValue(entry_schema, i)); }
+    return Tuple(values, entry_schema);
+}
+
+template class BeTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BeTreeIndex<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BeTreeIndex<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BeTreeIndex<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
@@ -0,0 +1,139 @@
+/**
+ * bloom_filter.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "index/bloom_filter.h"
+
+namespace cmudb {
+
+const int BloomFilter::BITS_PER_KEY;
+const int BloomFilter::PROBES;
+const int BloomFilter::BLOCK_WORDS;
+const size_t BloomFilter::MIN_KEYS;
+
+/*
+ * FNV-1a 加上 murmur3 的 fmix64，和 DiskExtendibleHash 用的一样
+ */
+uint64_t BloomFilter::Hash(const char *data, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void BloomFilter::Reset(size_t expected_keys)
+{
+    expected_keys = std::max(expected_keys, MIN_KEYS);
+    size_t blocks = (expected_keys * BITS_PER_KEY + BLOCK_WORDS * 64 - 1) / (BLOCK_WORDS * 64);
+    std::vector<std::atomic<uint64_t>> fresh(blocks * BLOCK_WORDS);
+    for (auto &word : fresh) { word.store(0, std::memory_order_relaxed); }
+    blocks_.swap(fresh);
+    capacity_ = expected_keys;
+    keys_ = 0;
+    deletes_ = 0;
+}
+
+/*
+ * 高 32 位选块（乘法代替取模），低 32 位在块里做 double hashing
+ */
+std::atomic<uint64_t> *BloomFilter::BlockOf(uint64_t hash)
+{
+    size_t block_count = blocks_.size() / BLOCK_WORDS;
+    size_t block = static_cast<size_t>(((hash >> 32) * block_count) >> 32);
+    return blocks_.data() + block * BLOCK_WORDS;
+}
+
+void BloomFilter::SetBits(uint64_t hash)
+{
+    auto *block = BlockOf(hash);
+    uint32_t h = static_cast<uint32_t>(hash);
+    uint32_t delta = (h >> 17) | (h << 15) | 1;
+    for (int i = 0; i < PROBES; i++) {
+        uint32_t bit = h & (BLOCK_WORDS * 64 - 1);
+        block[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+        h += delta;
+    }
+}
+
+void BloomFilter::Add(uint64_t hash)
+{
+    latch_.RLock();
+    SetBits(hash);
+    keys_++;
+    latch_.RUnlock();
+}
+
+bool BloomFilter::MayContain(uint64_t hash)
+{
+    // 还没有建起来的 filter 不能排除任何 key
+    if (stale_) { return true; }
+    latch_.RLock();
+    probes_++;
+    auto *block = BlockOf(hash);
+    uint32_t h = static_cast<uint32_t>(hash);
+    uint32_t delta = (h >> 17) | (h << 15) | 1;
+    bool result = true;
+    for (int i = 0; i < PROBES && result; i++) {
+        uint32_t bit = h & (BLOCK_WORDS * 64 - 1);
+        result = (block[bit / 64].load(std::memory_order_relaxed) >> (bit % 64)) & 1;
+        h += delta;
+    }
+    if (!result) { negatives_++; }
+    latch_.RUnlock();
+    return result;
+}
+
+void BloomFilter::Rebuild(const std::function<void(std::vector<uint64_t> &)> &collect)
+{
+    latch_.WLock();
+    // 别的线程可能已经重建过了
+    if (NeedsRebuild()) {
+        std::vector<uint64_t> hashes;
+        collect(hashes);
+        // 留一倍的余量给之后的插入
+        Reset(hashes.size() * 2);
+        for (uint64_t hash : hashes) { SetBits(hash); }
+        keys_ = hashes.size();
+        stale_ = false;
+    }
+    latch_.WUnlock();
+}
+
+double BloomFilter::GetFalsePositiveRate() const
+{
+    size_t absent = negatives_ + false_positives_;
+    return absent == 0 ? 0 : static_cast<double>(false_positives_) / absent;
+}
+
+/*
+ * 普通 bloom filter 的 (1 - e^(-kn/m))^k，块内的不均匀会让实际值稍高一点
+ */
+double BloomFilter::GetEstimatedFalsePositiveRate() const
+{
+    double bits = static_cast<double>(blocks_.size() * 64);
+    return std::pow(1 - std::exp(-PROBES * static_cast<double>(keys_) / bits), PROBES);
+}
+
+std::string BloomFilter::ToString() const
+{
+    std::stringstream os;
+    os << "BloomFilter[keys = " << keys_ << ", deletes = " << deletes_ << ", memory = " << GetMemoryUsage()
+       << " bytes, probes = " << probes_ << ", negatives = " << negatives_
+       << ", false positive rate = " << GetFalsePositiveRate()
+       << " (estimated " << GetEstimatedFalsePositiveRate() << ")]";
+    return os.str();
+}
+
+} // namespace cmudb
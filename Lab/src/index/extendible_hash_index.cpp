@@ -0,0 +1,75 @@
+/**
+ * extendible_hash_index.cpp
+ */
+
+#include "index/extendible_hash_index.h"
+
+namespace cmudb {
+/*
+ * Constructor
+ */
+INDEX_TEMPLATE_ARGUMENTS
+EXTENDIBLE_HASH_INDEX_TYPE::ExtendibleHashIndex(IndexMetadata *metadata,
+                                                BufferPoolManager *buffer_pool_manager,
+                                                page_id_t directory_page_id)
+    : Index(metadata), comparator_(metadata->GetKeySchema()),
+      container_(metadata->GetName(), buffer_pool_manager, comparator_,
+                 directory_page_id) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
+                                             Transaction *transaction) {
+    KeyType index_key;
+    index_key.SetFromKey(key, GetKeySchema());
+
+    container_.Insert(index_key, rid, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
+                                             Transaction *transaction) {
+    KeyType index_key;
+    index_key.SetFromKey(key, GetKeySchema());
+
+    container_.Remove(index_key, rid, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_INDEX_TYPE::CanHold(const Tuple &key) {
+    KeyType index_key;
+    return index_key.SetFromKey(key, GetKeySchema());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
+                                         Transaction *transaction,
+                                         std::vector<Tuple> *entries) {
+    KeyType index_key;
+    // varchar 放不下的 key 不可能在索引里
+    if (!index_key.SetFromKey(key, GetKeySchema())) { return; }
+
+    size_t count = result.size();
+    container_.GetValue(index_key, result, transaction);
+    // 等值查询，命中的 entry 就是查询的 key 本身
+    if (entries != nullptr) { entries->insert(entries->end(), result.size() - count, key); }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_INDEX_TYPE::ScanRange(const ScanBound *lo, const ScanBound *hi,
+                                           std::vector<RID> &result,
+                                           Transaction *transaction,
+                                           std::vector<Tuple> *entries) {
+    (void)lo;
+    (void)hi;
+    (void)result;
+    (void)transaction;
+    (void)entries;
+    throw Exception(EXCEPTION_TYPE_INDEX, "hash index does not support range scan");
+}
+
+template class ExtendibleHashIndex<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class ExtendibleHashIndex<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class ExtendibleHashIndex<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class ExtendibleHashIndex<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
@@ -17,15 +17,31 @@ IndexIterator(
     BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
     int index_, BufferPoolManager *buff_pool_manager): 
     leaf_(leaf), index_(index_), buff_pool_manager_(buff_pool_manager) 
-    {}
+    {
+        // Begin(key) 的 key 比叶子里所有的 key 都大时下标停在末尾，真正的起点在下一个叶子
+        if (leaf_ != nullptr && this->index_ == leaf_->GetKeySize() && leaf_->GetNextPageId() != INVALID_PAGE_ID) {
+            NextLeaf();
+        }
+    }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator>::
 ~IndexIterator() {
-    buff_pool_manager_->FetchPage(leaf_->GetPageId())->RUnlatch();
-    buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
+    if (leaf_ != nullptr) { Release(); }
 };
 
+/*
+ * 放掉当前叶子的读锁，FetchPage 多出来的那一次 pin 和 FindLeafPage 留下的 pin 都要还掉
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+Release() {
+    page_id_t page_id = leaf_->GetPageId();
+    buff_pool_manager_->FetchPage(page_id)->RUnlatch();
+    buff_pool_manager_->UnpinPage(page_id, false);
+    buff_pool_manager_->UnpinPage(page_id, false);
+}
+
 template <typename KeyType, typename ValueType, typename KeyComparator>
 bool IndexIterator<KeyType, ValueType, KeyComparator>::
 isEnd() {
@@ -36,7 +52,7 @@ isEnd() {
 
 // 这个就是对指针的 * 运算符的重载
 template <typename KeyType, typename ValueType, typename KeyComparator>
-const MappingType &IndexIterator<KeyType, ValueType, KeyComparator>::
+MappingType IndexIterator<KeyType, ValueType, KeyComparator>::
 operator*() {
     if (isEnd()) { throw std::out_of_range("IndexIterator: out of range"); }
     return leaf_->GetItem(index_);
@@ -48,32 +64,39 @@ IndexIterator<KeyType, ValueType, KeyComparator> &IndexIterator<KeyType, ValueTy
 operator++() {
     // 用来在 b+tree 的成 list 的叶子节点上的自增操作
     ++index_;
-    if (index_ == leaf_->GetKeySize() && leaf_->GetNextPageId() != INVALID_PAGE_ID) 
-    {
-        // first unpin leaf_, then get the next leaf
-        page_id_t next_page_id = leaf_->GetNextPageId();
-        auto *page = buff_pool_manager_->FetchPage(next_page_id);
-        if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while IndexIterator(operator++)"); }
-
-        // first acquire next page, then release previous page
-        page->RLatch();
-
-        buff_pool_manager_->FetchPage(leaf_->GetPageId())->RUnlatch();
-        buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
-
-        auto next_leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
-        assert(next_leaf->IsLeafPage());
-        index_ = 0;
-        leaf_ = next_leaf;
-    }
+    if (index_ == leaf_->GetKeySize() && leaf_->GetNextPageId() != INVALID_PAGE_ID) { NextLeaf(); }
     // 返回的是迭代器本身
     return *this;
 };
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+NextLeaf() {
+    // first unpin leaf_, then get the next leaf
+    page_id_t next_page_id = leaf_->GetNextPageId();
+    auto *page = buff_pool_manager_->FetchPage(next_page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while IndexIterator(operator++)"); }
+
+    // first acquire next page, then release previous page
+    // 先放掉当前叶子再锁下一个：删除时的合并会先锁右边再锁左边的兄弟，从左往右同时持有两把锁会死锁
+    Release();
+
+    page->RLatch();
+
+    auto next_leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *>(page->GetData());
+    assert(next_leaf->IsLeafPage());
+    index_ = 0;
+    leaf_ = next_leaf;
+}
+
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
 template class IndexIterator<GenericKey<8>, RID, GenericComparator<8>>;
 template class IndexIterator<GenericKey<16>, RID, GenericComparator<16>>;
 template class IndexIterator<GenericKey<32>, RID, GenericComparator<32>>;
 template class IndexIterator<GenericKey<64>, RID, GenericComparator<64>>;
+template class IndexIterator<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class IndexIterator<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class IndexIterator<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class IndexIterator<NormalizedKey<128>, RID, NormalizedComparator<128>>;
 
 } // namespace cmudb
@@ -0,0 +1,424 @@
+/**
+ * varlen_b_plus_tree.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/exception.h"
+#include "index/varlen_b_plus_tree.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+VarlenBPlusTree::VarlenBPlusTree(const std::string &name,
+                                 BufferPoolManager *buffer_pool_manager,
+                                 page_id_t root_page_id)
+    : index_name_(name), buffer_pool_manager_(buffer_pool_manager), root_page_id_(root_page_id) {}
+
+Page *VarlenBPlusTree::FetchPage(page_id_t page_id)
+{
+    auto *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while VarlenBPlusTree"); }
+    return page;
+}
+
+/*****************************************************************************
+ * KEY COMPARISON
+ *****************************************************************************/
+std::string VarlenBPlusTree::KeyAt(const VarlenBPlusTreePage *node, int index)
+{
+    std::string key(node->InlineKeyAt(index), node->InlineLengthAt(index));
+    page_id_t overflow_page_id = node->OverflowPageAt(index);
+    while (overflow_page_id != INVALID_PAGE_ID) {
+        auto *page = FetchPage(overflow_page_id);
+        auto *overflow = reinterpret_cast<VarlenOverflowPage *>(page->GetData());
+        key.append(overflow->data_, overflow->length_);
+        page_id_t next_page_id = overflow->next_page_id_;
+        buffer_pool_manager_->UnpinPage(overflow_page_id, false);
+        overflow_page_id = next_page_id;
+    }
+    return key;
+}
+
+/*
+ * 先比页里的前缀，前缀相同并且 key 还有 overflow 部分的时候才去读 overflow 页
+ */
+int VarlenBPlusTree::CompareKey(const VarlenBPlusTreePage *node, int index, const std::string &key)
+{
+    size_t inline_length = node->InlineLengthAt(index);
+    int cmp = memcmp(node->InlineKeyAt(index), key.data(), std::min(inline_length, key.size()));
+    if (cmp != 0) { return cmp < 0 ? -1 : 1; }
+    if (!node->IsOverflowAt(index)) {
+        return inline_length < key.size() ? -1 : (inline_length > key.size() ? 1 : 0);
+    }
+    if (key.size() <= inline_length) { return 1; }
+    cmp = KeyAt(node, index).compare(key);
+    return cmp < 0 ? -1 : (cmp > 0 ? 1 : 0);
+}
+
+int VarlenBPlusTree::LowerBound(const VarlenBPlusTreePage *node, const std::string &key)
+{
+    int lo = 0, hi = node->GetSize();
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (CompareKey(node, mid, key) < 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+/*
+ * 最后一个 <= key 的位置，第 0 个 key 是 -inf 不参与比较
+ */
+int VarlenBPlusTree::ChildIndex(const VarlenBPlusTreePage *node, const std::string &key)
+{
+    int lo = 1, hi = node->GetSize();
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (CompareKey(node, mid, key) <= 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo - 1;
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+/*
+ * 整棵树已经被锁住了，往下走的时候只 pin 当前的节点
+ */
+Page *VarlenBPlusTree::FindLeaf(const std::string &key, std::vector<std::pair<page_id_t, int>> *path)
+{
+    page_id_t page_id = root_page_id_;
+    auto *page = FetchPage(page_id);
+    while (!AsNode(page)->IsLeafPage()) {
+        auto *node = AsNode(page);
+        int index = ChildIndex(node, key);
+        page_id_t child_page_id = static_cast<page_id_t>(node->ValueAt(index));
+        if (path != nullptr) { path->emplace_back(page_id, index); }
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        page_id = child_page_id;
+        page = FetchPage(page_id);
+    }
+    return page;
+}
+
+bool VarlenBPlusTree::GetValue(const std::string &key, int64_t &value)
+{
+    latch_.RLock();
+    bool found = false;
+    if (!IsEmpty()) {
+        auto *page = FindLeaf(key, nullptr);
+        auto *leaf = AsNode(page);
+        int index = LowerBound(leaf, key);
+        if (index < leaf->GetSize() && CompareKey(leaf, index, key) == 0) {
+            value = leaf->ValueAt(index);
+            found = true;
+        }
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    }
+    latch_.RUnlock();
+    return found;
+}
+
+/*
+ * 叶子之间用 next page id 串起来，空的叶子直接跳过
+ */
+void VarlenBPlusTree::Scan(const std::string &lo,
+                           const std::function<bool(const std::string &, int64_t)> &visit)
+{
+    latch_.RLock();
+    if (IsEmpty()) {
+        latch_.RUnlock();
+        return;
+    }
+    auto *page = FindLeaf(lo, nullptr);
+    int index = LowerBound(AsNode(page), lo);
+    while (true) {
+        auto *leaf = AsNode(page);
+        for (; index < leaf->GetSize(); index++) {
+            if (!visit(KeyAt(leaf, index), leaf->ValueAt(index))) {
+                buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+                latch_.RUnlock();
+                return;
+            }
+        }
+        page_id_t next_page_id = leaf->GetNextPageId();
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        if (next_page_id == INVALID_PAGE_ID) { break; }
+        page = FetchPage(next_page_id);
+        index = 0;
+    }
+    latch_.RUnlock();
+}
+
+int VarlenBPlusTree::GetHeight()
+{
+    latch_.RLock();
+    int height = 0;
+    page_id_t page_id = root_page_id_;
+    while (page_id != INVALID_PAGE_ID) {
+        auto *node = AsNode(FetchPage(page_id));
+        height++;
+        page_id_t child_page_id = node->IsLeafPage() ? INVALID_PAGE_ID : static_cast<page_id_t>(node->ValueAt(0));
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        page_id = child_page_id;
+    }
+    latch_.RUnlock();
+    return height;
+}
+
+/*****************************************************************************
+ * OVERFLOW
+ *****************************************************************************/
+VarlenBPlusTree::Entry VarlenBPlusTree::MakeEntry(const std::string &key, int64_t value)
+{
+    Entry entry;
+    entry.key_length = static_cast<int>(key.size());
+    entry.value = value;
+    if (key.size() <= static_cast<size_t>(VARLEN_INLINE_KEY_SIZE)) {
+        entry.inline_key = key;
+        entry.overflow_page_id = INVALID_PAGE_ID;
+    } else {
+        entry.inline_key = key.substr(0, VARLEN_INLINE_KEY_SIZE);
+        entry.overflow_page_id = WriteOverflow(key.data() + VARLEN_INLINE_KEY_SIZE,
+                                               entry.key_length - VARLEN_INLINE_KEY_SIZE);
+    }
+    return entry;
+}
+
+/*
+ * 从最后一段往前写，这样每次只需要 pin 一个页
+ */
+page_id_t VarlenBPlusTree::WriteOverflow(const char *data, int length)
+{
+    const int capacity = VarlenOverflowPage::CAPACITY;
+    page_id_t next_page_id = INVALID_PAGE_ID;
+    for (int begin = (length - 1) / capacity * capacity; begin >= 0; begin -= capacity) {
+        page_id_t page_id;
+        auto *page = buffer_pool_manager_->NewPage(page_id);
+        if (page == nullptr) {
+            FreeOverflow(next_page_id);
+            throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while WriteOverflow");
+        }
+        auto *overflow = reinterpret_cast<VarlenOverflowPage *>(page->GetData());
+        overflow->next_page_id_ = next_page_id;
+        overflow->length_ = std::min(capacity, length - begin);
+        memcpy(overflow->data_, data + begin, overflow->length_);
+        buffer_pool_manager_->UnpinPage(page_id, true);
+        next_page_id = page_id;
+    }
+    return next_page_id;
+}
+
+void VarlenBPlusTree::FreeOverflow(page_id_t page_id)
+{
+    while (page_id != INVALID_PAGE_ID) {
+        auto *page = FetchPage(page_id);
+        page_id_t next_page_id = reinterpret_cast<VarlenOverflowPage *>(page->GetData())->next_page_id_;
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        buffer_pool_manager_->DeletePage(page_id);
+        page_id = next_page_id;
+    }
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+void VarlenBPlusTree::StartNewTree(const std::string &key, int64_t value)
+{
+    Entry entry = MakeEntry(key, value);
+    page_id_t page_id;
+    auto *page = buffer_pool_manager_->NewPage(page_id);
+    if (page == nullptr) {
+        FreeOverflow(entry.overflow_page_id);
+        throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while StartNewTree");
+    }
+    auto *root = AsNode(page);
+    root->Init(page_id, IndexPageType::LEAF_PAGE);
+    root->InsertAt(0, entry.inline_key.data(), static_cast<int>(entry.inline_key.size()), entry.overflow_page_id,
+                   entry.key_length, entry.value);
+    buffer_pool_manager_->UnpinPage(page_id, true);
+
+    root_page_id_ = page_id;
+    UpdateRootPageId(true);
+}
+
+/*
+ * @return: since we only support unique key, if user try to insert duplicate
+ * keys return false, otherwise return true.
+ */
+bool VarlenBPlusTree::Insert(const std::string &key, int64_t value)
+{
+    latch_.WLock();
+    if (IsEmpty()) {
+        StartNewTree(key, value);
+        latch_.WUnlock();
+        return true;
+    }
+
+    std::vector<std::pair<page_id_t, int>> path;
+    auto *page = FindLeaf(key, &path);
+    auto *leaf = AsNode(page);
+    int index = LowerBound(leaf, key);
+    bool exists = index < leaf->GetSize() && CompareKey(leaf, index, key) == 0;
+    page_id_t leaf_page_id = page->GetPageId();
+    buffer_pool_manager_->UnpinPage(leaf_page_id, false);
+    if (!exists) { InsertEntry(leaf_page_id, index, MakeEntry(key, value), path); }
+    latch_.WUnlock();
+    return !exists;
+}
+
+/*
+ * 节点放不下的时候，把原来的记录和新记录按字节数对半分到两个页里（不是按个数），
+ * 叶子往上插的分隔 key 是右边第一个 key 里能和左边最后一个 key 区分开的最短前缀；
+ * 中间节点把右边第一个 key 整个提上去，右边第 0 个 key 留空
+ */
+void VarlenBPlusTree::InsertEntry(page_id_t page_id, int index, Entry entry,
+                                  std::vector<std::pair<page_id_t, int>> &path)
+{
+    while (true) {
+        auto *page = FetchPage(page_id);
+        auto *node = AsNode(page);
+        int inline_length = static_cast<int>(entry.inline_key.size());
+        bool overflow = entry.overflow_page_id != INVALID_PAGE_ID;
+        if (node->HasRoomFor(inline_length, overflow)) {
+            node->InsertAt(index, entry.inline_key.data(), inline_length, entry.overflow_page_id,
+                           entry.key_length, entry.value);
+            buffer_pool_manager_->UnpinPage(page_id, true);
+            return;
+        }
+
+        page_id_t sibling_page_id;
+        auto *sibling_page = buffer_pool_manager_->NewPage(sibling_page_id);
+        if (sibling_page == nullptr) {
+            buffer_pool_manager_->UnpinPage(page_id, false);
+            throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Split");
+        }
+        bool is_leaf = node->IsLeafPage();
+        IndexPageType page_type = is_leaf ? IndexPageType::LEAF_PAGE : IndexPageType::INTERNAL_PAGE;
+        auto *sibling = AsNode(sibling_page);
+        sibling->Init(sibling_page_id, page_type);
+
+        // 原来的记录先拷出来，新记录虚拟地插在 index 处，一共 count 条
+        std::vector<char> buffer(page->GetData(), page->GetData() + PAGE_SIZE);
+        auto *old = reinterpret_cast<const VarlenBPlusTreePage *>(buffer.data());
+        int count = old->GetSize() + 1;
+        auto record_size = [&](int k) {
+            if (k == index) { return VarlenBPlusTreePage::RecordSize(inline_length, overflow); }
+            return old->RecordSizeAt(k < index ? k : k - 1);
+        };
+        auto place = [&](VarlenBPlusTreePage *dst, int k) {
+            if (k == index) {
+                dst->InsertAt(dst->GetSize(), entry.inline_key.data(), inline_length, entry.overflow_page_id,
+                              entry.key_length, entry.value);
+            } else {
+                dst->CopyFrom(old, k < index ? k : k - 1);
+            }
+        };
+
+        int total = 0;
+        for (int k = 0; k < count; k++) { total += record_size(k); }
+        int mid = 1, left_bytes = record_size(0);
+        while (mid < count - 1 && left_bytes + record_size(mid) <= total / 2) { left_bytes += record_size(mid++); }
+
+        page_id_t next_page_id = old->GetNextPageId();
+        node->Init(page_id, page_type);
+        for (int k = 0; k < mid; k++) { place(node, k); }
+
+        Entry separator;
+        if (is_leaf) {
+            for (int k = mid; k < count; k++) { place(sibling, k); }
+            sibling->SetNextPageId(next_page_id);
+            node->SetNextPageId(sibling_page_id);
+
+            // suffix truncation
+            std::string last = KeyAt(node, node->GetSize() - 1);
+            std::string first = KeyAt(sibling, 0);
+            size_t prefix = 0;
+            while (prefix < last.size() && last[prefix] == first[prefix]) { prefix++; }
+            separator = MakeEntry(first.substr(0, prefix + 1), sibling_page_id);
+        } else {
+            // 提上去的 key 的 overflow 链表交给父节点
+            if (mid == index) {
+                separator = entry;
+            } else {
+                int src = mid < index ? mid : mid - 1;
+                separator.inline_key.assign(old->InlineKeyAt(src), old->InlineLengthAt(src));
+                separator.overflow_page_id = old->OverflowPageAt(src);
+                separator.key_length = old->KeyLengthAt(src);
+                separator.value = old->ValueAt(src);
+            }
+            sibling->InsertAt(0, "", 0, INVALID_PAGE_ID, 0, separator.value);
+            separator.value = sibling_page_id;
+            for (int k = mid + 1; k < count; k++) { place(sibling, k); }
+        }
+        buffer_pool_manager_->UnpinPage(page_id, true);
+        buffer_pool_manager_->UnpinPage(sibling_page_id, true);
+
+        if (path.empty()) {
+            // root 分裂，树长高一层
+            page_id_t root_page_id;
+            auto *root_page = buffer_pool_manager_->NewPage(root_page_id);
+            if (root_page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while Split"); }
+            auto *root = AsNode(root_page);
+            root->Init(root_page_id, IndexPageType::INTERNAL_PAGE);
+            root->InsertAt(0, "", 0, INVALID_PAGE_ID, 0, page_id);
+            root->InsertAt(1, separator.inline_key.data(), static_cast<int>(separator.inline_key.size()),
+                           separator.overflow_page_id, separator.key_length, separator.value);
+            buffer_pool_manager_->UnpinPage(root_page_id, true);
+            root_page_id_ = root_page_id;
+            UpdateRootPageId(false);
+            return;
+        }
+
+        page_id = path.back().first;
+        index = path.back().second + 1;
+        path.pop_back();
+        entry = std::move(separator);
+    }
+}
+
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
+/*
+ * 不做合并：变空的叶子还挂在父节点和叶子链表上，之后落在这个范围的 key 还会插回来
+ */
+bool VarlenBPlusTree::Remove(const std::string &key)
+{
+    latch_.WLock();
+    if (IsEmpty()) {
+        latch_.WUnlock();
+        return false;
+    }
+    auto *page = FindLeaf(key, nullptr);
+    auto *leaf = AsNode(page);
+    int index = LowerBound(leaf, key);
+    if (index >= leaf->GetSize() || CompareKey(leaf, index, key) != 0) {
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+        latch_.WUnlock();
+        return false;
+    }
+    page_id_t overflow_page_id = leaf->OverflowPageAt(index);
+    leaf->RemoveAt(index);
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+    FreeOverflow(overflow_page_id);
+    latch_.WUnlock();
+    return true;
+}
+
+/*
+ * 和 BPlusTree::UpdateRootPageId 一样，header page 里记的是 <index name, root page id>
+ */
+void VarlenBPlusTree::UpdateRootPageId(bool insert_record)
+{
+    auto *page = FetchPage(HEADER_PAGE_ID);
+    auto *header_page = reinterpret_cast<HeaderPage *>(page);
+    if (insert_record) { header_page->InsertRecord(index_name_, root_page_id_); }
+    else { header_page->UpdateRecord(index_name_, root_page_id_); }
+    buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+} // namespace cmudb
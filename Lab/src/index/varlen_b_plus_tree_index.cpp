@@ -0,0 +1,104 @@
+/**
+ * varlen_b_plus_tree_index.cpp
+ */
+
+#include "index/varlen_b_plus_tree_index.h"
+
+namespace cmudb {
+/*
+ * Constructor
+ */
+VarlenBPlusTreeIndex::VarlenBPlusTreeIndex(IndexMetadata *metadata,
+                                           BufferPoolManager *buffer_pool_manager,
+                                           page_id_t root_page_id)
+    : Index(metadata), container_(metadata->GetName(), buffer_pool_manager, root_page_id) {}
+
+/*
+ * 和 BPlusTreeIndex 一样，(key, INCLUDE 列, RID) 在树里是唯一的
+ */
+std::string VarlenBPlusTreeIndex::EncodeEntry(const Tuple &key, RID rid) const {
+    std::string index_key;
+    VarlenKey::Append(index_key, key, GetEntrySchema());
+    VarlenKey::AppendRid(index_key, rid);
+    return index_key;
+}
+
+void VarlenBPlusTreeIndex::InsertEntry(const Tuple &key, RID rid,
+                                       Transaction *transaction) {
+    (void)transaction;
+    std::string index_key = EncodeEntry(key, rid);
+    container_.Insert(index_key, rid.Get());
+    if (bloom_filter_ != nullptr) { bloom_filter_->Add(KeyHash(index_key)); }
+}
+
+void VarlenBPlusTreeIndex::DeleteEntry(const Tuple &key, RID rid,
+                                       Transaction *transaction) {
+    (void)transaction;
+    container_.Remove(EncodeEntry(key, rid));
+    if (bloom_filter_ != nullptr) { bloom_filter_->RecordDelete(); }
+}
+
+void VarlenBPlusTreeIndex::ScanKey(const Tuple &key, std::vector<RID> &result,
+                                   Transaction *transaction,
+                                   std::vector<Tuple> *entries) {
+    std::string search_key;
+    VarlenKey::Append(search_key, key, GetKeySchema());
+    if (!MayContain(search_key)) { return; }
+    size_t found = result.size();
+    ScanBound bound{key, GetKeySchema()->GetColumnCount(), true};
+    ScanRange(&bound, &bound, result, transaction, entries);
+    if (bloom_filter_ != nullptr && result.size() == found) { bloom_filter_->RecordFalsePositive(); }
+}
+
+bool VarlenBPlusTreeIndex::MayContain(const std::string &search_key) {
+    if (bloom_filter_ == nullptr) { return true; }
+    if (bloom_filter_->NeedsRebuild()) {
+        bloom_filter_->Rebuild([this](std::vector<uint64_t> &hashes) {
+            container_.Scan("", [&](const std::string &index_key, int64_t) {
+                hashes.push_back(KeyHash(index_key));
+                return true;
+            });
+        });
+    }
+    return bloom_filter_->MayContain(KeyHash(search_key));
+}
+
+/*
+ * 查询用的 key 只编码 key 列，是同样 key 列的所有 entry 的前缀，所以从它开始扫不会漏掉
+ */
+void VarlenBPlusTreeIndex::ScanRange(const ScanBound *lo, const ScanBound *hi,
+                                     std::vector<RID> &result,
+                                     Transaction *transaction,
+                                     std::vector<Tuple> *entries) {
+    (void)transaction;
+    Schema *entry_schema = GetEntrySchema();
+    std::string lo_key, hi_key;
+    if (lo != nullptr) { VarlenKey::Append(lo_key, lo->key, GetKeySchema()); }
+    if (hi != nullptr) { VarlenKey::Append(hi_key, hi->key, GetKeySchema()); }
+
+    container_.Scan(lo_key, [&](const std::string &index_key, int64_t value) {
+        if (lo != nullptr && !lo->inclusive &&
+            VarlenKey::ComparePrefix(index_key, lo_key, entry_schema, lo->column_count) == 0) {
+            return true;
+        }
+        if (hi != nullptr) {
+            int cmp = VarlenKey::ComparePrefix(index_key, hi_key, entry_schema, hi->column_count);
+            if (cmp > 0 || (cmp == 0 && !hi->inclusive)) { return false; }
+        }
+        result.push_back(RID(value));
+        if (entries != nullptr) { entries->push_back(DecodeEntry(index_key)); }
+        return true;
+    });
+}
+
+Tuple VarlenBPlusTreeIndex::DecodeEntry(const std::string &index_key) const {
+    Schema *entry_schema = GetEntrySchema();
+    std::vector<Value> values;
+    values.reserve(entry_schema->GetColumnCount());
+    for (int i = 0; i < entry_schema->GetColumnCount(); i++) {
+        values.push_back(VarlenKey::GetValue(index_key, entry_schema, i));
+    }
+    return Tuple(values, entry_schema);
+}
+
+} // namespace cmudb
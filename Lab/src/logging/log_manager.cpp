@@ -147,13 +147,11 @@ lsn_t LogManager::AppendLogRecord(LogRecord &log_record)
     std::unique_lock<std::mutex> guard2(latch_);
     log_record.lsn_ = next_lsn_++;   // 这个地方是要原子分配的
 
-    if (size + log_buffer_size_ > LOG_BUFFER_SIZE) {
-        // 叫醒后台线程
-        GetBgTaskToWork();  // 启动后台线程
-        guard2.unlock();
-        WaitUntilBgTaskFinish();  // 反正先把数据全部 flush 到 kernel 先
-        assert(log_buffer_size_ == 0);
-        guard2.lock();
+    while (size + log_buffer_size_ > LOG_BUFFER_SIZE) {
+        // 叫醒后台线程，反正先把数据全部 flush 到 kernel 先
+        // 后台线程正在写上一批的时候 notify 会丢，所以要一直等到 log buffer 真的被换走
+        GetBgTaskToWork();
+        flushed.wait(guard2);
     }
 
     int pos = log_buffer_size_;
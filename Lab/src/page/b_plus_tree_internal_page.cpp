@@ -1,6 +1,7 @@
 /**
  * b_plus_tree_internal_page.cpp
  */
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -32,6 +33,7 @@ BPlusTreeInternalPage<KeyType, ValueType, KeyComparator>::Init(
     SetPageId(page_id);
     // set parent id
     SetParentPageId(parent_id);
+    SetRightLink(INVALID_PAGE_ID);
     /**
      * @brief set max page size, header is 24bytes
      * sizeof(BPlusTreeInternalPage) is the header
@@ -116,23 +118,22 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 ValueType BPlusTreeInternalPage<KeyType, ValueType, KeyComparator>::Lookup(
     const KeyType &key, const KeyComparator &comparator) const
 {
-    /* 要查找的key小于第一个或大于最后一个，就直接返回了，否则在一个 node 内部依然需要一些查找方法 */
     assert(GetValueSize() > 1);
-    if (comparator(key, array[1].first) < 0){ return array[0].second; }
-    else if (comparator(key, array[GetValueSize() - 1].first) >= 0) { 
-        return array[GetValueSize() - 1].second; 
-    }
 
     // 二分查找,节点内部的典型实现方式就是二分查找
-    int low = 1, high = GetValueSize() - 1, mid;
-    while (low < high && low + 1 != high)
-    {
-        mid = low + (high - low) / 2;
-        if (comparator(key, array[mid].first) < 0) { high = mid; }
-        else if (comparator(key, array[mid].first) > 0) { low = mid; }
-        else { return array[mid].second; }
+    // 找第一个大于 key 的 k（upper bound），它左边的 v 就是要去的孩子
+    // 每一轮只调用一次 comparator，不提前判断两端，区间长度每轮减半
+    int low = 1, count = GetValueSize() - 1;
+    while (count > 0) {
+        int half = count / 2;
+        if (comparator(array[low + half].first, key) <= 0) {
+            low += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
     }
-    return array[low].second;
+    return array[low - 1].second;
 }
 
 /*****************************************************************************
@@ -283,6 +284,30 @@ void BPlusTreeInternalPage<KeyType, ValueType, KeyComparator>::CopyHalfFrom(
     IncreaseValueSize(size - 1);  // 中间节点在初始化的时候初始 size=1，这里必须少一个1才是正确的
 }
 
+/**
+ * @brief bulk load 用的，items[0].first 是本节点的 low key，孩子都是刚建好的新页面
+ * 和 MoveHalfTo 一样，搬进来的孩子要把 parent id 改成自己
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeInternalPage<KeyType, ValueType, KeyComparator>::CopyNFrom(
+    const MappingType *items,
+    int size,
+    BufferPoolManager *buffer_pool_manager)
+{
+    assert(!IsLeafPage() && GetValueSize() == 1 && size > 0 && size <= GetMaxValueSize());
+    std::copy(items, items + size, array);
+    IncreaseValueSize(size - 1);
+
+    for (int i = 0; i < size; ++i)
+    {
+        auto *page = buffer_pool_manager->FetchPage(ValueAt(i));
+        if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CopyNFrom"); }
+        auto child = reinterpret_cast<BPlusTreePage *>(page->GetData());
+        child->SetParentPageId(GetPageId());
+        buffer_pool_manager->UnpinPage(child->GetPageId(), true);
+    }
+}
+
 /*****************************************************************************
  * REMOVE
  *****************************************************************************/
@@ -576,5 +601,9 @@ template class BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator
 template class BPlusTreeInternalPage<GenericKey<16>, page_id_t, GenericComparator<16>>;
 template class BPlusTreeInternalPage<GenericKey<32>, page_id_t, GenericComparator<32>>;
 template class BPlusTreeInternalPage<GenericKey<64>, page_id_t, GenericComparator<64>>;
+template class BPlusTreeInternalPage<NormalizedKey<16>, page_id_t, NormalizedComparator<16>>;
+template class BPlusTreeInternalPage<NormalizedKey<32>, page_id_t, NormalizedComparator<32>>;
+template class BPlusTreeInternalPage<NormalizedKey<64>, page_id_t, NormalizedComparator<64>>;
+template class BPlusTreeInternalPage<NormalizedKey<128>, page_id_t, NormalizedComparator<128>>;
 
 } // namespace cmudb
@@ -2,6 +2,7 @@
  * b_plus_tree_leaf_page.cpp
  */
 
+#include <algorithm>
 #include <sstream>
 
 #include "common/exception.h"
@@ -40,9 +41,13 @@ BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Init(
     SetParentPageId(parent_id);
     // set next page id
     SetNextPageId(INVALID_PAGE_ID);
+    // 空页面的 frame 没有意义，第一个 key 进来的时候整个 key 就是 frame
+    elastic_order_ = false;
+    prefix_len_ = sizeof(KeyType);
+    suffix_len_ = 0;
 
-    // set max capacity
-    int size = (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) / (sizeof(KeyType) + sizeof(ValueType));
+    // set max capacity (没有压缩时的容量)
+    int size = (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) / (sizeof(KeyType) + ValueSize());
     SetMaxCapacity(size);
 }
 
@@ -63,21 +68,65 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::SetNextPageId(page_id
 
 /**
  * Helper method to find the first index i so that array[i].first >= key
- * NOTE: This method is only used when generating index iterator
  * b+tree节点中的 k 是按照升序排列的
  *  如果给定一个key，想要判断其位置，假设这个key是比较大的，那么key在线性比较的过程中
  *  一定是key会大于前面的值，从中间的某一个值开始小
  * 给定key返回index
+ * 就是 lower bound，Lookup、插入和删除都用它：每一轮只调用一次 comparator，区间长度每轮减半
+ * slot 里只有 key 的中间一段，不再每一轮都拼一个完整的 key
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 int
 BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::KeyIndex(
     const KeyType &key, const KeyComparator &comparator) const
 {
-    for (int i = 0; i < GetKeySize(); ++i) {
-        if (comparator(key, array[i].first) <= 0) { return i; }
+    if (GetKeySize() == 0) { return 0; }
+    if (ByteComparable<KeyComparator>::value) { return KeyIndexInPlace(key); }
+
+    // comparator 要完整的 key：前后缀拷一次，每一轮只换中间那一段
+    KeyType probe = frame_;
+    int middle = sizeof(KeyType) - prefix_len_ - suffix_len_;
+    int slot_size = SlotSize(prefix_len_, suffix_len_);
+    int low = 0, count = GetKeySize();
+    while (count > 0) {
+        int half = count / 2;
+        memcpy(reinterpret_cast<char *>(&probe) + prefix_len_, array + (low + half) * slot_size, middle);
+        if (comparator(probe, key) < 0) {
+            low += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
     }
-    return GetKeySize();
+    return low;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::KeyIndexInPlace(const KeyType &key) const
+{
+    const int width = sizeof(KeyType);
+    auto *target = reinterpret_cast<const char *>(&key);
+    auto *frame = reinterpret_cast<const char *>(&frame_);
+    // 页内所有 key 的前缀都一样，前缀不同的话 key 要么在所有 key 前面，要么在所有 key 后面
+    int cmp = memcmp(target, frame, prefix_len_);
+    if (cmp != 0) { return cmp < 0 ? 0 : GetKeySize(); }
+    // 后缀也是共用的，只有中间那一段相同的时候才用得上，先比好
+    int suffix_cmp = memcmp(frame + width - suffix_len_, target + width - suffix_len_, suffix_len_);
+
+    int middle = width - prefix_len_ - suffix_len_;
+    int slot_size = SlotSize(prefix_len_, suffix_len_);
+    int low = 0, count = GetKeySize();
+    while (count > 0) {
+        int half = count / 2;
+        cmp = memcmp(array + (low + half) * slot_size, target + prefix_len_, middle);
+        if ((cmp != 0 ? cmp : suffix_cmp) < 0) {
+            low += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return low;
 }
 
 /*
@@ -90,7 +139,24 @@ KeyType BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::KeyAt(int index) c
 {
     // replace with your own code
     assert(0 <= index && index < GetKeySize());
-    return array[index].first;
+    // frame 提供前后缀，slot 提供中间那一段
+    KeyType key = frame_;
+    memcpy(reinterpret_cast<char *>(&key) + prefix_len_,
+        array + index * SlotSize(prefix_len_, suffix_len_),
+        sizeof(KeyType) - prefix_len_ - suffix_len_);
+    return key;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+ValueType BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::ValueAt(int index) const
+{
+    assert(0 <= index && index < GetKeySize());
+    if (ValueInKey::value) { return ValueInKey::Extract(KeyAt(index)); }
+    ValueType value;
+    memcpy(reinterpret_cast<char *>(&value),
+        array + index * SlotSize(prefix_len_, suffix_len_) + sizeof(KeyType) - prefix_len_ - suffix_len_,
+        sizeof(ValueType));
+    return value;
 }
 
 /*
@@ -100,11 +166,144 @@ KeyType BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::KeyAt(int index) c
  * 迭代器遍历的过程中可能会使用到
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
-const MappingType &BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::GetItem(int index)
+MappingType BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::GetItem(int index) const
 {
-    // replace with your own code
-    assert(0 <= index && index < GetKeySize());
-    return array[index];
+    // slot 里存的不是完整的 kv，只能返回拼好的拷贝
+    return {KeyAt(index), ValueAt(index)};
+}
+
+/*****************************************************************************
+ * PREFIX / SUFFIX COMPRESSION
+ * 同一个叶子里的 key 挨得很近，字节上往往有很长的公共前缀（复合 key 的前几列、varchar 的公共开头）
+ * 和公共后缀（小整数的高位字节、varchar 补的 0），这些字节只在 frame_ 里存一份
+ * frame 只会在插入时变窄（Widen），分裂、合并这种整页重排的时候再收紧（Rewrite）
+ *****************************************************************************/
+template <typename KeyType, typename ValueType, typename KeyComparator>
+int BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::SplitSizeFor(int prefix, int suffix) const
+{
+    if (!elastic_order_) { return GetOrder(); }
+    // 没有压缩时 CapacityFor - 1 就是秩；放大到两倍为止，保证分裂出来的两半还在秩以内
+    return std::min(CapacityFor(prefix, suffix) - 1, 2 * GetOrder() - 2);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::FrameWith(
+    const KeyType &key, int &prefix, int &suffix) const
+{
+    const int width = sizeof(KeyType);
+    if (GetKeySize() == 0) {
+        prefix = width;
+        suffix = 0;
+        return;
+    }
+    auto *lhs = reinterpret_cast<const char *>(&frame_);
+    auto *rhs = reinterpret_cast<const char *>(&key);
+    prefix = 0;
+    while (prefix < prefix_len_ && lhs[prefix] == rhs[prefix]) { ++prefix; }
+    suffix = 0;
+    while (suffix < suffix_len_ && lhs[width - 1 - suffix] == rhs[width - 1 - suffix]) { ++suffix; }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CanHold(const KeyType &key) const
+{
+    int prefix, suffix;
+    FrameWith(key, prefix, suffix);
+    return GetKeySize() + 1 <= CapacityFor(prefix, suffix);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::IsSafeToInsert(const KeyType &key) const
+{
+    int prefix, suffix;
+    FrameWith(key, prefix, suffix);
+    return GetKeySize() + 1 < SplitSizeFor(prefix, suffix);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::WriteSlot(
+    int index, const KeyType &key, const ValueType &value)
+{
+    int middle = sizeof(KeyType) - prefix_len_ - suffix_len_;
+    char *slot = array + index * SlotSize(prefix_len_, suffix_len_);
+    memcpy(slot, reinterpret_cast<const char *>(&key) + prefix_len_, middle);
+    // value 已经在 key 里了，插进来的 value 必须就是 key 带的那一个
+    assert(!ValueInKey::value || ValueInKey::Extract(key) == value);
+    memcpy(slot + middle, reinterpret_cast<const char *>(&value), ValueSize());
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::ShiftSlots(int from, int to, int count)
+{
+    int slot_size = SlotSize(prefix_len_, suffix_len_);
+    memmove(array + to * slot_size, array + from * slot_size, static_cast<size_t>(count * slot_size));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+std::vector<MappingType> BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Items(int begin, int end) const
+{
+    std::vector<MappingType> items;
+    items.reserve(end - begin);
+    for (int i = begin; i < end; ++i) { items.push_back(GetItem(i)); }
+    return items;
+}
+
+/**
+ * @brief 要放进来的 key 和 frame 的公共前后缀更短，slot 变宽，整页按新宽度重新编码
+ * 调用者保证变宽之后还放得下（CanHold）
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Widen(const KeyType &key)
+{
+    if (GetKeySize() == 0) {
+        frame_ = key;
+        prefix_len_ = sizeof(KeyType);
+        suffix_len_ = 0;
+        return;
+    }
+    int prefix, suffix;
+    FrameWith(key, prefix, suffix);
+    if (prefix == prefix_len_ && suffix == suffix_len_) { return; }
+    assert(GetKeySize() + 1 <= CapacityFor(prefix, suffix));
+
+    auto items = Items(0, GetKeySize());
+    prefix_len_ = prefix;
+    suffix_len_ = suffix;
+    for (int i = 0; i < GetKeySize(); ++i) { WriteSlot(i, items[i].first, items[i].second); }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Rewrite(const MappingType *items, int size)
+{
+    const int width = sizeof(KeyType);
+    int prefix = width, suffix = width;
+    if (size > 0) {
+        frame_ = items[0].first;
+        auto *lhs = reinterpret_cast<const char *>(&frame_);
+        for (int i = 1; i < size; ++i) {
+            auto *rhs = reinterpret_cast<const char *>(&items[i].first);
+            int p = 0;
+            while (p < prefix && lhs[p] == rhs[p]) { ++p; }
+            int s = 0;
+            while (s < suffix && lhs[width - 1 - s] == rhs[width - 1 - s]) { ++s; }
+            prefix = p;
+            suffix = s;
+        }
+    }
+    // 只有一个 key 的时候前后缀会重叠
+    prefix_len_ = prefix;
+    suffix_len_ = std::min(suffix, width - prefix);
+    assert(size <= CapacityFor(prefix_len_, suffix_len_));
+
+    for (int i = 0; i < size; ++i) { WriteSlot(i, items[i].first, items[i].second); }
+    SetKeySize(size);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Compact()
+{
+    auto items = Items(0, GetKeySize());
+    Rewrite(items.data(), GetKeySize());
 }
 
 /*****************************************************************************
@@ -126,45 +325,17 @@ int BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Insert(
     // 为空或者要插入的值比当前最大的还大
     // 真的是底层写好之后，上面的逻辑确实是在调包
     // 叶子节点 getsize 获得的是 k 的数量，即比 秩小一 的那个值
-    if (GetKeySize() == 0 || comparator(key, KeyAt(GetKeySize() - 1)) > 0) {
-        // 当前叶子节点为空 或 insert 的大于该节点中的最大 key
-        // c++ 11 就可以用花括号来为 std::pair 初始化，类型转换构造函数，std::make_pair 不是必须的
-        // std::pair(key, value);
-        array[GetKeySize()] = {key, value};
-    }
-
-    // 要插入的值当前最小的还小
-    else if (comparator(key, array[0].first) < 0) {
-        // 整体向后搬一个 slot, 这些均为内存操作
-        memmove(
-            (void *)(array + 1), 
-            (void *)array, 
-            static_cast<size_t>(GetKeySize() * sizeof(MappingType)));
-        array[0] = {key, value};
-    } else {
-        // 要插入的位置是一个居中的位置，因为是排序的key，所以采用二分查找
-        int low = 0, high = GetKeySize() - 1, mid;
-        while (low < high && low + 1 != high)
-        {
-            mid = low + (high - low) / 2;
-            if (comparator(key, array[mid].first) < 0) { high = mid; }
-            else if (comparator(key, array[mid].first) > 0) { low = mid; }
-            else {
-                // 由于只支持不重复的key，所以不应当执行到这
-                assert(0);
-            }
-        }
-        // move 剩下的部分，同样的这也都是内存操作，仅仅是使 page dirty
-        memmove(
-            (void *)(array + high + 1), 
-            (void *)(array + high), 
-            static_cast<size_t>((GetKeySize() - high) * sizeof(MappingType)));
-
-        array[high] = {key, value};
-    }
+    // 先让 frame 能装下这个 key
+    Widen(key);
+    // 要插入的位置就是 lower bound，只支持不重复的 key，这个位置上不会是相同的 key
+    int index = KeyIndex(key, comparator);
+    assert(index == GetKeySize() || comparator(key, KeyAt(index)) != 0);
+    // move 剩下的部分，这些均为内存操作，仅仅是使 page dirty
+    ShiftSlots(index, index + 1, GetKeySize() - index);
+    WriteSlot(index, key, value);
 
     IncreaseKeySize(1);  // b+tree 叶子节点中增加了一个元素
-    assert(GetKeySize() <= GetMaxCapacity());
+    assert(GetKeySize() <= GetKeyCapacity());
     // assert(GetKeySize() < GetOrder()); 这里是有可能超过，我打算先 insert 再 split
     return GetKeySize();
 }
@@ -191,25 +362,44 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveHalfTo(
     assert(GetKeySize() > 0);
 
     int size = GetKeySize() / 2;  // 这是向下取整的，如果阶是3，则这里的 3/2=1
-    // src 是指向 MappingType( std::pair ) 的指针，所以 +1 -1 这种操作都是针对 std::pair 的
-    // MappingType *src = array + GetKeySize() - size;
+    // 前少半部分保留在原 node 中的kv
+    MoveTailTo(recipient, GetKeySize() - size, buffer_pool_manager);
+}
 
-    MappingType *src = array + size;  // 前少半部分保留在原 node 中的kv
-    int movesize = GetKeySize() - size;
-    recipient->CopyHalfFrom(src, movesize);
-    IncreaseKeySize(-1 * movesize);  // 并没有去清理不需要的kv，仅仅是把游标改了
+/**
+ * @brief 和 MoveHalfTo 一样，只是搬走的个数由调用者定
+ * 单调递增的 key 只会追加到最右的叶子上，对半分的话左边那一半再也不会被写，永远只有半满
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveTailTo(
+    BPlusTreeLeafPage *recipient, int count, __attribute__((unused)) BufferPoolManager *buffer_pool_manager)
+{
+    assert(count > 0 && count < GetKeySize());
+    auto src = Items(GetKeySize() - count, GetKeySize());
+    recipient->CopyHalfFrom(src.data(), count);
+    IncreaseKeySize(-1 * count);  // 并没有去清理不需要的kv，仅仅是把游标改了
+    // 剩下的部分公共前后缀只会更长，收紧 frame
+    Compact();
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CopyHalfFrom(
-    MappingType *items, int size)
+    const MappingType *items, int size)
 {
     assert(IsLeafPage() && GetKeySize() == 0);
-    for (int i = 0; i < size; ++i)
-    {
-        array[i] = *items++;  // 这里是值传递，不存在传丢了的情况
-    }
-    IncreaseKeySize(size);
+    Rewrite(items, size);
+}
+
+/**
+ * @brief bulk load 用的，和 CopyHalfFrom 一样只能往空叶子里拷
+ * 不走 Insert 的逐个比较和挪动，kv 的顺序由调用者保证
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CopyNFrom(
+    const MappingType *items, int size, BufferPoolManager * /* Unused */)
+{
+    assert(IsLeafPage() && GetKeySize() == 0 && size <= GetMaxKeySize());
+    Rewrite(items, size);
 }
 
 /*****************************************************************************
@@ -227,29 +417,10 @@ bool BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::Lookup(
     const KeyType &key, ValueType &value,
     const KeyComparator &comparator) const
 {
-    if (GetKeySize() == 0 || comparator(key, KeyAt(0)) < 0 || comparator(key, KeyAt(GetKeySize() - 1)) > 0) { 
-        return false; 
-    }
-
-    int low = 0, high = GetKeySize() - 1, mid;
-    while (low <= high)
-    {
-        mid = low + (high - low) / 2;
-        if (comparator(key, KeyAt(mid)) > 0)
-        {
-            low = mid + 1;
-        }
-        else if (comparator(key, KeyAt(mid)) < 0)
-        {
-            high = mid - 1;
-        }
-        else
-        {
-            value = array[mid].second;
-            return true;
-        }
-    }
-    return false;
+    int index = KeyIndex(key, comparator);
+    if (index == GetKeySize() || comparator(key, KeyAt(index)) != 0) { return false; }
+    value = ValueAt(index);
+    return true;
 }
 
 /*****************************************************************************
@@ -267,27 +438,15 @@ int BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::RemoveAndDeleteRecord(
     const KeyType &key, 
     const KeyComparator &comparator)
 {
-    if (GetKeySize() == 0 || comparator(key, KeyAt(0)) < 0 || 
-        comparator(key, KeyAt(GetKeySize() - 1)) > 0) { 
+    int index = KeyIndex(key, comparator);
+    if (index == GetKeySize() || comparator(key, KeyAt(index)) != 0) {
         // 要被删除的 key 不在这个叶子节点中
         return GetKeySize();
     }
 
-    int low = 0, high = GetKeySize() - 1, mid;
-    while (low <= high) {
-        mid = low + (high - low) / 2;
-        if (comparator(key, KeyAt(mid)) > 0) { low = mid + 1; }
-        else if (comparator(key, KeyAt(mid)) < 0) { high = mid - 1; }
-        else {
-            // 删除节点
-            memmove(
-                (void *)(array + mid), 
-                (void *)(array + mid + 1), 
-                static_cast<size_t>((GetKeySize() - mid - 1) * sizeof(MappingType)));
-            IncreaseKeySize(-1);
-            break;
-        }
-    }
+    // 删除节点
+    ShiftSlots(index + 1, index, GetKeySize() - index - 1);
+    IncreaseKeySize(-1);
 
     // 返回减少后的节点中的 key 的数量
     return GetKeySize();
@@ -309,7 +468,8 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveAllTo(
     int, 
     BufferPoolManager *)
 {
-    recipient->CopyAllFrom(array, GetKeySize());
+    auto items = Items(0, GetKeySize());
+    recipient->CopyAllFrom(items.data(), GetKeySize());
     recipient->SetNextPageId(GetNextPageId());
 }
 
@@ -323,12 +483,13 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveAllTo(
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CopyAllFrom(
-    MappingType *items, int size)
+    const MappingType *items, int size)
 {
     assert(GetKeySize() + size <= GetMaxKeySize());
-    auto start = GetKeySize();
-    for (int i = 0; i < size; ++i) { array[start + i] = *items++; }
-    IncreaseKeySize(size);
+    // 两页的 key 合在一起重新算 frame
+    auto all = Items(0, GetKeySize());
+    all.insert(all.end(), items, items + size);
+    Rewrite(all.data(), all.size());
 }
 
 /*****************************************************************************
@@ -348,7 +509,7 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveFirstToEndOf(
     MappingType pair = GetItem(0);
     IncreaseKeySize(-1);  // 拿走第一个
     // 整体前移
-    memmove(array, array + 1, static_cast<size_t>(GetKeySize() * sizeof(MappingType)));
+    ShiftSlots(1, 0, GetKeySize());
     recipient->CopyLastFrom(pair);
 
     // update parent's kv
@@ -365,7 +526,7 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::MoveFirstToEndOf(
     // 由于错位的关系，接收多余kv的是排在前面的node，所以对应需要修改的 k 就是 value 就是当前 pageid 的
 
     // parent->SetKeyAt(parent->ValueIndex(GetPageId()), pair.first);  这里我觉得作者写的有点问题
-    parent->SetKeyAt(parent->ValueIndex(GetPageId()), array[0].first);
+    parent->SetKeyAt(parent->ValueIndex(GetPageId()), KeyAt(0));
 
     buffer_pool_manager->UnpinPage(GetParentPageId(), true);
 }
@@ -374,7 +535,8 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CopyLastFrom(const MappingType &item)
 {
     assert(GetKeySize() + 1 <= GetMaxKeySize());
-    array[GetKeySize()] = item;
+    Widen(item.first);
+    WriteSlot(GetKeySize(), item.first, item.second);
     IncreaseKeySize(1);
 }
 
@@ -411,10 +573,11 @@ void BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::CopyFirstFrom(
     BufferPoolManager *buffer_pool_manager)
 {
     assert(GetKeySize() + 1 <= GetMaxKeySize());
-    memmove((void *)(array + 1), (void *)array, GetKeySize() * sizeof(MappingType));
+    Widen(item.first);
+    ShiftSlots(0, 1, GetKeySize());
     IncreaseKeySize(1);
 
-    array[0] = item;
+    WriteSlot(0, item.first, item.second);
     auto *page = buffer_pool_manager->FetchPage(GetParentPageId());
     if (page == nullptr) { throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while CopyFirstFrom"); }
 
@@ -447,8 +610,8 @@ std::string BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>::ToString(bool
     {
         if (first) { first = false;}
         else { stream << " "; }
-        stream << std::dec << " " << array[entry].first;
-        if (verbose) { stream << " (" << array[entry].second << ")";}  // 叶子节点的值 是 pageid+slotid 密集索引
+        stream << std::dec << " " << KeyAt(entry);
+        if (verbose) { stream << " (" << ValueAt(entry) << ")";}  // 叶子节点的值 是 pageid+slotid 密集索引
         ++entry;
         stream << " ";
     }
@@ -462,5 +625,9 @@ template class BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTreeLeafPage<GenericKey<16>, RID, GenericComparator<16>>;
 template class BPlusTreeLeafPage<GenericKey<32>, RID, GenericComparator<32>>;
 template class BPlusTreeLeafPage<GenericKey<64>, RID, GenericComparator<64>>;
+template class BPlusTreeLeafPage<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BPlusTreeLeafPage<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BPlusTreeLeafPage<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BPlusTreeLeafPage<NormalizedKey<128>, RID, NormalizedComparator<128>>;
 
 } // namespace cmudb
@@ -0,0 +1,144 @@
+/**
+ * be_tree_page.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "page/be_tree_page.h"
+
+namespace cmudb {
+
+#define BETREE_PAGE_HEADER_SIZE 24
+
+/*
+ * Init method after creating a new page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BeTreePage<KeyType, ValueType, KeyComparator>::Init(page_id_t page_id, IndexPageType page_type,
+                                                         int max_size, int max_buffer_size)
+{
+    page_type_ = page_type;
+    page_id_ = page_id;
+    size_ = 0;
+    buffer_size_ = 0;
+    if (page_type == IndexPageType::LEAF_PAGE) {
+        max_size_ = max_size > 0 ? max_size : LeafCapacity();
+        max_buffer_size_ = 0;
+        assert(max_size_ <= LeafCapacity());
+    } else {
+        max_size_ = max_size > 0 ? max_size : FanoutCapacity();
+        max_buffer_size_ = max_buffer_size > 0 ? max_buffer_size : BufferCapacity(max_size_);
+        assert(max_buffer_size_ <= BufferCapacity(max_size_));
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::LeafCapacity()
+{
+    return static_cast<int>((PAGE_SIZE - BETREE_PAGE_HEADER_SIZE) / sizeof(MappingType));
+}
+
+/*
+ * 整页都放消息能放 n 条，扇出取 sqrt(n)，至少是 4
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::FanoutCapacity()
+{
+    int messages = static_cast<int>((PAGE_SIZE - BETREE_PAGE_HEADER_SIZE) / sizeof(Message));
+    return std::max(4, static_cast<int>(std::sqrt(static_cast<double>(messages))));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::BufferCapacity(int fanout)
+{
+    int pivots = fanout * static_cast<int>(sizeof(page_id_t) + sizeof(KeyType));
+    return static_cast<int>((PAGE_SIZE - BETREE_PAGE_HEADER_SIZE - pivots) / sizeof(Message));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::LowerBound(const KeyType &key,
+                                                              const KeyComparator &comparator) const
+{
+    const MappingType *entries = Entries();
+    int lo = 0, hi = size_;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (comparator(entries[mid].first, key) < 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BeTreePage<KeyType, ValueType, KeyComparator>::Lookup(const KeyType &key, ValueType &value,
+                                                           const KeyComparator &comparator) const
+{
+    int index = LowerBound(key, comparator);
+    if (index == size_ || comparator(Entries()[index].first, key) != 0) { return false; }
+    value = Entries()[index].second;
+    return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::ChildIndex(const KeyType &key,
+                                                              const KeyComparator &comparator) const
+{
+    const KeyType *pivots = Pivots();
+    int lo = 1, hi = size_;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (comparator(pivots[mid], key) <= 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo - 1;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BeTreePage<KeyType, ValueType, KeyComparator>::MessageLowerBound(const KeyType &key,
+                                                                     const KeyComparator &comparator) const
+{
+    const Message *buffer = Buffer();
+    int lo = 0, hi = buffer_size_;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (comparator(buffer[mid].key, key) < 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+const BeTreeMessage<KeyType, ValueType, KeyComparator> *
+BeTreePage<KeyType, ValueType, KeyComparator>::FindMessage(const KeyType &key,
+                                                           const KeyComparator &comparator) const
+{
+    int index = MessageLowerBound(key, comparator);
+    if (index == buffer_size_ || comparator(Buffer()[index].key, key) != 0) { return nullptr; }
+    return &Buffer()[index];
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BeTreePage<KeyType, ValueType, KeyComparator>::PutMessage(const Message &message,
+                                                               const KeyComparator &comparator)
+{
+    Message *buffer = Buffer();
+    int index = MessageLowerBound(message.key, comparator);
+    if (index < buffer_size_ && comparator(buffer[index].key, message.key) == 0) {
+        buffer[index] = message;
+        return;
+    }
+    assert(buffer_size_ < max_buffer_size_);
+    memmove(buffer + index + 1, buffer + index, (buffer_size_ - index) * sizeof(Message));
+    buffer[index] = message;
+    buffer_size_++;
+}
+
+template class BeTreePage<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class BeTreePage<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class BeTreePage<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class BeTreePage<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
@@ -0,0 +1,81 @@
+/**
+ * hash_bucket_page.cpp
+ */
+
+#include "common/rid.h"
+#include "page/hash_bucket_page.h"
+
+namespace cmudb {
+
+/*
+ * Init method after creating a new bucket page
+ * set page id, set current size to zero, no overflow page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::Init(page_id_t page_id, int local_depth)
+{
+    page_id_ = page_id;
+    lsn_ = INVALID_LSN;
+    size_ = 0;
+    local_depth_ = local_depth;
+    overflow_page_id_ = INVALID_PAGE_ID;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::Append(const KeyType &key, const ValueType &value)
+{
+    assert(!IsFull());
+    array[size_].first = key;
+    array[size_].second = value;
+    size_++;
+}
+
+/*
+ * 桶里的 kv 没有顺序，只能一个一个比
+ * @return: 找到的 value 个数
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_BUCKET_PAGE_TYPE::GetValues(
+    const KeyType &key, std::vector<ValueType> &result, const KeyComparator &comparator) const
+{
+    int count = 0;
+    for (int i = 0; i < size_; i++) {
+        if (comparator(array[i].first, key) == 0) {
+            result.push_back(array[i].second);
+            count++;
+        }
+    }
+    return count;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_BUCKET_PAGE_TYPE::Find(
+    const KeyType &key, const ValueType &value, const KeyComparator &comparator) const
+{
+    for (int i = 0; i < size_; i++) {
+        if (comparator(array[i].first, key) == 0 && array[i].second == value) { return i; }
+    }
+    return -1;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::RemoveAt(int index)
+{
+    assert(index >= 0 && index < size_);
+    array[index] = array[size_ - 1];
+    size_--;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+MappingType HASH_BUCKET_PAGE_TYPE::PopBack()
+{
+    assert(size_ > 0);
+    return array[--size_];
+}
+
+template class HashBucketPage<NormalizedKey<16>, RID, NormalizedComparator<16>>;
+template class HashBucketPage<NormalizedKey<32>, RID, NormalizedComparator<32>>;
+template class HashBucketPage<NormalizedKey<64>, RID, NormalizedComparator<64>>;
+template class HashBucketPage<NormalizedKey<128>, RID, NormalizedComparator<128>>;
+
+} // namespace cmudb
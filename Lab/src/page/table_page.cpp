@@ -448,6 +448,29 @@ bool TablePage::GetNextTupleRid(const RID &cur_rid, RID &next_rid) {
   return false; // End of last tuple
 }
 
+void TablePage::GetTupleRids(std::vector<RID> &rids) {
+  for (int i = 0; i < GetTupleCount(); ++i) {
+    if (GetTupleSize(i) > 0) { // valid tuple
+      rids.emplace_back(GetPageId(), i);
+    }
+  }
+}
+
+void TablePage::GetTuples(std::vector<Tuple> &tuples) {
+  for (int i = 0; i < GetTupleCount(); ++i) {
+    int32_t tuple_size = GetTupleSize(i);
+    if (tuple_size <= 0) { // deleted
+      continue;
+    }
+    tuples.emplace_back(RID(GetPageId(), i));
+    Tuple &tuple = tuples.back();
+    tuple.size_ = tuple_size;
+    tuple.data_ = new char[tuple_size];
+    memcpy(tuple.data_, GetData() + GetTupleOffset(i), tuple_size);
+    tuple.allocated_ = true;
+  }
+}
+
 /**
  * helper functions
  */
@@ -0,0 +1,141 @@
+/**
+ * varlen_b_plus_tree_page.cpp
+ */
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "page/varlen_b_plus_tree_page.h"
+
+namespace cmudb {
+
+/*
+ * Init method after creating a new page
+ * 没有记录，空闲空间是 slot 目录末尾到页尾
+ */
+void VarlenBPlusTreePage::Init(page_id_t page_id, IndexPageType page_type)
+{
+    page_type_ = page_type;
+    lsn_ = INVALID_LSN;
+    size_ = 0;
+    free_end_ = PAGE_SIZE;
+    page_id_ = page_id;
+    next_page_id_ = INVALID_PAGE_ID;
+    garbage_ = 0;
+    reserved_ = 0;
+}
+
+page_id_t VarlenBPlusTreePage::OverflowPageAt(int index) const
+{
+    if (!IsOverflowAt(index)) { return INVALID_PAGE_ID; }
+    page_id_t overflow_page_id;
+    memcpy(&overflow_page_id, reinterpret_cast<const char *>(this) + slots_[index].offset + sizeof(int64_t),
+           sizeof(page_id_t));
+    return overflow_page_id;
+}
+
+int VarlenBPlusTreePage::KeyLengthAt(int index) const
+{
+    if (!IsOverflowAt(index)) { return InlineLengthAt(index); }
+    int key_length;
+    memcpy(&key_length,
+           reinterpret_cast<const char *>(this) + slots_[index].offset + sizeof(int64_t) + sizeof(page_id_t),
+           sizeof(int));
+    return key_length;
+}
+
+int64_t VarlenBPlusTreePage::ValueAt(int index) const
+{
+    int64_t value;
+    memcpy(&value, reinterpret_cast<const char *>(this) + slots_[index].offset, sizeof(int64_t));
+    return value;
+}
+
+void VarlenBPlusTreePage::SetValueAt(int index, int64_t value)
+{
+    memcpy(reinterpret_cast<char *>(this) + slots_[index].offset, &value, sizeof(int64_t));
+}
+
+int VarlenBPlusTreePage::RecordSize(int inline_length, bool overflow)
+{
+    return sizeof(Slot) + sizeof(int64_t) + (overflow ? sizeof(page_id_t) + sizeof(int) : 0) + inline_length;
+}
+
+int VarlenBPlusTreePage::GetFreeSpace() const
+{
+    return free_end_ - static_cast<int>(sizeof(VarlenBPlusTreePage) + size_ * sizeof(Slot)) + garbage_;
+}
+
+int VarlenBPlusTreePage::GetUsedSpace() const
+{
+    return static_cast<int>(PAGE_SIZE - sizeof(VarlenBPlusTreePage)) - GetFreeSpace();
+}
+
+void VarlenBPlusTreePage::InsertAt(int index, const char *inline_key, int inline_length,
+                                   page_id_t overflow_page_id, int key_length, int64_t value)
+{
+    bool overflow = overflow_page_id != INVALID_PAGE_ID;
+    int record_size = RecordSize(inline_length, overflow) - static_cast<int>(sizeof(Slot));
+    assert(index >= 0 && index <= size_);
+    assert(HasRoomFor(inline_length, overflow));
+    // 连续的空闲空间不够就先压缩
+    if (free_end_ - static_cast<int>(sizeof(VarlenBPlusTreePage) + (size_ + 1) * sizeof(Slot)) < record_size) {
+        Compact();
+    }
+
+    free_end_ -= record_size;
+    char *dst = reinterpret_cast<char *>(this) + free_end_;
+    memcpy(dst, &value, sizeof(int64_t));
+    dst += sizeof(int64_t);
+    if (overflow) {
+        memcpy(dst, &overflow_page_id, sizeof(page_id_t));
+        memcpy(dst + sizeof(page_id_t), &key_length, sizeof(int));
+        dst += sizeof(page_id_t) + sizeof(int);
+    }
+    memcpy(dst, inline_key, inline_length);
+
+    memmove(slots_ + index + 1, slots_ + index, (size_ - index) * sizeof(Slot));
+    slots_[index].offset = static_cast<uint16_t>(free_end_);
+    slots_[index].length = static_cast<uint16_t>(inline_length | (overflow ? OVERFLOW_FLAG : 0));
+    size_++;
+}
+
+void VarlenBPlusTreePage::CopyFrom(const VarlenBPlusTreePage *src, int index)
+{
+    InsertAt(size_, src->InlineKeyAt(index), src->InlineLengthAt(index), src->OverflowPageAt(index),
+             src->KeyLengthAt(index), src->ValueAt(index));
+}
+
+void VarlenBPlusTreePage::RemoveAt(int index)
+{
+    assert(index >= 0 && index < size_);
+    garbage_ += RecordSizeAt(index) - static_cast<int>(sizeof(Slot));
+    memmove(slots_ + index, slots_ + index + 1, (size_ - index - 1) * sizeof(Slot));
+    size_--;
+}
+
+void VarlenBPlusTreePage::Truncate(int size)
+{
+    while (size_ > size) { RemoveAt(size_ - 1); }
+}
+
+/*
+ * 按 slot 的顺序把记录拷到临时缓冲区的尾部，再整体拷回来
+ */
+void VarlenBPlusTreePage::Compact()
+{
+    std::vector<char> buffer(PAGE_SIZE);
+    int end = PAGE_SIZE;
+    for (int i = 0; i < size_; i++) {
+        int record_size = RecordSizeAt(i) - static_cast<int>(sizeof(Slot));
+        end -= record_size;
+        memcpy(buffer.data() + end, reinterpret_cast<char *>(this) + slots_[i].offset, record_size);
+        slots_[i].offset = static_cast<uint16_t>(end);
+    }
+    memcpy(reinterpret_cast<char *>(this) + end, buffer.data() + end, PAGE_SIZE - end);
+    free_end_ = end;
+    garbage_ = 0;
+}
+
+} // namespace cmudb
@@ -152,7 +152,6 @@ void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
   assert(page != nullptr);
   page->WLatch();
   page->ApplyDelete(rid, txn, log_manager_);
-  lock_manager_->Unlock(txn, rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
@@ -167,6 +166,56 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
 
+/**
+ * @brief 提交时真正删除一个 page 上的一批 tuple，page 只 fetch/latch 一次
+ * @param  page_id          desc
+ * @param  rids             desc 都在 page_id 上
+ * @param  txn              desc
+ */
+void TableHeap::ApplyDeletes(page_id_t page_id, const std::vector<RID> &rids,
+                             Transaction *txn) {
+  auto page = reinterpret_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(page_id));
+  assert(page != nullptr);
+  page->WLatch();
+  for (auto &rid : rids) {
+    assert(rid.GetPageId() == page_id);
+    page->ApplyDelete(rid, txn, log_manager_);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
+/**
+ * @brief 回滚一个 page 上的一批写操作，records 已经是逆序（后写的先回滚）
+ * @param  page_id          desc
+ * @param  records          desc 都在 page_id 上
+ * @param  txn              desc
+ */
+void TableHeap::Rollback(page_id_t page_id,
+                         const std::vector<WriteRecord *> &records,
+                         Transaction *txn) {
+  auto page = reinterpret_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(page_id));
+  assert(page != nullptr);
+  page->WLatch();
+  for (auto item : records) {
+    assert(item->rid_.GetPageId() == page_id);
+    if (item->wtype_ == WType::DELETE) {
+      page->RollbackDelete(item->rid_, txn, log_manager_);
+    } else if (item->wtype_ == WType::INSERT) {
+      page->ApplyDelete(item->rid_, txn, log_manager_);
+    } else if (item->wtype_ == WType::UPDATE) {
+      // 事务已经 ABORTED，这里的 update 不会再进 write set
+      Tuple old_tuple;
+      page->UpdateTuple(item->tuple_, old_tuple, item->rid_, txn, lock_manager_,
+                        log_manager_);
+    }
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
 // called by tuple iterator
 bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
   auto page = static_cast<TablePage *>(
@@ -186,6 +235,71 @@ bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
   return res;
 }
 
+/**
+ * @brief 一次性锁住一批 tuple，避免逐个 rid 去抢锁管理器的全局 latch
+ * 没有开启日志时不加锁（与 TablePage 中的行为一致）
+ * @param  rids             desc
+ * @param  txn              desc
+ * @param  exclusive        desc
+ * @return true @c
+ * @return false @c
+ */
+bool TableHeap::LockTuples(const std::vector<RID> &rids, Transaction *txn,
+                           bool exclusive) {
+  if (!ENABLE_LOGGING || txn == nullptr || rids.empty()) {
+    return true;
+  }
+  return exclusive ? lock_manager_->LockExclusiveBatch(txn, rids)
+                   : lock_manager_->LockSharedBatch(txn, rids);
+}
+
+void TableHeap::GetPageIds(std::vector<page_id_t> &page_ids) {
+  page_id_t page_id = first_page_id_;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    assert(page != nullptr);
+    page_ids.push_back(page_id);
+    page->RLatch();
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+}
+
+/**
+ * @brief 和 TableIterator 进入一个新页面时一样：页面读 latch 住，一次性锁住所有 tuple，
+ * 然后整页拷出来，不再逐个 GetTuple
+ * @return false if the page can not be fetched or the locks are not granted
+ */
+bool TableHeap::GetPageTuples(page_id_t page_id, std::vector<Tuple> &tuples,
+                              Transaction *txn, std::mutex *txn_mutex) {
+  auto page =
+      static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  if (page == nullptr) {
+    return false;
+  }
+  page->RLatch();
+  bool locked = true;
+  if (ENABLE_LOGGING && txn != nullptr) {
+    std::vector<RID> rids;
+    page->GetTupleRids(rids);
+    if (txn_mutex != nullptr) {
+      std::lock_guard<std::mutex> lock(*txn_mutex);
+      locked = LockTuples(rids, txn);
+    } else {
+      locked = LockTuples(rids, txn);
+    }
+  }
+  if (locked) {
+    page->GetTuples(tuples);
+  }
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, false);
+  return locked;
+}
+
 bool TableHeap::DeleteTableHeap() {
   // todo: real delete
   return true;
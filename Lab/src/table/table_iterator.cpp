@@ -11,7 +11,18 @@ namespace cmudb {
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
   if (rid.GetPageId() != INVALID_PAGE_ID) {
-    table_heap_->GetTuple(tuple_->rid_, *tuple_, txn_);
+    auto page = static_cast<TablePage *>(
+        table_heap_->buffer_pool_manager_->FetchPage(rid.GetPageId()));
+    assert(page != nullptr);
+    page->RLatch();
+    bool locked = LockPage(page);
+    page->RUnlatch();
+    table_heap_->buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+    if (locked) {
+      table_heap_->GetTuple(tuple_->rid_, *tuple_, txn_);
+    } else {
+      tuple_->rid_ = RID();
+    }
   }
 };
 
@@ -46,10 +57,16 @@ TableIterator &TableIterator::operator++() {
         break;
     }
   }
+  bool new_page = next_tuple_rid.GetPageId() != tuple_->rid_.GetPageId();
   tuple_->rid_ = next_tuple_rid;
 
   if (*this != table_heap_->end()) {
-    table_heap_->GetTuple(tuple_->rid_, *tuple_, txn_);
+    if (new_page && !LockPage(cur_page)) {
+      // 锁不到就结束扫描，事务已经是 ABORTED，由调用方检查事务的状态
+      tuple_->rid_ = RID();
+    } else {
+      table_heap_->GetTuple(tuple_->rid_, *tuple_, txn_);
+    }
   }
   // release until copy the tuple
   cur_page->RUnlatch();
@@ -57,6 +74,26 @@ TableIterator &TableIterator::operator++() {
   return *this;
 }
 
+/**
+ * @brief 进入一个新的 page 时，一次性给该 page 上所有的 tuple 加读锁
+ * 后面逐个 GetTuple 时发现已经持有锁就不会再去找锁管理器了
+ * 和 GetTuple 一样，拿不到锁时事务被置为 ABORTED
+ * @param  page             latched by caller
+ * @return false if the locks are not granted
+ */
+bool TableIterator::LockPage(TablePage *page) {
+  if (!ENABLE_LOGGING || txn_ == nullptr) {
+    return true;
+  }
+  std::vector<RID> rids;
+  page->GetTupleRids(rids);
+  if (!table_heap_->LockTuples(rids, txn_)) {
+    txn_->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
 TableIterator TableIterator::operator++(int) {
   TableIterator clone(*this);
   ++(*this);
@@ -2,8 +2,10 @@
  * virtual_table.cpp
  */
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <sys/stat.h>
 #include <vector>
 
@@ -17,6 +19,14 @@ namespace cmudb {
 
 SQLITE_EXTENSION_INIT1
 
+// 索引的根页号按名字记在 header page 里，同一张表上的索引不能重名
+static void CheckIndexName(const std::vector<Index *> &indexes, IndexMetadata *metadata) {
+    for (auto *index : indexes) {
+        if (index->GetName() == metadata->GetName())
+            throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, duplicate index name " + metadata->GetName());
+    }
+}
+
 /* API implementation */
 
 /** 创建虚拟表
@@ -68,21 +78,32 @@ int VtabCreate(
         // return SQLITE_ERROR;
     }
 
-    // parse arg[4](string that defines table index)
-    Index *index = nullptr;
-    if (argc > 4) {
-        // 如果大于4，则说明需要 为表 创建索引
-        // 正常的操作是在表的某一列（多列）上创建索引，且索引是有名字的
-        std::string index_string(argv[4]);  // 在哪些列上创建索引  (column1, column2) column name
-        index_string = index_string.substr(1, (index_string.size() - 2));  // 这个地方是为了把括号去掉
-        // create index object, allocate memory space
-        IndexMetadata *index_metadata = ParseIndexStatement(index_string, std::string(argv[2]), schema);
-        // 组合索引，B+tree也仅仅只有一个
-        index = ConstructIndex(index_metadata, buffer_pool_manager);
+    // parse arg[4], arg[5] ... (strings that define table indexes)
+    // 每个参数是一个索引，一张表可以有任意多个索引
+    // 索引描述写错了或者建不了（比如 key 太宽）会抛异常，不能让它穿过 sqlite 的回调，变成 SQLITE_ERROR
+    std::vector<Index *> indexes;
+    try {
+        for (int i = 4; i < argc; i++) {
+            // 正常的操作是在表的某一列（多列）上创建索引，且索引是有名字的
+            std::string index_string(argv[i]);  // 在哪些列上创建索引  (column1, column2) column name
+            index_string = index_string.substr(1, (index_string.size() - 2));  // 这个地方是为了把括号去掉
+            // create index object, allocate memory space
+            std::unique_ptr<IndexMetadata> index_metadata(
+                ParseIndexStatement(index_string, std::string(argv[2]), schema));
+            CheckIndexName(indexes, index_metadata.get());
+            indexes.push_back(ConstructIndex(index_metadata.get(), buffer_pool_manager));
+            index_metadata.release();
+        }
+    } catch (Exception &e) {
+        for (auto *index : indexes) { delete index; }
+        delete schema;
+        buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, false);
+        *pzErr = sqlite3_mprintf("%s", e.what());
+        return SQLITE_ERROR;
     }
 
     // create table object, allocate memory space
-    VirtualTable *table = new VirtualTable(schema, buffer_pool_manager, lock_manager, log_manager, index);
+    VirtualTable *table = new VirtualTable(schema, buffer_pool_manager, lock_manager, log_manager, indexes);
     // insert table root page info into header page
     header_page->InsertRecord(std::string(argv[2]), table->GetFirstPageId());
 
@@ -133,21 +154,45 @@ int VtabConnect(
     page_id_t table_root_id;
     header_page->GetRootId(std::string(argv[2]), table_root_id);
 
-    // parse arg[4](string that defines table index)
-    Index *index = nullptr;
-    if (argc > 4) {
-        std::string index_string(argv[4]);
-        index_string = index_string.substr(1, (index_string.size() - 2));
-        // create index object, allocate memory space
-        IndexMetadata *index_metadata = ParseIndexStatement(index_string, std::string(argv[2]), schema);
-        // Retrieve index root page info from header page
-        page_id_t index_root_id;
-        header_page->GetRootId(index_metadata->GetName(), index_root_id);
-        index = ConstructIndex(index_metadata, buffer_pool_manager, index_root_id);
+    // parse arg[4], arg[5] ... (strings that define table indexes)
+    std::vector<Index *> indexes;
+    std::vector<Index *> build_indexes;
+    // 和 VtabCreate 一样，建不了的索引变成 SQLITE_ERROR
+    try {
+        for (int i = 4; i < argc; i++) {
+            std::string index_string(argv[i]);
+            index_string = index_string.substr(1, (index_string.size() - 2));
+            // create index object, allocate memory space
+            std::unique_ptr<IndexMetadata> index_metadata(
+                ParseIndexStatement(index_string, std::string(argv[2]), schema));
+            CheckIndexName(indexes, index_metadata.get());
+            // Retrieve index root page info from header page
+            page_id_t index_root_id = INVALID_PAGE_ID;
+            bool build_index = !header_page->GetRootId(index_metadata->GetName(), index_root_id);
+            indexes.push_back(ConstructIndex(index_metadata.get(), buffer_pool_manager, index_root_id));
+            index_metadata.release();
+            if (build_index) { build_indexes.push_back(indexes.back()); }
+        }
+    } catch (Exception &e) {
+        for (auto *index : indexes) { delete index; }
+        delete schema;
+        buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, false);
+        *pzErr = sqlite3_mprintf("%s", e.what());
+        return SQLITE_ERROR;
     }
 
     VirtualTable *table = new VirtualTable(
-        schema, buffer_pool_manager, lock_manager, log_manager, index, table_root_id);
+        schema, buffer_pool_manager, lock_manager, log_manager, indexes, table_root_id);
+    // 表已经存在但是索引还没有建过，直接从 table heap bulk load
+    for (auto *index : build_indexes) {
+        if (!table->BuildIndex(index)) {
+            *pzErr = sqlite3_mprintf("can't build index %s, existing key is too long",
+                                     index->GetName().c_str());
+            buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, false);
+            delete table;
+            return SQLITE_ERROR;
+        }
+    }
 
     // register virtual table within sqlite system
     schema_string = "CREATE TABLE X(" + schema_string + ");";
@@ -159,43 +204,155 @@ int VtabConnect(
 }
 
 /*
- * we only support
- * (1) equlity check. e.g select * from foo where a = 1
- * (2) indexed column == predicated column
+ * we support
+ * (1) equlity check on every indexed column, e.g select * from foo where a = 1
+ *     idxNum = 1, point query
+ * (2) equality on a prefix of the indexed columns, optionally followed by a range
+ *     on the next column, e.g. a = 1 and b > 2, a between 1 and 3, a >= 1
+ *     idxNum = 2, range scan. idxStr 每两个字符描述一个 argv：
+ *     第一个是 'a' + 该列在索引 key 中的位置，第二个是比较符 '=' '>' 'G'(>=) '<' 'L'(<=)
+ * IN list (a in (1, 2, 3)) 由 sqlite 拆成 (1)，每个值调用一次 xFilter
+ * 约束不会 omit，sqlite 会再检查一遍
+ * hash 索引 (using hash) 没有顺序，只支持 (1)，点查只访问目录和一个桶
+ * 语句用到的列 (colUsed) 都在索引的 key 列和 INCLUDE 列里时，idxNum 再或上 VTAB_COVERING_SCAN，
+ * VtabColumn 直接从索引 entry 取值，不用回表
+ *
+ * 表上有多个索引时每个索引都做一个计划，选估计代价最小的，选中的索引号放在 idxNum 的高位
  */
+static const int VTAB_PLAN_MASK = 0xff;
+static const int VTAB_COVERING_SCAN = 0x100;
+static const int VTAB_INDEX_SHIFT = 16;
+
+// 没有统计信息，代价按经验值估计（和 sqlite 自己没有 ANALYZE 时的做法类似）：
+// 表按 VTAB_ESTIMATED_ROWS 行算，每一列等值把行数除以 10，范围条件一边除以 4
+static const double VTAB_ESTIMATED_ROWS = 1000000.0;
+static const double VTAB_EQ_SELECTIVITY = 0.1;
+static const double VTAB_RANGE_SELECTIVITY = 0.25;
+
+// colUsed 的第 i 位表示第 i 列被用到，第 63 位表示第 63 列及以后的某一列
+static bool IsCoveredBy(sqlite3_uint64 col_used, const std::vector<int> &entry_attrs) {
+  for (int column = 0; column < 64; column++) {
+    if ((col_used & (static_cast<sqlite3_uint64>(1) << column)) == 0)
+      continue;
+    if (column == 63 || std::find(entry_attrs.begin(), entry_attrs.end(), column) == entry_attrs.end())
+      return false;
+  }
+  return true;
+}
+
+// plan of one index, idx_num = 0 means the index is useless for the query
+struct IndexPlan {
+  int idx_num = 0;
+  std::string idx_str;
+  // argvIndex of every constraint
+  std::vector<int> argv_index;
+  double rows = VTAB_ESTIMATED_ROWS;
+  double cost = 0;
+};
+
+static IndexPlan PlanIndex(Index *index, sqlite3_index_info *pIdxInfo) {
+  IndexPlan plan;
+  plan.argv_index.assign(pIdxInfo->nConstraint, 0);
+  const std::vector<int> &key_attrs = index->GetKeyAttrs();
+
+  // find a usable constraint on column with the given op
+  auto find_constraint = [pIdxInfo](int column, unsigned char op) {
+    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+      const auto &constraint = pIdxInfo->aConstraint[i];
+      if (constraint.usable != 0 && constraint.iColumn == column && constraint.op == op)
+        return i;
+    }
+    return -1;
+  };
+
+  int argv_index = 0;
+  auto use_constraint = [&](int i, int key_pos, char op) {
+    plan.argv_index[i] = ++argv_index;
+    plan.idx_str.push_back(static_cast<char>('a' + key_pos));
+    plan.idx_str.push_back(op);
+  };
+
+  // equality on the longest prefix of the key
+  int prefix = 0;
+  for (; prefix < (int)key_attrs.size(); prefix++) {
+    int i = find_constraint(key_attrs[prefix], SQLITE_INDEX_CONSTRAINT_EQ);
+    if (i < 0)
+      break;
+    use_constraint(i, prefix, '=');
+    plan.rows *= VTAB_EQ_SELECTIVITY;
+  }
+
+  // 不回表的扫描每行少一次 table heap 的随机读
+  bool covering = IsCoveredBy(pIdxInfo->colUsed, index->GetEntryAttrs());
+  auto finish = [&](int idx_num, double descent) {
+    plan.idx_num = idx_num | (covering ? VTAB_COVERING_SCAN : 0);
+    plan.rows = std::max(plan.rows, 1.0);
+    plan.cost = descent + plan.rows * (covering ? 1 : 2);
+  };
+  // hash 索引找桶不用从 root 往下走
+  double descent = index->GetMetadata()->GetIndexType() == IndexType::HASH ? 1 : std::log2(VTAB_ESTIMATED_ROWS);
+
+  if (prefix == (int)key_attrs.size()) {
+    plan.idx_str.clear();
+    finish(1, descent);
+    return plan;
+  }
+
+  // hash 索引只能做所有列的等值查询
+  if (index->GetMetadata()->GetIndexType() == IndexType::HASH)
+    return IndexPlan();
+
+  // at most one lower and one upper bound on the column right after the prefix
+  int column = key_attrs[prefix];
+  int i;
+  bool ranged = false;
+  if ((i = find_constraint(column, SQLITE_INDEX_CONSTRAINT_GT)) >= 0 ||
+      (i = find_constraint(column, SQLITE_INDEX_CONSTRAINT_GE)) >= 0) {
+    use_constraint(i, prefix, pIdxInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_GT ? '>' : 'G');
+    plan.rows *= VTAB_RANGE_SELECTIVITY;
+    ranged = true;
+  }
+  if ((i = find_constraint(column, SQLITE_INDEX_CONSTRAINT_LT)) >= 0 ||
+      (i = find_constraint(column, SQLITE_INDEX_CONSTRAINT_LE)) >= 0) {
+    use_constraint(i, prefix, pIdxInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_LT ? '<' : 'L');
+    plan.rows *= VTAB_RANGE_SELECTIVITY;
+    ranged = true;
+  }
+
+  if (prefix == 0 && !ranged)
+    return IndexPlan();
+
+  finish(2, descent);
+  return plan;
+}
+
 int VtabBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
   // LOG_DEBUG("VtabBestIndex");
   VirtualTable *table = reinterpret_cast<VirtualTable *>(tab);
-  if (table->GetIndex() == nullptr)
-    return SQLITE_OK;
-  const std::vector<int> key_attrs = table->GetIndex()->GetKeyAttrs();
-  // make sure indexed column == predicate column
-  // e.g select * from foo where a = 1 and b =2; indexed column must be {a,b}
-  if (pIdxInfo->nConstraint != (int)(key_attrs.size()))
-    return SQLITE_OK;
+  const std::vector<Index *> &indexes = table->GetIndexes();
 
-  int counter = 0;
-  bool is_index_scan = true;
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    if (pIdxInfo->aConstraint[i].usable == 0)
-      continue;
-    int item = pIdxInfo->aConstraint[i].iColumn;
-    // if predicate column is part of indexed column
-    if (std::find(key_attrs.begin(), key_attrs.end(), item) !=
-        key_attrs.end()) {
-      // equlity check
-      if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
-        is_index_scan = false;
-        break;
-      }
-      pIdxInfo->aConstraintUsage[i].argvIndex = (i + 1);
-      counter++;
+  int best = -1;
+  IndexPlan best_plan;
+  for (int index_no = 0; index_no < (int)indexes.size(); index_no++) {
+    IndexPlan plan = PlanIndex(indexes[index_no], pIdxInfo);
+    if (plan.idx_num != 0 && (best < 0 || plan.cost < best_plan.cost)) {
+      best = index_no;
+      best_plan = plan;
     }
   }
+  // 没有索引用得上，全表扫描
+  if (best < 0)
+    return SQLITE_OK;
 
-  if (counter == (int)key_attrs.size() && is_index_scan) {
-    pIdxInfo->idxNum = 1;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++)
+    pIdxInfo->aConstraintUsage[i].argvIndex = best_plan.argv_index[i];
+  pIdxInfo->idxNum = best_plan.idx_num | (best << VTAB_INDEX_SHIFT);
+  if (!best_plan.idx_str.empty()) {
+    pIdxInfo->idxStr = sqlite3_mprintf("%s", best_plan.idx_str.c_str());
+    pIdxInfo->needToFreeIdxStr = 1;
   }
+  pIdxInfo->estimatedCost = best_plan.cost;
+  pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(best_plan.rows);
   return SQLITE_OK;
 }
 
@@ -207,11 +364,15 @@ int VtabBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
 int VtabDisconnect(sqlite3_vtab *pVtab) {
   std::printf("disconnect vtable!\n");
   VirtualTable *virtual_table = reinterpret_cast<VirtualTable *>(pVtab);
+  // VtabOpen 里为只读语句开的事务还没有提交
+  VtabCommit(pVtab);
   // 将所有的脏页写回
   storage_engine_->buffer_pool_manager_->FlushAllDirtyPage();
   delete virtual_table;
   // delete all the global managers
   delete storage_engine_;
+  // 下一次加载扩展时需要重新初始化
+  storage_engine_ = nullptr;
   return SQLITE_OK;
 }
 
@@ -253,6 +414,58 @@ int VtabClose(sqlite3_vtab_cursor *cur) {
     return SQLITE_OK;
 }
 
+/*
+ * 范围条件右边的值转换成数值列上的边界 [lo, hi]，和 sqlite 比较时的规则一致：
+ *  整数列上的小数往里取整，lo = ceil，hi = floor，fraction 为 true 时两边都要改成闭区间
+ *  （a < 2.5 就是 a <= 2，a = 2.5 得到 lo > hi 的空区间）
+ * 不是数值（数值列和 text 比较时 text 总是更大）、或者超出了列的范围时返回 false，
+ * 这时候不能用这个值定位，只能扫整个索引，由 sqlite 逐行检查
+ */
+static bool ConstructBound(TypeId type, sqlite3_value *value, Value &lo, Value &hi, bool &fraction) {
+  fraction = false;
+  int64_t min, max;
+  switch (type) {
+  case TypeId::TINYINT: min = PELOTON_INT8_MIN; max = PELOTON_INT8_MAX; break;
+  case TypeId::SMALLINT: min = PELOTON_INT16_MIN; max = PELOTON_INT16_MAX; break;
+  case TypeId::INTEGER: min = PELOTON_INT32_MIN; max = PELOTON_INT32_MAX; break;
+  case TypeId::BIGINT: min = PELOTON_INT64_MIN; max = PELOTON_INT64_MAX; break;
+  case TypeId::DECIMAL: {
+    int numeric_type = sqlite3_value_numeric_type(value);
+    if (numeric_type != SQLITE_INTEGER && numeric_type != SQLITE_FLOAT)
+      return false;
+    lo = hi = ConstructValue(type, value);
+    return true;
+  }
+  default:
+    lo = hi = ConstructValue(type, value);
+    return true;
+  }
+
+  int64_t lo_number, hi_number;
+  switch (sqlite3_value_numeric_type(value)) {
+  case SQLITE_INTEGER:
+    lo_number = hi_number = sqlite3_value_int64(value);
+    break;
+  case SQLITE_FLOAT: {
+    double number = sqlite3_value_double(value);
+    // 转换成 int64 之前先排除 NaN 和超出范围的值
+    if (!(number > static_cast<double>(min) && number < static_cast<double>(max)))
+      return false;
+    lo_number = static_cast<int64_t>(std::ceil(number));
+    hi_number = static_cast<int64_t>(std::floor(number));
+    fraction = lo_number != hi_number;
+    break;
+  }
+  default:
+    return false;
+  }
+  if (lo_number < min || hi_number > max)
+    return false;
+  lo = type == TypeId::BIGINT ? Value(type, lo_number) : Value(type, static_cast<int32_t>(lo_number));
+  hi = type == TypeId::BIGINT ? Value(type, hi_number) : Value(type, static_cast<int32_t>(hi_number));
+  return true;
+}
+
 /*
 ** This method is called to "rewind" the cursor object back
 ** to the first row of output. This method is always called at least
@@ -264,13 +477,58 @@ int VtabFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
   // LOG_DEBUG("VtabFilter");
   Cursor *cursor = reinterpret_cast<Cursor *>(pVtabCursor);
   Schema *key_schema;
+  if (idxNum != 0)
+    cursor->SetIndex(idxNum >> VTAB_INDEX_SHIFT);
+  cursor->SetCoveringFlag((idxNum & VTAB_COVERING_SCAN) != 0);
+  idxNum &= VTAB_PLAN_MASK;
   // if indexed scan
   if (idxNum == 1) {
     cursor->SetScanFlag(true);
     // Construct the tuple for point query
     key_schema = cursor->GetKeySchema();
     Tuple scan_tuple = ConstructTuple(key_schema, argv);
-    cursor->ScanKey(scan_tuple);
+    if (!cursor->ScanKey(scan_tuple)) { return SQLITE_ABORT; }
+  } else if (idxNum == 2) {
+    cursor->SetScanFlag(true);
+    key_schema = cursor->GetKeySchema();
+    // 没有约束的列填最小值，下界可以直接用来定位
+    std::vector<Value> lo_values, hi_values;
+    for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+      lo_values.push_back(Type::GetMinValue(key_schema->GetType(i)));
+    }
+    hi_values = lo_values;
+    int lo_count = 0, hi_count = 0;
+    bool lo_inclusive = true, hi_inclusive = true;
+    // 有值不能转换成边界时扫整个索引
+    bool bounded = true;
+
+    assert((int)strlen(idxStr) == 2 * argc);
+    for (int i = 0; i < argc; i++) {
+      int key_pos = idxStr[2 * i] - 'a';
+      char op = idxStr[2 * i + 1];
+      Value lo_value(TypeId::INVALID), hi_value(TypeId::INVALID);
+      bool fraction;
+      if (!ConstructBound(key_schema->GetType(key_pos), argv[i], lo_value, hi_value, fraction)) {
+        bounded = false;
+        break;
+      }
+      if (op == '=' || op == '>' || op == 'G') {
+        lo_values[key_pos] = lo_value;
+        lo_count = key_pos + 1;
+        lo_inclusive = (op != '>') || fraction;
+      }
+      if (op == '=' || op == '<' || op == 'L') {
+        hi_values[key_pos] = hi_value;
+        hi_count = key_pos + 1;
+        hi_inclusive = (op != '<') || fraction;
+      }
+    }
+
+    ScanBound lo{Tuple(lo_values, key_schema), lo_count, lo_inclusive};
+    ScanBound hi{Tuple(hi_values, key_schema), hi_count, hi_inclusive};
+    if (!cursor->ScanRange(bounded && lo_count > 0 ? &lo : nullptr, bounded && hi_count > 0 ? &hi : nullptr)) {
+      return SQLITE_ABORT;
+    }
   }
   return SQLITE_OK;
 }
@@ -279,6 +537,10 @@ int VtabNext(sqlite3_vtab_cursor *cur) {
   // LOG_DEBUG("VtabNext");
   Cursor *cursor = reinterpret_cast<Cursor *>(cur);
   ++(*cursor);
+  // 顺序扫描进入新页面时锁不到，迭代器直接走到末尾，事务已经 abort
+  if (global_transaction_ != nullptr && global_transaction_->GetState() == TransactionState::ABORTED) {
+    return SQLITE_ABORT;
+  }
   return SQLITE_OK;
 }
 
@@ -332,6 +594,13 @@ int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
   return SQLITE_OK;
 }
 
+// 错误信息交给 sqlite，由它释放
+static int VtabError(sqlite3_vtab *pVTab, int rc, const char *message) {
+    sqlite3_free(pVTab->zErrMsg);
+    pVTab->zErrMsg = sqlite3_mprintf("%s", message);
+    return rc;
+}
+
 int VtabUpdate(
     sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     sqlite_int64 *pRowid) 
@@ -342,46 +611,54 @@ int VtabUpdate(
 
     // RID帮忙索引一个tuple所在的pageid与slotid
 
-    // The single row with rowid equal to argv[0] is deleted
-    // 删除单行操作
-    if (argc == 1) {
-        const RID rid(sqlite3_value_int64(argv[0]));
-        // delete entry from index
-        table->DeleteEntry(rid);
-        // delete tuple from table heap
-        table->DeleteTuple(rid);
-    }
-    // A new row is inserted with a rowid argv[1] and column values in argv[2] and
-    // following. If argv[1] is an SQL NULL, the a new unique rowid is generated
-    // automatically.
-    // 增加新行
-    else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
-        Schema *schema = table->GetSchema();
-        Tuple tuple = ConstructTuple(schema, (argv + 2));
-        // insert into table heap
-        RID rid;
-        table->InsertTuple(tuple, rid);
-        // insert into index
-        table->InsertEntry(tuple, rid);
-    }
-    // The row with rowid argv[0] is updated with new values in argv[2] and
-    // following parameters.
-    else if (argc > 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
-        Schema *schema = table->GetSchema();
-        Tuple tuple = ConstructTuple(schema, (argv + 2));
-        RID rid(sqlite3_value_int64(argv[0]));
-        // for update, index always delete and insert
-        // because you have no clue key has been updated or not
-        table->DeleteEntry(rid);  // 没有索引直接返回 
-        // if true, then update succeed, rid keep the same
-        // else, delete & insert
-        // tuple与rid都是新构建的
-        if (table->UpdateTuple(tuple, rid) == false) {
+    // 异常不能穿过 sqlite 的栈，转成错误码
+    try {
+        // The single row with rowid equal to argv[0] is deleted
+        // 删除单行操作
+        if (argc == 1) {
+            const RID rid(sqlite3_value_int64(argv[0]));
+            // delete entry from index
+            table->DeleteEntry(rid);
+            // delete tuple from table heap
             table->DeleteTuple(rid);
-            // rid should be different
+        }
+        // A new row is inserted with a rowid argv[1] and column values in argv[2] and
+        // following. If argv[1] is an SQL NULL, the a new unique rowid is generated
+        // automatically.
+        // 增加新行
+        else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+            Schema *schema = table->GetSchema();
+            Tuple tuple = ConstructTuple(schema, (argv + 2));
+            // 索引放不下的 key 在写 table heap 之前拒绝
+            if (!table->CanIndex(tuple)) { return VtabError(pVTab, SQLITE_CONSTRAINT, "index key is too long"); }
+            // insert into table heap
+            RID rid;
             table->InsertTuple(tuple, rid);
+            // insert into index
+            table->InsertEntry(tuple, rid);
+        }
+        // The row with rowid argv[0] is updated with new values in argv[2] and
+        // following parameters.
+        else if (argc > 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+            Schema *schema = table->GetSchema();
+            Tuple tuple = ConstructTuple(schema, (argv + 2));
+            if (!table->CanIndex(tuple)) { return VtabError(pVTab, SQLITE_CONSTRAINT, "index key is too long"); }
+            RID rid(sqlite3_value_int64(argv[0]));
+            // for update, index always delete and insert
+            // because you have no clue key has been updated or not
+            table->DeleteEntry(rid);  // 没有索引直接返回 
+            // if true, then update succeed, rid keep the same
+            // else, delete & insert
+            // tuple与rid都是新构建的
+            if (table->UpdateTuple(tuple, rid) == false) {
+                table->DeleteTuple(rid);
+                // rid should be different
+                table->InsertTuple(tuple, rid);
+            }
+            table->InsertEntry(tuple, rid);
         }
-        table->InsertEntry(tuple, rid);
+    } catch (Exception &e) {
+        return VtabError(pVTab, SQLITE_ERROR, e.what());
     }
     return SQLITE_OK;
 }
@@ -393,6 +670,10 @@ int VtabUpdate(
  */
 int VtabBegin(sqlite3_vtab *pVTab) {
     // LOG_DEBUG("VtabBegin");
+    // VtabOpen 为只读语句开的事务没有人提交，在这里先提交掉，否则它持有的读锁永远不会释放
+    if (global_transaction_ != nullptr) {
+        VtabCommit(pVTab);
+    }
     // create new transaction(write operation will call this method)
     global_transaction_ = storage_engine_->transaction_manager_->Begin();
 
@@ -598,6 +879,56 @@ IndexMetadata *ParseIndexStatement(
     index_name = sql.substr(0, n);
     sql = sql.substr(n + 1);
 
+    // 最后可以加 "with bloom"，点查先问 bloom filter，一定不存在的 key 不用下降
+    bool bloom_filter = false;
+    n = sql.find(" with ");
+    if (n != std::string::npos) {
+        std::string option = sql.substr(n + 6);
+        StringUtility::Trim(option);
+        if (option != "bloom")
+            throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, unknown index option " + option);
+        bloom_filter = true;
+        sql = sql.substr(0, n);
+    }
+
+    // 末尾可以用 "using btree" / "using hash" / "using betree" 指定索引的实现
+    // betree 是写优化的 B^epsilon tree，随机插入多的表用它
+    IndexType index_type = IndexType::BPLUSTREE;
+    n = sql.find(" using ");
+    if (n != std::string::npos) {
+        std::string method = sql.substr(n + 7);
+        StringUtility::Trim(method);
+        if (method == "hash") {
+            index_type = IndexType::HASH;
+        } else if (method == "betree") {
+            index_type = IndexType::BETREE;
+        } else if (method != "btree") {
+            throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, unknown index method " + method);
+        }
+        sql = sql.substr(0, n);
+    }
+    if (bloom_filter && index_type == IndexType::HASH)
+        throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, hash index does not support bloom filter");
+
+    // 覆盖索引："idx a include c, d" 或者 "idx a include (c, d)"，INCLUDE 列只跟着 key 存，不参与查找
+    std::vector<int> include_attrs;
+    n = sql.find(" include ");
+    if (n != std::string::npos) {
+        if (index_type == IndexType::HASH)
+            throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, hash index does not support include columns");
+        std::string include = sql.substr(n + 9);
+        include.erase(std::remove(include.begin(), include.end(), '('), include.end());
+        include.erase(std::remove(include.begin(), include.end(), ')'), include.end());
+        for (std::string &t : StringUtility::Split(include, ',')) {
+            StringUtility::Trim(t);
+            column_id = schema->GetColumnID(t);
+            if (column_id == -1)
+                throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, unknown include column " + t);
+            include_attrs.emplace_back(column_id);
+        }
+        sql = sql.substr(0, n);
+    }
+
     std::vector<std::string> tok = StringUtility::Split(sql, ',');
     // iterate through returned result
     // 组合索引，需要check都要在哪些列上创建索引
@@ -609,78 +940,106 @@ IndexMetadata *ParseIndexStatement(
     }
     if ((int)key_attrs.size() > schema->GetColumnCount())
         throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
+    // 已经是 key 的列不用再 include 一次
+    include_attrs.erase(std::remove_if(include_attrs.begin(), include_attrs.end(), [&key_attrs](int column) {
+                            return std::find(key_attrs.begin(), key_attrs.end(), column) != key_attrs.end();
+                        }), include_attrs.end());
 
     // 需要在哪些列上创建组合索引
     IndexMetadata *metadata =
-        new IndexMetadata(index_name, table_name, schema, key_attrs);
+        new IndexMetadata(index_name, table_name, schema, key_attrs, index_type, include_attrs, bloom_filter);
 
     // LOG_DEBUG("%s", metadata->ToString().c_str());
     return metadata;
 }
 
+Value ConstructValue(TypeId type, sqlite3_value *value) {
+  Value v(TypeId::INVALID);
+  switch (type) {
+  case TypeId::BOOLEAN:
+  case TypeId::INTEGER:
+  case TypeId::SMALLINT:
+  case TypeId::TINYINT:
+    v = Value(type, (int32_t)sqlite3_value_int(value));
+    break;
+  case TypeId::BIGINT:
+    v = Value(type, (int64_t)sqlite3_value_int64(value));
+    break;
+  case TypeId::DECIMAL:
+    v = Value(type, sqlite3_value_double(value));
+    break;
+  case TypeId::VARCHAR:
+    v = Value(type, std::string(reinterpret_cast<const char *>(
+                        sqlite3_value_text(value))));
+    break;
+  default:
+    break;
+  } // End of switch
+  return v;
+}
+
 Tuple ConstructTuple(Schema *schema, sqlite3_value **argv) {
   int column_count = schema->GetColumnCount();
-  Value v(TypeId::INVALID);
   std::vector<Value> values;
   // iterate through schema, generate column value to insert
   for (int i = 0; i < column_count; i++) {
-    TypeId type = schema->GetType(i);
-
-    switch (type) {
-    case TypeId::BOOLEAN:
-    case TypeId::INTEGER:
-    case TypeId::SMALLINT:
-    case TypeId::TINYINT:
-      v = Value(type, (int32_t)sqlite3_value_int(argv[i]));
-      break;
-    case TypeId::BIGINT:
-      v = Value(type, (int64_t)sqlite3_value_int64(argv[i]));
-      break;
-    case TypeId::DECIMAL:
-      v = Value(type, sqlite3_value_double(argv[i]));
-      break;
-    case TypeId::VARCHAR:
-      v = Value(type, std::string(reinterpret_cast<const char *>(
-                          sqlite3_value_text(argv[i]))));
-      break;
-    default:
-      break;
-    } // End of switch
-    values.emplace_back(v);
+    values.emplace_back(ConstructValue(schema->GetType(i), argv[i]));
   }
   Tuple tuple(values, schema);
 
   return tuple;
 }
 
-// serve the functionality of index factory
-Index *ConstructIndex(
+// key 编码成按字节就能比较的格式，末尾带着 RID，按 key 的宽度选一个实例
+template <template <typename, typename, typename> class IndexClass>
+static Index *ConstructSizedIndex(
     IndexMetadata *metadata,
     BufferPoolManager *buffer_pool_manager,
-    page_id_t root_id) 
+    page_id_t root_id,
+    int key_size)
 {
-    // The size of the key in bytes
-    Schema *key_schema = metadata->GetKeySchema();  // table schema 的子集
-    int key_size = key_schema->GetLength();
-    // for each varchar attribute, we assume the largest size is 16 bytes
-    key_size += 16 * key_schema->GetUnlinedColumnCount();
-
-    if (key_size <= 4) {
-        return new BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>(
-            metadata, buffer_pool_manager, root_id);
-    } else if (key_size <= 8) {
-        return new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
-            metadata, buffer_pool_manager, root_id);
-    } else if (key_size <= 16) {
-        return new BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>(
+    if (key_size <= 16) {
+        return new IndexClass<NormalizedKey<16>, RID, NormalizedComparator<16>>(
             metadata, buffer_pool_manager, root_id);
     } else if (key_size <= 32) {
-        return new BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>(
+        return new IndexClass<NormalizedKey<32>, RID, NormalizedComparator<32>>(
+            metadata, buffer_pool_manager, root_id);
+    } else if (key_size <= 64) {
+        return new IndexClass<NormalizedKey<64>, RID, NormalizedComparator<64>>(
             metadata, buffer_pool_manager, root_id);
-    } else {
-        return new BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>(
+    } else if (key_size <= NORMALIZED_KEY_MAX_SIZE) {
+        return new IndexClass<NormalizedKey<128>, RID, NormalizedComparator<128>>(
             metadata, buffer_pool_manager, root_id);
     }
+    throw Exception(EXCEPTION_TYPE_INDEX, "index key is too wide");
+}
+
+// serve the functionality of index factory
+// root_id 对 b+ tree 和 betree 是 root 页号，对 hash 索引是目录页号
+Index *ConstructIndex(
+    IndexMetadata *metadata,
+    BufferPoolManager *buffer_pool_manager,
+    page_id_t root_id) 
+{
+    // The size of the key in bytes, include columns are stored in the key as well
+    // varchar 按声明的长度放下，b+ tree 放不进最大的定长 key 时用变长 key，
+    // 不截断，页里能放多少 key 也按实际长度算
+    int key_size = std::max(NormalizedKeySize(metadata->GetEntrySchema()),
+                            NormalizedKeyDeclaredSize(metadata->GetEntrySchema()));
+    if (metadata->GetIndexType() != IndexType::BPLUSTREE) {
+        // hash 和 betree 没有变长 key，放不下声明的长度时用最宽的定长 key，varchar 列平分剩下的空间，
+        // 超出的值在插入时被拒绝（VirtualTable::CanIndex）
+        if (key_size > NORMALIZED_KEY_MAX_SIZE &&
+            NormalizedKeySize(metadata->GetEntrySchema()) <= NORMALIZED_KEY_MAX_SIZE) {
+            key_size = NORMALIZED_KEY_MAX_SIZE;
+        }
+        if (metadata->GetIndexType() == IndexType::HASH) {
+            return ConstructSizedIndex<ExtendibleHashIndex>(metadata, buffer_pool_manager, root_id, key_size);
+        }
+        return ConstructSizedIndex<BeTreeIndex>(metadata, buffer_pool_manager, root_id, key_size);
+    }
+    if (key_size > NORMALIZED_KEY_MAX_SIZE) { return new VarlenBPlusTreeIndex(metadata, buffer_pool_manager, root_id); }
+    return ConstructSizedIndex<BPlusTreeIndex>(metadata, buffer_pool_manager, root_id, key_size);
 }
 
 // 虚拟表的全局函数
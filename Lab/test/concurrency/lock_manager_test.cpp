@@ -2,6 +2,7 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
 #include <thread>
 
 #include "concurrency/transaction_manager.h"
@@ -643,4 +644,180 @@ TEST(LockManagerTest, DeadlockTest3) {
   thread1.join();
 }
 
+TEST(LockManagerTest, BatchTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+  std::vector<RID> rids{RID{0, 0}, RID{0, 1}, RID{0, 2}};
+
+  Transaction txn0(0);
+  Transaction txn1(1);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn1, rids[1]));
+
+  std::thread t0([&] {
+    // older txn waits for rids[1] and gets the whole batch afterwards
+    EXPECT_TRUE(lock_mgr.LockSharedBatch(&txn0, rids));
+    EXPECT_EQ(txn0.GetState(), TransactionState::GROWING);
+    EXPECT_EQ(txn0.GetSharedLockSet()->size(), rids.size());
+    txn_mgr.Commit(&txn0);
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  txn_mgr.Commit(&txn1);
+  t0.join();
+  EXPECT_EQ(txn0.GetState(), TransactionState::COMMITTED);
+}
+
+TEST(LockManagerTest, BatchDeadlockTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+  std::vector<RID> rids{RID{0, 0}, RID{0, 1}};
+
+  Transaction txn0(0);
+  Transaction txn1(1);
+  Transaction txn2(2);
+  EXPECT_TRUE(lock_mgr.LockShared(&txn0, rids[1]));
+
+  // younger txn dies on rids[1], its request on rids[0] must not stay queued
+  EXPECT_FALSE(lock_mgr.LockExclusiveBatch(&txn1, rids));
+  EXPECT_EQ(txn1.GetState(), TransactionState::ABORTED);
+  EXPECT_TRUE(txn1.GetExclusiveLockSet()->empty());
+  txn_mgr.Abort(&txn1);
+
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn2, rids[0]));
+  txn_mgr.Commit(&txn2);
+  txn_mgr.Commit(&txn0);
+}
+
+TEST(LockManagerTest, FairnessTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  std::atomic<int> order{0};
+  int writer_at = -1, reader_at = -1;
+
+  Transaction txn1(1);
+  Transaction txn2(2);
+  Transaction txn3(3);
+  EXPECT_TRUE(lock_mgr.LockShared(&txn3, rid));
+
+  // older writer queues behind the younger reader
+  std::thread writer([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn2, rid));
+    writer_at = order++;
+    txn_mgr.Commit(&txn2);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // compatible with the granted shared lock, but must not overtake the queued writer
+  std::thread reader([&] {
+    EXPECT_TRUE(lock_mgr.LockShared(&txn1, rid));
+    reader_at = order++;
+    txn_mgr.Commit(&txn1);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(order, 0);
+
+  txn_mgr.Commit(&txn3);
+  writer.join();
+  reader.join();
+  EXPECT_EQ(writer_at, 0);
+  EXPECT_EQ(reader_at, 1);
+}
+
+TEST(LockManagerTest, UpgradePriorityTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  std::atomic<int> order{0};
+  int upgrade_at = -1, writer_at = -1;
+
+  Transaction txn0(0);
+  Transaction txn1(1);
+  Transaction txn3(3);
+  Transaction txn4(4);
+  EXPECT_TRUE(lock_mgr.LockShared(&txn3, rid));
+  EXPECT_TRUE(lock_mgr.LockShared(&txn4, rid));
+
+  std::thread writer([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid));
+    writer_at = order++;
+    txn_mgr.Commit(&txn0);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // a second upgrade on the same rid would deadlock, it aborts instead
+  std::thread upgrader([&] {
+    EXPECT_TRUE(lock_mgr.LockUpgrade(&txn3, rid));
+    upgrade_at = order++;
+    EXPECT_TRUE(txn3.IsExclusiveLocked(rid));
+    EXPECT_FALSE(txn3.IsSharedLocked(rid));
+    txn_mgr.Commit(&txn3);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(lock_mgr.LockUpgrade(&txn4, rid));
+  EXPECT_EQ(txn4.GetState(), TransactionState::ABORTED);
+
+  // a younger writer dies on the pending upgrade
+  EXPECT_FALSE(lock_mgr.LockExclusive(&txn1, rid));
+  txn_mgr.Abort(&txn1);
+
+  // the upgrade jumps ahead of the writer that queued first
+  txn_mgr.Abort(&txn4);
+  upgrader.join();
+  writer.join();
+  EXPECT_EQ(upgrade_at, 0);
+  EXPECT_EQ(writer_at, 1);
+}
+
+TEST(LockManagerTest, RecycleTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+
+  for (int round = 0; round < 10; ++round) {
+    Transaction txn(round);
+    std::vector<RID> rids;
+    for (int i = 0; i < 500; ++i) {
+      rids.emplace_back(round, i);
+    }
+    EXPECT_TRUE(lock_mgr.LockSharedBatch(&txn, rids));
+    EXPECT_EQ(lock_mgr.GetStats().queues, rids.size());
+    txn_mgr.Commit(&txn);
+    // idle queues are reclaimed, only the bounded pools stay around
+    LockTableStats stats = lock_mgr.GetStats();
+    EXPECT_EQ(stats.queues, 0u);
+    EXPECT_EQ(stats.requests, 0u);
+    EXPECT_LE(stats.pooled_queues, static_cast<size_t>(LOCK_POOL_SIZE));
+    EXPECT_LE(stats.pooled_requests, static_cast<size_t>(LOCK_POOL_SIZE));
+  }
+}
+
+TEST(LockManagerTest, ReleasedLsnBoundTest) {
+  // without a log manager nothing is known to be persistent, the early-release lsns still stay bounded
+  LockManager lock_mgr{false};
+  const int count = 4 * LOCK_POOL_SIZE;
+  for (int i = 0; i < count; ++i) {
+    Transaction txn(i);
+    RID rid(0, i);
+    EXPECT_TRUE(lock_mgr.LockShared(&txn, rid));
+    txn.SetState(TransactionState::COMMITTED);
+    txn.SetPrevLSN(i);
+    EXPECT_TRUE(lock_mgr.Unlock(&txn, rid));
+    EXPECT_LE(lock_mgr.GetStats().released, static_cast<size_t>(LOCK_POOL_SIZE));
+  }
+
+  // a recent release is remembered exactly
+  Transaction recent(count);
+  EXPECT_TRUE(lock_mgr.LockShared(&recent, RID(0, count - 1)));
+  EXPECT_EQ(recent.GetDependencyLSN(), count - 1);
+  // a dropped one is covered by the floor, never forgotten
+  Transaction dropped(count + 1);
+  EXPECT_TRUE(lock_mgr.LockShared(&dropped, RID(0, 0)));
+  EXPECT_GE(dropped.GetDependencyLSN(), 0);
+  EXPECT_LT(dropped.GetDependencyLSN(), count - 1);
+  recent.SetState(TransactionState::ABORTED);
+  dropped.SetState(TransactionState::ABORTED);
+  EXPECT_TRUE(lock_mgr.Unlock(&recent, RID(0, count - 1)));
+  EXPECT_TRUE(lock_mgr.Unlock(&dropped, RID(0, 0)));
+}
+
 } // namespace cmudb
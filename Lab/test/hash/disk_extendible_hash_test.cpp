@@ -0,0 +1,157 @@
+/**
+ * disk_extendible_hash_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "hash/disk_extendible_hash.h"
+#include "page/header_page.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(DiskExtendibleHashTest, InsertRemoveTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    DiskExtendibleHash<NormalizedKey<16>, RID, NormalizedComparator<16>> table("foo_hash", bpm, comparator);
+    EXPECT_TRUE(table.IsEmpty());
+
+    NormalizedKey<16> index_key;
+    std::vector<RID> rids;
+    index_key.SetFromInteger(1);
+    EXPECT_FALSE(table.GetValue(index_key, rids));
+    EXPECT_FALSE(table.Remove(index_key, RID(0, 1)));
+
+    std::vector<int64_t> numbers;
+    for (int64_t number = 0; number < 10000; ++number) { numbers.push_back(number); }
+    std::random_shuffle(numbers.begin(), numbers.end());
+    for (auto number : numbers) {
+        index_key.SetFromInteger(number);
+        EXPECT_TRUE(table.Insert(index_key, RID(0, number)));
+    }
+    // the same (key, value) only once
+    index_key.SetFromInteger(42);
+    EXPECT_FALSE(table.Insert(index_key, RID(0, 42)));
+    EXPECT_TRUE(bpm->Check());
+
+    // 10000 keys do not fit in one bucket page, the directory has grown
+    int global_depth = table.GetGlobalDepth();
+    EXPECT_GT(global_depth, 0);
+    EXPECT_LE(global_depth, HASH_MAX_GLOBAL_DEPTH);
+    for (uint32_t slot = 0; slot < (1u << global_depth); ++slot) {
+        EXPECT_LE(table.GetLocalDepth(slot), global_depth);
+    }
+
+    for (int64_t number = 0; number < 10000; ++number) {
+        rids.clear();
+        index_key.SetFromInteger(number);
+        EXPECT_TRUE(table.GetValue(index_key, rids));
+        ASSERT_EQ(rids.size(), 1u);
+        EXPECT_EQ(rids[0].GetSlotNum(), number);
+    }
+
+    // one hot key never splits apart, once its bucket holds nothing else it goes to overflow pages
+    index_key.SetFromInteger(-1);
+    for (int i = 0; i < 1000; ++i) { EXPECT_TRUE(table.Insert(index_key, RID(1, i))); }
+    EXPECT_LE(table.GetGlobalDepth(), HASH_MAX_GLOBAL_DEPTH);
+    rids.clear();
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    EXPECT_EQ(rids.size(), 1000u);
+
+    for (int i = 0; i < 1000; i += 2) { EXPECT_TRUE(table.Remove(index_key, RID(1, i))); }
+    EXPECT_FALSE(table.Remove(index_key, RID(1, 0)));
+    rids.clear();
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    ASSERT_EQ(rids.size(), 500u);
+    for (auto &rid : rids) { EXPECT_EQ(rid.GetSlotNum() % 2, 1); }
+
+    for (int64_t number = 0; number < 10000; number += 2) {
+        index_key.SetFromInteger(number);
+        EXPECT_TRUE(table.Remove(index_key, RID(0, number)));
+    }
+    for (int64_t number = 0; number < 10000; ++number) {
+        rids.clear();
+        index_key.SetFromInteger(number);
+        EXPECT_EQ(table.GetValue(index_key, rids), number % 2 == 1);
+    }
+    EXPECT_TRUE(bpm->Check());
+
+    // reopen from the directory page recorded in the header page
+    page_id_t directory_page_id;
+    EXPECT_TRUE(reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID))->GetRootId("foo_hash", directory_page_id));
+    bpm->UnpinPage(HEADER_PAGE_ID, false);
+    EXPECT_EQ(directory_page_id, table.GetDirectoryPageId());
+    DiskExtendibleHash<NormalizedKey<16>, RID, NormalizedComparator<16>> reopened("foo_hash", bpm, comparator,
+                                                                               directory_page_id);
+    rids.clear();
+    index_key.SetFromInteger(9999);
+    EXPECT_TRUE(reopened.GetValue(index_key, rids));
+    EXPECT_EQ(rids.size(), 1u);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete key_schema;
+    delete bpm;
+    delete disk_manager;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(DiskExtendibleHashTest, ConcurrentInsertTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    DiskExtendibleHash<NormalizedKey<16>, RID, NormalizedComparator<16>> table("foo_hash", bpm, comparator);
+
+    const int num_threads = 4;
+    const int per_thread = 2000;
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; ++tid) {
+        threads.emplace_back([&table, tid]() {
+            NormalizedKey<16> key;
+            for (int i = 0; i < per_thread; ++i) {
+                int64_t number = i * num_threads + tid;
+                key.SetFromInteger(number);
+                table.Insert(key, RID(0, number));
+                // readers run against concurrent splits
+                std::vector<RID> rids;
+                EXPECT_TRUE(table.GetValue(key, rids));
+            }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+
+    NormalizedKey<16> index_key;
+    for (int64_t number = 0; number < num_threads * per_thread; ++number) {
+        std::vector<RID> rids;
+        index_key.SetFromInteger(number);
+        EXPECT_TRUE(table.GetValue(index_key, rids));
+        ASSERT_EQ(rids.size(), 1u);
+        EXPECT_EQ(rids[0].GetSlotNum(), number);
+    }
+    EXPECT_TRUE(bpm->Check());
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete key_schema;
+    delete bpm;
+    delete disk_manager;
+    remove("test.db");
+    remove("test.log");
+}
+
+} // namespace cmudb
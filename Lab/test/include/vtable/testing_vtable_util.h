@@ -38,4 +38,41 @@ bool ExecSQL(sqlite3 *db, std::string sql) {
   return true;
 }
 
+// run a query that returns a single integer, e.g. SELECT count(*) FROM foo
+int64_t QueryInt(sqlite3 *db, std::string sql) {
+  int64_t result = -1;
+  char *zErrMsg = 0;
+  auto callback = [](void *out, int argc, char **argv, char **) {
+    if (argc > 0 && argv[0] != nullptr)
+      *reinterpret_cast<int64_t *>(out) = std::stoll(argv[0]);
+    return 0;
+  };
+  int rc = sqlite3_exec(db, sql.c_str(), callback, &result, &zErrMsg);
+  if (rc != SQLITE_OK) {
+    std::cerr << "SQL error: " + std::string(zErrMsg) << std::endl;
+    sqlite3_free(zErrMsg);
+  }
+  return result;
+}
+
+// idxNum that xBestIndex picked for the virtual table scan of a query, 0 for a full scan
+// EXPLAIN QUERY PLAN prints it as "... VIRTUAL TABLE INDEX <idxNum>:<idxStr>"
+int64_t QueryIdxNum(sqlite3 *db, std::string sql) {
+  int64_t result = -1;
+  char *zErrMsg = 0;
+  auto callback = [](void *out, int argc, char **argv, char **) {
+    std::string detail = argc > 0 && argv[argc - 1] != nullptr ? argv[argc - 1] : "";
+    auto n = detail.find("VIRTUAL TABLE INDEX ");
+    if (n != std::string::npos)
+      *reinterpret_cast<int64_t *>(out) = std::stoll(detail.substr(n + 20));
+    return 0;
+  };
+  int rc = sqlite3_exec(db, ("EXPLAIN QUERY PLAN " + sql).c_str(), callback, &result, &zErrMsg);
+  if (rc != SQLITE_OK) {
+    std::cerr << "SQL error: " + std::string(zErrMsg) << std::endl;
+    sqlite3_free(zErrMsg);
+  }
+  return result;
+}
+
 } // namespace cmudb
\ No newline at end of file
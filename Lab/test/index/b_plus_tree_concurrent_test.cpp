@@ -100,6 +100,23 @@ void DeleteHelperSplit(
   delete transaction;
 }
 
+// helper function to look up the keys of one thread
+void LookupHelperSplit(
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> &tree,
+    const std::vector<int64_t> &keys, int total_threads,
+    __attribute__((unused)) uint64_t thread_itr) {
+  GenericKey<8> index_key;
+  std::vector<RID> rids;
+  for (auto key : keys) {
+    if ((uint64_t) key%total_threads == thread_itr) {
+      rids.clear();
+      index_key.SetFromInteger(key);
+      tree.GetValue(index_key, rids);
+      EXPECT_EQ(rids.size(), 1);
+    }
+  }
+}
+
 TEST(BPlusTreeConcurrentTest, InsertTest1) {
   // create KeyComparator and index schema
   Schema *key_schema = ParseCreateStatement("a bigint");
@@ -416,4 +433,98 @@ TEST(BPlusTreeConcurrentTest, MixTest2) {
   remove("test.log");
 }
 
+// small order, so that splits and merges race with the optimistic readers
+TEST(BPlusTreeConcurrentTest, StressTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(256, disk_manager);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  tree.SetOrder(4);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void) header_page;
+
+  std::vector<int64_t> keys, removed;
+  for (int64_t key = 1; key <= 2000; key++) {
+    keys.push_back(key);
+    if (key % 2 == 0) { removed.push_back(key); }
+  }
+  std::random_shuffle(keys.begin(), keys.end());
+  LaunchParallelTest(8, InsertHelperSplit, std::ref(tree), std::ref(keys), 8);
+  LaunchParallelTest(8, LookupHelperSplit, std::ref(tree), std::ref(keys), 8);
+
+  std::thread reader([&] {
+    // odd keys stay in the tree while the even ones are removed
+    GenericKey<8> index_key;
+    std::vector<RID> rids;
+    for (int64_t key = 1; key <= 2000; key += 2) {
+      rids.clear();
+      index_key.SetFromInteger(key);
+      EXPECT_TRUE(tree.GetValue(index_key, rids));
+    }
+  });
+  LaunchParallelTest(8, DeleteHelperSplit, std::ref(tree), std::ref(removed), 8);
+  reader.join();
+
+  int64_t current_key = 1;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(current_key);
+  for (auto iterator = tree.Begin(index_key); iterator.isEnd() == false;
+       ++iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key + 2;
+  }
+  EXPECT_EQ(current_key, 2001);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+// insert and point lookup throughput from 1 to 64 threads
+TEST(BPlusTreeConcurrentTest, ThroughputTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  const int64_t scale_factor = 20000;
+
+  std::vector<int64_t> keys;
+  for (int64_t key = 1; key <= scale_factor; key++) {
+    keys.push_back(key);
+  }
+  std::random_shuffle(keys.begin(), keys.end());
+
+  for (int threads = 1; threads <= 64; threads *= 2) {
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(1024, disk_manager);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                             comparator);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    auto start = std::chrono::steady_clock::now();
+    LaunchParallelTest(threads, InsertHelperSplit, std::ref(tree), std::ref(keys), threads);
+    auto inserted = std::chrono::steady_clock::now();
+    LaunchParallelTest(threads, LookupHelperSplit, std::ref(tree), std::ref(keys), threads);
+    auto looked_up = std::chrono::steady_clock::now();
+
+    auto insert_us = std::chrono::duration_cast<std::chrono::microseconds>(inserted - start).count();
+    auto lookup_us = std::chrono::duration_cast<std::chrono::microseconds>(looked_up - inserted).count();
+    std::cout << threads << " threads: "
+              << scale_factor * 1000000 / std::max<int64_t>(insert_us, 1) << " inserts/s, "
+              << scale_factor * 1000000 / std::max<int64_t>(lookup_us, 1) << " lookups/s" << std::endl;
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+  }
+}
+
 } // namespace cmudb
@@ -3,8 +3,11 @@
  */
 
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <iostream>
+#include <numeric>
+#include <random>
 #include <sstream>
 
 #include "buffer/buffer_pool_manager.h"
@@ -913,4 +916,1159 @@ TEST(BPlusTreeTests, RandomTest) {
     remove("test.log");
 }
 
+// high keys and right links stay consistent with the leaf chain after splits and merges
+TEST(BPlusTreeTests, BLinkTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(500, disk_manager);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(4);
+
+    GenericKey<8> index_key;
+    RID rid;
+    Transaction *transaction = new Transaction(0);
+
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    for (int64_t key = 1; key <= 200; ++key) {
+        rid.Set((int32_t) (key >> 32), key & 0xFFFFFFFF);
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, rid, transaction);
+    }
+    for (int64_t key = 1; key <= 200; key += 3) {
+        index_key.SetFromInteger(key);
+        tree.Remove(index_key, transaction);
+    }
+
+    auto *first = tree.FindLeafPage(index_key, true);
+    ASSERT_NE(first, nullptr);
+    auto *leaf = first;
+    int leaves = 1;
+    while (leaf->GetRightLink() != INVALID_PAGE_ID) {
+        auto *next = reinterpret_cast<BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>> *>(
+            bpm->FetchPage(leaf->GetRightLink())->GetData());
+        // keys of a leaf are below its high key, the right sibling starts at or above it
+        EXPECT_LT(comparator(leaf->KeyAt(leaf->GetKeySize() - 1), leaf->GetHighKey()), 0);
+        EXPECT_LE(comparator(leaf->GetHighKey(), next->KeyAt(0)), 0);
+        EXPECT_FALSE(leaf->NeedMoveRight(leaf->KeyAt(0), comparator));
+        EXPECT_TRUE(leaf->NeedMoveRight(next->KeyAt(0), comparator));
+        if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+        leaf = next;
+        ++leaves;
+    }
+    EXPECT_FALSE(leaf->NeedMoveRight(leaf->KeyAt(leaf->GetKeySize() - 1), comparator));
+    EXPECT_GT(leaves, 1);
+    if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+    bpm->FetchPage(first->GetPageId())->RUnlatch();
+    bpm->UnpinPage(first->GetPageId(), false);
+    bpm->UnpinPage(first->GetPageId(), false);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, BulkLoadTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(4);
+
+    GenericKey<8> index_key;
+    RID rid;
+    Transaction *transaction = new Transaction(0);
+
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    // unsorted input with duplicates, the first one of a duplicate key wins
+    std::vector<int64_t> keys;
+    for (int64_t key = 1; key <= 1000; ++key) { keys.push_back(key); }
+    std::random_shuffle(keys.begin(), keys.end());
+    std::vector<std::pair<GenericKey<8>, RID>> items;
+    for (auto key : keys) {
+        rid.Set((int32_t) (key >> 32), key & 0xFFFFFFFF);
+        index_key.SetFromInteger(key);
+        items.emplace_back(index_key, rid);
+    }
+    index_key.SetFromInteger(500);
+    items.emplace_back(index_key, RID(-1, -1));
+
+    EXPECT_TRUE(tree.BulkLoad(items, 0.7));
+    EXPECT_EQ(items.size(), 1000u);
+    // only an empty tree can be bulk loaded
+    EXPECT_FALSE(tree.BulkLoad(items));
+
+    std::vector<RID> rids;
+    for (int64_t key = 1; key <= 1000; ++key) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.GetValue(index_key, rids));
+        ASSERT_EQ(rids.size(), 1u);
+        EXPECT_EQ(rids[0].GetSlotNum(), key);
+    }
+
+    int64_t current_key = 1;
+    for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+        EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+        current_key++;
+    }
+    EXPECT_EQ(current_key, 1001);
+
+    // every leaf respects the order and the B-link invariants
+    auto *first = tree.FindLeafPage(index_key, true);
+    ASSERT_NE(first, nullptr);
+    auto *leaf = first;
+    while (true) {
+        EXPECT_LE(leaf->GetKeySize(), leaf->GetMaxKeySize());
+        EXPECT_GE(leaf->GetKeySize(), leaf->GetMinKeySize());
+        if (leaf->GetRightLink() == INVALID_PAGE_ID) { break; }
+        auto *next = reinterpret_cast<BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>> *>(
+            bpm->FetchPage(leaf->GetRightLink())->GetData());
+        EXPECT_LT(comparator(leaf->KeyAt(leaf->GetKeySize() - 1), leaf->GetHighKey()), 0);
+        EXPECT_EQ(comparator(leaf->GetHighKey(), next->KeyAt(0)), 0);
+        if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+        leaf = next;
+    }
+    if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+    bpm->FetchPage(first->GetPageId())->RUnlatch();
+    bpm->UnpinPage(first->GetPageId(), false);
+    bpm->UnpinPage(first->GetPageId(), false);
+
+    // the loaded tree keeps working with normal insert/remove
+    for (int64_t key = 1001; key <= 1200; ++key) {
+        rid.Set((int32_t) (key >> 32), key & 0xFFFFFFFF);
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.Insert(index_key, rid, transaction));
+    }
+    for (int64_t key = 1; key <= 1200; key += 2) {
+        index_key.SetFromInteger(key);
+        tree.Remove(index_key, transaction);
+    }
+    for (int64_t key = 1; key <= 1200; ++key) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        EXPECT_EQ(tree.GetValue(index_key, rids), key % 2 == 0);
+    }
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, CompressionTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint, b bigint, c bigint, d bigint");
+    GenericComparator<32> comparator(key_schema);
+    using LeafPage = BPlusTreeLeafPage<GenericKey<32>, RID, GenericComparator<32>>;
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    // no SetOrder: the leaf split size follows the compressed capacity
+    BPlusTree<GenericKey<32>, RID, GenericComparator<32>> tree("foo_pk", bpm, comparator);
+
+    RID rid;
+    Transaction *transaction = new Transaction(0);
+
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    auto make_key = [](int64_t a, int64_t b) {
+        GenericKey<32> key;
+        int64_t columns[4] = {a, b, b * 31, b * 17};
+        memcpy(key.data, columns, sizeof(columns));
+        return key;
+    };
+    // walks the leaf chain, returns the number of leaves and the largest leaf
+    auto walk_leaves = [&](int &max_size) {
+        auto *first = tree.FindLeafPage(make_key(0, 0), true);
+        auto *leaf = first;
+        int leaves = 1;
+        max_size = 0;
+        while (true) {
+            max_size = std::max(max_size, leaf->GetKeySize());
+            EXPECT_LE(leaf->GetKeySize(), leaf->GetKeyCapacity());
+            if (leaf->GetRightLink() == INVALID_PAGE_ID) { break; }
+            auto *next = reinterpret_cast<LeafPage *>(bpm->FetchPage(leaf->GetRightLink())->GetData());
+            EXPECT_EQ(comparator(leaf->GetHighKey(), next->KeyAt(0)), 0);
+            if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+            leaf = next;
+            ++leaves;
+        }
+        if (leaf != first) { bpm->UnpinPage(leaf->GetPageId(), false); }
+        int max_keys = first->GetMaxKeySize();
+        bpm->FetchPage(first->GetPageId())->RUnlatch();
+        bpm->UnpinPage(first->GetPageId(), false);
+        bpm->UnpinPage(first->GetPageId(), false);
+        return std::make_pair(leaves, max_keys);
+    };
+
+    // only the first column differs, leaves keep just its low bytes
+    std::vector<int64_t> keys;
+    for (int64_t key = 1; key <= 3000; ++key) { keys.push_back(key); }
+    std::random_shuffle(keys.begin(), keys.end());
+    for (auto key : keys) {
+        rid.Set(0, key);
+        EXPECT_TRUE(tree.Insert(make_key(key, 0), rid, transaction));
+    }
+    int max_size;
+    auto leaves = walk_leaves(max_size);
+    EXPECT_GT(max_size, leaves.second);
+    EXPECT_LT(leaves.first * leaves.second, 3000);
+
+    // wide keys in every leaf shrink the common prefix/suffix and force splits before the insert
+    for (int64_t key = 1; key <= 3000; key += 7) {
+        rid.Set(1, key);
+        EXPECT_TRUE(tree.Insert(make_key(key, key * 0x9E3779B9LL), rid, transaction));
+    }
+    walk_leaves(max_size);
+
+    for (int64_t key = 1; key <= 3000; key += 2) { tree.Remove(make_key(key, 0), transaction); }
+    std::vector<RID> rids;
+    for (int64_t key = 1; key <= 3000; ++key) {
+        rids.clear();
+        EXPECT_EQ(tree.GetValue(make_key(key, 0), rids), key % 2 == 0);
+        if (key % 7 == 1) {
+            rids.clear();
+            EXPECT_TRUE(tree.GetValue(make_key(key, key * 0x9E3779B9LL), rids));
+            ASSERT_EQ(rids.size(), 1u);
+            EXPECT_EQ(rids[0].GetPageId(), 1);
+        }
+    }
+
+    int count = 0;
+    GenericKey<32> last;
+    for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+        if (count > 0) { EXPECT_LT(comparator(last, (*iterator).first), 0); }
+        last = (*iterator).first;
+        ++count;
+    }
+    EXPECT_EQ(count, 1500 + 429);
+
+    // normalized keys are searched in place against the compressed slots
+    NormalizedComparator<16> normalized_comparator(ParseCreateStatement("a bigint"));
+    std::vector<char> leaf_data(PAGE_SIZE);
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<NormalizedKey<16>, RID, NormalizedComparator<16>> *>(
+        leaf_data.data());
+    leaf->Init(INVALID_PAGE_ID);
+    leaf->SetOrder(leaf->GetMaxCapacity() - 1);
+    auto normalized_key = [](int64_t number, int slot) {
+        NormalizedKey<16> key;
+        key.SetFromInteger(number);
+        key.SetRid(RID(7, slot));
+        return key;
+    };
+    // 1000..1198 share every byte but the low ones of the column and the RID slot
+    for (int64_t number = 1000; number < 1200; number += 2) {
+        leaf->Insert(normalized_key(number, 1), RID(7, 1), normalized_comparator);
+    }
+    for (int64_t number = 990; number < 1210; ++number) {
+        for (int slot : {0, 1, 2}) {
+            int expected = number < 1000 ? 0 : number >= 1200 ? 100 : static_cast<int>(number - 999) / 2;
+            if (number >= 1000 && number < 1200 && number % 2 == 0 && slot > 1) { expected++; }
+            EXPECT_EQ(leaf->KeyIndex(normalized_key(number, slot), normalized_comparator), expected) << number;
+        }
+    }
+    EXPECT_EQ(leaf->KeyIndex(normalized_key(-1, 1), normalized_comparator), 0);
+    EXPECT_EQ(leaf->KeyIndex(normalized_key(1LL << 40, 1), normalized_comparator), 100);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+// ns per in-page lookup at different fill levels, leaf and internal pages
+// make_key(v) 的 RID 是 (0, v / 2)，和叶子里存的 value 一致
+template <typename KeyType, typename KeyComparator, typename MakeKey>
+void PageSearchBenchmark(const char *name, const KeyComparator &comparator, MakeKey make_key) {
+    std::vector<char> leaf_data(PAGE_SIZE), internal_data(PAGE_SIZE);
+    auto *leaf = reinterpret_cast<BPlusTreeLeafPage<KeyType, RID, KeyComparator> *>(leaf_data.data());
+    auto *internal =
+        reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(internal_data.data());
+    const int lookups = 100000;
+
+    for (int fill : {25, 50, 75, 100}) {
+        leaf->Init(INVALID_PAGE_ID);
+        leaf->SetOrder(leaf->GetMaxCapacity() - 1);
+        internal->Init(INVALID_PAGE_ID);
+        internal->SetOrder(internal->GetMaxCapacity() - 1);
+        int leaf_size = leaf->GetMaxKeySize() * fill / 100;
+        int internal_size = internal->GetMaxValueSize() * fill / 100;
+
+        // even keys only, odd probes miss
+        std::vector<std::pair<KeyType, RID>> items;
+        for (int i = 0; i < leaf_size; ++i) { items.emplace_back(make_key(2 * i), RID(0, i)); }
+        leaf->CopyNFrom(items.data(), leaf_size, nullptr);
+        internal->PopulateNewRoot(0, make_key(2), 1);
+        for (int i = 2; i < internal_size; ++i) { internal->InsertNodeAfter(i - 1, make_key(2 * i), i); }
+
+        std::vector<int64_t> probes;
+        for (int i = 0; i < lookups; ++i) { probes.push_back(std::rand() % (2 * leaf_size)); }
+        std::vector<KeyType> leaf_probes, internal_probes;
+        for (auto probe : probes) {
+            leaf_probes.push_back(make_key(probe));
+            internal_probes.push_back(make_key(probe % (2 * internal_size)));
+        }
+
+        int leaf_errors = 0;
+        RID rid;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i) {
+            bool found = leaf->Lookup(leaf_probes[i], rid, comparator);
+            leaf_errors += found != (probes[i] % 2 == 0);
+        }
+        auto leaf_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / lookups;
+
+        int internal_errors = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i) {
+            page_id_t child = internal->Lookup(internal_probes[i], comparator);
+            internal_errors += child != (probes[i] % (2 * internal_size)) / 2;
+        }
+        auto internal_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / lookups;
+
+        EXPECT_EQ(leaf_errors, 0);
+        EXPECT_EQ(internal_errors, 0);
+        std::cout << name << " fill " << fill << "%: leaf " << leaf_size << " keys " << leaf_ns
+                  << " ns/lookup, internal " << internal_size << " children " << internal_ns << " ns/lookup\n";
+    }
+}
+
+TEST(BPlusTreeTests, PageSearchBenchmark) {
+    // 索引用的 NormalizedKey：叶子在压缩的 slot 上原地 memcmp，中间节点用 NormalizedComparator
+    Schema *bigint_schema = ParseCreateStatement("a bigint");
+    PageSearchBenchmark<NormalizedKey<16>>("bigint ", NormalizedComparator<16>(bigint_schema), [](int64_t key) {
+        NormalizedKey<16> index_key;
+        index_key.SetFromInteger(key);
+        index_key.SetRid(RID(0, static_cast<int>(key / 2)));
+        return index_key;
+    });
+    // GenericKey 每一轮都把列反序列化成 Value 再比较
+    Schema *double_schema = ParseCreateStatement("a double");
+    PageSearchBenchmark<GenericKey<8>>("double ", GenericComparator<8>(double_schema), [](int64_t key) {
+        GenericKey<8> index_key;
+        double value = key;
+        memcpy(index_key.data, &value, sizeof(value));
+        return index_key;
+    });
+    delete bigint_schema;
+    delete double_schema;
+}
+
+TEST(BPlusTreeTests, NormalizedKeyTest) {
+    Schema *key_schema = ParseCreateStatement("a int, b double, c varchar");
+    ASSERT_EQ(NormalizedKeySize(key_schema), 36);
+    NormalizedComparator<64> comparator(key_schema);
+
+    std::vector<int32_t> ints = {PELOTON_INT32_MIN, -3, -1, 0, 1, 2, 300, INT32_MAX};
+    std::vector<double> doubles = {-1e300, -2.5, -0.0, 0.0, 1e-300, 1.5, 1e300};
+    std::vector<std::string> strings = {"", "a", "ab", "abc", "b", "zzzzzzzzzzzzzzzzzzz"};
+    std::vector<Tuple> tuples;
+    for (int i = 0; i < 200; ++i) {
+        std::vector<Value> values;
+        values.emplace_back(TypeId::INTEGER, ints[std::rand() % ints.size()]);
+        values.emplace_back(TypeId::DECIMAL, doubles[std::rand() % doubles.size()]);
+        values.emplace_back(TypeId::VARCHAR, strings[std::rand() % strings.size()]);
+        tuples.emplace_back(values, key_schema);
+    }
+
+    // byte order of the encoded keys must match the Value order column by column
+    auto value_compare = [&](const Tuple &lhs, const Tuple &rhs, int column_count) {
+        for (int i = 0; i < column_count; ++i) {
+            Value l = lhs.GetValue(key_schema, i);
+            Value r = rhs.GetValue(key_schema, i);
+            if (l.CompareLessThan(r) == CMP_TRUE) { return -1; }
+            if (l.CompareGreaterThan(r) == CMP_TRUE) { return 1; }
+        }
+        return 0;
+    };
+    std::vector<NormalizedKey<64>> keys(tuples.size());
+    for (size_t i = 0; i < tuples.size(); ++i) { keys[i].SetFromKey(tuples[i], key_schema); }
+    for (size_t i = 0; i < tuples.size(); ++i) {
+        for (size_t j = 0; j < tuples.size(); ++j) {
+            EXPECT_EQ(comparator(keys[i], keys[j]), value_compare(tuples[i], tuples[j], 3));
+            EXPECT_EQ(comparator.ComparePrefix(keys[i], keys[j], 1), value_compare(tuples[i], tuples[j], 1));
+            EXPECT_EQ(comparator.ComparePrefix(keys[i], keys[j], 2), value_compare(tuples[i], tuples[j], 2));
+        }
+    }
+
+    // every column decodes back to the value it was built from
+    for (size_t i = 0; i < tuples.size(); ++i) {
+        for (int column = 0; column < 3; ++column) {
+            Value original = tuples[i].GetValue(key_schema, column);
+            Value decoded = keys[i].GetValue(key_schema, column);
+            if (original.IsNull()) {
+                EXPECT_TRUE(decoded.IsNull());
+            } else {
+                EXPECT_EQ(decoded.CompareEquals(original), CMP_TRUE);
+            }
+        }
+    }
+
+    // varchar columns share what the fixed columns and the RID leave, longer strings are truncated and reported
+    std::vector<Value> values;
+    values.emplace_back(TypeId::INTEGER, 1);
+    values.emplace_back(TypeId::DECIMAL, 1.0);
+    values.emplace_back(TypeId::VARCHAR, std::string(44, 'x'));
+    NormalizedKey<64> key;
+    EXPECT_TRUE(key.SetFromKey(Tuple(values, key_schema), key_schema));
+    values[2] = Value(TypeId::VARCHAR, std::string(45, 'x'));
+    EXPECT_FALSE(key.SetFromKey(Tuple(values, key_schema), key_schema));
+    EXPECT_EQ(key.GetValue(key_schema, 2).CompareEquals(Value(TypeId::VARCHAR, std::string(44, 'x'))), CMP_TRUE);
+
+    // the leaf keeps the RID only once, inside the key
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    Schema *bigint_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> bigint_comparator(bigint_schema);
+    BPlusTree<NormalizedKey<16>, RID, NormalizedComparator<16>> tree("foo_pk", bpm, bigint_comparator);
+    tree.SetOrder(5);
+    Transaction *transaction = new Transaction(0);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    NormalizedKey<16> index_key;
+    RID rid;
+    std::vector<int64_t> numbers;
+    for (int64_t number = -500; number < 500; ++number) { numbers.push_back(number); }
+    std::random_shuffle(numbers.begin(), numbers.end());
+    for (auto number : numbers) {
+        index_key.SetFromInteger(number);
+        rid.Set(0, number);
+        index_key.SetRid(rid);
+        EXPECT_TRUE(tree.Insert(index_key, rid, transaction));
+    }
+    int64_t current = -500;
+    for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+        EXPECT_EQ((*iterator).second.GetSlotNum(), current);
+        EXPECT_EQ((*iterator).first.GetRid(), (*iterator).second);
+        ++current;
+    }
+    EXPECT_EQ(current, 500);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, GetValuesTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    BPlusTree<NormalizedKey<16>, RID, NormalizedComparator<16>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(4);
+    Transaction *transaction = new Transaction(0);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    // even keys only, key k has k % 3 + 1 duplicates told apart by the RID
+    NormalizedKey<16> index_key;
+    std::vector<int64_t> numbers;
+    for (int64_t number = 0; number < 1000; number += 2) { numbers.push_back(number); }
+    std::random_shuffle(numbers.begin(), numbers.end());
+    for (auto number : numbers) {
+        for (int i = 0; i <= number % 3; ++i) {
+            RID rid(static_cast<page_id_t>(number), i);
+            index_key.SetFromInteger(number);
+            index_key.SetRid(rid);
+            EXPECT_TRUE(tree.Insert(index_key, rid, transaction));
+        }
+    }
+
+    // unsorted probes: hits, misses, repeats, neighbours and far apart keys
+    std::vector<int64_t> probes = {998, 0, 1, 500, 502, 504, -7, 2000, 500, 4, 3, 996, 250, 252};
+    for (int64_t number = 100; number < 160; ++number) { probes.push_back(number); }
+    std::random_shuffle(probes.begin(), probes.end());
+    std::vector<std::pair<NormalizedKey<16>, NormalizedKey<16>>> ranges;
+    for (auto number : probes) {
+        NormalizedKey<16> lo, hi;
+        lo.SetFromInteger(number);
+        hi.SetFromInteger(number);
+        hi.SetRid(RID(PELOTON_INT32_MAX, PELOTON_INT32_MAX));
+        ranges.emplace_back(lo, hi);
+    }
+    std::vector<std::vector<RID>> result;
+    tree.GetValues(ranges, result, transaction);
+    ASSERT_EQ(result.size(), probes.size());
+    for (size_t i = 0; i < probes.size(); ++i) {
+        int64_t number = probes[i];
+        bool hit = number >= 0 && number < 1000 && number % 2 == 0;
+        ASSERT_EQ(result[i].size(), hit ? static_cast<size_t>(number % 3 + 1) : 0u) << number;
+        for (size_t j = 0; j < result[i].size(); ++j) {
+            EXPECT_EQ(result[i][j], RID(static_cast<page_id_t>(number), static_cast<int>(j)));
+        }
+    }
+
+    // exact keys, same answers as GetValue
+    std::vector<NormalizedKey<16>> keys;
+    for (auto number : probes) {
+        index_key.SetFromInteger(number);
+        index_key.SetRid(RID(static_cast<page_id_t>(number), 0));
+        keys.push_back(index_key);
+    }
+    tree.GetValues(keys, result, transaction);
+    ASSERT_EQ(result.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::vector<RID> rids;
+        tree.GetValue(keys[i], rids);
+        EXPECT_EQ(result[i], rids);
+    }
+
+    // the whole batch released its latches and pins
+    index_key.SetFromInteger(0);
+    index_key.SetRid(RID(-1, -1));
+    EXPECT_TRUE(tree.Insert(index_key, RID(-1, -1), transaction));
+    tree.Remove(index_key, transaction);
+
+    // IN list through the index, repeated keys are looked up once
+    Schema *table_schema = ParseCreateStatement("a int, b int");
+    BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>> index(
+        new IndexMetadata("foo_b", "foo", table_schema, {1}), bpm);
+    for (int a = 0; a < 300; ++a) {
+        Tuple key(std::vector<Value>{Value(TypeId::INTEGER, a % 10)}, index.GetKeySchema());
+        index.InsertEntry(key, RID(a, 0), transaction);
+    }
+    std::vector<Tuple> in_list;
+    for (int b : {7, 3, 42, 7, -1}) {
+        in_list.emplace_back(std::vector<Value>{Value(TypeId::INTEGER, b)}, index.GetKeySchema());
+    }
+    std::vector<RID> rids;
+    index.ScanKeys(in_list, rids, transaction);
+    ASSERT_EQ(rids.size(), 60u);
+    for (auto &rid : rids) { EXPECT_TRUE(rid.GetPageId() % 10 == 3 || rid.GetPageId() % 10 == 7); }
+    delete table_schema;
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, IncludeColumnTest) {
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    Transaction *transaction = new Transaction(0);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    // index on b, include c and d
+    Schema *table_schema = ParseCreateStatement("a int, b int, c double, d varchar(8)");
+    BPlusTreeIndex<NormalizedKey<64>, RID, NormalizedComparator<64>> index(
+        new IndexMetadata("foo_b", "foo", table_schema, {1}, IndexType::BPLUSTREE, {2, 3}), bpm);
+    Schema *entry_schema = index.GetEntrySchema();
+    ASSERT_EQ(entry_schema->GetColumnCount(), 3);
+    for (int a = 0; a < 300; ++a) {
+        Tuple entry(std::vector<Value>{Value(TypeId::INTEGER, a % 10), Value(TypeId::DECIMAL, a * 0.5),
+                                       Value(TypeId::VARCHAR, "v" + std::to_string(a))},
+                    entry_schema);
+        index.InsertEntry(entry, RID(a, 0), transaction);
+    }
+
+    // lookups only give the key columns, the include columns come back with the entries
+    std::vector<RID> rids;
+    std::vector<Tuple> entries;
+    Tuple key(std::vector<Value>{Value(TypeId::INTEGER, 7)}, index.GetKeySchema());
+    index.ScanKey(key, rids, transaction, &entries);
+    ASSERT_EQ(rids.size(), 30u);
+    ASSERT_EQ(entries.size(), 30u);
+    for (size_t i = 0; i < rids.size(); ++i) {
+        int a = rids[i].GetPageId();
+        EXPECT_EQ(a % 10, 7);
+        EXPECT_EQ(entries[i].GetValue(entry_schema, 0).GetAs<int32_t>(), 7);
+        EXPECT_EQ(entries[i].GetValue(entry_schema, 1).GetAs<double>(), a * 0.5);
+        EXPECT_EQ(entries[i].GetValue(entry_schema, 2).ToString(), "v" + std::to_string(a));
+    }
+
+    // range over the key column, and the batched lookup falls back to one probe per key for entries
+    rids.clear();
+    entries.clear();
+    ScanBound lo{Tuple(std::vector<Value>{Value(TypeId::INTEGER, 3)}, index.GetKeySchema()), 1, true};
+    ScanBound hi{Tuple(std::vector<Value>{Value(TypeId::INTEGER, 4)}, index.GetKeySchema()), 1, false};
+    index.ScanRange(&lo, &hi, rids, transaction, &entries);
+    EXPECT_EQ(rids.size(), 30u);
+    EXPECT_EQ(entries.size(), 30u);
+    rids.clear();
+    entries.clear();
+    index.ScanKeys({key, lo.key}, rids, transaction, &entries);
+    EXPECT_EQ(rids.size(), 60u);
+    EXPECT_EQ(entries.size(), 60u);
+    rids.clear();
+    index.ScanKeys({key, lo.key}, rids, transaction);
+    EXPECT_EQ(rids.size(), 60u);
+
+    // delete needs the include columns as well
+    Tuple entry(std::vector<Value>{Value(TypeId::INTEGER, 7), Value(TypeId::DECIMAL, 3.5),
+                                   Value(TypeId::VARCHAR, std::string("v7"))},
+                entry_schema);
+    index.DeleteEntry(entry, RID(7, 0), transaction);
+    rids.clear();
+    index.ScanKey(key, rids, transaction);
+    EXPECT_EQ(rids.size(), 29u);
+    delete table_schema;
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, LazyMergeTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(500, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    Transaction *transaction = new Transaction(0);
+
+    // leaves hold at most 39 keys, a split leaves about 20 on each side
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> eager("foo_eager", bpm, comparator);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> lazy("foo_lazy", bpm, comparator);
+    eager.SetOrder(40);
+    lazy.SetOrder(40);
+    lazy.SetMergeThreshold(4);
+    EXPECT_THROW(lazy.SetMergeThreshold(1), Exception);
+
+    GenericKey<8> index_key;
+    const int64_t scale = 6000;
+    // descending: ascending keys would take the 90/10 right-most split and leave the leaves nearly full
+    for (int64_t key = scale; key >= 1; key--) {
+        index_key.SetFromInteger(key);
+        eager.Insert(index_key, RID(0, static_cast<int>(key)), transaction);
+        lazy.Insert(index_key, RID(0, static_cast<int>(key)), transaction);
+    }
+    int eager_leaves = eager.GetLeafCount();
+    int lazy_leaves = lazy.GetLeafCount();
+    EXPECT_EQ(eager_leaves, lazy_leaves);
+
+    // one third removed, leaves drop to about 13 keys: below half but above a quarter
+    for (int64_t key = 1; key <= scale; key += 3) {
+        index_key.SetFromInteger(key);
+        eager.Remove(index_key, transaction);
+        lazy.Remove(index_key, transaction);
+    }
+    EXPECT_LT(eager.GetLeafCount(), eager_leaves);
+    EXPECT_EQ(lazy.GetLeafCount(), lazy_leaves);
+
+    // compaction brings the sparse leaves back to half full
+    EXPECT_GT(lazy.Compact(transaction), 0);
+    EXPECT_LT(lazy.GetLeafCount(), lazy_leaves * 4 / 5);
+    int64_t current_key = 2;
+    for (auto iterator = lazy.Begin(); !iterator.isEnd(); ++iterator) {
+        EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+        current_key += current_key % 3 == 2 ? 1 : 2;
+    }
+    EXPECT_EQ(current_key, scale + 2);
+    std::vector<RID> rids;
+    for (int64_t key = 1; key <= scale; key++) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        lazy.GetValue(index_key, rids);
+        EXPECT_EQ(rids.size(), key % 3 == 1 ? 0u : 1u);
+    }
+
+    // the background task does the same off the delete path
+    int before = lazy.GetLeafCount();
+    lazy.StartBackgroundCompaction(std::chrono::milliseconds(10));
+    for (int64_t key = 2; key <= scale; key += 3) {
+        index_key.SetFromInteger(key);
+        lazy.Remove(index_key, transaction);
+    }
+    int after = before;
+    for (int i = 0; i < 200 && after >= before * 3 / 4; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        after = lazy.GetLeafCount();
+    }
+    lazy.StopBackgroundCompaction();
+    EXPECT_LT(after, before * 3 / 4);
+    for (int64_t key = 3; key <= scale; key += 3) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        lazy.GetValue(index_key, rids);
+        EXPECT_EQ(rids.size(), 1u);
+    }
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, StatisticsDefragmentTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    Transaction *transaction = new Transaction(0);
+
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(20);
+    EXPECT_EQ(tree.GetStatistics().height, 0);
+
+    // 乱序插入，分裂出来的叶子在文件里是打散的
+    const int64_t scale = 3000;
+    std::vector<int64_t> keys(scale);
+    for (int64_t i = 0; i < scale; i++) { keys[i] = i + 1; }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(15445));
+    GenericKey<8> index_key;
+    for (auto key : keys) {
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, RID(0, static_cast<int>(key)), transaction);
+    }
+    auto stats = tree.GetStatistics();
+    EXPECT_EQ(stats.keys, static_cast<size_t>(scale));
+    EXPECT_EQ(stats.height, static_cast<int>(stats.layer_pages.size()));
+    EXPECT_GE(stats.height, 3);
+    EXPECT_EQ(stats.layer_pages[0], 1);
+    EXPECT_EQ(stats.layer_pages.back(), tree.GetLeafCount());
+    EXPECT_EQ(stats.splits, static_cast<size_t>(std::accumulate(stats.layer_pages.begin(), stats.layer_pages.end(), 0) -
+                                                stats.height));
+    EXPECT_EQ(stats.merges, 0u);
+    EXPECT_GT(stats.min_fill_factor, 0.4);
+    EXPECT_GE(stats.avg_fill_factor, stats.min_fill_factor);
+    EXPECT_LT(stats.leaf_contiguity, 0.5);
+
+    // 2/3 删掉，留下的叶子不到半满的就会合并
+    tree.SetMergeThreshold(4);
+    for (int64_t key = 1; key <= scale; key++) {
+        if (key % 3 == 0) { continue; }
+        index_key.SetFromInteger(key);
+        tree.Remove(index_key, transaction);
+    }
+    stats = tree.GetStatistics();
+    EXPECT_EQ(stats.keys, static_cast<size_t>(scale / 3));
+
+    // 读者在整理期间一直能查到所有留下的 key
+    std::atomic<bool> done{false};
+    std::atomic<int> missing{0};
+    std::thread reader([&]() {
+        std::vector<RID> rids;
+        GenericKey<8> probe;
+        while (!done) {
+            for (int64_t key = 3; key <= scale; key += 3) {
+                rids.clear();
+                probe.SetFromInteger(key);
+                tree.GetValue(probe, rids);
+                if (rids.size() != 1) { missing++; }
+            }
+        }
+    });
+    EXPECT_GT(tree.Defragment(transaction), 0);
+    done = true;
+    reader.join();
+    EXPECT_EQ(missing, 0);
+
+    auto after = tree.GetStatistics();
+    EXPECT_EQ(after.keys, static_cast<size_t>(scale / 3));
+    EXPECT_EQ(after.leaf_contiguity, 1.0);
+    EXPECT_GT(after.min_fill_factor, 0.45);
+    EXPECT_GT(after.merges, stats.merges);
+    EXPECT_LT(after.layer_pages.back(), stats.layer_pages.back());
+    EXPECT_EQ(tree.Defragment(transaction), 0);
+
+    int64_t current_key = 3;
+    for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator) {
+        EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+        current_key += 3;
+    }
+    EXPECT_EQ(current_key, scale + 3);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+
+TEST(BPlusTreeTests, RightmostAppendTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    Transaction *transaction = new Transaction(0);
+
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(20);
+
+    // 递增的 key 都追加到最右的叶子上，分裂只分出去一小部分，左边的叶子几乎是满的
+    const int64_t scale = 5000;
+    GenericKey<8> index_key;
+    for (int64_t key = 1; key <= scale; key++) {
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.Insert(index_key, RID(0, static_cast<int>(key)), transaction));
+    }
+    auto stats = tree.GetStatistics();
+    EXPECT_EQ(stats.keys, static_cast<size_t>(scale));
+    EXPECT_GT(stats.avg_fill_factor, 0.8);
+    // 对半分的话差不多是 scale / 10 个叶子
+    EXPECT_LT(stats.layer_pages.back(), static_cast<int>(scale / 15));
+
+    // 重复的 key 和插到中间的 key 走原来的路径
+    index_key.SetFromInteger(scale / 2);
+    EXPECT_FALSE(tree.Insert(index_key, RID(0, 0), transaction));
+    index_key.SetFromInteger(scale);
+    EXPECT_FALSE(tree.Insert(index_key, RID(0, 0), transaction));
+
+    // 两个线程交替追加，key 整体递增但彼此会插到对方前面
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([&, t]() {
+            GenericKey<8> k;
+            for (int64_t key = scale + 1 + t; key <= 2 * scale; key += 2) {
+                k.SetFromInteger(key);
+                tree.Insert(k, RID(0, static_cast<int>(key)));
+            }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+
+    std::vector<RID> rids;
+    for (int64_t key = 1; key <= 2 * scale; key++) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        tree.GetValue(index_key, rids);
+        ASSERT_EQ(rids.size(), 1u);
+        EXPECT_EQ(rids[0].GetSlotNum(), key);
+    }
+    int64_t current_key = 1;
+    for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator) {
+        EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+        current_key++;
+    }
+    EXPECT_EQ(current_key, 2 * scale + 1);
+
+    // 删除之后最右的叶子被合并掉了，缓存失效，接着追加还是对的
+    for (int64_t key = 2 * scale; key > scale; key--) {
+        index_key.SetFromInteger(key);
+        tree.Remove(index_key, transaction);
+    }
+    for (int64_t key = scale + 1; key <= scale + 100; key++) {
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.Insert(index_key, RID(0, static_cast<int>(key)), transaction));
+    }
+    stats = tree.GetStatistics();
+    EXPECT_EQ(stats.keys, static_cast<size_t>(scale + 100));
+    for (int64_t key = 1; key <= scale + 100; key++) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        tree.GetValue(index_key, rids);
+        ASSERT_EQ(rids.size(), 1u);
+    }
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+
+TEST(BPlusTreeTests, ParallelBuildTest) {
+    storage_engine_ = new StorageEngine("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(64, storage_engine_->disk_manager_);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    // b 是打乱的，heap 里每一段的 key 都是乱序的
+    Schema *table_schema = ParseCreateStatement("a int, b int");
+    VirtualTable *table = new VirtualTable(table_schema, bpm, storage_engine_->lock_manager_,
+                                           storage_engine_->log_manager_, std::vector<Index *>());
+    const int scale = 20000;
+    std::vector<int> values(scale);
+    std::iota(values.begin(), values.end(), 0);
+    std::shuffle(values.begin(), values.end(), std::mt19937(15445));
+    global_transaction_ = storage_engine_->transaction_manager_->Begin();
+    RID rid;
+    for (int a = 0; a < scale; a++) {
+        Tuple tuple(std::vector<Value>{Value(TypeId::INTEGER, a), Value(TypeId::INTEGER, values[a])}, table_schema);
+        ASSERT_TRUE(table->InsertTuple(tuple, rid));
+    }
+    storage_engine_->transaction_manager_->Commit(global_transaction_);
+    global_transaction_ = nullptr;
+
+    // 页面足够多，BuildIndex 按 BUILD_PAGES_PER_WORKER 切成几段并行扫描
+    std::vector<page_id_t> page_ids;
+    table->GetTableHeap()->GetPageIds(page_ids);
+    ASSERT_GE(page_ids.size(), 4 * BUILD_PAGES_PER_WORKER);
+
+    BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>> index(
+        new IndexMetadata("foo_b", "foo", table_schema, {1}), bpm);
+    EXPECT_TRUE(table->BuildIndex(&index));
+
+    Transaction transaction(0);
+    std::vector<RID> rids;
+    for (int b = -1; b <= scale; b++) {
+        rids.clear();
+        Tuple key(std::vector<Value>{Value(TypeId::INTEGER, b)}, index.GetKeySchema());
+        index.ScanKey(key, rids, &transaction);
+        if (b < 0 || b == scale) {
+            EXPECT_TRUE(rids.empty());
+            continue;
+        }
+        ASSERT_EQ(rids.size(), 1u);
+        Tuple tuple(rids[0]);
+        ASSERT_TRUE(table->GetTableHeap()->GetTuple(rids[0], tuple, &transaction));
+        EXPECT_EQ(values[tuple.GetValue(table_schema, 0).GetAs<int32_t>()], b);
+    }
+
+    delete table;
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete bpm;
+    delete storage_engine_;
+    storage_engine_ = nullptr;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, ParallelIndexMaintenanceTest) {
+    storage_engine_ = new StorageEngine("test.db");
+    // 默认的 BUFFER_POOL_SIZE 只够一个任务，换一个大的 buffer pool 才会并行维护
+    BufferPoolManager *bpm = new BufferPoolManager(64, storage_engine_->disk_manager_);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+
+    Schema *table_schema = ParseCreateStatement("a int, b int, c int, d int, e int, f int");
+    std::vector<Index *> indexes;
+    for (int column = 0; column < 6; column++) {
+        indexes.push_back(new BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>>(
+            new IndexMetadata("foo_" + std::to_string(column), "foo", table_schema, {column}), bpm));
+    }
+    VirtualTable *table = new VirtualTable(table_schema, bpm, storage_engine_->lock_manager_,
+                                           storage_engine_->log_manager_, indexes);
+    EXPECT_EQ(table->IndexWorkers(), 6u);
+
+    // 每一列是 a 的不同排列（乘数和 scale 互素），几个索引的分裂发生在不同的时候
+    const int multipliers[] = {1, 3, 7, 9, 11, 13};
+    global_transaction_ = storage_engine_->transaction_manager_->Begin();
+    const int scale = 2000;
+    std::vector<RID> rids(scale);
+    for (int a = 0; a < scale; a++) {
+        std::vector<Value> values;
+        for (int column = 0; column < 6; column++) {
+            values.emplace_back(TypeId::INTEGER, a * multipliers[column] % scale);
+        }
+        Tuple tuple(values, table_schema);
+        ASSERT_TRUE(table->InsertTuple(tuple, rids[a]));
+        table->InsertEntry(tuple, rids[a]);
+    }
+    for (int a = 0; a < scale; a += 2) {
+        table->DeleteEntry(rids[a]);
+        ASSERT_TRUE(table->DeleteTuple(rids[a]));
+    }
+
+    std::vector<RID> result;
+    for (int column = 0; column < 6; column++) {
+        for (int a = 0; a < scale; a++) {
+            result.clear();
+            int key_value = a * multipliers[column] % scale;
+            Tuple key(std::vector<Value>{Value(TypeId::INTEGER, key_value)}, indexes[column]->GetKeySchema());
+            indexes[column]->ScanKey(key, result, global_transaction_);
+            if (a % 2 == 0) {
+                EXPECT_TRUE(result.empty());
+            } else {
+                ASSERT_EQ(result.size(), 1u);
+                EXPECT_EQ(result[0], rids[a]);
+            }
+        }
+    }
+    storage_engine_->transaction_manager_->Commit(global_transaction_);
+    global_transaction_ = nullptr;
+
+    delete table;
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete bpm;
+    delete storage_engine_;
+    storage_engine_ = nullptr;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BPlusTreeTests, AdaptiveHashTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    GenericComparator<8> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    Transaction *transaction = new Transaction(0);
+
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+    tree.SetOrder(20);
+    tree.EnableAdaptiveHash(1024);
+
+    // key 是 10 的倍数，中间留出空给后面的插入
+    const int64_t scale = 2000;
+    std::vector<int64_t> keys(scale);
+    for (int64_t i = 0; i < scale; i++) { keys[i] = (i + 1) * 10; }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(15445));
+    GenericKey<8> index_key;
+    for (auto key : keys) {
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, RID(0, static_cast<int>(key)), transaction);
+    }
+
+    std::vector<RID> rids;
+    auto lookup = [&](int64_t key) {
+        rids.clear();
+        index_key.SetFromInteger(key);
+        tree.GetValue(index_key, rids);
+        return rids.size() == 1 ? rids[0].GetSlotNum() : -static_cast<int>(rids.size());
+    };
+
+    // 查了几次之后热点 key 只访问一个叶子
+    const int64_t hot = 100;
+    for (int round = 0; round < 5; round++) {
+        for (int64_t key = 10; key <= hot * 10; key += 10) { EXPECT_EQ(lookup(key), key); }
+    }
+    EXPECT_EQ(lookup(5), 0);
+    auto stats = tree.GetStatistics();
+    EXPECT_GE(stats.hash_hits, static_cast<size_t>(hot));
+
+    // 插入让热点所在的叶子分裂，记下的 slot 失效，查到的还是对的
+    for (int64_t key = 5; key <= hot * 10; key += 10) {
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, RID(0, static_cast<int>(key)), transaction);
+    }
+    EXPECT_GT(tree.GetStatistics().splits, stats.splits);
+    for (int round = 0; round < 3; round++) {
+        for (int64_t key = 5; key <= hot * 10; key += 5) { EXPECT_EQ(lookup(key), key); }
+    }
+
+    // 删除引起合并，一半的热点 key 被删掉
+    for (int64_t key = 5; key <= scale * 10; key += 5) {
+        if (key % 20 == 0 || (key > hot * 10 && key % 10 == 0)) {
+            index_key.SetFromInteger(key);
+            tree.Remove(index_key, transaction);
+        }
+    }
+    EXPECT_GT(tree.GetStatistics().merges, 0u);
+    for (int64_t key = 5; key <= hot * 10; key += 5) { EXPECT_EQ(lookup(key), key % 20 == 0 ? 0 : key); }
+
+    // 读者一直查热点 key，写者在旁边插入删除让叶子分裂合并
+    std::atomic<bool> done{false};
+    std::atomic<int> wrong{0};
+    std::thread reader([&]() {
+        std::vector<RID> result;
+        GenericKey<8> probe;
+        while (!done) {
+            for (int64_t key = 10; key <= hot * 10; key += 20) {
+                result.clear();
+                probe.SetFromInteger(key);
+                tree.GetValue(probe, result);
+                if (result.size() != 1 || result[0].GetSlotNum() != key) { wrong++; }
+            }
+        }
+    });
+    GenericKey<8> write_key;
+    for (int round = 0; round < 5; round++) {
+        for (int64_t key = 1; key <= hot * 10; key += 2) {
+            write_key.SetFromInteger(key);
+            tree.Insert(write_key, RID(0, static_cast<int>(key)), transaction);
+        }
+        for (int64_t key = 1; key <= hot * 10; key += 2) {
+            write_key.SetFromInteger(key);
+            tree.Remove(write_key, transaction);
+        }
+    }
+    done = true;
+    reader.join();
+    EXPECT_EQ(wrong, 0);
+    EXPECT_GT(tree.GetStatistics().hash_hits, stats.hash_hits);
+
+    // Begin(key) 也先查哈希表，absent key 记的是它的 lower bound
+    stats = tree.GetStatistics();
+    for (int round = 0; round < 5; round++) {
+        // 20 的倍数和奇数都删掉了，后面一个 key 是 +10
+        for (int64_t key = 20; key < hot * 10; key += 40) {
+            index_key.SetFromInteger(key);
+            auto iterator = tree.Begin(index_key);
+            ASSERT_FALSE(iterator.isEnd());
+            EXPECT_EQ((*iterator).second.GetSlotNum(), key + 10);
+        }
+    }
+    EXPECT_GE(tree.GetStatistics().hash_hits, stats.hash_hits + static_cast<size_t>(hot) / 2);
+
+    // BPlusTreeIndex 默认打开哈希表：按 key 列查的下界不在树里，插入让叶子分裂之后结果还是对的
+    Schema *table_schema = ParseCreateStatement("a int, b int");
+    BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>> index(
+        new IndexMetadata("foo_b", "foo", table_schema, {1}), bpm);
+    auto index_key_of = [&](int b) {
+        return Tuple(std::vector<Value>{Value(TypeId::INTEGER, b)}, index.GetKeySchema());
+    };
+    for (int a = 0; a < 500; ++a) { index.InsertEntry(index_key_of(a % 50), RID(a, 0), transaction); }
+    for (int round = 0; round < 4; round++) {
+        for (int b = 0; b < 50; b += 7) {
+            rids.clear();
+            index.ScanKey(index_key_of(b), rids, transaction);
+            ASSERT_EQ(rids.size(), 10u + 10u * round);
+            for (auto &rid : rids) { EXPECT_EQ(rid.GetPageId() % 50, b); }
+        }
+        for (int a = 500 * (round + 1); a < 500 * (round + 2); ++a) {
+            index.InsertEntry(index_key_of(a % 50), RID(a, 0), transaction);
+        }
+    }
+    delete table_schema;
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete transaction;
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
 } // namespace cmudb
@@ -0,0 +1,138 @@
+/**
+ * be_tree_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/be_tree.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(BeTreeTests, InsertScanRemoveTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    BeTree<NormalizedKey<16>, RID, NormalizedComparator<16>> tree("foo_betree", bpm, comparator);
+    // small nodes so that messages go through several levels of buffers
+    EXPECT_THROW(tree.SetNodeCapacity(16, 2, 16), Exception);
+    tree.SetNodeCapacity(16, 4, 16);
+
+    NormalizedKey<16> index_key;
+    RID value;
+    index_key.SetFromInteger(1);
+    tree.Remove(index_key);
+    EXPECT_TRUE(tree.IsEmpty());
+    EXPECT_FALSE(tree.GetValue(index_key, value));
+
+    const int64_t scale = 5000;
+    std::vector<int64_t> keys;
+    for (int64_t key = 0; key < scale; key++) { keys.push_back(key); }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(15445));
+    for (auto key : keys) {
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, RID(0, static_cast<int>(key)));
+    }
+    EXPECT_GE(tree.GetHeight(), 4);
+    EXPECT_GT(tree.GetPendingMessageCount(), 0u);
+
+    for (int64_t key = 0; key < scale; key++) {
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.GetValue(index_key, value));
+        EXPECT_EQ(value.GetSlotNum(), key);
+    }
+    int64_t current_key = 0;
+    tree.Scan(NormalizedKey<16>{}, [&](const NormalizedKey<16> &, const RID &rid) {
+        EXPECT_EQ(rid.GetSlotNum(), current_key);
+        current_key++;
+        return true;
+    });
+    EXPECT_EQ(current_key, scale);
+
+    // remove the odd keys, overwrite the value of the multiples of 10
+    for (auto key : keys) {
+        index_key.SetFromInteger(key);
+        if (key % 2 == 1) { tree.Remove(index_key); }
+        if (key % 10 == 0) { tree.Insert(index_key, RID(1, static_cast<int>(key))); }
+    }
+    for (int64_t key = 0; key < scale; key++) {
+        index_key.SetFromInteger(key);
+        EXPECT_EQ(tree.GetValue(index_key, value), key % 2 == 0);
+        if (key % 2 == 0) { EXPECT_EQ(value.GetPageId(), key % 10 == 0 ? 1 : 0); }
+    }
+
+    // scan from the middle and stop early
+    std::vector<int64_t> scanned;
+    index_key.SetFromInteger(2001);
+    tree.Scan(index_key, [&](const NormalizedKey<16> &, const RID &rid) {
+        scanned.push_back(rid.GetSlotNum());
+        return scanned.size() < 5;
+    });
+    EXPECT_EQ(scanned, (std::vector<int64_t>{2002, 2004, 2006, 2008, 2010}));
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+TEST(BeTreeTests, DefaultCapacityTest) {
+    Schema *key_schema = ParseCreateStatement("a bigint");
+    NormalizedComparator<16> comparator(key_schema);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    BeTree<NormalizedKey<16>, RID, NormalizedComparator<16>> tree("foo_betree", bpm, comparator);
+
+    const int64_t scale = 50000;
+    std::vector<int64_t> keys;
+    for (int64_t key = 0; key < scale; key++) { keys.push_back(key); }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(15445));
+    NormalizedKey<16> index_key;
+    for (auto key : keys) {
+        index_key.SetFromInteger(key);
+        tree.Insert(index_key, RID(0, static_cast<int>(key)));
+    }
+    EXPECT_GE(tree.GetHeight(), 2);
+
+    // the tree can be reopened from its root page id
+    BeTree<NormalizedKey<16>, RID, NormalizedComparator<16>> reopened("foo_betree", bpm, comparator,
+                                                                     tree.GetRootPageId());
+    RID value;
+    for (int64_t key = 0; key < scale; key += 7) {
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(reopened.GetValue(index_key, value));
+        EXPECT_EQ(value.GetSlotNum(), key);
+    }
+    int64_t count = 0;
+    reopened.Scan(NormalizedKey<16>{}, [&](const NormalizedKey<16> &, const RID &rid) {
+        EXPECT_EQ(rid.GetSlotNum(), count);
+        count++;
+        return true;
+    });
+    EXPECT_EQ(count, scale);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete key_schema;
+    delete disk_manager;
+    delete bpm;
+    remove("test.db");
+    remove("test.log");
+}
+
+} // namespace cmudb
@@ -0,0 +1,118 @@
+/**
+ * bloom_filter_test.cpp
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree_index.h"
+#include "index/bloom_filter.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(BloomFilterTest, FalsePositiveRateTest) {
+    BloomFilter filter;
+    filter.Rebuild([](std::vector<uint64_t> &) {});
+    EXPECT_FALSE(filter.NeedsRebuild());
+
+    for (int i = 0; i < 20000; i++) {
+        std::string key = "key" + std::to_string(i);
+        filter.Add(BloomFilter::Hash(key.data(), key.size()));
+    }
+    // 超过了容量，需要按现在的 key 数重建
+    EXPECT_TRUE(filter.NeedsRebuild());
+    filter.Rebuild([](std::vector<uint64_t> &hashes) {
+        for (int i = 0; i < 20000; i++) {
+            std::string key = "key" + std::to_string(i);
+            hashes.push_back(BloomFilter::Hash(key.data(), key.size()));
+        }
+    });
+    EXPECT_FALSE(filter.NeedsRebuild());
+    EXPECT_EQ(filter.GetKeyCount(), 20000u);
+
+    // no false negatives
+    for (int i = 0; i < 20000; i++) {
+        std::string key = "key" + std::to_string(i);
+        EXPECT_TRUE(filter.MayContain(BloomFilter::Hash(key.data(), key.size())));
+    }
+    int false_positives = 0;
+    for (int i = 0; i < 100000; i++) {
+        std::string key = "miss" + std::to_string(i);
+        if (filter.MayContain(BloomFilter::Hash(key.data(), key.size()))) {
+            false_positives++;
+            filter.RecordFalsePositive();
+        }
+    }
+    // 20 bit/key after the rebuild, well under 1%
+    EXPECT_LT(false_positives, 1000);
+    EXPECT_LT(filter.GetFalsePositiveRate(), 0.01);
+    EXPECT_LT(filter.GetEstimatedFalsePositiveRate(), 0.01);
+    EXPECT_LE(filter.GetMemoryUsage(), 20000u * 2 * BloomFilter::BITS_PER_KEY / 8 + 64);
+    std::cout << filter.ToString() << std::endl;
+
+    for (int i = 0; i < 20000; i++) { filter.RecordDelete(); }
+    EXPECT_TRUE(filter.NeedsRebuild());
+}
+
+TEST(BloomFilterTest, IndexLookupTest) {
+    Schema *schema = ParseCreateStatement("a bigint, b bigint");
+    IndexMetadata *metadata =
+        new IndexMetadata("foo_a", "foo", schema, {0}, IndexType::BPLUSTREE, std::vector<int>(), true);
+
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    BPlusTreeIndex<NormalizedKey<16>, RID, NormalizedComparator<16>> index(metadata, bpm);
+    BloomFilter *filter = index.GetBloomFilter();
+    ASSERT_NE(filter, nullptr);
+
+    Schema *key_schema = index.GetKeySchema();
+    auto make_key = [key_schema](int64_t a) {
+        return Tuple(std::vector<Value>{Value(TypeId::BIGINT, a)}, key_schema);
+    };
+    for (int64_t a = 0; a < 10000; a += 2) { index.InsertEntry(make_key(a), RID(0, static_cast<int>(a))); }
+
+    std::vector<RID> rids;
+    for (int64_t a = 0; a < 10000; a++) { index.ScanKey(make_key(a), rids); }
+    EXPECT_EQ(rids.size(), 5000u);
+    EXPECT_FALSE(filter->NeedsRebuild());
+    // 大部分不存在的 key 没有下降
+    EXPECT_LT(filter->GetFalsePositiveRate(), 0.05);
+
+    std::vector<Tuple> keys;
+    for (int64_t a = 10000; a < 10100; a++) { keys.push_back(make_key(a)); }
+    keys.push_back(make_key(42));
+    rids.clear();
+    index.ScanKeys(keys, rids);
+    ASSERT_EQ(rids.size(), 1u);
+    EXPECT_EQ(rids[0].GetSlotNum(), 42);
+    EXPECT_TRUE(bpm->Check());
+
+    // delete-heavy churn makes the filter rebuild on the next probe
+    for (int64_t a = 0; a < 8000; a += 2) { index.DeleteEntry(make_key(a), RID(0, static_cast<int>(a))); }
+    EXPECT_TRUE(filter->NeedsRebuild());
+    rids.clear();
+    index.ScanKey(make_key(8000), rids);
+    EXPECT_EQ(rids.size(), 1u);
+    EXPECT_FALSE(filter->NeedsRebuild());
+    EXPECT_EQ(filter->GetKeyCount(), 1000u);
+    rids.clear();
+    for (int64_t a = 0; a < 8000; a++) { index.ScanKey(make_key(a), rids); }
+    EXPECT_TRUE(rids.empty());
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete schema;
+    delete bpm;
+    delete disk_manager;
+    remove("test.db");
+    remove("test.log");
+}
+
+} // namespace cmudb
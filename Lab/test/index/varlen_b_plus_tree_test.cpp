@@ -0,0 +1,133 @@
+/**
+ * varlen_b_plus_tree_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/varlen_b_plus_tree.h"
+#include "page/header_page.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// 前缀相同、只有 overflow 部分不同的 key，以及跨好几个 overflow 页的 key
+static std::string MakeKey(int number) {
+    char digits[16];
+    snprintf(digits, sizeof(digits), "%06d", number);
+    switch (number % 4) {
+    case 0: return std::string(digits);
+    case 1: return std::string(digits) + std::string(number % 300, 'a');
+    case 2: return std::string(VARLEN_INLINE_KEY_SIZE + 100, 'b') + digits;
+    default: return std::string(digits) + std::string(PAGE_SIZE * 2 + number % 1000, 'c');
+    }
+}
+
+TEST(VarlenBPlusTreeTest, InsertScanRemoveTest) {
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(20, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    VarlenBPlusTree tree("foo_varlen", bpm);
+    EXPECT_TRUE(tree.IsEmpty());
+
+    std::vector<int> numbers;
+    for (int number = 0; number < 2000; ++number) { numbers.push_back(number); }
+    std::random_shuffle(numbers.begin(), numbers.end());
+    for (int number : numbers) { EXPECT_TRUE(tree.Insert(MakeKey(number), number)); }
+    EXPECT_FALSE(tree.Insert(MakeKey(42), 42));
+    EXPECT_FALSE(tree.IsEmpty());
+    EXPECT_GT(tree.GetHeight(), 1);
+    EXPECT_TRUE(bpm->Check());
+
+    std::set<std::string> expected;
+    for (int number = 0; number < 2000; ++number) {
+        int64_t value = -1;
+        EXPECT_TRUE(tree.GetValue(MakeKey(number), value));
+        EXPECT_EQ(value, number);
+        expected.insert(MakeKey(number));
+    }
+    int64_t value;
+    EXPECT_FALSE(tree.GetValue(std::string(VARLEN_INLINE_KEY_SIZE + 100, 'b'), value));
+    EXPECT_FALSE(tree.GetValue(MakeKey(3) + "d", value));
+
+    // 全部按字节序出来
+    std::vector<std::string> scanned;
+    tree.Scan("", [&](const std::string &key, int64_t) {
+        scanned.push_back(key);
+        return true;
+    });
+    EXPECT_TRUE(std::equal(scanned.begin(), scanned.end(), expected.begin(), expected.end()));
+
+    // 从中间开始，提前停下
+    std::string lo = MakeKey(1001);
+    scanned.clear();
+    tree.Scan(lo, [&](const std::string &key, int64_t) {
+        scanned.push_back(key);
+        return scanned.size() < 10;
+    });
+    ASSERT_EQ(scanned.size(), 10u);
+    EXPECT_TRUE(std::equal(scanned.begin(), scanned.end(), expected.find(lo)));
+    EXPECT_TRUE(bpm->Check());
+
+    for (int number = 0; number < 2000; number += 2) { EXPECT_TRUE(tree.Remove(MakeKey(number))); }
+    EXPECT_FALSE(tree.Remove(MakeKey(0)));
+    int count = 0;
+    tree.Scan("", [&](const std::string &key, int64_t value) {
+        EXPECT_EQ(value % 2, 1);
+        EXPECT_EQ(key, MakeKey(static_cast<int>(value)));
+        count++;
+        return true;
+    });
+    EXPECT_EQ(count, 1000);
+    // 删掉的位置还能再插回来
+    for (int number = 0; number < 2000; number += 4) { EXPECT_TRUE(tree.Insert(MakeKey(number), number)); }
+    EXPECT_TRUE(tree.GetValue(MakeKey(1000), value));
+    EXPECT_TRUE(bpm->Check());
+
+    // reopen from the root page recorded in the header page
+    page_id_t root_page_id;
+    EXPECT_TRUE(reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID))->GetRootId("foo_varlen", root_page_id));
+    bpm->UnpinPage(HEADER_PAGE_ID, false);
+    EXPECT_EQ(root_page_id, tree.GetRootPageId());
+    VarlenBPlusTree reopened("foo_varlen", bpm, root_page_id);
+    EXPECT_TRUE(reopened.GetValue(MakeKey(1999), value));
+    EXPECT_EQ(value, 1999);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete bpm;
+    delete disk_manager;
+    remove("test.db");
+    remove("test.log");
+}
+
+// 短 key 一个页能放几百个，fanout 跟着 key 的实际长度走
+TEST(VarlenBPlusTreeTest, ShortKeyFanoutTest) {
+    DiskManager *disk_manager = new DiskManager("test.db");
+    BufferPoolManager *bpm = new BufferPoolManager(20, disk_manager);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void) header_page;
+    VarlenBPlusTree tree("foo_short", bpm);
+
+    for (int number = 0; number < 20000; ++number) {
+        char key[8];
+        snprintf(key, sizeof(key), "%05d", number);
+        EXPECT_TRUE(tree.Insert(key, number));
+    }
+    EXPECT_EQ(tree.GetHeight(), 2);
+    EXPECT_TRUE(bpm->Check());
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete bpm;
+    delete disk_manager;
+    remove("test.db");
+    remove("test.log");
+}
+
+} // namespace cmudb
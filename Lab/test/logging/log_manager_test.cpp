@@ -1,6 +1,7 @@
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <thread>
 
 #include "logging/common.h"
 #include "logging/log_recovery.h"
@@ -124,4 +125,45 @@ TEST(LogManagerTest, RedoTestWithOneTxn) {
   remove("test.log");
 }
 
+// early lock release: the waiter gets the lock right after the holder's COMMIT
+// record is appended, and inherits the holder's commit lsn as its dependency
+TEST(LogManagerTest, EarlyLockReleaseTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  EXPECT_TRUE(ENABLE_LOGGING);
+
+  // wait-die: only the older transaction is allowed to wait
+  Transaction *waiter = storage_engine->transaction_manager_->Begin();
+  Transaction *holder = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, holder);
+  Schema *schema = ParseCreateStatement("a varchar, b smallint, c bigint");
+  RID rid;
+  Tuple tuple = ConstructTuple(schema);
+  EXPECT_TRUE(test_table->InsertTuple(tuple, rid, holder));
+
+  std::thread reader([&] {
+    Tuple result;
+    EXPECT_TRUE(test_table->GetTuple(rid, result, waiter));
+    storage_engine->transaction_manager_->Commit(waiter);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  storage_engine->transaction_manager_->Commit(holder);
+  reader.join();
+
+  EXPECT_EQ(holder->GetPrevLSN(), waiter->GetDependencyLSN());
+  EXPECT_LE(waiter->GetDependencyLSN(),
+            storage_engine->log_manager_->GetPersistentLSN());
+
+  storage_engine->log_manager_->StopFlushThread();
+  delete waiter;
+  delete holder;
+  delete test_table;
+  delete schema;
+  delete storage_engine;
+  remove("test.db");
+  remove("test.log");
+}
+
 } // namespace cmudb
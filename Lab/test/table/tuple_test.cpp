@@ -61,4 +61,72 @@ TEST(TupleTest, TableHeapTest) {
   delete disk_manager;
 }
 
+// commit/abort apply the write set page by page
+TEST(TupleTest, WriteSetApplyTest) {
+  Schema *schema = ParseCreateStatement("a varchar, b smallint, c bigint");
+  Tuple tuple = ConstructTuple(schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *buffer_pool_manager =
+      new BufferPoolManager(50, disk_manager);
+  LockManager *lock_manager = new LockManager(true);
+  LogManager *log_manager = new LogManager(disk_manager);
+  TransactionManager *txn_manager =
+      new TransactionManager(lock_manager, log_manager);
+
+  auto count = [&](TableHeap *table) {
+    Transaction txn(100);
+    int n = 0;
+    for (auto itr = table->begin(&txn); itr != table->end(); ++itr) {
+      ++n;
+    }
+    return n;
+  };
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *table =
+      new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn);
+  RID rid;
+  std::vector<RID> rid_v;
+  for (int i = 0; i < 2000; ++i) {
+    EXPECT_TRUE(table->InsertTuple(tuple, rid, txn));
+    rid_v.push_back(rid);
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  EXPECT_EQ(count(table), 2000);
+
+  // rollback deletes and inserts spread over many pages
+  txn = txn_manager->Begin();
+  std::random_shuffle(rid_v.begin(), rid_v.end());
+  for (auto &r : rid_v) {
+    EXPECT_TRUE(table->MarkDelete(r, txn));
+  }
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_TRUE(table->InsertTuple(tuple, rid, txn));
+  }
+  txn_manager->Abort(txn);
+  delete txn;
+  EXPECT_EQ(count(table), 2000);
+
+  // commit deletes of half of the rows
+  txn = txn_manager->Begin();
+  for (size_t i = 0; i < rid_v.size() / 2; ++i) {
+    EXPECT_TRUE(table->MarkDelete(rid_v[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  EXPECT_EQ(count(table), 1000);
+
+  remove("test.db");
+  remove("test.log");
+  delete schema;
+  delete table;
+  delete txn_manager;
+  delete lock_manager;
+  delete log_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
 } // namespace cmudb
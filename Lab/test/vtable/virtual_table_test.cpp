@@ -78,4 +78,516 @@ TEST(VtableTest, CreateTest) {
   remove("vtable.db");
   return;
 }
+
+TEST(VtableTest, RangeScanTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // composite index on (a, b)
+  EXPECT_TRUE(ExecSQL(
+      db, "CREATE VIRTUAL TABLE foo2 USING vtable('a int, b int, c int','foo2_pk a, b')"));
+  std::string insert = "INSERT INTO foo2 VALUES";
+  for (int a = 1; a <= 5; a++) {
+    for (int b = 1; b <= 4; b++) {
+      insert += (a == 1 && b == 1 ? "(" : ", (") + std::to_string(a) + ", " +
+                std::to_string(b) + ", " + std::to_string(a * 10 + b) + ")";
+    }
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  // point query, range, BETWEEN and prefix match
+  EXPECT_EQ(QueryInt(db, "SELECT c FROM foo2 WHERE a = 3 AND b = 2"), 32);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a > 3"), 8);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a >= 3"), 12);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a < 2"), 4);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a <= 2"), 8);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a BETWEEN 2 AND 4"), 12);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 4"), 4);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 4 AND b > 1"), 3);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 4 AND b < 4"), 3);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 2 AND b BETWEEN 2 AND 3"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(c) FROM foo2 WHERE a > 1 AND a < 3"), 21 + 22 + 23 + 24);
+  // constraint only on the second key column can not use the index
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE b = 1"), 5);
+  // fractional bounds on an integer column round inwards, text compares greater than any number
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a < 2.5"), 8);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a <= 2.5"), 8);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a > 2.5"), 12);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a >= 4.5"), 4);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 2.5"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a = 2 AND b < 3.5"), 3);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a > -1e30 AND a < 1e30"), 20);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo2 WHERE a < 'x'"), 20);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo2"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+TEST(VtableTest, DuplicateKeyTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // index on a low-cardinality column, one hot key spans several leaves
+  EXPECT_TRUE(ExecSQL(
+      db, "CREATE VIRTUAL TABLE foo3 USING vtable('a int, b int','foo3_idx b')"));
+  std::string insert = "INSERT INTO foo3 VALUES";
+  for (int a = 0; a < 1500; a++) {
+    int b = a < 900 ? 7 : a % 3;
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", " + std::to_string(b) + ")";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b = 7"), 900);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b = 1"), 200);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo3 WHERE b = 7"), 899 * 900 / 2);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b > 0 AND b < 7"), 400);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b >= 2"), 1100);
+
+  // deletes remove only the entry of the deleted row
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo3 WHERE a < 100"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b = 7"), 800);
+  EXPECT_EQ(QueryInt(db, "SELECT min(a) FROM foo3 WHERE b = 7"), 100);
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo3 SET b = 1 WHERE a >= 800 AND a < 900"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b = 7"), 700);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo3 WHERE b = 1"), 300);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo3"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, HashIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // equality lookups go through the hash index, anything else scans the table
+  EXPECT_TRUE(ExecSQL(
+      db, "CREATE VIRTUAL TABLE foo4 USING vtable('a int, b varchar(32)','foo4_idx b using hash')"));
+  std::string insert = "INSERT INTO foo4 VALUES";
+  for (int a = 0; a < 2000; a++) {
+    std::string b = a < 500 ? "hot" : "k" + std::to_string(a % 700);
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", '" + b + "')";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'hot'"), 500);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'k3'"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo4 WHERE b = 'k3'"), 703 + 1403);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'missing'"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b IN ('k3', 'k4', 'hot', 'k3')"), 504);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b > 'k6'"), 286);
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo4 WHERE a < 100"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'hot'"), 400);
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo4 SET b = 'k3' WHERE a >= 100 AND a < 200"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'hot'"), 300);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo4 WHERE b = 'k3'"), 102);
+  // varchar(32) is sized by its declared length, not the 16 byte minimum
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo4 VALUES (5000, 'abcdefghijklmnopqrstuvwxyz0123')"));
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo4 WHERE b = 'abcdefghijklmnopqrstuvwxyz0123'"), 5000);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo4"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, CoveringIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // b is the key, c and d are only carried in the index
+  EXPECT_TRUE(ExecSQL(
+      db, "CREATE VIRTUAL TABLE foo5 USING vtable('a int, b int, c double, d varchar(8)','foo5_idx b include (c, d)')"));
+  std::string insert = "INSERT INTO foo5 VALUES";
+  for (int a = 0; a < 1000; a++) {
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", " + std::to_string(a % 100) + ", " +
+              std::to_string(a) + ".5, 'd" + std::to_string(a % 7) + "')";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  // answered from the index entries
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo5 WHERE b = 42"), 10);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(c) FROM foo5 WHERE b = 42"), 42 * 10 + 4500 + 5);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo5 WHERE b >= 10 AND b < 20 AND d = 'd3'"), 14);
+  // a is not in the index, goes back to the table heap
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo5 WHERE b = 42"), 42 * 10 + 4500);
+
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo5 SET c = 1.0 WHERE b = 42"));
+  EXPECT_EQ(QueryInt(db, "SELECT sum(c) FROM foo5 WHERE b = 42"), 10);
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo5 WHERE a < 500"));
+  EXPECT_EQ(QueryInt(db, "SELECT sum(c) FROM foo5 WHERE b = 42"), 5);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo5 WHERE b < 50 AND d = 'd0'"), 36);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo5"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, MultipleIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // index 0 on a, 1 on b (hash), 2 on (c, d), 3 on d
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo6 USING vtable('a int, b int, c varchar(8), d int',"
+                          "'foo6_a a', 'foo6_b b using hash', 'foo6_cd c, d', 'foo6_d d include (a)')"));
+  std::string insert = "INSERT INTO foo6 VALUES";
+  for (int a = 0; a < 1000; a++) {
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", " + std::to_string(a % 50) + ", 'c" +
+              std::to_string(a % 3) + "', " + std::to_string(a % 20) + ")";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  // every query picks the index on its own columns
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6 WHERE a > 10 AND a < 20") >> 16, 0);
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6 WHERE b = 7") >> 16, 1);
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6 WHERE d = 7") >> 16, 3);
+  // (c, d) narrows more than d alone
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6 WHERE c = 'c1' AND d = 7") >> 16, 2);
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6 WHERE c > 'c1'") >> 16, 2);
+  EXPECT_EQ(QueryIdxNum(db, "SELECT * FROM foo6"), 0);
+
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE a > 10 AND a < 20"), 9);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE b = 7"), 20);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo6 WHERE d = 7"), 7 * 50 + 20 * 49 * 50 / 2);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE c = 'c1' AND d = 7"), 17);
+
+  // every index follows deletes and updates
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo6 WHERE a < 100"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo6 SET b = 1000, d = 100 WHERE a >= 900"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE a > 10 AND a < 200"), 100);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE b = 7"), 16);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE b = 1000"), 100);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE d = 7"), 40);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE d = 100"), 100);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo6 WHERE c = 'c1' AND d = 100"), 33);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo6"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, LongVarcharIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // varchar(1000) does not fit a fixed size key, the index keeps the whole string
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo7 USING vtable('a int, b varchar(1000)', 'foo7_b b include (a)')"));
+  // even rows only differ after the first 600 bytes, odd rows have 1 to 500 bytes
+  auto make_b = [](int a) {
+    return a % 2 == 0 ? std::string(600, 'p') + std::to_string(a) : "q" + std::to_string(a) + std::string(a % 500, 'z');
+  };
+  std::string insert = "INSERT INTO foo7 VALUES";
+  for (int a = 0; a < 300; a++) {
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", '" + make_b(a) + "')";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  std::string point = "SELECT a FROM foo7 WHERE b = '" + make_b(122) + "'";
+  EXPECT_NE(QueryIdxNum(db, point), 0);
+  EXPECT_EQ(QueryInt(db, point), 122);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo7 WHERE b = '" + make_b(201) + "'"), 201);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo7 WHERE b = '" + std::string(600, 'p') + "'"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo7 WHERE b > 'q'"), 150 * 150);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo7 WHERE b < 'q'"), 150);
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo7 WHERE a < 100"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo7 WHERE b < 'q'"), 100);
+  EXPECT_EQ(QueryInt(db, point), 122);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo7 WHERE b = '" + make_b(22) + "'"), 0);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo7"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, BloomFilterIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo8 USING vtable('a int, b varchar(8)', 'foo8_a a with bloom',"
+                          "'foo8_b b include (a) with bloom')"));
+  std::string insert = "INSERT INTO foo8 VALUES";
+  for (int a = 0; a < 1000; a += 2) {
+    insert += (a == 0 ? "(" : ", (") + std::to_string(a) + ", 'b" + std::to_string(a) + "')";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a = 42"), 1);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a = 43"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a IN (1, 3, 5, 42, 44)"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo8 WHERE b = 'b998'"), 998);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE b = 'b999'"), 0);
+
+  // the filters follow deletes and updates
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo8 WHERE a < 900"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo8 SET a = 1, b = 'x' WHERE a = 998"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a = 42"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a = 1"), 1);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo8 WHERE b = 'x'"), 1);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo8 WHERE a >= 900"), 49);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo8"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, BeTreeIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo9 USING vtable('a int, b varchar(8)', 'foo9_a a using betree',"
+                          "'foo9_b b include (a) using betree')"));
+  // random order, most of the entries are still in the buffers of internal nodes
+  std::string insert = "INSERT INTO foo9 VALUES";
+  for (int i = 0; i < 2000; i++) {
+    int a = (i * 7919) % 2000;
+    insert += (i == 0 ? "(" : ", (") + std::to_string(a) + ", 'b" + std::to_string(a % 100) + "')";
+  }
+  EXPECT_TRUE(ExecSQL(db, insert));
+
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE a = 42"), 1);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE a IN (1, 3, 5, 2001)"), 3);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE a >= 100 AND a < 200"), 100);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE b = 'b7'"), 20);
+  EXPECT_EQ(QueryInt(db, "SELECT sum(a) FROM foo9 WHERE b = 'b99'"), 99 * 20 + 100 * 190);
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo9 WHERE a < 1000"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo9 SET b = 'x' WHERE a = 1500"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE a = 42"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE a >= 0"), 1000);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo9 WHERE b = 'b0'"), 9);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo9 WHERE b = 'x'"), 1500);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo9"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, WideBeTreeIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // an index that can't be built fails the statement instead of the process
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE foo11 USING vtable('a int', 'foo11_a a using lsm')"));
+
+  // declared wider than the widest fixed key: the column gets what is left of 128 bytes, longer values are rejected
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo11 USING vtable('a int, b varchar(200)', 'foo11_b b using betree')"));
+  std::string wide_b(150, 'y');
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo11 VALUES (1, '" + wide_b.substr(0, 120) + "'), (2, 'short')"));
+  EXPECT_FALSE(ExecSQL(db, "INSERT INTO foo11 VALUES (3, '" + wide_b + "')"));
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo11 WHERE b = '" + wide_b.substr(0, 120) + "'"), 1);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo11 WHERE b = 'short'"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo11"), 2);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo11"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
+TEST(VtableTest, KeyTooLongTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  const char *zFile = "libvtable"; // shared library name
+  const char *zProc = 0;           // entry point within library
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, zFile, zProc, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // bare varchar gets a fixed size slot in the key, longer strings are rejected before the heap is written
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo10 USING vtable('a int, b varchar', 'foo10_b b')"));
+  std::string long_b(70, 'x');
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo10 VALUES (1, 'short')"));
+  // declared as 32 bytes, the key is 64 bytes and the column gets all 56 bytes before the RID
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo10 VALUES (2, '" + long_b.substr(0, 56) + "')"));
+  EXPECT_FALSE(ExecSQL(db, "INSERT INTO foo10 VALUES (3, '" + long_b + "')"));
+  EXPECT_FALSE(ExecSQL(db, "UPDATE foo10 SET b = '" + long_b + "' WHERE a = 1"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo10"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo10 WHERE b = 'short'"), 1);
+
+  // search keys that do not fit still work, the truncated upper bound must not lose the 56 byte row
+  EXPECT_EQ(QueryInt(db, "SELECT a FROM foo10 WHERE b = '" + long_b.substr(0, 56) + "'"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo10 WHERE b = '" + long_b + "'"), 0);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo10 WHERE b < '" + long_b + "'"), 2);
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo10 WHERE b >= '" + long_b + "'"), 0);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo10"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("vtable.db");
+  return;
+}
+
 } // namespace cmudb